@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "bitstream.h"
+
+void bs_init(bitstream_p bs, void *data, int size)
+{
+    memset(bs, 0, sizeof(*bs));
+    bs->data = data;
+    bs->size = size;
+}
+
+unsigned int bs_read_bits(bitstream_p bs, int n)
+{
+    unsigned int value = 0;
+
+    while (n--) {
+        int byte = bs->pos >> 3;
+
+        if (byte >= bs->size) {
+            bs->overrun = 1;
+            return 0;
+        }
+
+        value <<= 1;
+        value |= (bs->data[byte] >> (7 - (bs->pos & 7))) & 1;
+        bs->pos++;
+    }
+
+    return value;
+}
+
+/* Exp-Golomb coded unsigned value */
+unsigned int bs_read_ue(bitstream_p bs)
+{
+    int zeros = 0;
+
+    while (!bs_read_bits(bs, 1)) {
+        if (bs->overrun || ++zeros > 31)
+            return 0;
+    }
+
+    return (1u << zeros) - 1 + bs_read_bits(bs, zeros);
+}
+
+int bs_read_se(bitstream_p bs)
+{
+    unsigned int value = bs_read_ue(bs);
+
+    return (value & 1) ? (int) ((value + 1) >> 1) : -(int) (value >> 1);
+}
+
+void bs_write_bits(bitstream_p bs, int n, unsigned int value)
+{
+    /* Up to a byte at a time, the slice data of whole frames goes through here */
+    while (n > 0) {
+        int byte = bs->pos >> 3;
+        int free = 8 - (bs->pos & 7);
+        int bits = n < free ? n : free;
+
+        if (byte >= bs->size) {
+            bs->overrun = 1;
+            return;
+        }
+
+        if (free == 8)
+            bs->data[byte] = 0;
+        n -= bits;
+        bs->data[byte] |= ((value >> n) & ((1u << bits) - 1)) << (free - bits);
+        bs->pos += bits;
+    }
+}
+
+void bs_write_ue(bitstream_p bs, unsigned int value)
+{
+    int bits = 0;
+
+    while ((value + 1) >> (bits + 1))
+        bits++;
+
+    bs_write_bits(bs, bits, 0);
+    bs_write_bits(bs, bits + 1, value + 1);
+}
+
+void bs_write_se(bitstream_p bs, int value)
+{
+    bs_write_ue(bs, value > 0 ? 2 * value - 1 : -2 * value);
+}
+
+/* rbsp_trailing_bits(): stop bit, then zeros up to the byte boundary */
+void bs_write_trailing(bitstream_p bs)
+{
+    bs_write_bits(bs, 1, 1);
+    if (bs->pos & 7)
+        bs_write_bits(bs, 8 - (bs->pos & 7), 0);
+}
@@ -0,0 +1,3288 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <va/va.h>
+#include <va/va_enc_h264.h>
+
+#include "bitstream.h"
+#include "h264_utils.h"
+#include "h264_swenc.h"
+#include "v4l2_utils.h"
+
+#define SWENC_MAX_THREADS       8
+
+/* Border around reference pictures, and how far past it blocks may point */
+#define SWENC_PAD               48
+#define SWENC_MV_MARGIN         24
+
+/* Worst case of one coded macroblock and of a slice header, in bytes */
+#define SWENC_MB_BYTES          1600
+#define SWENC_SLICE_HEADER_BYTES 64
+#define SWENC_HEADER_BYTES      128
+
+#define SWENC_MAX_LEVEL         2047
+/* Per macroblock QP offsets stay within what mb_qp_delta can code */
+#define SWENC_MIN_QP_OFFSET     (-13)
+#define SWENC_MAX_QP_OFFSET     12
+
+/* I frame budget against a P frame, and frames to pay back a deviation */
+#define SWENC_RC_INTRA_RATIO    3
+#define SWENC_RC_MAX_QP_STEP    4
+/* Bit rates taken from VAENC_RC, up to the Level 5.2 High profile limit */
+#define SWENC_RC_MIN_BITRATE    1000
+#define SWENC_RC_MAX_BITRATE    300000000
+
+/* mmap offsets handed out by QUERYBUF */
+#define SWENC_CODED_OFFSET      0
+#define SWENC_INPUT_OFFSET(plane) (((plane) + 1) << 12)
+
+#define NAL_SLICE               1
+#define NAL_SLICE_IDR           5
+#define NAL_SPS                 7
+#define NAL_PPS                 8
+
+#define SLICE_P                 0
+#define SLICE_I                 2
+
+enum { MB_I4x4, MB_I16x16, MB_P16x16, MB_PSKIP };
+#define MB_IS_INTRA(type)       ((type) <= MB_I16x16)
+
+/* Intra prediction modes, 16x16 and 4x4 share the first three */
+#define PRED_V                  0
+#define PRED_H                  1
+#define PRED_DC                 2
+#define PRED_PLANE              3
+
+#define CHROMA_DC               0
+#define CHROMA_H                1
+#define CHROMA_V                2
+#define CHROMA_PLANE            3
+
+/* Neighbouring macroblocks in the same slice */
+#define AVAIL_LEFT              1
+#define AVAIL_TOP               2
+#define AVAIL_TOPLEFT           4
+#define AVAIL_TOPRIGHT          8
+
+/* Macroblock decisions taken from the controls */
+#define MB_FORCE_INTRA          1
+#define MB_STATIC               2
+
+enum { BUF_FREE, BUF_QUEUED, BUF_ACTIVE, BUF_DONE };
+enum { SWENC_IDLE, SWENC_ANALYSE, SWENC_FILTER, SWENC_INTERPOLATE };
+
+/* Raster index of the 4x4 luma blocks in coding order */
+static const unsigned char swenc_blk_raster[16] = {
+    0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15
+};
+
+static const unsigned char swenc_zigzag[16] = {
+    0, 1, 4, 8, 5, 2, 3, 6, 9, 12, 13, 10, 7, 11, 14, 15
+};
+
+/* Quantizer class of a coefficient position */
+static const unsigned char swenc_pos_class[16] = {
+    0, 2, 0, 2, 2, 1, 2, 1, 0, 2, 0, 2, 2, 1, 2, 1
+};
+
+static const int swenc_quant_mf[6][3] = {
+    { 13107, 5243, 8066 }, { 11916, 4660, 7490 }, { 10082, 4194, 6554 },
+    { 9362, 3647, 5825 }, { 8192, 3355, 5243 }, { 7282, 2893, 4559 },
+};
+
+static const int swenc_dequant_v[6][3] = {
+    { 10, 16, 13 }, { 11, 18, 14 }, { 13, 20, 16 },
+    { 14, 23, 18 }, { 16, 25, 20 }, { 18, 29, 23 },
+};
+
+static const unsigned char swenc_chroma_qp[52] = {
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+    16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 29, 30,
+    31, 32, 32, 33, 34, 34, 35, 35, 36, 36, 37, 37, 37, 38, 38, 38,
+    39, 39, 39, 39,
+};
+
+/* Rate-distortion multiplier of SAD/SATD against bits, per QP */
+static const unsigned char swenc_lambda[52] = {
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+     2,  2,  2,  2,  3,  3,  3,  4,  4,  4,  5,  6,  6,  7,  8,  9,
+    10, 11, 13, 14, 16, 18, 20, 23, 25, 29, 32, 36, 40, 45, 51, 57,
+    64, 72, 81, 91,
+};
+
+/* Table 8-16 and 8-17, indexed by QP since the slice offsets are 0 */
+static const unsigned char swenc_alpha[52] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   4,   4,   5,   6,   7,   8,   9,  10,  12,  13,  15,  17,
+     20,  22,  25,  28,  32,  36,  40,  45,  50,  56,  63,  71,  80,  90,
+    101, 113, 127, 144, 162, 182, 203, 226, 255, 255,
+};
+
+static const unsigned char swenc_beta[52] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     2,  2,  2,  3,  3,  3,  3,  4,  4,  4,  6,  6,  7,  7,  8,  8,
+     9,  9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16, 16,
+    17, 17, 18, 18,
+};
+
+static const unsigned char swenc_tc0[52][3] = {
+    { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+    { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+    { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+    { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 1 }, { 0, 0, 1 }, { 0, 0, 1 },
+    { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 },
+    { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 2 }, { 1, 1, 2 }, { 1, 1, 2 },
+    { 1, 1, 2 }, { 1, 2, 3 }, { 1, 2, 3 }, { 2, 2, 3 }, { 2, 2, 4 },
+    { 2, 3, 4 }, { 2, 3, 4 }, { 3, 3, 5 }, { 3, 4, 6 }, { 3, 4, 6 },
+    { 4, 5, 7 }, { 4, 5, 8 }, { 4, 6, 9 }, { 5, 7, 10 }, { 6, 8, 11 },
+    { 6, 8, 13 }, { 7, 10, 14 }, { 8, 11, 16 }, { 9, 12, 18 },
+    { 10, 13, 20 }, { 11, 15, 23 }, { 13, 17, 25 },
+};
+
+/* coded_block_pattern to codeNum, Table 9-4, intra 4x4 then inter */
+static const unsigned char swenc_cbp_code[2][48] = {
+    {  3, 29, 30, 17, 31, 18, 37,  8, 32, 38, 19,  9, 20, 10, 11,  2,
+      16, 33, 34, 21, 35, 22, 39,  4, 36, 40, 23,  5, 24,  6,  7,  1,
+      41, 42, 43, 25, 44, 26, 46, 12, 45, 47, 27, 13, 28, 14, 15,  0 },
+    {  0,  2,  3,  7,  4,  8, 17, 13,  5, 18,  9, 14, 10, 15, 16, 11,
+       1, 32, 33, 36, 34, 37, 44, 40, 35, 45, 38, 41, 39, 42, 43, 19,
+       6, 24, 25, 20, 26, 21, 46, 28, 27, 47, 22, 29, 23, 30, 31, 12 },
+};
+
+/* coeff_token, Table 9-5, by [nC class][TotalCoeff * 4 + TrailingOnes] */
+static const unsigned char swenc_coeff_token_len[4][68] = {
+    {  1,  0,  0,  0,  6,  2,  0,  0,  8,  6,  3,  0,  9,  8,  7,  5,
+      10,  9,  8,  6, 11, 10,  9,  7, 13, 11, 10,  8, 13, 13, 11,  9,
+      13, 13, 13, 10, 14, 14, 13, 11, 14, 14, 14, 13, 15, 15, 14, 14,
+      15, 15, 15, 14, 16, 15, 15, 15, 16, 16, 16, 15, 16, 16, 16, 16,
+      16, 16, 16, 16 },
+    {  2,  0,  0,  0,  6,  2,  0,  0,  6,  5,  3,  0,  7,  6,  6,  4,
+       8,  6,  6,  4,  8,  7,  7,  5,  9,  8,  8,  6, 11,  9,  9,  6,
+      11, 11, 11,  7, 12, 11, 11,  9, 12, 12, 12, 11, 12, 12, 12, 11,
+      13, 13, 13, 12, 13, 13, 13, 13, 13, 14, 13, 13, 14, 14, 14, 13,
+      14, 14, 14, 14 },
+    {  4,  0,  0,  0,  6,  4,  0,  0,  6,  5,  4,  0,  6,  5,  5,  4,
+       7,  5,  5,  4,  7,  5,  5,  4,  7,  6,  6,  4,  7,  6,  6,  4,
+       8,  7,  7,  5,  8,  8,  7,  6,  9,  8,  8,  7,  9,  9,  8,  8,
+       9,  9,  9,  8, 10,  9,  9,  9, 10, 10, 10, 10, 10, 10, 10, 10,
+      10, 10, 10, 10 },
+    {  6,  0,  0,  0,  6,  6,  0,  0,  6,  6,  6,  0,  6,  6,  6,  6,
+       6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,
+       6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,
+       6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,
+       6,  6,  6,  6 },
+};
+
+static const unsigned char swenc_coeff_token_bits[4][68] = {
+    {  1,  0,  0,  0,  5,  1,  0,  0,  7,  4,  1,  0,  7,  6,  5,  3,
+       7,  6,  5,  3,  7,  6,  5,  4, 15,  6,  5,  4, 11, 14,  5,  4,
+       8, 10, 13,  4, 15, 14,  9,  4, 11, 10, 13, 12, 15, 14,  9, 12,
+      11, 10, 13,  8, 15,  1,  9, 12, 11, 14, 13,  8,  7, 10,  9, 12,
+       4,  6,  5,  8 },
+    {  3,  0,  0,  0, 11,  2,  0,  0,  7,  7,  3,  0,  7, 10,  9,  5,
+       7,  6,  5,  4,  4,  6,  5,  6,  7,  6,  5,  8, 15,  6,  5,  4,
+      11, 14, 13,  4, 15, 10,  9,  4, 11, 14, 13, 12,  8, 10,  9,  8,
+      15, 14, 13, 12, 11, 10,  9, 12,  7, 11,  6,  8,  9,  8, 10,  1,
+       7,  6,  5,  4 },
+    { 15,  0,  0,  0, 15, 14,  0,  0, 11, 15, 13,  0,  8, 12, 14, 12,
+      15, 10, 11, 11, 11,  8,  9, 10,  9, 14, 13,  9,  8, 10,  9,  8,
+      15, 14, 13, 13, 11, 14, 10, 12, 15, 10, 13, 12, 11, 14,  9, 12,
+       8, 10, 13,  8, 13,  7,  9, 12,  9, 12, 11, 10,  5,  8,  7,  6,
+       1,  4,  3,  2 },
+    {  3,  0,  0,  0,  0,  1,  0,  0,  4,  5,  6,  0,  8,  9, 10, 11,
+      12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27,
+      28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43,
+      44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59,
+      60, 61, 62, 63 },
+};
+
+/* coeff_token of the chroma DC, nC == -1 */
+static const unsigned char swenc_chroma_dc_token_len[20] = {
+    2, 0, 0, 0, 6, 1, 0, 0, 6, 6, 3, 0, 6, 7, 7, 6, 6, 8, 8, 7,
+};
+
+static const unsigned char swenc_chroma_dc_token_bits[20] = {
+    1, 0, 0, 0, 7, 1, 0, 0, 4, 6, 1, 0, 3, 3, 2, 5, 2, 3, 2, 0,
+};
+
+/* total_zeros, Table 9-7 and 9-8, by [TotalCoeff - 1][total_zeros] */
+static const unsigned char swenc_total_zeros_len[15][16] = {
+    { 1, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 9 },
+    { 3, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 6, 6, 6, 6 },
+    { 4, 3, 3, 3, 4, 4, 3, 3, 4, 5, 5, 6, 5, 6 },
+    { 5, 3, 4, 4, 3, 3, 3, 4, 3, 4, 5, 5, 5 },
+    { 4, 4, 4, 3, 3, 3, 3, 3, 4, 5, 4, 5 },
+    { 6, 5, 3, 3, 3, 3, 3, 3, 4, 3, 6 },
+    { 6, 5, 3, 3, 3, 2, 3, 4, 3, 6 },
+    { 6, 4, 5, 3, 2, 2, 3, 3, 6 },
+    { 6, 6, 4, 2, 2, 3, 2, 5 },
+    { 5, 5, 3, 2, 2, 2, 4 },
+    { 4, 4, 3, 3, 1, 3 },
+    { 4, 4, 2, 1, 3 },
+    { 3, 3, 1, 2 },
+    { 2, 2, 1 },
+    { 1, 1 },
+};
+
+static const unsigned char swenc_total_zeros_bits[15][16] = {
+    { 1, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 1 },
+    { 7, 6, 5, 4, 3, 5, 4, 3, 2, 3, 2, 3, 2, 1, 0 },
+    { 5, 7, 6, 5, 4, 3, 4, 3, 2, 3, 2, 1, 1, 0 },
+    { 3, 7, 5, 4, 6, 5, 4, 3, 3, 2, 2, 1, 0 },
+    { 5, 4, 3, 7, 6, 5, 4, 3, 2, 1, 1, 0 },
+    { 1, 1, 7, 6, 5, 4, 3, 2, 1, 1, 0 },
+    { 1, 1, 5, 4, 3, 3, 2, 1, 1, 0 },
+    { 1, 1, 1, 3, 3, 2, 2, 1, 0 },
+    { 1, 0, 1, 3, 2, 1, 1, 1 },
+    { 1, 0, 1, 3, 2, 1, 1 },
+    { 0, 1, 1, 2, 1, 3 },
+    { 0, 1, 1, 1, 1 },
+    { 0, 1, 1, 1 },
+    { 0, 1, 1 },
+    { 0, 1 },
+};
+
+static const unsigned char swenc_chroma_dc_zeros_len[3][4] = {
+    { 1, 2, 3, 3 }, { 1, 2, 2 }, { 1, 1 },
+};
+
+static const unsigned char swenc_chroma_dc_zeros_bits[3][4] = {
+    { 1, 1, 1, 0 }, { 1, 1, 0 }, { 1, 0 },
+};
+
+/* run_before, Table 9-10, by [min(zerosLeft, 7) - 1][run_before] */
+static const unsigned char swenc_run_len[7][15] = {
+    { 1, 1 },
+    { 1, 2, 2 },
+    { 2, 2, 2, 2 },
+    { 2, 2, 2, 3, 3 },
+    { 2, 2, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 4, 5, 6, 7, 8, 9, 10, 11 },
+};
+
+static const unsigned char swenc_run_bits[7][15] = {
+    { 1, 0 },
+    { 1, 1, 0 },
+    { 3, 2, 1, 0 },
+    { 3, 2, 1, 1, 0 },
+    { 3, 2, 3, 2, 1, 0 },
+    { 3, 0, 1, 3, 2, 5, 4 },
+    { 7, 6, 5, 4, 3, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+};
+
+/*
+ * Quarter sample luma as the rounded average of two of the full, half
+ * horizontal, half vertical and centre planes, Table 8-12. Each entry is
+ * { plane, x offset, y offset }, by [yFrac * 4 + xFrac].
+ */
+static const signed char swenc_qpel[16][2][3] = {
+    { { 0, 0, 0 }, { 0, 0, 0 } }, { { 0, 0, 0 }, { 1, 0, 0 } },
+    { { 1, 0, 0 }, { 1, 0, 0 } }, { { 1, 0, 0 }, { 0, 1, 0 } },
+    { { 0, 0, 0 }, { 2, 0, 0 } }, { { 1, 0, 0 }, { 2, 0, 0 } },
+    { { 1, 0, 0 }, { 3, 0, 0 } }, { { 1, 0, 0 }, { 2, 1, 0 } },
+    { { 2, 0, 0 }, { 2, 0, 0 } }, { { 2, 0, 0 }, { 3, 0, 0 } },
+    { { 3, 0, 0 }, { 3, 0, 0 } }, { { 3, 0, 0 }, { 2, 1, 0 } },
+    { { 2, 0, 0 }, { 0, 0, 1 } }, { { 2, 0, 0 }, { 1, 0, 1 } },
+    { { 3, 0, 0 }, { 1, 0, 1 } }, { { 1, 0, 1 }, { 2, 1, 0 } },
+};
+
+typedef struct swenc_mb {
+    unsigned char   type;
+    unsigned char   qp;             /* QP_Y as the decoder derives it */
+    signed char     qp_delta;
+    unsigned char   cbp;            /* luma in bits 0-3, chroma in 4-5 */
+    unsigned char   i16_mode;
+    unsigned char   chroma_mode;
+    unsigned char   i4_modes[16];   /* raster order */
+    unsigned char   nnz[16];        /* coded TotalCoeff, raster order */
+    unsigned char   nnz_c[8];       /* Cb then Cr AC blocks */
+    short           mv[2];          /* quarter pel */
+    short           mvp[2];
+    short           luma_dc[16];    /* levels, in scan order */
+    short           luma[16][16];
+    short           chroma_dc[2][4];
+    short           chroma_ac[8][16];
+} swenc_mb_t, *swenc_mb_p;
+
+/**
+ * Reconstructed picture: the full sample plane with its three half sample
+ * planes, all padded by SWENC_PAD, and the chroma planes padded by half.
+ */
+typedef struct swenc_picture {
+    unsigned char  *mem;
+    unsigned char  *luma[4];
+    unsigned char  *chroma[2];
+} swenc_picture_t, *swenc_picture_p;
+
+/**
+ * What carries over from frame to frame.
+ */
+typedef struct swenc_stream {
+    int             frames;
+    int             since_idr;
+    int             idr_pic_id;
+    int             frame_num_offset;
+    int             poc_offset;
+    int             ref;            /* reference picture, -1 for none */
+
+    /* Rate control: bits times quantizer step of the last P and I frame */
+    double          complexity[2];
+    double          fullness;       /* bits spent over the budget */
+    int             last_qp[2];
+    int             bytes_per_mb[2];
+
+    unsigned char   sps[SWENC_HEADER_BYTES];
+    unsigned char   pps[SWENC_HEADER_BYTES];
+    int             sps_bytes;
+    int             pps_bytes;
+} swenc_stream_t;
+
+typedef struct swenc_frame {
+    h264_header_info_t hdr;
+    int             intra;
+    int             idr;
+    int             nal_ref_idc;
+    int             idr_pic_id;
+    int             qp;
+    int             chroma_qp_offset;
+    int             deblock;
+    int             slice_mbs;
+    int             num_slices;
+    int             subpel;
+    int             intra_4x4;
+    int             range_x;
+    int             range_y;
+    int             cur;
+
+    unsigned char   sps[SWENC_HEADER_BYTES];
+    unsigned char   pps[SWENC_HEADER_BYTES];
+    int             sps_bytes;
+    int             pps_bytes;
+    int             write_sps;
+    int             write_pps;
+
+    double          budget;         /* bits per frame, 0 without a bitrate */
+    int             coded_bytes;
+    int             overflow;
+} swenc_frame_t;
+
+typedef struct swenc_worker {
+    h264_swenc_p    enc;
+    pthread_t       thread;
+    short          *scratch;
+} swenc_worker_t, *swenc_worker_p;
+
+struct h264_swenc {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    swenc_worker_t  workers[SWENC_MAX_THREADS];
+    int             num_threads;
+    int             quit;
+
+    /* Phase in progress, its tasks and the row progress of wavefronts */
+    int             phase;
+    int             next_task;
+    int             num_tasks;
+    int             pending;
+    int            *row_done;
+
+    /* Formats */
+    int             width;
+    int             height;
+    int             coded_size;
+    int             mb_width;
+    int             mb_height;
+    int             num_mbs;
+    int             stride;
+    int             stride_c;
+    int             allocated;
+
+    /* Buffers, one of each like the VPU */
+    unsigned char  *coded;
+    unsigned char  *input[3];
+    int             input_size[3];
+    int             input_state;
+    int             output_state;
+
+    /* Controls */
+    VAEncSequenceParameterBufferH264 sps;
+    VAEncPictureParameterBufferH264 pps;
+    int             bitrate;
+    int             target_bits;
+    int             frame_rc;
+    int             qp_i;
+    int             qp_p;
+    int             min_qp;
+    int             max_qp;
+    int             slice_mode;
+    int             slice_max_mb;
+    int             slice_max_bytes;
+    int             range_x;
+    int             range_y;
+    int             loop_filter;
+    int             force_key_frame;
+    int             fps_num;
+    int             fps_den;
+    struct rk_vepu_area intra_area;
+    struct rk_vepu_dirty_area dirty;
+    int             dirty_valid;
+    struct rk_vepu_roi roi;
+    struct rk_vepu_quality quality;
+    signed char    *qp_map;
+    int             qp_map_valid;
+
+    /* Coding state */
+    swenc_stream_t  stream;
+    swenc_frame_t   frame;
+    swenc_picture_t pics[2];
+    swenc_mb_p      mbs;
+    unsigned char  *mb_qp;
+    unsigned char  *mb_flags;
+    unsigned char  *slice_data;
+    int            *slice_bytes;
+
+    /* Source planes, a 16 aligned copy when the size is not */
+    unsigned char  *src[3];
+    int             src_stride[3];
+    unsigned char  *aligned;
+};
+
+/* Per macroblock analysis state */
+typedef struct swenc_mbctx {
+    h264_swenc_p    enc;
+    swenc_mb_p      mb;
+    int             x;
+    int             y;
+    int             qp;
+    int             qpc;
+    int             lambda;
+    int             avail;
+    int             stride;
+    int             stride_c;
+    unsigned char  *rec[3];
+    unsigned char   src[256];
+    unsigned char   src_c[2][64];
+    unsigned char   pred[256];
+    unsigned char   pred_c[2][64];
+} swenc_mbctx_t, *swenc_mbctx_p;
+
+static inline int swenc_clip3(int lo, int hi, int v)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+static inline unsigned char swenc_clip(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static inline int swenc_median(int a, int b, int c)
+{
+    int lo = a < b ? a : b, hi = a < b ? b : a;
+
+    return c < lo ? lo : c > hi ? hi : c;
+}
+
+static unsigned int swenc_sad_16x16(const unsigned char *a, int a_stride,
+        const unsigned char *b, int b_stride)
+{
+    unsigned int sad = 0;
+    int i;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint16x8_t acc = vdupq_n_u16(0);
+
+    for (i = 0; i < 16; i++, a += a_stride, b += b_stride)
+        acc = vpadalq_u8(acc, vabdq_u8(vld1q_u8(a), vld1q_u8(b)));
+
+    uint32x4_t acc32 = vpaddlq_u16(acc);
+    sad = vgetq_lane_u32(acc32, 0) + vgetq_lane_u32(acc32, 1) +
+        vgetq_lane_u32(acc32, 2) + vgetq_lane_u32(acc32, 3);
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+
+    for (i = 0; i < 16; i++, a += a_stride, b += b_stride)
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(
+                    _mm_loadu_si128((const __m128i *) a),
+                    _mm_loadu_si128((const __m128i *) b)));
+
+    sad = _mm_cvtsi128_si32(acc) +
+        _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+#else
+    int j;
+
+    for (i = 0; i < 16; i++, a += a_stride, b += b_stride)
+        for (j = 0; j < 16; j++)
+            sad += a[j] > b[j] ? a[j] - b[j] : b[j] - a[j];
+#endif
+
+    return sad;
+}
+
+/* Rounded average of two 16x16 blocks of the same stride, packed in dst */
+static void swenc_avg_16x16(unsigned char *dst, const unsigned char *a,
+        const unsigned char *b, int stride)
+{
+    int i;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (i = 0; i < 16; i++, a += stride, b += stride, dst += 16)
+        vst1q_u8(dst, vrhaddq_u8(vld1q_u8(a), vld1q_u8(b)));
+#elif defined(__SSE2__)
+    for (i = 0; i < 16; i++, a += stride, b += stride, dst += 16)
+        _mm_storeu_si128((__m128i *) dst, _mm_avg_epu8(
+                    _mm_loadu_si128((const __m128i *) a),
+                    _mm_loadu_si128((const __m128i *) b)));
+#else
+    int j;
+
+    for (i = 0; i < 16; i++, a += stride, b += stride, dst += 16)
+        for (j = 0; j < 16; j++)
+            dst[j] = (a[j] + b[j] + 1) >> 1;
+#endif
+}
+
+/* Sum of absolute Hadamard transformed differences, halved */
+static int swenc_satd_4x4(const unsigned char *a, int a_stride,
+        const unsigned char *b, int b_stride)
+{
+    int d[16], i, sum = 0;
+
+    for (i = 0; i < 4; i++, a += a_stride, b += b_stride) {
+        int d0 = a[0] - b[0], d1 = a[1] - b[1];
+        int d2 = a[2] - b[2], d3 = a[3] - b[3];
+        int s0 = d0 + d1, s1 = d0 - d1, s2 = d2 + d3, s3 = d2 - d3;
+
+        d[i * 4 + 0] = s0 + s2;
+        d[i * 4 + 1] = s1 + s3;
+        d[i * 4 + 2] = s0 - s2;
+        d[i * 4 + 3] = s1 - s3;
+    }
+
+    for (i = 0; i < 4; i++) {
+        int s0 = d[i] + d[4 + i], s1 = d[i] - d[4 + i];
+        int s2 = d[8 + i] + d[12 + i], s3 = d[8 + i] - d[12 + i];
+
+        sum += abs(s0 + s2) + abs(s1 + s3) + abs(s0 - s2) + abs(s1 - s3);
+    }
+
+    return (sum + 1) >> 1;
+}
+
+static int swenc_satd(const unsigned char *a, int a_stride,
+        const unsigned char *b, int b_stride, int size)
+{
+    int x, y, sum = 0;
+
+    for (y = 0; y < size; y += 4)
+        for (x = 0; x < size; x += 4)
+            sum += swenc_satd_4x4(a + y * a_stride + x, a_stride,
+                    b + y * b_stride + x, b_stride);
+
+    return sum;
+}
+
+/* Length of the se(v) code of v */
+static int swenc_se_bits(int v)
+{
+    unsigned int code = v > 0 ? 2 * v : -2 * v + 1;
+    int bits = 0;
+
+    while (code >>= 1)
+        bits++;
+
+    return 2 * bits + 1;
+}
+
+/* Forward core transform of src - pred, raster order */
+static void swenc_fdct_4x4(int *out, const unsigned char *src, int src_stride,
+        const unsigned char *pred, int pred_stride)
+{
+    int d[16], i;
+
+    for (i = 0; i < 4; i++, src += src_stride, pred += pred_stride) {
+        int d0 = src[0] - pred[0], d1 = src[1] - pred[1];
+        int d2 = src[2] - pred[2], d3 = src[3] - pred[3];
+        int s0 = d0 + d3, s1 = d1 + d2, s2 = d1 - d2, s3 = d0 - d3;
+
+        d[i * 4 + 0] = s0 + s1;
+        d[i * 4 + 1] = 2 * s3 + s2;
+        d[i * 4 + 2] = s0 - s1;
+        d[i * 4 + 3] = s3 - 2 * s2;
+    }
+
+    for (i = 0; i < 4; i++) {
+        int s0 = d[i] + d[12 + i], s1 = d[4 + i] + d[8 + i];
+        int s2 = d[4 + i] - d[8 + i], s3 = d[i] - d[12 + i];
+
+        out[i] = s0 + s1;
+        out[4 + i] = 2 * s3 + s2;
+        out[8 + i] = s0 - s1;
+        out[12 + i] = s3 - 2 * s2;
+    }
+}
+
+/* Inverse transform of d, 8.5.12, added to pred into dst */
+static void swenc_idct_4x4_add(unsigned char *dst, int dst_stride,
+        const unsigned char *pred, int pred_stride, const int *d)
+{
+    int t[16], i;
+
+    for (i = 0; i < 4; i++) {
+        const int *r = d + i * 4;
+        int e0 = r[0] + r[2], e1 = r[0] - r[2];
+        int e2 = (r[1] >> 1) - r[3], e3 = r[1] + (r[3] >> 1);
+
+        t[i * 4 + 0] = e0 + e3;
+        t[i * 4 + 1] = e1 + e2;
+        t[i * 4 + 2] = e1 - e2;
+        t[i * 4 + 3] = e0 - e3;
+    }
+
+    for (i = 0; i < 4; i++) {
+        int e0 = t[i] + t[8 + i], e1 = t[i] - t[8 + i];
+        int e2 = (t[4 + i] >> 1) - t[12 + i], e3 = t[4 + i] + (t[12 + i] >> 1);
+
+        dst[i] = swenc_clip(pred[i] + ((e0 + e3 + 32) >> 6));
+        dst[dst_stride + i] =
+            swenc_clip(pred[pred_stride + i] + ((e1 + e2 + 32) >> 6));
+        dst[2 * dst_stride + i] =
+            swenc_clip(pred[2 * pred_stride + i] + ((e1 - e2 + 32) >> 6));
+        dst[3 * dst_stride + i] =
+            swenc_clip(pred[3 * pred_stride + i] + ((e0 - e3 + 32) >> 6));
+    }
+}
+
+static void swenc_copy_4x4(unsigned char *dst, int dst_stride,
+        const unsigned char *src, int src_stride)
+{
+    int i;
+
+    for (i = 0; i < 4; i++, dst += dst_stride, src += src_stride)
+        memcpy(dst, src, 4);
+}
+
+/* Quantize the coefficients from start on into levels in scan order */
+static int swenc_quant_4x4(short *levels, const int *coef, int start,
+        int qp, int intra)
+{
+    int qbits = 15 + qp / 6, f = (1 << qbits) / (intra ? 3 : 6);
+    const int *mf = swenc_quant_mf[qp % 6];
+    int i, n = 0;
+
+    for (i = start; i < 16; i++) {
+        int pos = swenc_zigzag[i], c = coef[pos];
+        int level = ((c < 0 ? -c : c) * mf[swenc_pos_class[pos]] + f) >> qbits;
+
+        if (level > SWENC_MAX_LEVEL)
+            level = SWENC_MAX_LEVEL;
+        levels[i] = c < 0 ? -level : level;
+        n += level != 0;
+    }
+
+    return n;
+}
+
+static void swenc_dequant_4x4(int *coef, const short *levels, int start,
+        int qp)
+{
+    const int *v = swenc_dequant_v[qp % 6];
+    int i, scale = 1 << (qp / 6);
+
+    for (i = start; i < 16; i++) {
+        int pos = swenc_zigzag[i];
+
+        coef[pos] = levels[i] * v[swenc_pos_class[pos]] * scale;
+    }
+}
+
+/* 4x4 Hadamard transform in place, raster order */
+static void swenc_hadamard_4x4(int *d)
+{
+    int t[16], i;
+
+    for (i = 0; i < 4; i++) {
+        const int *r = d + i * 4;
+        int s0 = r[0] + r[1], s1 = r[0] - r[1];
+        int s2 = r[2] + r[3], s3 = r[2] - r[3];
+
+        t[i * 4 + 0] = s0 + s2;
+        t[i * 4 + 1] = s0 - s2;
+        t[i * 4 + 2] = s1 - s3;
+        t[i * 4 + 3] = s1 + s3;
+    }
+
+    for (i = 0; i < 4; i++) {
+        int s0 = t[i] + t[4 + i], s1 = t[i] - t[4 + i];
+        int s2 = t[8 + i] + t[12 + i], s3 = t[8 + i] - t[12 + i];
+
+        d[i] = s0 + s2;
+        d[4 + i] = s0 - s2;
+        d[8 + i] = s1 - s3;
+        d[12 + i] = s1 + s3;
+    }
+}
+
+/* Quantize a DC transform of n coefficients, scan gives their order */
+static int swenc_quant_dc(short *levels, const int *dc, int n,
+        const unsigned char *scan, int qp, int intra)
+{
+    int qbits = 16 + qp / 6, f = (1 << qbits) / (intra ? 3 : 6);
+    int mf = swenc_quant_mf[qp % 6][0];
+    int i, nz = 0;
+
+    for (i = 0; i < n; i++) {
+        int c = dc[scan ? scan[i] : i];
+        int level = ((c < 0 ? -c : c) * mf + f) >> qbits;
+
+        if (level > SWENC_MAX_LEVEL)
+            level = SWENC_MAX_LEVEL;
+        levels[i] = c < 0 ? -level : level;
+        nz += level != 0;
+    }
+
+    return nz;
+}
+
+/* Intra 16x16 DC levels back to the 16 DC coefficients, 8.5.10 */
+static void swenc_dequant_luma_dc(int *dc, const short *levels, int qp)
+{
+    int scale = 16 * swenc_dequant_v[qp % 6][0], i;
+
+    for (i = 0; i < 16; i++)
+        dc[swenc_zigzag[i]] = levels[i];
+
+    swenc_hadamard_4x4(dc);
+
+    for (i = 0; i < 16; i++) {
+        if (qp >= 36)
+            dc[i] = dc[i] * scale * (1 << (qp / 6 - 6));
+        else
+            dc[i] = (dc[i] * scale + (1 << (5 - qp / 6))) >> (6 - qp / 6);
+    }
+}
+
+static void swenc_transform_2x2(int *f, const int *c)
+{
+    f[0] = c[0] + c[1] + c[2] + c[3];
+    f[1] = c[0] - c[1] + c[2] - c[3];
+    f[2] = c[0] + c[1] - c[2] - c[3];
+    f[3] = c[0] - c[1] - c[2] + c[3];
+}
+
+/* Chroma DC levels back to the 4 DC coefficients, 8.5.11 */
+static void swenc_dequant_chroma_dc(int *dc, const short *levels, int qp)
+{
+    int scale = 16 * swenc_dequant_v[qp % 6][0], c[4], i;
+
+    for (i = 0; i < 4; i++)
+        c[i] = levels[i];
+
+    swenc_transform_2x2(dc, c);
+
+    for (i = 0; i < 4; i++)
+        dc[i] = (dc[i] * scale * (1 << (qp / 6))) >> 5;
+}
+
+/* Intra 16x16 prediction from the reconstructed neighbours of rec, 8.3.3 */
+static void swenc_pred_16x16(unsigned char *pred, const unsigned char *rec,
+        int stride, int mode, int avail)
+{
+    const unsigned char *top = rec - stride;
+    int i, j;
+
+    switch (mode) {
+    case PRED_V:
+        for (i = 0; i < 16; i++)
+            memcpy(pred + i * 16, top, 16);
+        break;
+    case PRED_H:
+        for (i = 0; i < 16; i++)
+            memset(pred + i * 16, rec[i * stride - 1], 16);
+        break;
+    case PRED_DC: {
+        int sum = 0, dc = 128;
+
+        if (avail & AVAIL_TOP)
+            for (j = 0; j < 16; j++)
+                sum += top[j];
+        if (avail & AVAIL_LEFT)
+            for (i = 0; i < 16; i++)
+                sum += rec[i * stride - 1];
+
+        if ((avail & (AVAIL_TOP | AVAIL_LEFT)) == (AVAIL_TOP | AVAIL_LEFT))
+            dc = (sum + 16) >> 5;
+        else if (avail & (AVAIL_TOP | AVAIL_LEFT))
+            dc = (sum + 8) >> 4;
+        memset(pred, dc, 256);
+        break;
+    }
+    case PRED_PLANE: {
+        int h = 0, v = 0, a, b, c;
+
+        for (i = 0; i < 8; i++) {
+            h += (i + 1) * (top[8 + i] - top[6 - i]);
+            v += (i + 1) * (rec[(8 + i) * stride - 1] -
+                    rec[(6 - i) * stride - 1]);
+        }
+        a = 16 * (rec[15 * stride - 1] + top[15]);
+        b = (5 * h + 32) >> 6;
+        c = (5 * v + 32) >> 6;
+
+        for (i = 0; i < 16; i++)
+            for (j = 0; j < 16; j++)
+                pred[i * 16 + j] =
+                    swenc_clip((a + b * (j - 7) + c * (i - 7) + 16) >> 5);
+        break;
+    }
+    }
+}
+
+/* Intra chroma prediction of one 8x8 plane, 8.3.4 */
+static void swenc_pred_chroma(unsigned char *pred, const unsigned char *rec,
+        int stride, int mode, int avail)
+{
+    const unsigned char *top = rec - stride;
+    int i, j;
+
+    switch (mode) {
+    case CHROMA_DC: {
+        int bx, by;
+
+        for (by = 0; by < 2; by++) {
+            for (bx = 0; bx < 2; bx++) {
+                int st = 0, sl = 0, dc = 128;
+                int has_top = avail & AVAIL_TOP, has_left = avail & AVAIL_LEFT;
+
+                for (i = 0; i < 4; i++) {
+                    st += top[bx * 4 + i];
+                    sl += rec[(by * 4 + i) * stride - 1];
+                }
+                if (!has_top)
+                    st = 0;
+                if (!has_left)
+                    sl = 0;
+
+                /* The top right block prefers the top, the bottom left the left */
+                if (bx == by) {
+                    if (has_top && has_left)
+                        dc = (st + sl + 4) >> 3;
+                    else if (has_top)
+                        dc = (st + 2) >> 2;
+                    else if (has_left)
+                        dc = (sl + 2) >> 2;
+                } else if (bx) {
+                    if (has_top)
+                        dc = (st + 2) >> 2;
+                    else if (has_left)
+                        dc = (sl + 2) >> 2;
+                } else {
+                    if (has_left)
+                        dc = (sl + 2) >> 2;
+                    else if (has_top)
+                        dc = (st + 2) >> 2;
+                }
+
+                for (i = 0; i < 4; i++)
+                    memset(pred + (by * 4 + i) * 8 + bx * 4, dc, 4);
+            }
+        }
+        break;
+    }
+    case CHROMA_H:
+        for (i = 0; i < 8; i++)
+            memset(pred + i * 8, rec[i * stride - 1], 8);
+        break;
+    case CHROMA_V:
+        for (i = 0; i < 8; i++)
+            memcpy(pred + i * 8, top, 8);
+        break;
+    case CHROMA_PLANE: {
+        int h = 0, v = 0, a, b, c;
+
+        for (i = 0; i < 4; i++) {
+            h += (i + 1) * (top[4 + i] - top[2 - i]);
+            v += (i + 1) * (rec[(4 + i) * stride - 1] -
+                    rec[(2 - i) * stride - 1]);
+        }
+        a = 16 * (rec[7 * stride - 1] + top[7]);
+        b = (34 * h + 32) >> 6;
+        c = (34 * v + 32) >> 6;
+
+        for (i = 0; i < 8; i++)
+            for (j = 0; j < 8; j++)
+                pred[i * 8 + j] =
+                    swenc_clip((a + b * (j - 3) + c * (i - 3) + 16) >> 5);
+        break;
+    }
+    }
+}
+
+/* Intra 4x4 prediction, vertical, horizontal and DC only */
+static void swenc_pred_4x4(unsigned char *pred, const unsigned char *rec,
+        int stride, int mode, int has_left, int has_top)
+{
+    const unsigned char *top = rec - stride;
+    int i;
+
+    switch (mode) {
+    case PRED_V:
+        for (i = 0; i < 4; i++)
+            memcpy(pred + i * 4, top, 4);
+        break;
+    case PRED_H:
+        for (i = 0; i < 4; i++)
+            memset(pred + i * 4, rec[i * stride - 1], 4);
+        break;
+    default: {
+        int st = 0, sl = 0, dc = 128;
+
+        for (i = 0; i < 4; i++) {
+            st += top[i];
+            sl += rec[i * stride - 1];
+        }
+        if (has_top && has_left)
+            dc = (st + sl + 4) >> 3;
+        else if (has_top)
+            dc = (st + 2) >> 2;
+        else if (has_left)
+            dc = (sl + 2) >> 2;
+        memset(pred, dc, 16);
+        break;
+    }
+    }
+}
+
+/* Luma samples of a 16x16 block at (x, y) moved by mv, packed in dst */
+static void swenc_mc_luma(swenc_picture_p ref, int stride, int x, int y,
+        const int *mv, unsigned char *dst)
+{
+    const signed char (*e)[3] = swenc_qpel[(mv[1] & 3) * 4 + (mv[0] & 3)];
+    int ix = x + (mv[0] >> 2), iy = y + (mv[1] >> 2), i;
+    const unsigned char *a, *b;
+
+    a = ref->luma[e[0][0]] + (iy + e[0][2]) * stride + ix + e[0][1];
+    b = ref->luma[e[1][0]] + (iy + e[1][2]) * stride + ix + e[1][1];
+
+    if (a == b) {
+        for (i = 0; i < 16; i++, a += stride)
+            memcpy(dst + i * 16, a, 16);
+    } else {
+        swenc_avg_16x16(dst, a, b, stride);
+    }
+}
+
+/* Chroma of the macroblock moved by mv, eighth pel bilinear, 8.4.2.2.2 */
+static void swenc_mc_chroma(swenc_mbctx_p m, swenc_picture_p ref,
+        const int *mv)
+{
+    int fx = mv[0] & 7, fy = mv[1] & 7;
+    int wa = (8 - fx) * (8 - fy), wb = fx * (8 - fy);
+    int wc = (8 - fx) * fy, wd = fx * fy;
+    int stride = m->stride_c, c, i, j;
+
+    for (c = 0; c < 2; c++) {
+        const unsigned char *s = ref->chroma[c] +
+            (m->y * 8 + (mv[1] >> 3)) * stride + m->x * 8 + (mv[0] >> 3);
+        unsigned char *dst = m->pred_c[c];
+
+        for (i = 0; i < 8; i++, s += stride, dst += 8)
+            for (j = 0; j < 8; j++)
+                dst[j] = (wa * s[j] + wb * s[j + 1] + wc * s[stride + j] +
+                        wd * s[stride + j + 1] + 32) >> 6;
+    }
+}
+
+/* Neighbours of the macroblock at (x, y) that are in its slice */
+static int swenc_avail(h264_swenc_p enc, int x, int y)
+{
+    int w = enc->mb_width, addr = y * w + x;
+    int first = addr / enc->frame.slice_mbs * enc->frame.slice_mbs;
+    int avail = 0;
+
+    if (x > 0 && addr - 1 >= first)
+        avail |= AVAIL_LEFT;
+    if (y > 0 && addr - w >= first)
+        avail |= AVAIL_TOP;
+    if (x > 0 && y > 0 && addr - w - 1 >= first)
+        avail |= AVAIL_TOPLEFT;
+    if (x + 1 < w && y > 0 && addr - w + 1 >= first)
+        avail |= AVAIL_TOPRIGHT;
+
+    return avail;
+}
+
+/* Motion vector prediction, 8.4.1.3, and the P_Skip vector, 8.4.1.1 */
+static void swenc_predict_mv(h264_swenc_p enc, swenc_mb_p mb, int avail,
+        int *mvp, int *skip)
+{
+    swenc_mb_p nb[3];
+    int mv[3][2], match = 0, last = 0, i, w = enc->mb_width;
+
+    nb[0] = avail & AVAIL_LEFT ? mb - 1 : NULL;
+    nb[1] = avail & AVAIL_TOP ? mb - w : NULL;
+    nb[2] = avail & AVAIL_TOPRIGHT ? mb - w + 1 :
+        avail & AVAIL_TOPLEFT ? mb - w - 1 : NULL;
+
+    /* Only the left one: it is the predictor */
+    if (!nb[1] && !nb[2] && nb[0])
+        nb[1] = nb[2] = nb[0];
+
+    for (i = 0; i < 3; i++) {
+        if (nb[i] && !MB_IS_INTRA(nb[i]->type)) {
+            mv[i][0] = nb[i]->mv[0];
+            mv[i][1] = nb[i]->mv[1];
+            match++;
+            last = i;
+        } else {
+            mv[i][0] = mv[i][1] = 0;
+        }
+    }
+
+    if (match == 1) {
+        mvp[0] = mv[last][0];
+        mvp[1] = mv[last][1];
+    } else {
+        mvp[0] = swenc_median(mv[0][0], mv[1][0], mv[2][0]);
+        mvp[1] = swenc_median(mv[0][1], mv[1][1], mv[2][1]);
+    }
+
+    skip[0] = mvp[0];
+    skip[1] = mvp[1];
+    if (!(avail & AVAIL_LEFT) || !(avail & AVAIL_TOP)) {
+        skip[0] = skip[1] = 0;
+    } else {
+        swenc_mb_p a = mb - 1, b = mb - w;
+
+        if ((!MB_IS_INTRA(a->type) && !a->mv[0] && !a->mv[1]) ||
+                (!MB_IS_INTRA(b->type) && !b->mv[0] && !b->mv[1]))
+            skip[0] = skip[1] = 0;
+    }
+}
+
+/* Predicted intra 4x4 mode of the block at raster r, 8.3.1.1 */
+static int swenc_pred_i4_mode(h264_swenc_p enc, swenc_mb_p mb, int avail,
+        int r)
+{
+    int bx = r & 3, by = r >> 2, a, b;
+
+    if (bx)
+        a = mb->i4_modes[r - 1];
+    else if (avail & AVAIL_LEFT)
+        a = mb[-1].type == MB_I4x4 ? mb[-1].i4_modes[r + 3] : PRED_DC;
+    else
+        return PRED_DC;
+
+    if (by)
+        b = mb->i4_modes[r - 4];
+    else if (avail & AVAIL_TOP)
+        b = mb[-enc->mb_width].type == MB_I4x4 ?
+            mb[-enc->mb_width].i4_modes[r + 12] : PRED_DC;
+    else
+        return PRED_DC;
+
+    return a < b ? a : b;
+}
+
+/* Inter luma residual against m->pred, reconstructed into the picture */
+static void swenc_code_luma_inter(swenc_mbctx_p m)
+{
+    swenc_mb_p mb = m->mb;
+    int coef[16], r, i, i8, cbp = 0;
+
+    for (r = 0; r < 16; r++) {
+        int off = (r >> 2) * 64 + (r & 3) * 4;
+
+        swenc_fdct_4x4(coef, m->src + off, 16, m->pred + off, 16);
+        mb->nnz[r] = swenc_quant_4x4(mb->luma[r], coef, 0, m->qp, 0);
+    }
+
+    for (i8 = 0; i8 < 4; i8++) {
+        int sum = 0;
+
+        for (i = 0; i < 4; i++) {
+            short *levels = mb->luma[swenc_blk_raster[i8 * 4 + i]];
+            int k;
+
+            for (k = 0; k < 16; k++)
+                sum += abs(levels[k]);
+        }
+
+        if (sum > 1) {
+            cbp |= 1 << i8;
+            continue;
+        }
+
+        /* A lone +-1 costs more bits than it is worth */
+        for (i = 0; i < 4; i++) {
+            r = swenc_blk_raster[i8 * 4 + i];
+            memset(mb->luma[r], 0, sizeof(mb->luma[r]));
+            mb->nnz[r] = 0;
+        }
+    }
+
+    for (r = 0; r < 16; r++) {
+        int i8 = (r >> 3) * 2 + ((r & 3) >> 1);
+        int off = (r >> 2) * 64 + (r & 3) * 4;
+        unsigned char *rec = m->rec[0] + (r >> 2) * 4 * m->stride + (r & 3) * 4;
+
+        if (cbp & (1 << i8)) {
+            swenc_dequant_4x4(coef, mb->luma[r], 0, m->qp);
+            swenc_idct_4x4_add(rec, m->stride, m->pred + off, 16, coef);
+        } else {
+            swenc_copy_4x4(rec, m->stride, m->pred + off, 16);
+        }
+    }
+
+    mb->cbp = (mb->cbp & 0x30) | cbp;
+}
+
+/* Intra 16x16 residual against m->pred */
+static void swenc_code_i16(swenc_mbctx_p m)
+{
+    swenc_mb_p mb = m->mb;
+    int coef[16][16], dc[16], r, ac = 0;
+
+    for (r = 0; r < 16; r++) {
+        int off = (r >> 2) * 64 + (r & 3) * 4;
+
+        swenc_fdct_4x4(coef[r], m->src + off, 16, m->pred + off, 16);
+        dc[r] = coef[r][0];
+    }
+
+    swenc_hadamard_4x4(dc);
+    for (r = 0; r < 16; r++)
+        dc[r] = (dc[r] + 1) >> 1;
+    swenc_quant_dc(mb->luma_dc, dc, 16, swenc_zigzag, m->qp, 1);
+
+    for (r = 0; r < 16; r++) {
+        mb->nnz[r] = swenc_quant_4x4(mb->luma[r], coef[r], 1, m->qp, 1);
+        ac += mb->nnz[r];
+    }
+
+    swenc_dequant_luma_dc(dc, mb->luma_dc, m->qp);
+    for (r = 0; r < 16; r++) {
+        int off = (r >> 2) * 64 + (r & 3) * 4;
+        unsigned char *rec = m->rec[0] + (r >> 2) * 4 * m->stride + (r & 3) * 4;
+
+        if (ac)
+            swenc_dequant_4x4(coef[r], mb->luma[r], 1, m->qp);
+        else
+            memset(coef[r], 0, sizeof(coef[r]));
+        coef[r][0] = dc[r];
+        swenc_idct_4x4_add(rec, m->stride, m->pred + off, 16, coef[r]);
+    }
+
+    mb->cbp = (mb->cbp & 0x30) | (ac ? 15 : 0);
+}
+
+/* Intra 4x4 blocks in coding order, each predicted from the ones before */
+static int swenc_code_i4x4(swenc_mbctx_p m)
+{
+    h264_swenc_p enc = m->enc;
+    swenc_mb_p mb = m->mb;
+    int cost = 24 * m->lambda, coef[16], blk, cbp = 0;
+
+    for (blk = 0; blk < 16; blk++) {
+        int r = swenc_blk_raster[blk], bx = r & 3, by = r >> 2;
+        int has_left = bx > 0 || (m->avail & AVAIL_LEFT);
+        int has_top = by > 0 || (m->avail & AVAIL_TOP);
+        unsigned char *rec = m->rec[0] + by * 4 * m->stride + bx * 4;
+        const unsigned char *src = m->src + by * 64 + bx * 4;
+        unsigned char pred[16], best_pred[16];
+        int pm = swenc_pred_i4_mode(enc, mb, m->avail, r);
+        int mode, best = INT_MAX, best_mode = PRED_DC;
+
+        for (mode = PRED_V; mode <= PRED_DC; mode++) {
+            int c;
+
+            if ((mode == PRED_V && !has_top) || (mode == PRED_H && !has_left))
+                continue;
+
+            swenc_pred_4x4(pred, rec, m->stride, mode, has_left, has_top);
+            c = swenc_satd_4x4(src, 16, pred, 4) +
+                m->lambda * (mode == pm ? 1 : 4);
+            if (c < best) {
+                best = c;
+                best_mode = mode;
+                memcpy(best_pred, pred, 16);
+            }
+        }
+
+        mb->i4_modes[r] = best_mode;
+        cost += best;
+
+        swenc_fdct_4x4(coef, src, 16, best_pred, 4);
+        mb->nnz[r] = swenc_quant_4x4(mb->luma[r], coef, 0, m->qp, 1);
+        if (mb->nnz[r]) {
+            swenc_dequant_4x4(coef, mb->luma[r], 0, m->qp);
+            swenc_idct_4x4_add(rec, m->stride, best_pred, 4, coef);
+            cbp |= 1 << (blk >> 2);
+        } else {
+            swenc_copy_4x4(rec, m->stride, best_pred, 4);
+        }
+    }
+
+    mb->cbp = (mb->cbp & 0x30) | cbp;
+
+    return cost;
+}
+
+/* Chroma residual of both planes against m->pred_c */
+static void swenc_code_chroma(swenc_mbctx_p m, int intra)
+{
+    swenc_mb_p mb = m->mb;
+    int coef[2][4][16], dc[4], c, b, k, cbp = 0, ac_sum = 0;
+
+    for (c = 0; c < 2; c++) {
+        for (b = 0; b < 4; b++) {
+            int off = (b >> 1) * 32 + (b & 1) * 4;
+
+            swenc_fdct_4x4(coef[c][b], m->src_c[c] + off, 8,
+                    m->pred_c[c] + off, 8);
+            dc[b] = coef[c][b][0];
+        }
+
+        {
+            int f[4];
+
+            swenc_transform_2x2(f, dc);
+            if (swenc_quant_dc(mb->chroma_dc[c], f, 4, NULL, m->qpc, intra))
+                cbp |= 1;
+        }
+
+        for (b = 0; b < 4; b++) {
+            short *levels = mb->chroma_ac[c * 4 + b];
+
+            mb->nnz_c[c * 4 + b] =
+                swenc_quant_4x4(levels, coef[c][b], 1, m->qpc, intra);
+            for (k = 1; k < 16; k++)
+                ac_sum += abs(levels[k]);
+        }
+    }
+
+    /* As for luma, a lone +-1 in the AC of inter chroma is dropped */
+    if (ac_sum > (intra ? 0 : 1)) {
+        cbp = 2;
+    } else {
+        memset(mb->chroma_ac, 0, sizeof(mb->chroma_ac));
+        memset(mb->nnz_c, 0, sizeof(mb->nnz_c));
+    }
+
+    for (c = 0; c < 2; c++) {
+        if (cbp)
+            swenc_dequant_chroma_dc(dc, mb->chroma_dc[c], m->qpc);
+        else
+            memset(dc, 0, sizeof(dc));
+
+        for (b = 0; b < 4; b++) {
+            int off = (b >> 1) * 32 + (b & 1) * 4;
+            unsigned char *rec = m->rec[1 + c] +
+                (b >> 1) * 4 * m->stride_c + (b & 1) * 4;
+
+            if (cbp == 2)
+                swenc_dequant_4x4(coef[c][b], mb->chroma_ac[c * 4 + b], 1,
+                        m->qpc);
+            else
+                memset(coef[c][b], 0, sizeof(coef[c][b]));
+            coef[c][b][0] = dc[b];
+            swenc_idct_4x4_add(rec, m->stride_c, m->pred_c[c] + off, 8,
+                    coef[c][b]);
+        }
+    }
+
+    mb->cbp = (mb->cbp & 15) | cbp << 4;
+}
+
+/* Cheapest intra 16x16 mode by SATD, its prediction left in m->pred */
+static int swenc_best_i16(swenc_mbctx_p m, int *best_mode)
+{
+    static const unsigned char need[4] = {
+        AVAIL_TOP, AVAIL_LEFT, 0, AVAIL_TOP | AVAIL_LEFT | AVAIL_TOPLEFT,
+    };
+    unsigned char pred[256];
+    int mode, best = INT_MAX;
+
+    *best_mode = PRED_DC;
+    for (mode = PRED_V; mode <= PRED_PLANE; mode++) {
+        int cost;
+
+        if ((m->avail & need[mode]) != need[mode])
+            continue;
+
+        swenc_pred_16x16(pred, m->rec[0], m->stride, mode, m->avail);
+        cost = swenc_satd(m->src, 16, pred, 16, 16) +
+            m->lambda * (mode == PRED_DC ? 1 : 3);
+        if (cost < best) {
+            best = cost;
+            *best_mode = mode;
+            memcpy(m->pred, pred, 256);
+        }
+    }
+
+    return best;
+}
+
+/* Cheapest chroma mode by SATD over both planes, predictions left in pred_c */
+static int swenc_best_chroma(swenc_mbctx_p m)
+{
+    static const unsigned char need[4] = {
+        0, AVAIL_LEFT, AVAIL_TOP, AVAIL_TOP | AVAIL_LEFT | AVAIL_TOPLEFT,
+    };
+    unsigned char pred[2][64];
+    int mode, c, best = INT_MAX, best_mode = CHROMA_DC;
+
+    for (mode = CHROMA_DC; mode <= CHROMA_PLANE; mode++) {
+        int cost = 0;
+
+        if ((m->avail & need[mode]) != need[mode])
+            continue;
+
+        for (c = 0; c < 2; c++) {
+            swenc_pred_chroma(pred[c], m->rec[1 + c], m->stride_c, mode,
+                    m->avail);
+            cost += swenc_satd(m->src_c[c], 8, pred[c], 8, 8);
+        }
+        if (cost < best) {
+            best = cost;
+            best_mode = mode;
+            memcpy(m->pred_c, pred, sizeof(pred));
+        }
+    }
+
+    return best_mode;
+}
+
+static void swenc_analyse_intra(swenc_mbctx_p m)
+{
+    swenc_mb_p mb = m->mb;
+    int mode, cost;
+
+    cost = swenc_best_i16(m, &mode);
+    if (m->enc->frame.intra_4x4 && swenc_code_i4x4(m) < cost) {
+        mb->type = MB_I4x4;
+    } else {
+        mb->type = MB_I16x16;
+        mb->i16_mode = mode;
+        swenc_code_i16(m);
+    }
+
+    mb->chroma_mode = swenc_best_chroma(m);
+    swenc_code_chroma(m, 1);
+    mb->mv[0] = mb->mv[1] = 0;
+}
+
+/* Quarter pel vectors whose block stays within the padded reference */
+static void swenc_mv_limits(swenc_mbctx_p m, int *lo, int *hi)
+{
+    h264_swenc_p enc = m->enc;
+
+    lo[0] = (-m->x * 16 - SWENC_MV_MARGIN) * 4;
+    lo[1] = (-m->y * 16 - SWENC_MV_MARGIN) * 4;
+    hi[0] = ((enc->mb_width - 1 - m->x) * 16 + SWENC_MV_MARGIN) * 4;
+    hi[1] = ((enc->mb_height - 1 - m->y) * 16 + SWENC_MV_MARGIN) * 4;
+}
+
+static inline int swenc_mv_cost(swenc_mbctx_p m, const int *mvp, int x, int y)
+{
+    return m->lambda * (swenc_se_bits(x - mvp[0]) + swenc_se_bits(y - mvp[1]));
+}
+
+/*
+ * Full pel diamond search from the best of the predictors, then half and
+ * quarter pel refinement around it, by SAD plus the vector bits.
+ */
+static void swenc_motion_search(swenc_mbctx_p m, swenc_picture_p ref,
+        const int *mvp, const int *skip, int *best)
+{
+    static const signed char large[8][2] = {
+        { 0, -2 }, { 2, 0 }, { 0, 2 }, { -2, 0 },
+        { 1, -1 }, { 1, 1 }, { -1, 1 }, { -1, -1 },
+    };
+    static const signed char small[4][2] = {
+        { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 },
+    };
+    h264_swenc_p enc = m->enc;
+    swenc_mb_p mb = m->mb;
+    int stride = m->stride, lo[2], hi[2], fmin[2], fmax[2];
+    const unsigned char *plane = ref->luma[0] + m->y * 16 * stride + m->x * 16;
+    int cand[6][2], num = 0, bx = 0, by = 0, bcost = INT_MAX, i, iter;
+    int qx, qy, step;
+
+    swenc_mv_limits(m, lo, hi);
+    fmin[0] = lo[0] / 4 > -enc->frame.range_x ? lo[0] / 4 : -enc->frame.range_x;
+    fmin[1] = lo[1] / 4 > -enc->frame.range_y ? lo[1] / 4 : -enc->frame.range_y;
+    fmax[0] = hi[0] / 4 < enc->frame.range_x ? hi[0] / 4 : enc->frame.range_x;
+    fmax[1] = hi[1] / 4 < enc->frame.range_y ? hi[1] / 4 : enc->frame.range_y;
+
+    cand[num][0] = mvp[0];
+    cand[num++][1] = mvp[1];
+    cand[num][0] = skip[0];
+    cand[num++][1] = skip[1];
+    cand[num][0] = cand[num][1] = 0;
+    num++;
+    if (m->avail & AVAIL_LEFT) {
+        cand[num][0] = mb[-1].mv[0];
+        cand[num++][1] = mb[-1].mv[1];
+    }
+    if (m->avail & AVAIL_TOP) {
+        cand[num][0] = mb[-enc->mb_width].mv[0];
+        cand[num++][1] = mb[-enc->mb_width].mv[1];
+    }
+    if (m->avail & AVAIL_TOPRIGHT) {
+        cand[num][0] = mb[1 - enc->mb_width].mv[0];
+        cand[num++][1] = mb[1 - enc->mb_width].mv[1];
+    }
+
+    for (i = 0; i < num; i++) {
+        int cx = swenc_clip3(fmin[0], fmax[0], (cand[i][0] + 2) >> 2);
+        int cy = swenc_clip3(fmin[1], fmax[1], (cand[i][1] + 2) >> 2);
+        int cost = swenc_sad_16x16(m->src, 16, plane + cy * stride + cx,
+                stride) + swenc_mv_cost(m, mvp, cx * 4, cy * 4);
+
+        if (cost < bcost) {
+            bcost = cost;
+            bx = cx;
+            by = cy;
+        }
+    }
+
+    for (iter = 0; iter < 16; iter++) {
+        int cx = bx, cy = by;
+
+        for (i = 0; i < 8; i++) {
+            int x = cx + large[i][0], y = cy + large[i][1], cost;
+
+            if (x < fmin[0] || x > fmax[0] || y < fmin[1] || y > fmax[1])
+                continue;
+            cost = swenc_sad_16x16(m->src, 16, plane + y * stride + x, stride) +
+                swenc_mv_cost(m, mvp, x * 4, y * 4);
+            if (cost < bcost) {
+                bcost = cost;
+                bx = x;
+                by = y;
+            }
+        }
+        if (bx == cx && by == cy)
+            break;
+    }
+
+    for (iter = 0; iter < 8; iter++) {
+        int cx = bx, cy = by;
+
+        for (i = 0; i < 4; i++) {
+            int x = cx + small[i][0], y = cy + small[i][1], cost;
+
+            if (x < fmin[0] || x > fmax[0] || y < fmin[1] || y > fmax[1])
+                continue;
+            cost = swenc_sad_16x16(m->src, 16, plane + y * stride + x, stride) +
+                swenc_mv_cost(m, mvp, x * 4, y * 4);
+            if (cost < bcost) {
+                bcost = cost;
+                bx = x;
+                by = y;
+            }
+        }
+        if (bx == cx && by == cy)
+            break;
+    }
+
+    qx = bx * 4;
+    qy = by * 4;
+    for (step = 2; step >= 1 && enc->frame.subpel >= 3 - step; step >>= 1) {
+        int cx = qx, cy = qy, dx, dy;
+        unsigned char pred[256];
+
+        for (dy = -step; dy <= step; dy += step) {
+            for (dx = -step; dx <= step; dx += step) {
+                int mv[2] = { cx + dx, cy + dy }, cost;
+
+                if ((!dx && !dy) || mv[0] < lo[0] || mv[0] > hi[0] ||
+                        mv[1] < lo[1] || mv[1] > hi[1])
+                    continue;
+                swenc_mc_luma(ref, stride, m->x * 16, m->y * 16, mv, pred);
+                cost = swenc_sad_16x16(m->src, 16, pred, 16) +
+                    swenc_mv_cost(m, mvp, mv[0], mv[1]);
+                if (cost < bcost) {
+                    bcost = cost;
+                    qx = mv[0];
+                    qy = mv[1];
+                }
+            }
+        }
+    }
+
+    best[0] = qx;
+    best[1] = qy;
+}
+
+/* Inter coding of a P macroblock; 0 when intra should be used instead */
+static int swenc_analyse_inter(swenc_mbctx_p m, int flags)
+{
+    h264_swenc_p enc = m->enc;
+    swenc_picture_p ref = &enc->pics[enc->stream.ref];
+    swenc_mb_p mb = m->mb;
+    int mvp[2], skip[2], mv[2], lo[2], hi[2], cost, mode;
+
+    swenc_predict_mv(enc, mb, m->avail, mvp, skip);
+    mb->mvp[0] = mvp[0];
+    mb->mvp[1] = mvp[1];
+    swenc_mv_limits(m, lo, hi);
+
+    /* Unchanged area: a zero vector and no residual */
+    if (flags & MB_STATIC) {
+        int zero[2] = { 0, 0 };
+
+        swenc_mc_luma(ref, m->stride, m->x * 16, m->y * 16, zero, m->pred);
+        swenc_mc_chroma(m, ref, zero);
+        for (mode = 0; mode < 16; mode++)
+            memcpy(m->rec[0] + mode * m->stride, m->pred + mode * 16, 16);
+        for (mode = 0; mode < 8; mode++) {
+            memcpy(m->rec[1] + mode * m->stride_c, m->pred_c[0] + mode * 8, 8);
+            memcpy(m->rec[2] + mode * m->stride_c, m->pred_c[1] + mode * 8, 8);
+        }
+        mb->type = !skip[0] && !skip[1] ? MB_PSKIP : MB_P16x16;
+        mb->mv[0] = mb->mv[1] = 0;
+        return 1;
+    }
+
+    /* Most of a static or panning picture stops at the skip vector */
+    if (skip[0] >= lo[0] && skip[0] <= hi[0] &&
+            skip[1] >= lo[1] && skip[1] <= hi[1]) {
+        swenc_mc_luma(ref, m->stride, m->x * 16, m->y * 16, skip, m->pred);
+        if (swenc_sad_16x16(m->src, 16, m->pred, 16) <
+                (unsigned int) (64 * m->lambda)) {
+            swenc_mc_chroma(m, ref, skip);
+            swenc_code_luma_inter(m);
+            swenc_code_chroma(m, 0);
+            if (!mb->cbp) {
+                mb->type = MB_PSKIP;
+                mb->mv[0] = skip[0];
+                mb->mv[1] = skip[1];
+                return 1;
+            }
+            mb->cbp = 0;
+        }
+    }
+
+    swenc_motion_search(m, ref, mvp, skip, mv);
+    swenc_mc_luma(ref, m->stride, m->x * 16, m->y * 16, mv, m->pred);
+    cost = swenc_satd(m->src, 16, m->pred, 16, 16) +
+        swenc_mv_cost(m, mvp, mv[0], mv[1]) + m->lambda;
+
+    /* Intra in a P slice costs a longer mb_type */
+    if (swenc_best_i16(m, &mode) + 4 * m->lambda < cost)
+        return 0;
+
+    /* swenc_best_i16() took m->pred */
+    swenc_mc_luma(ref, m->stride, m->x * 16, m->y * 16, mv, m->pred);
+    swenc_mc_chroma(m, ref, mv);
+    swenc_code_luma_inter(m);
+    swenc_code_chroma(m, 0);
+
+    mb->mv[0] = mv[0];
+    mb->mv[1] = mv[1];
+    mb->type = mv[0] == skip[0] && mv[1] == skip[1] && !mb->cbp ?
+        MB_PSKIP : MB_P16x16;
+
+    return 1;
+}
+
+static void swenc_analyse_mb(h264_swenc_p enc, int x, int y)
+{
+    swenc_frame_t *frame = &enc->frame;
+    swenc_picture_p cur = &enc->pics[frame->cur];
+    int addr = y * enc->mb_width + x, i;
+    swenc_mbctx_t m;
+
+    m.enc = enc;
+    m.mb = &enc->mbs[addr];
+    m.x = x;
+    m.y = y;
+    m.qp = enc->mb_qp[addr];
+    m.qpc = swenc_chroma_qp[swenc_clip3(0, 51, m.qp + frame->chroma_qp_offset)];
+    m.lambda = swenc_lambda[m.qp];
+    m.avail = swenc_avail(enc, x, y);
+    m.stride = enc->stride;
+    m.stride_c = enc->stride_c;
+    m.rec[0] = cur->luma[0] + y * 16 * m.stride + x * 16;
+    m.rec[1] = cur->chroma[0] + y * 8 * m.stride_c + x * 8;
+    m.rec[2] = cur->chroma[1] + y * 8 * m.stride_c + x * 8;
+
+    for (i = 0; i < 16; i++)
+        memcpy(m.src + i * 16, enc->src[0] +
+                (y * 16 + i) * enc->src_stride[0] + x * 16, 16);
+    for (i = 0; i < 8; i++) {
+        memcpy(m.src_c[0] + i * 8, enc->src[1] +
+                (y * 8 + i) * enc->src_stride[1] + x * 8, 8);
+        memcpy(m.src_c[1] + i * 8, enc->src[2] +
+                (y * 8 + i) * enc->src_stride[2] + x * 8, 8);
+    }
+
+    m.mb->qp = m.qp;
+    m.mb->cbp = 0;
+    m.mb->mv[0] = m.mb->mv[1] = 0;
+    m.mb->mvp[0] = m.mb->mvp[1] = 0;
+    memset(m.mb->nnz, 0, sizeof(m.mb->nnz));
+    memset(m.mb->nnz_c, 0, sizeof(m.mb->nnz_c));
+
+    if (!frame->intra && !(enc->mb_flags[addr] & MB_FORCE_INTRA) &&
+            swenc_analyse_inter(&m, enc->mb_flags[addr]))
+        return;
+
+    swenc_analyse_intra(&m);
+}
+
+/*
+ * Filter one edge, 8.7.2. pix is the first q sample, step crosses the
+ * edge and next walks along it; bs holds the strength of each quarter.
+ */
+static void swenc_filter_edge(unsigned char *pix, int step, int next,
+        int len, const int *bs, int qp, int chroma)
+{
+    int alpha = swenc_alpha[qp], beta = swenc_beta[qp], i;
+
+    if (!alpha || !beta)
+        return;
+
+    for (i = 0; i < len; i++, pix += next) {
+        int s = bs[chroma ? i >> 1 : i >> 2];
+        int p0 = pix[-step], p1 = pix[-2 * step];
+        int q0 = pix[0], q1 = pix[step];
+
+        if (!s || abs(p0 - q0) >= alpha || abs(p1 - p0) >= beta ||
+                abs(q1 - q0) >= beta)
+            continue;
+
+        if (s < 4) {
+            int tc0 = swenc_tc0[qp][s - 1], tc, delta;
+
+            if (chroma) {
+                tc = tc0 + 1;
+            } else {
+                int p2 = pix[-3 * step], q2 = pix[2 * step];
+                int ap = abs(p2 - p0) < beta, aq = abs(q2 - q0) < beta;
+
+                tc = tc0 + ap + aq;
+                if (ap)
+                    pix[-2 * step] = p1 + swenc_clip3(-tc0, tc0,
+                            (p2 + ((p0 + q0 + 1) >> 1) - 2 * p1) >> 1);
+                if (aq)
+                    pix[step] = q1 + swenc_clip3(-tc0, tc0,
+                            (q2 + ((p0 + q0 + 1) >> 1) - 2 * q1) >> 1);
+            }
+
+            delta = swenc_clip3(-tc, tc, ((q0 - p0) * 4 + (p1 - q1) + 4) >> 3);
+            pix[-step] = swenc_clip(p0 + delta);
+            pix[0] = swenc_clip(q0 - delta);
+        } else if (chroma) {
+            pix[-step] = (2 * p1 + p0 + q1 + 2) >> 2;
+            pix[0] = (2 * q1 + q0 + p1 + 2) >> 2;
+        } else {
+            int p2 = pix[-3 * step], q2 = pix[2 * step];
+            int p3 = pix[-4 * step], q3 = pix[3 * step];
+            int strong = abs(p0 - q0) < ((alpha >> 2) + 2);
+
+            if (strong && abs(p2 - p0) < beta) {
+                pix[-step] = (p2 + 2 * p1 + 2 * p0 + 2 * q0 + q1 + 4) >> 3;
+                pix[-2 * step] = (p2 + p1 + p0 + q0 + 2) >> 2;
+                pix[-3 * step] = (2 * p3 + 3 * p2 + p1 + p0 + q0 + 4) >> 3;
+            } else {
+                pix[-step] = (2 * p1 + p0 + q1 + 2) >> 2;
+            }
+
+            if (strong && abs(q2 - q0) < beta) {
+                pix[0] = (p1 + 2 * p0 + 2 * q0 + 2 * q1 + q2 + 4) >> 3;
+                pix[step] = (p0 + q0 + q1 + q2 + 2) >> 2;
+                pix[2 * step] = (2 * q3 + 3 * q2 + q1 + q0 + p0 + 4) >> 3;
+            } else {
+                pix[0] = (2 * q1 + q0 + p1 + 2) >> 2;
+            }
+        }
+    }
+}
+
+/* Boundary strengths of edge e, vertical edges when dir is 0, 8.7.2.1 */
+static int swenc_edge_bs(swenc_mb_p q, swenc_mb_p p, int dir, int e, int *bs)
+{
+    int s, any = 0;
+
+    for (s = 0; s < 4; s++) {
+        int qb = dir ? e * 4 + s : s * 4 + e;
+        int pb = dir ? (e ? qb - 4 : 12 + s) : (e ? qb - 1 : s * 4 + 3);
+
+        if (MB_IS_INTRA(p->type) || MB_IS_INTRA(q->type))
+            bs[s] = e ? 3 : 4;
+        else if (p->nnz[pb] || q->nnz[qb])
+            bs[s] = 2;
+        else if (abs(p->mv[0] - q->mv[0]) >= 4 || abs(p->mv[1] - q->mv[1]) >= 4)
+            bs[s] = 1;
+        else
+            bs[s] = 0;
+        any |= bs[s];
+    }
+
+    return any;
+}
+
+static inline int swenc_qpc(h264_swenc_p enc, int qp)
+{
+    return swenc_chroma_qp[swenc_clip3(0, 51, qp + enc->frame.chroma_qp_offset)];
+}
+
+/* Deblock the macroblock at (x, y); the filter runs across slices */
+static void swenc_deblock_mb(h264_swenc_p enc, int x, int y)
+{
+    swenc_picture_p pic = &enc->pics[enc->frame.cur];
+    swenc_mb_p mb = &enc->mbs[y * enc->mb_width + x];
+    int stride = enc->stride, stride_c = enc->stride_c, dir, e, c, bs[4];
+    unsigned char *luma = pic->luma[0] + y * 16 * stride + x * 16;
+    unsigned char *chroma[2] = {
+        pic->chroma[0] + y * 8 * stride_c + x * 8,
+        pic->chroma[1] + y * 8 * stride_c + x * 8,
+    };
+
+    for (dir = 0; dir < 2; dir++) {
+        swenc_mb_p nb = dir ? mb - enc->mb_width : mb - 1;
+        int step = dir ? stride : 1, next = dir ? 1 : stride;
+        int step_c = dir ? stride_c : 1, next_c = dir ? 1 : stride_c;
+
+        for (e = 0; e < 4; e++) {
+            swenc_mb_p p = e ? mb : nb;
+            int qp, qpc;
+
+            if (!e && !(dir ? y : x))
+                continue;
+            if (!swenc_edge_bs(mb, p, dir, e, bs))
+                continue;
+
+            qp = (mb->qp + p->qp + 1) >> 1;
+            swenc_filter_edge(luma + e * 4 * step, step, next, 16, bs, qp, 0);
+
+            if (e & 1)
+                continue;
+            qpc = (swenc_qpc(enc, mb->qp) + swenc_qpc(enc, p->qp) + 1) >> 1;
+            for (c = 0; c < 2; c++)
+                swenc_filter_edge(chroma[c] + e * 2 * step_c, step_c, next_c,
+                        8, bs, qpc, 1);
+        }
+    }
+}
+
+/*
+ * Half sample planes of 16 rows of the current picture, over the padding
+ * too, 8.4.2.2.1. The centre plane filters the unrounded horizontal taps.
+ */
+static void swenc_interpolate_band(h264_swenc_p enc, swenc_worker_p worker,
+        int band)
+{
+    swenc_picture_p pic = &enc->pics[enc->frame.cur];
+    int stride = enc->stride;
+    int top = -SWENC_PAD + 2, bottom = enc->mb_height * 16 + SWENC_PAD - 3;
+    int left = -SWENC_PAD + 2, right = enc->mb_width * 16 + SWENC_PAD - 3;
+    int y0 = top + band * 16, y1 = y0 + 16 < bottom ? y0 + 16 : bottom;
+    const unsigned char *f = pic->luma[0];
+    int r, x;
+
+    /* Horizontal taps of rows y0 - 2 to y1 + 2 */
+    for (r = y0 - 2; r < y1 + 3; r++) {
+        short *t = worker->scratch + (r - y0 + 2) * stride + SWENC_PAD;
+        const unsigned char *s = f + r * stride;
+
+        for (x = left; x < right; x++)
+            t[x] = s[x - 2] - 5 * s[x - 1] + 20 * s[x] + 20 * s[x + 1] -
+                5 * s[x + 2] + s[x + 3];
+    }
+
+    for (r = y0; r < y1; r++) {
+        const short *t = worker->scratch + (r - y0 + 2) * stride + SWENC_PAD;
+        const unsigned char *s = f + r * stride;
+        unsigned char *h = pic->luma[1] + r * stride;
+        unsigned char *v = pic->luma[2] + r * stride;
+        unsigned char *c = pic->luma[3] + r * stride;
+
+        for (x = left; x < right; x++) {
+            h[x] = swenc_clip((t[x] + 16) >> 5);
+            v[x] = swenc_clip((s[x - 2 * stride] - 5 * s[x - stride] +
+                        20 * s[x] + 20 * s[x + stride] - 5 * s[x + 2 * stride] +
+                        s[x + 3 * stride] + 16) >> 5);
+            c[x] = swenc_clip((t[x - 2 * stride] - 5 * t[x - stride] +
+                        20 * t[x] + 20 * t[x + stride] - 5 * t[x + 2 * stride] +
+                        t[x + 3 * stride] + 512) >> 10);
+        }
+    }
+}
+
+static int swenc_interpolate_bands(h264_swenc_p enc)
+{
+    return (enc->mb_height * 16 + 2 * SWENC_PAD - 5 + 15) / 16;
+}
+
+/* Repeat the edges of a reconstructed picture into its padding */
+static void swenc_pad_picture(h264_swenc_p enc, swenc_picture_p pic)
+{
+    int p;
+
+    for (p = 0; p < 3; p++) {
+        unsigned char *plane = p ? pic->chroma[p - 1] : pic->luma[0];
+        int stride = p ? enc->stride_c : enc->stride;
+        int pad = p ? SWENC_PAD / 2 : SWENC_PAD;
+        int w = enc->mb_width * (p ? 8 : 16), h = enc->mb_height * (p ? 8 : 16);
+        int i;
+
+        for (i = 0; i < h; i++) {
+            unsigned char *row = plane + i * stride;
+
+            memset(row - pad, row[0], pad);
+            memset(row + w, row[w - 1], pad);
+        }
+        for (i = 1; i <= pad; i++) {
+            memcpy(plane - i * stride - pad, plane - pad, stride);
+            memcpy(plane + (h - 1 + i) * stride - pad,
+                    plane + (h - 1) * stride - pad, stride);
+        }
+    }
+}
+
+static inline int swenc_nc(int na, int nb)
+{
+    if (na >= 0 && nb >= 0)
+        return (na + nb + 1) >> 1;
+
+    return na >= 0 ? na : nb >= 0 ? nb : 0;
+}
+
+/* nC of the luma block at raster r, 9.2.1 */
+static int swenc_luma_nc(h264_swenc_p enc, swenc_mb_p mb, int avail, int r)
+{
+    int na = -1, nb = -1;
+
+    if (r & 3)
+        na = mb->nnz[r - 1];
+    else if (avail & AVAIL_LEFT)
+        na = mb[-1].nnz[r + 3];
+
+    if (r >> 2)
+        nb = mb->nnz[r - 4];
+    else if (avail & AVAIL_TOP)
+        nb = mb[-enc->mb_width].nnz[r + 12];
+
+    return swenc_nc(na, nb);
+}
+
+static int swenc_chroma_nc(h264_swenc_p enc, swenc_mb_p mb, int avail,
+        int c, int b)
+{
+    const unsigned char *nnz = mb->nnz_c + c * 4;
+    int na = -1, nb = -1;
+
+    if (b & 1)
+        na = nnz[b - 1];
+    else if (avail & AVAIL_LEFT)
+        na = mb[-1].nnz_c[c * 4 + b + 1];
+
+    if (b >> 1)
+        nb = nnz[b - 2];
+    else if (avail & AVAIL_TOP)
+        nb = mb[-enc->mb_width].nnz_c[c * 4 + b + 2];
+
+    return swenc_nc(na, nb);
+}
+
+/* residual_block_cavlc() of max levels in scan order; nC -1 is chroma DC */
+static void swenc_write_block(bitstream_p bs, const short *levels, int max,
+        int nc)
+{
+    int level[16], run[16], n = 0, t1, zeros = 0, i, suffix_length;
+
+    for (i = max - 1; i >= 0 && !levels[i]; i--)
+        ;
+    for (; i >= 0; i--) {
+        if (levels[i]) {
+            level[n] = levels[i];
+            run[n++] = 0;
+        } else {
+            run[n - 1]++;
+            zeros++;
+        }
+    }
+
+    for (t1 = 0; t1 < n && t1 < 3 && abs(level[t1]) == 1; t1++)
+        ;
+
+    if (nc < 0) {
+        bs_write_bits(bs, swenc_chroma_dc_token_len[n * 4 + t1],
+                swenc_chroma_dc_token_bits[n * 4 + t1]);
+    } else {
+        int tab = nc < 2 ? 0 : nc < 4 ? 1 : nc < 8 ? 2 : 3;
+
+        bs_write_bits(bs, swenc_coeff_token_len[tab][n * 4 + t1],
+                swenc_coeff_token_bits[tab][n * 4 + t1]);
+    }
+
+    if (!n)
+        return;
+
+    for (i = 0; i < t1; i++)
+        bs_write_bits(bs, 1, level[i] < 0);
+
+    suffix_length = n > 10 && t1 < 3;
+    for (i = t1; i < n; i++) {
+        int l = level[i];
+        int code = l > 0 ? 2 * l - 2 : -2 * l - 1;
+
+        if (i == t1 && t1 < 3)
+            code -= 2;
+
+        if (suffix_length == 0 && code < 14) {
+            bs_write_bits(bs, code + 1, 1);
+        } else if (suffix_length == 0 && code < 30) {
+            bs_write_bits(bs, 15, 1);
+            bs_write_bits(bs, 4, code - 14);
+        } else if (suffix_length == 0) {
+            bs_write_bits(bs, 16, 1);
+            bs_write_bits(bs, 12, code - 30);
+        } else if (code < (15 << suffix_length)) {
+            bs_write_bits(bs, (code >> suffix_length) + 1, 1);
+            bs_write_bits(bs, suffix_length,
+                    code & ((1 << suffix_length) - 1));
+        } else {
+            bs_write_bits(bs, 16, 1);
+            bs_write_bits(bs, 12, code - (15 << suffix_length));
+        }
+
+        if (suffix_length == 0)
+            suffix_length = 1;
+        if (abs(l) > (3 << (suffix_length - 1)) && suffix_length < 6)
+            suffix_length++;
+    }
+
+    if (n < max) {
+        if (max == 4)
+            bs_write_bits(bs, swenc_chroma_dc_zeros_len[n - 1][zeros],
+                    swenc_chroma_dc_zeros_bits[n - 1][zeros]);
+        else
+            bs_write_bits(bs, swenc_total_zeros_len[n - 1][zeros],
+                    swenc_total_zeros_bits[n - 1][zeros]);
+    }
+
+    for (i = 0; i < n - 1 && zeros > 0; i++) {
+        int vlc = (zeros < 7 ? zeros : 7) - 1;
+
+        bs_write_bits(bs, swenc_run_len[vlc][run[i]], swenc_run_bits[vlc][run[i]]);
+        zeros -= run[i];
+    }
+}
+
+/* macroblock_layer() of a coded macroblock, 7.3.5 */
+static void swenc_write_mb(h264_swenc_p enc, bitstream_p bs, int addr)
+{
+    swenc_frame_t *frame = &enc->frame;
+    swenc_mb_p mb = &enc->mbs[addr];
+    int avail = swenc_avail(enc, addr % enc->mb_width, addr / enc->mb_width);
+    int cbp_l = mb->cbp & 15, cbp_c = mb->cbp >> 4, type = 0, i, c, b;
+
+    if (mb->type == MB_I16x16)
+        type = 1 + mb->i16_mode + 4 * cbp_c + (cbp_l ? 12 : 0);
+    if (!frame->intra && MB_IS_INTRA(mb->type))
+        type += 5;
+    bs_write_ue(bs, type);
+
+    if (mb->type == MB_I4x4) {
+        for (i = 0; i < 16; i++) {
+            int r = swenc_blk_raster[i], mode = mb->i4_modes[r];
+            int pred = swenc_pred_i4_mode(enc, mb, avail, r);
+
+            if (mode == pred) {
+                bs_write_bits(bs, 1, 1);
+            } else {
+                bs_write_bits(bs, 1, 0);
+                bs_write_bits(bs, 3, mode < pred ? mode : mode - 1);
+            }
+        }
+    }
+
+    if (MB_IS_INTRA(mb->type)) {
+        bs_write_ue(bs, mb->chroma_mode);
+    } else {
+        bs_write_se(bs, mb->mv[0] - mb->mvp[0]);
+        bs_write_se(bs, mb->mv[1] - mb->mvp[1]);
+    }
+
+    if (mb->type != MB_I16x16)
+        bs_write_ue(bs, swenc_cbp_code[mb->type != MB_I4x4][mb->cbp]);
+
+    if (!mb->cbp && mb->type != MB_I16x16)
+        return;
+
+    bs_write_se(bs, mb->qp_delta);
+
+    if (mb->type == MB_I16x16) {
+        swenc_write_block(bs, mb->luma_dc, 16, swenc_luma_nc(enc, mb, avail, 0));
+        if (cbp_l)
+            for (i = 0; i < 16; i++) {
+                int r = swenc_blk_raster[i];
+
+                swenc_write_block(bs, mb->luma[r] + 1, 15,
+                        swenc_luma_nc(enc, mb, avail, r));
+            }
+    } else {
+        for (i = 0; i < 16; i++) {
+            int r = swenc_blk_raster[i];
+
+            if (cbp_l & (1 << (i >> 2)))
+                swenc_write_block(bs, mb->luma[r], 16,
+                        swenc_luma_nc(enc, mb, avail, r));
+        }
+    }
+
+    if (cbp_c) {
+        for (c = 0; c < 2; c++)
+            swenc_write_block(bs, mb->chroma_dc[c], 4, -1);
+    }
+    if (cbp_c == 2) {
+        for (c = 0; c < 2; c++)
+            for (b = 0; b < 4; b++)
+                swenc_write_block(bs, mb->chroma_ac[c * 4 + b] + 1, 15,
+                        swenc_chroma_nc(enc, mb, avail, c, b));
+    }
+}
+
+static void swenc_write_slice_header(h264_swenc_p enc, bitstream_p bs,
+        int first_mb)
+{
+    swenc_frame_t *frame = &enc->frame;
+    h264_header_info_p hdr = &frame->hdr;
+
+    /* nal_unit_header() */
+    bs_write_bits(bs, 1, 0);
+    bs_write_bits(bs, 2, frame->nal_ref_idc);
+    bs_write_bits(bs, 5, frame->idr ? NAL_SLICE_IDR : NAL_SLICE);
+
+    bs_write_ue(bs, first_mb);
+    bs_write_ue(bs, (frame->intra ? SLICE_I : SLICE_P) + 5);
+    bs_write_ue(bs, hdr->pic_parameter_set_id);
+    bs_write_bits(bs, hdr->log2_max_frame_num, hdr->frame_num);
+
+    if (frame->idr)
+        bs_write_ue(bs, frame->idr_pic_id);
+
+    if (hdr->pic_order_cnt_type == 0) {
+        bs_write_bits(bs, hdr->log2_max_poc_lsb, hdr->pic_order_cnt_lsb);
+        if (hdr->pic_order_present)
+            bs_write_se(bs, 0);             /* delta_pic_order_cnt_bottom */
+    }
+
+    if (hdr->redundant_pic_cnt_present)
+        bs_write_ue(bs, 0);
+
+    if (!frame->intra) {
+        bs_write_bits(bs, 1, 1);            /* num_ref_idx_active_override */
+        bs_write_ue(bs, 0);                 /* num_ref_idx_l0_active_minus1 */
+        bs_write_bits(bs, 1, 0);            /* ref_pic_list_modification */
+    }
+
+    if (frame->nal_ref_idc) {
+        if (frame->idr) {
+            bs_write_bits(bs, 1, 0);        /* no_output_of_prior_pics */
+            bs_write_bits(bs, 1, 0);        /* long_term_reference */
+        } else {
+            bs_write_bits(bs, 1, 0);        /* adaptive_ref_pic_marking */
+        }
+    }
+
+    bs_write_se(bs, frame->qp - hdr->pic_init_qp);
+
+    if (hdr->deblocking_filter_control_present) {
+        bs_write_ue(bs, frame->deblock ? 0 : 1);
+        if (frame->deblock) {
+            bs_write_se(bs, 0);             /* slice_alpha_c0_offset_div2 */
+            bs_write_se(bs, 0);             /* slice_beta_offset_div2 */
+        }
+    }
+}
+
+static unsigned char *swenc_slice_rbsp(h264_swenc_p enc, int slice, int *size)
+{
+    int first = slice * enc->frame.slice_mbs;
+    int last = first + enc->frame.slice_mbs;
+
+    if (last > enc->num_mbs)
+        last = enc->num_mbs;
+    *size = (last - first) * SWENC_MB_BYTES + SWENC_SLICE_HEADER_BYTES;
+
+    return enc->slice_data + first * SWENC_MB_BYTES +
+        slice * SWENC_SLICE_HEADER_BYTES;
+}
+
+/* Entropy code one slice into its own RBSP buffer */
+static void swenc_write_slice(h264_swenc_p enc, int slice)
+{
+    swenc_frame_t *frame = &enc->frame;
+    int first = slice * frame->slice_mbs, addr, size, skip_run = 0;
+    unsigned char *rbsp = swenc_slice_rbsp(enc, slice, &size);
+    bitstream_t bs;
+
+    bs_init(&bs, rbsp, size);
+    swenc_write_slice_header(enc, &bs, first);
+
+    for (addr = first; addr < first + frame->slice_mbs &&
+            addr < enc->num_mbs; addr++) {
+        if (enc->mbs[addr].type == MB_PSKIP) {
+            skip_run++;
+            continue;
+        }
+        if (!frame->intra) {
+            bs_write_ue(&bs, skip_run);
+            skip_run = 0;
+        }
+        swenc_write_mb(enc, &bs, addr);
+    }
+
+    if (skip_run)
+        bs_write_ue(&bs, skip_run);
+    bs_write_trailing(&bs);
+
+    enc->slice_bytes[slice] = bs.overrun ? -1 : bs.pos >> 3;
+}
+
+/* seq_parameter_set_rbsp(), Constrained Baseline */
+static int swenc_write_sps(h264_swenc_p enc, unsigned char *rbsp, int size)
+{
+    VAEncSequenceParameterBufferH264 *sps = &enc->sps;
+    swenc_frame_t *frame = &enc->frame;
+    int crop_right = enc->mb_width * 16 - enc->width;
+    int crop_bottom = enc->mb_height * 16 - enc->height;
+    int level = sps->level_idc;
+    bitstream_t bs;
+
+    if (!level) {
+        const h264_level_t *l = h264_find_level(enc->width, enc->height,
+                enc->fps_num, enc->fps_den, enc->bitrate);
+
+        level = l ? l->level_idc : 51;
+    }
+
+    bs_init(&bs, rbsp, size);
+
+    bs_write_bits(&bs, 1, 0);
+    bs_write_bits(&bs, 2, 3);
+    bs_write_bits(&bs, 5, NAL_SPS);
+
+    bs_write_bits(&bs, 8, 66);              /* profile_idc */
+    bs_write_bits(&bs, 8, 0xc0);            /* constraint_set0 and 1 */
+    bs_write_bits(&bs, 8, level);
+    bs_write_ue(&bs, sps->seq_parameter_set_id);
+    bs_write_ue(&bs, frame->hdr.log2_max_frame_num - 4);
+    bs_write_ue(&bs, frame->hdr.pic_order_cnt_type);
+    if (frame->hdr.pic_order_cnt_type == 0)
+        bs_write_ue(&bs, frame->hdr.log2_max_poc_lsb - 4);
+    bs_write_ue(&bs, sps->max_num_ref_frames > 1 ? sps->max_num_ref_frames : 1);
+    bs_write_bits(&bs, 1, 0);               /* gaps_in_frame_num_allowed */
+    bs_write_ue(&bs, enc->mb_width - 1);
+    bs_write_ue(&bs, enc->mb_height - 1);
+    bs_write_bits(&bs, 1, 1);               /* frame_mbs_only */
+    bs_write_bits(&bs, 1, 1);               /* direct_8x8_inference */
+
+    if (crop_right || crop_bottom) {
+        bs_write_bits(&bs, 1, 1);
+        bs_write_ue(&bs, 0);
+        bs_write_ue(&bs, crop_right / 2);
+        bs_write_ue(&bs, 0);
+        bs_write_ue(&bs, crop_bottom / 2);
+    } else {
+        bs_write_bits(&bs, 1, 0);
+    }
+
+    if (sps->vui_parameters_present_flag &&
+            (sps->vui_fields.bits.aspect_ratio_info_present_flag ||
+             sps->vui_fields.bits.timing_info_present_flag)) {
+        bs_write_bits(&bs, 1, 1);
+        bs_write_bits(&bs, 1, sps->vui_fields.bits.aspect_ratio_info_present_flag);
+        if (sps->vui_fields.bits.aspect_ratio_info_present_flag) {
+            bs_write_bits(&bs, 8, sps->aspect_ratio_idc);
+            if (sps->aspect_ratio_idc == 255) {
+                bs_write_bits(&bs, 16, sps->sar_width);
+                bs_write_bits(&bs, 16, sps->sar_height);
+            }
+        }
+        bs_write_bits(&bs, 1, 0);           /* overscan_info_present */
+        bs_write_bits(&bs, 1, 0);           /* video_signal_type_present */
+        bs_write_bits(&bs, 1, 0);           /* chroma_loc_info_present */
+        bs_write_bits(&bs, 1, sps->vui_fields.bits.timing_info_present_flag);
+        if (sps->vui_fields.bits.timing_info_present_flag) {
+            bs_write_bits(&bs, 32, sps->num_units_in_tick);
+            bs_write_bits(&bs, 32, sps->time_scale);
+            bs_write_bits(&bs, 1, 0);       /* fixed_frame_rate */
+        }
+        bs_write_bits(&bs, 1, 0);           /* nal_hrd_parameters_present */
+        bs_write_bits(&bs, 1, 0);           /* vcl_hrd_parameters_present */
+        bs_write_bits(&bs, 1, 0);           /* pic_struct_present */
+        bs_write_bits(&bs, 1, 0);           /* bitstream_restriction */
+    } else {
+        bs_write_bits(&bs, 1, 0);
+    }
+
+    bs_write_trailing(&bs);
+
+    return bs.overrun ? -1 : bs.pos >> 3;
+}
+
+/* pic_parameter_set_rbsp(), CAVLC with the app's ids and defaults */
+static int swenc_write_pps(h264_swenc_p enc, unsigned char *rbsp, int size)
+{
+    VAEncPictureParameterBufferH264 *pps = &enc->pps;
+    h264_header_info_p hdr = &enc->frame.hdr;
+    bitstream_t bs;
+
+    bs_init(&bs, rbsp, size);
+
+    bs_write_bits(&bs, 1, 0);
+    bs_write_bits(&bs, 2, 3);
+    bs_write_bits(&bs, 5, NAL_PPS);
+
+    bs_write_ue(&bs, pps->pic_parameter_set_id);
+    bs_write_ue(&bs, pps->seq_parameter_set_id);
+    bs_write_bits(&bs, 1, 0);               /* entropy_coding_mode */
+    bs_write_bits(&bs, 1, hdr->pic_order_present);
+    bs_write_ue(&bs, 0);                    /* num_slice_groups_minus1 */
+    bs_write_ue(&bs, pps->num_ref_idx_l0_active_minus1);
+    bs_write_ue(&bs, pps->num_ref_idx_l1_active_minus1);
+    bs_write_bits(&bs, 1, 0);               /* weighted_pred */
+    bs_write_bits(&bs, 2, 0);               /* weighted_bipred_idc */
+    bs_write_se(&bs, hdr->pic_init_qp - 26);
+    bs_write_se(&bs, 0);                    /* pic_init_qs_minus26 */
+    bs_write_se(&bs, enc->frame.chroma_qp_offset);
+    bs_write_bits(&bs, 1, hdr->deblocking_filter_control_present);
+    bs_write_bits(&bs, 1, 0);               /* constrained_intra_pred */
+    bs_write_bits(&bs, 1, hdr->redundant_pic_cnt_present);
+    bs_write_trailing(&bs);
+
+    return bs.overrun ? -1 : bs.pos >> 3;
+}
+
+static double swenc_fps(h264_swenc_p enc)
+{
+    if (enc->fps_num > 0 && enc->fps_den > 0)
+        return (double) enc->fps_num / enc->fps_den;
+    if (enc->sps.num_units_in_tick && enc->sps.time_scale)
+        return enc->sps.time_scale / (2.0 * enc->sps.num_units_in_tick);
+
+    return 30.0;
+}
+
+/* Bits per frame from the bitrate, 0 without one */
+static double swenc_frame_budget(h264_swenc_p enc)
+{
+    int bitrate = enc->bitrate ? enc->bitrate : (int) enc->sps.bits_per_second;
+
+    return bitrate > 0 ? bitrate / swenc_fps(enc) : 0;
+}
+
+/*
+ * Frame QP. The rate control models bits as complexity over the quantizer
+ * step, learnt from the last frame of the same type, and aims at the
+ * budget less what was overspent, paid back over a second of frames.
+ */
+static int swenc_rc_qp(h264_swenc_p enc, int intra)
+{
+    swenc_stream_t *stream = &enc->stream;
+    swenc_frame_t *frame = &enc->frame;
+    int init = enc->pps.pic_init_qp ? enc->pps.pic_init_qp : 26;
+    int min_qp = swenc_clip3(0, 51, enc->min_qp);
+    int max_qp = swenc_clip3(min_qp, 51, enc->max_qp);
+    double target, complexity;
+    int qp;
+
+    frame->budget = swenc_frame_budget(enc);
+
+    if (!enc->frame_rc) {
+        qp = intra ? enc->qp_i : enc->qp_p;
+        return swenc_clip3(0, 51, qp >= 0 ? qp : init);
+    }
+
+    if (enc->target_bits > 0) {
+        target = enc->target_bits;
+    } else if (frame->budget > 0) {
+        target = frame->budget - stream->fullness / swenc_fps(enc);
+        if (target < frame->budget / 4)
+            target = frame->budget / 4;
+        if (intra)
+            target *= SWENC_RC_INTRA_RATIO;
+    } else {
+        return swenc_clip3(min_qp, max_qp, init);
+    }
+
+    complexity = stream->complexity[intra];
+    if (complexity <= 0 && !intra && stream->complexity[1] > 0)
+        complexity = stream->complexity[1] / SWENC_RC_INTRA_RATIO;
+    if (complexity <= 0)
+        return swenc_clip3(min_qp, max_qp, init);
+
+    qp = (int) floor(6.0 * log2(complexity / target / 0.625) + 0.5);
+    if (stream->last_qp[intra] > 0)
+        qp = swenc_clip3(stream->last_qp[intra] - SWENC_RC_MAX_QP_STEP,
+                stream->last_qp[intra] + SWENC_RC_MAX_QP_STEP, qp);
+
+    return swenc_clip3(min_qp, max_qp, qp);
+}
+
+static void swenc_rc_update(h264_swenc_p enc)
+{
+    swenc_stream_t *stream = &enc->stream;
+    swenc_frame_t *frame = &enc->frame;
+    double bits = frame->coded_bytes * 8.0;
+    double complexity = bits * 0.625 * pow(2.0, frame->qp / 6.0);
+    int intra = frame->intra;
+
+    if (stream->complexity[intra] > 0)
+        stream->complexity[intra] = (stream->complexity[intra] + complexity) / 2;
+    else
+        stream->complexity[intra] = complexity;
+    stream->last_qp[intra] = frame->qp;
+
+    if (frame->budget > 0) {
+        double limit = frame->budget * 30;
+
+        stream->fullness += bits - frame->budget;
+        stream->fullness = stream->fullness > limit ? limit :
+            stream->fullness < -limit ? -limit : stream->fullness;
+    }
+
+    stream->bytes_per_mb[intra] = frame->coded_bytes / enc->num_mbs + 1;
+}
+
+static int swenc_in_area(const struct rk_vepu_area *area, int x, int y)
+{
+    return area->enable && x >= area->left && x <= area->right &&
+        y >= area->top && y <= area->bottom;
+}
+
+/* Macroblock QPs and decisions from the QP map, ROI and area controls */
+static void swenc_plan_mbs(h264_swenc_p enc)
+{
+    swenc_frame_t *frame = &enc->frame;
+    int x, y, i;
+
+    for (y = 0; y < enc->mb_height; y++) {
+        for (x = 0; x < enc->mb_width; x++) {
+            int addr = y * enc->mb_width + x, offset = 0, flags = 0;
+
+            if (enc->qp_map_valid)
+                offset = enc->qp_map[addr];
+            for (i = 0; i < RK_VEPU_MAX_ROI_AREAS; i++) {
+                if (swenc_in_area(&enc->roi.area[i], x, y)) {
+                    offset += enc->roi.qp_delta[i];
+                    break;
+                }
+            }
+            offset = swenc_clip3(SWENC_MIN_QP_OFFSET, SWENC_MAX_QP_OFFSET,
+                    offset);
+            enc->mb_qp[addr] = swenc_clip3(0, 51, frame->qp + offset);
+
+            if (swenc_in_area(&enc->intra_area, x, y))
+                flags |= MB_FORCE_INTRA;
+            if (enc->dirty_valid) {
+                flags |= MB_STATIC;
+                for (i = 0; i < (int) enc->dirty.count &&
+                        i < RK_VEPU_MAX_DIRTY_AREAS; i++) {
+                    if (swenc_in_area(&enc->dirty.area[i], x, y)) {
+                        flags &= ~MB_STATIC;
+                        break;
+                    }
+                }
+            }
+            enc->mb_flags[addr] = flags;
+        }
+    }
+}
+
+/* Source planes, copied with the edges repeated when not 16 aligned */
+static void swenc_load_source(h264_swenc_p enc)
+{
+    int aligned_w = enc->mb_width * 16, aligned_h = enc->mb_height * 16;
+    int p, i;
+
+    if (aligned_w == enc->width && aligned_h == enc->height) {
+        for (p = 0; p < 3; p++) {
+            enc->src[p] = enc->input[p];
+            enc->src_stride[p] = p ? enc->width / 2 : enc->width;
+        }
+        return;
+    }
+
+    for (p = 0; p < 3; p++) {
+        int w = p ? enc->width / 2 : enc->width;
+        int h = p ? enc->height / 2 : enc->height;
+        int aw = p ? aligned_w / 2 : aligned_w;
+        int ah = p ? aligned_h / 2 : aligned_h;
+        unsigned char *dst = enc->aligned +
+            (p ? aligned_w * aligned_h + (p - 1) * aw * ah : 0);
+
+        for (i = 0; i < ah; i++) {
+            const unsigned char *row = enc->input[p] + (i < h ? i : h - 1) * w;
+
+            memcpy(dst + i * aw, row, w);
+            memset(dst + i * aw + w, row[w - 1], aw - w);
+        }
+        enc->src[p] = dst;
+        enc->src_stride[p] = aw;
+    }
+}
+
+/* Slice size in macroblocks from the MULTI_SLICE controls */
+static int swenc_slice_mbs(h264_swenc_p enc, int intra)
+{
+    int mbs = enc->num_mbs;
+
+    if (enc->slice_mode == V4L2_MPEG_VIDEO_MULTI_SICE_MODE_MAX_MB &&
+            enc->slice_max_mb > 0) {
+        mbs = enc->slice_max_mb;
+    } else if (enc->slice_mode == V4L2_MPEG_VIDEO_MULTI_SICE_MODE_MAX_BYTES &&
+            enc->slice_max_bytes > 0) {
+        /* Slices are cut by count, sized from the last frame of the type */
+        int per_mb = enc->stream.bytes_per_mb[intra];
+
+        if (!per_mb)
+            per_mb = intra ? 64 : 16;
+        mbs = enc->slice_max_bytes * 3 / 4 / per_mb;
+    }
+
+    return swenc_clip3(1, enc->num_mbs, mbs);
+}
+
+/* Header info of the frame from the app's SPS and PPS */
+static void swenc_frame_header(h264_swenc_p enc)
+{
+    VAEncSequenceParameterBufferH264 *sps = &enc->sps;
+    VAEncPictureParameterBufferH264 *pps = &enc->pps;
+    h264_header_info_p hdr = &enc->frame.hdr;
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->log2_max_frame_num = sps->seq_fields.bits.log2_max_frame_num_minus4 + 4;
+    /* The app's type 1 is coded as 2, frames are never reordered here */
+    hdr->pic_order_cnt_type = sps->seq_fields.bits.pic_order_cnt_type ? 2 : 0;
+    hdr->log2_max_poc_lsb =
+        sps->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4 + 4;
+    hdr->frame_mbs_only = 1;
+    hdr->pic_init_qp = swenc_clip3(0, 51, pps->pic_init_qp ? pps->pic_init_qp : 26);
+    hdr->pic_order_present = pps->pic_fields.bits.pic_order_present_flag;
+    hdr->redundant_pic_cnt_present =
+        pps->pic_fields.bits.redundant_pic_cnt_present_flag;
+    hdr->deblocking_filter_control_present =
+        pps->pic_fields.bits.deblocking_filter_control_present_flag;
+    hdr->chroma_format_idc = 1;
+    hdr->pic_parameter_set_id = pps->pic_parameter_set_id;
+    hdr->slice_valid = 1;
+
+    enc->frame.chroma_qp_offset = swenc_clip3(-12, 12, pps->chroma_qp_index_offset);
+}
+
+/*
+ * Set up the frame whose buffers were just queued, under the lock.
+ */
+static void swenc_start_frame(h264_swenc_p enc)
+{
+    swenc_frame_t *frame = &enc->frame;
+    swenc_stream_t *stream = &enc->stream;
+    VAEncPictureParameterBufferH264 *pps = &enc->pps;
+    int intra_period = enc->sps.intra_period;
+    int max_frame_num, max_poc;
+
+    swenc_frame_header(enc);
+
+    frame->idr = !stream->frames || pps->pic_fields.bits.idr_pic_flag ||
+        enc->force_key_frame || stream->ref < 0;
+    frame->intra = frame->idr ||
+        (intra_period && stream->since_idr % intra_period == 0);
+    frame->nal_ref_idc = frame->idr ? 3 :
+        pps->pic_fields.bits.reference_pic_flag ? 2 : 0;
+
+    if (frame->idr) {
+        stream->frame_num_offset = pps->frame_num;
+        stream->poc_offset = pps->CurrPic.TopFieldOrderCnt;
+        stream->since_idr = 0;
+        frame->idr_pic_id = stream->idr_pic_id++ & 0xffff;
+    }
+    max_frame_num = 1 << frame->hdr.log2_max_frame_num;
+    max_poc = 1 << frame->hdr.log2_max_poc_lsb;
+    frame->hdr.frame_num = (pps->frame_num - stream->frame_num_offset) &
+        (max_frame_num - 1);
+    frame->hdr.pic_order_cnt_lsb = (pps->CurrPic.TopFieldOrderCnt -
+            stream->poc_offset) & (max_poc - 1);
+    frame->hdr.nal_ref_idc = frame->nal_ref_idc;
+
+    frame->slice_mbs = swenc_slice_mbs(enc, frame->intra);
+    frame->num_slices = (enc->num_mbs + frame->slice_mbs - 1) /
+        frame->slice_mbs;
+
+    enc->force_key_frame = 0;
+
+    frame->qp = swenc_rc_qp(enc, frame->intra);
+    frame->deblock = enc->loop_filter !=
+        V4L2_MPEG_VIDEO_H264_LOOP_FILTER_MODE_DISABLED ||
+        !frame->hdr.deblocking_filter_control_present;
+    frame->subpel = enc->quality.subpel;
+    frame->intra_4x4 = enc->quality.intra_4x4;
+    frame->range_x = swenc_clip3(1, 64, enc->range_x);
+    frame->range_y = swenc_clip3(1, 64, enc->range_y);
+    frame->cur = stream->ref == 0 ? 1 : 0;
+    frame->coded_bytes = 0;
+    frame->overflow = 0;
+
+    frame->sps_bytes = swenc_write_sps(enc, frame->sps, sizeof(frame->sps));
+    frame->pps_bytes = swenc_write_pps(enc, frame->pps, sizeof(frame->pps));
+    frame->write_sps = frame->idr || frame->sps_bytes != stream->sps_bytes ||
+        memcmp(frame->sps, stream->sps, frame->sps_bytes);
+    frame->write_pps = frame->write_sps || frame->pps_bytes != stream->pps_bytes ||
+        memcmp(frame->pps, stream->pps, frame->pps_bytes);
+
+    swenc_plan_mbs(enc);
+    enc->dirty_valid = 0;
+    swenc_load_source(enc);
+}
+
+/* Effective QPs: macroblocks without mb_qp_delta keep the one before */
+static void swenc_chain_qp(h264_swenc_p enc)
+{
+    swenc_frame_t *frame = &enc->frame;
+    int addr, prev = frame->qp;
+
+    for (addr = 0; addr < enc->num_mbs; addr++) {
+        swenc_mb_p mb = &enc->mbs[addr];
+
+        if (addr % frame->slice_mbs == 0)
+            prev = frame->qp;
+
+        if (mb->type == MB_PSKIP || (mb->type != MB_I16x16 && !mb->cbp)) {
+            mb->qp = prev;
+            mb->qp_delta = 0;
+        } else {
+            mb->qp_delta = mb->qp - prev;
+            prev = mb->qp;
+        }
+    }
+}
+
+/* Headers and slices into the coded buffer, then the stream state */
+static void swenc_finish_frame(h264_swenc_p enc)
+{
+    swenc_frame_t *frame = &enc->frame;
+    swenc_stream_t *stream = &enc->stream;
+    int pos = 0, n, s;
+
+    if (frame->write_sps) {
+        n = frame->sps_bytes < 0 ? -1 : h264_escape(frame->sps,
+                frame->sps_bytes, enc->coded + pos, enc->coded_size - pos);
+        frame->overflow |= n < 0;
+        pos += n > 0 ? n : 0;
+    }
+    if (frame->write_pps) {
+        n = frame->pps_bytes < 0 ? -1 : h264_escape(frame->pps,
+                frame->pps_bytes, enc->coded + pos, enc->coded_size - pos);
+        frame->overflow |= n < 0;
+        pos += n > 0 ? n : 0;
+    }
+
+    for (s = 0; s < frame->num_slices && !frame->overflow; s++) {
+        int size;
+        unsigned char *rbsp = swenc_slice_rbsp(enc, s, &size);
+
+        n = enc->slice_bytes[s] < 0 ? -1 : h264_escape(rbsp,
+                enc->slice_bytes[s], enc->coded + pos, enc->coded_size - pos);
+        frame->overflow |= n < 0;
+        pos += n > 0 ? n : 0;
+    }
+    frame->coded_bytes = pos;
+
+    if (frame->overflow)
+        return;
+
+    if (frame->write_sps) {
+        memcpy(stream->sps, frame->sps, frame->sps_bytes);
+        stream->sps_bytes = frame->sps_bytes;
+    }
+    if (frame->write_pps) {
+        memcpy(stream->pps, frame->pps, frame->pps_bytes);
+        stream->pps_bytes = frame->pps_bytes;
+    }
+
+    swenc_rc_update(enc);
+    stream->frames++;
+    stream->since_idr++;
+}
+
+/* Row progress of the wavefront in the ANALYSE and FILTER phases */
+static void swenc_wait_row(h264_swenc_p enc, int row, int count)
+{
+    pthread_mutex_lock(&enc->lock);
+    while (enc->row_done[row] < count)
+        pthread_cond_wait(&enc->cond, &enc->lock);
+    pthread_mutex_unlock(&enc->lock);
+}
+
+static void swenc_set_row(h264_swenc_p enc, int row, int count)
+{
+    pthread_mutex_lock(&enc->lock);
+    enc->row_done[row] = count;
+    pthread_cond_broadcast(&enc->cond);
+    pthread_mutex_unlock(&enc->lock);
+}
+
+/*
+ * A macroblock row, each macroblock once the row above is two ahead so
+ * that its top right neighbour is final.
+ */
+static void swenc_row(h264_swenc_p enc, int y, int deblock)
+{
+    int x, ahead = 0;
+
+    for (x = 0; x < enc->mb_width; x++) {
+        int need = x + 2 < enc->mb_width ? x + 2 : enc->mb_width;
+
+        if (y > 0 && ahead < need) {
+            swenc_wait_row(enc, y - 1, need);
+            ahead = need;
+        }
+
+        if (deblock)
+            swenc_deblock_mb(enc, x, y);
+        else
+            swenc_analyse_mb(enc, x, y);
+
+        if (x + 1 == enc->mb_width || (x & 3) == 3)
+            swenc_set_row(enc, y, x + 1);
+    }
+}
+
+static void swenc_run_task(h264_swenc_p enc, swenc_worker_p worker,
+        int phase, int task)
+{
+    switch (phase) {
+    case SWENC_ANALYSE:
+        swenc_row(enc, task, 0);
+        break;
+    case SWENC_FILTER:
+        /* Deblocking rows first, then the slices */
+        if (enc->frame.deblock && task < enc->mb_height)
+            swenc_row(enc, task, 1);
+        else
+            swenc_write_slice(enc, task -
+                    (enc->frame.deblock ? enc->mb_height : 0));
+        break;
+    case SWENC_INTERPOLATE:
+        swenc_interpolate_band(enc, worker, task);
+        break;
+    }
+}
+
+/* Hand out the tasks of a phase, called locked */
+static void swenc_begin_phase(h264_swenc_p enc, int phase, int tasks)
+{
+    memset(enc->row_done, 0, enc->mb_height * sizeof(*enc->row_done));
+    enc->phase = phase;
+    enc->next_task = 0;
+    enc->num_tasks = tasks;
+    enc->pending = tasks;
+    pthread_cond_broadcast(&enc->cond);
+}
+
+/*
+ * The last task of a phase is done, called locked. The coded frame is
+ * ready after FILTER; the half sample planes of a reference picture are
+ * computed while the app takes it.
+ */
+static void swenc_end_phase(h264_swenc_p enc)
+{
+    swenc_frame_t *frame = &enc->frame;
+
+    switch (enc->phase) {
+    case SWENC_ANALYSE:
+        swenc_chain_qp(enc);
+        enc->input_state = BUF_DONE;
+        swenc_begin_phase(enc, SWENC_FILTER, frame->num_slices +
+                (frame->deblock ? enc->mb_height : 0));
+        return;
+    case SWENC_FILTER:
+        swenc_finish_frame(enc);
+        enc->output_state = BUF_DONE;
+        if (frame->nal_ref_idc) {
+            swenc_pad_picture(enc, &enc->pics[frame->cur]);
+            swenc_begin_phase(enc, SWENC_INTERPOLATE,
+                    swenc_interpolate_bands(enc));
+            return;
+        }
+        break;
+    case SWENC_INTERPOLATE:
+        enc->stream.ref = frame->cur;
+        break;
+    }
+
+    enc->phase = SWENC_IDLE;
+    enc->next_task = enc->num_tasks = 0;
+    pthread_cond_broadcast(&enc->cond);
+}
+
+static void *swenc_thread(void *arg)
+{
+    swenc_worker_p worker = arg;
+    h264_swenc_p enc = worker->enc;
+
+    pthread_mutex_lock(&enc->lock);
+    for (;;) {
+        int phase, task;
+
+        while (enc->next_task >= enc->num_tasks && !enc->quit)
+            pthread_cond_wait(&enc->cond, &enc->lock);
+        if (enc->quit)
+            break;
+
+        phase = enc->phase;
+        task = enc->next_task++;
+        pthread_mutex_unlock(&enc->lock);
+        swenc_run_task(enc, worker, phase, task);
+        pthread_mutex_lock(&enc->lock);
+
+        if (--enc->pending == 0)
+            swenc_end_phase(enc);
+    }
+    pthread_mutex_unlock(&enc->lock);
+
+    return NULL;
+}
+
+/* Start coding once both buffers are queued, called locked */
+static void swenc_try_start(h264_swenc_p enc)
+{
+    if (enc->input_state != BUF_QUEUED || enc->output_state != BUF_QUEUED)
+        return;
+
+    while (enc->phase != SWENC_IDLE)
+        pthread_cond_wait(&enc->cond, &enc->lock);
+
+    enc->input_state = enc->output_state = BUF_ACTIVE;
+    swenc_start_frame(enc);
+    swenc_begin_phase(enc, SWENC_ANALYSE, enc->mb_height);
+}
+
+static void swenc_free(h264_swenc_p enc)
+{
+    int i;
+
+    for (i = 0; i < 2; i++)
+        free(enc->pics[i].mem);
+    for (i = 0; i < 3; i++)
+        free(enc->input[i]);
+    for (i = 0; i < enc->num_threads; i++) {
+        free(enc->workers[i].scratch);
+        enc->workers[i].scratch = NULL;
+    }
+    free(enc->coded);
+    free(enc->mbs);
+    free(enc->mb_qp);
+    free(enc->mb_flags);
+    free(enc->qp_map);
+    free(enc->row_done);
+    free(enc->slice_data);
+    free(enc->slice_bytes);
+    free(enc->aligned);
+
+    memset(enc->pics, 0, sizeof(enc->pics));
+    memset(enc->input, 0, sizeof(enc->input));
+    enc->coded = NULL;
+    enc->mbs = NULL;
+    enc->mb_qp = enc->mb_flags = enc->slice_data = enc->aligned = NULL;
+    enc->qp_map = NULL;
+    enc->row_done = enc->slice_bytes = NULL;
+    enc->allocated = 0;
+}
+
+static int swenc_alloc(h264_swenc_p enc)
+{
+    int luma_size, chroma_size, i, p, fail = 0;
+
+    enc->mb_width = (enc->width + 15) / 16;
+    enc->mb_height = (enc->height + 15) / 16;
+    enc->num_mbs = enc->mb_width * enc->mb_height;
+    enc->stride = enc->mb_width * 16 + 2 * SWENC_PAD;
+    enc->stride_c = enc->mb_width * 8 + SWENC_PAD;
+    luma_size = enc->stride * (enc->mb_height * 16 + 2 * SWENC_PAD);
+    chroma_size = enc->stride_c * (enc->mb_height * 8 + SWENC_PAD);
+
+    for (i = 0; i < 2; i++) {
+        swenc_picture_p pic = &enc->pics[i];
+
+        pic->mem = calloc(1, 4 * luma_size + 2 * chroma_size);
+        if (!pic->mem) {
+            fail = 1;
+            continue;
+        }
+        for (p = 0; p < 4; p++)
+            pic->luma[p] = pic->mem + p * luma_size +
+                SWENC_PAD * enc->stride + SWENC_PAD;
+        for (p = 0; p < 2; p++)
+            pic->chroma[p] = pic->mem + 4 * luma_size + p * chroma_size +
+                SWENC_PAD / 2 * enc->stride_c + SWENC_PAD / 2;
+    }
+
+    enc->input_size[0] = enc->width * enc->height;
+    enc->input_size[1] = enc->input_size[2] = enc->input_size[0] / 4;
+    for (i = 0; i < 3; i++)
+        fail |= !(enc->input[i] = malloc(enc->input_size[i]));
+
+    for (i = 0; i < enc->num_threads; i++)
+        fail |= !(enc->workers[i].scratch =
+                malloc(21 * enc->stride * sizeof(short)));
+
+    enc->coded = malloc(enc->coded_size);
+    enc->mbs = calloc(enc->num_mbs, sizeof(*enc->mbs));
+    enc->mb_qp = malloc(enc->num_mbs);
+    enc->mb_flags = malloc(enc->num_mbs);
+    enc->qp_map = malloc(enc->num_mbs);
+    enc->row_done = calloc(enc->mb_height, sizeof(*enc->row_done));
+    enc->slice_data = malloc(enc->num_mbs *
+            (SWENC_MB_BYTES + SWENC_SLICE_HEADER_BYTES));
+    enc->slice_bytes = calloc(enc->num_mbs, sizeof(*enc->slice_bytes));
+    if (enc->mb_width * 16 != enc->width || enc->mb_height * 16 != enc->height)
+        fail |= !(enc->aligned = malloc(enc->num_mbs * 384));
+
+    if (fail || !enc->coded || !enc->mbs || !enc->mb_qp || !enc->mb_flags ||
+            !enc->qp_map || !enc->row_done || !enc->slice_data ||
+            !enc->slice_bytes) {
+        swenc_free(enc);
+        return -1;
+    }
+
+    enc->allocated = 1;
+
+    return 0;
+}
+
+static int swenc_s_ctrl(h264_swenc_p enc, struct v4l2_ext_control *ctrl)
+{
+    switch (ctrl->id) {
+    case V4L2_CID_PRIVATE_ROCKCHIP_VAENC_SPS:
+        if (ctrl->size < sizeof(enc->sps))
+            return -1;
+        memcpy(&enc->sps, ctrl->ptr, sizeof(enc->sps));
+        break;
+    case V4L2_CID_PRIVATE_ROCKCHIP_VAENC_PPS:
+        if (ctrl->size < sizeof(enc->pps))
+            return -1;
+        memcpy(&enc->pps, ctrl->ptr, sizeof(enc->pps));
+        break;
+    case V4L2_CID_PRIVATE_ROCKCHIP_VAENC_SLICE:
+        /* Slices are laid out from the MULTI_SLICE controls */
+        break;
+    case V4L2_CID_PRIVATE_ROCKCHIP_VAENC_RC: {
+        VAEncMiscParameterRateControl *rc = ctrl->ptr;
+
+        if (ctrl->size < sizeof(*rc) ||
+                rc->bits_per_second < SWENC_RC_MIN_BITRATE ||
+                rc->bits_per_second > SWENC_RC_MAX_BITRATE)
+            return -1;
+        enc->bitrate = rc->bits_per_second;
+        break;
+    }
+    case V4L2_CID_PRIVATE_ROCKCHIP_VAENC_INTRA_AREA:
+        if (ctrl->size < sizeof(enc->intra_area))
+            return -1;
+        memcpy(&enc->intra_area, ctrl->ptr, sizeof(enc->intra_area));
+        break;
+    case V4L2_CID_PRIVATE_ROCKCHIP_VAENC_TARGET_BITS:
+        enc->target_bits = ctrl->value;
+        break;
+    case V4L2_CID_PRIVATE_ROCKCHIP_VAENC_DIRTY_AREA:
+        if (ctrl->size < sizeof(enc->dirty))
+            return -1;
+        memcpy(&enc->dirty, ctrl->ptr, sizeof(enc->dirty));
+        enc->dirty_valid = 1;
+        break;
+    case V4L2_CID_PRIVATE_ROCKCHIP_VAENC_ROI:
+        if (ctrl->size < sizeof(enc->roi))
+            return -1;
+        memcpy(&enc->roi, ctrl->ptr, sizeof(enc->roi));
+        break;
+    case V4L2_CID_PRIVATE_ROCKCHIP_VAENC_QP_MAP:
+        if (!enc->allocated || (int) ctrl->size != enc->num_mbs)
+            return -1;
+        memcpy(enc->qp_map, ctrl->ptr, enc->num_mbs);
+        enc->qp_map_valid = 1;
+        break;
+    case V4L2_CID_PRIVATE_ROCKCHIP_VAENC_QUALITY:
+        if (ctrl->size < sizeof(enc->quality))
+            return -1;
+        memcpy(&enc->quality, ctrl->ptr, sizeof(enc->quality));
+        break;
+    case V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME:
+        enc->force_key_frame = 1;
+        break;
+    case V4L2_CID_MPEG_VIDEO_FRAME_RC_ENABLE:
+        enc->frame_rc = ctrl->value;
+        break;
+    case V4L2_CID_MPEG_VIDEO_H264_I_FRAME_QP:
+        enc->qp_i = ctrl->value;
+        break;
+    case V4L2_CID_MPEG_VIDEO_H264_P_FRAME_QP:
+        enc->qp_p = ctrl->value;
+        break;
+    case V4L2_CID_MPEG_VIDEO_H264_MIN_QP:
+        enc->min_qp = ctrl->value;
+        break;
+    case V4L2_CID_MPEG_VIDEO_H264_MAX_QP:
+        enc->max_qp = ctrl->value;
+        break;
+    case V4L2_CID_MPEG_VIDEO_H264_CPB_SIZE:
+        /* The host HRD model steers through TARGET_BITS and the QP range */
+        break;
+    case V4L2_CID_MPEG_VIDEO_MULTI_SLICE_MODE:
+        enc->slice_mode = ctrl->value;
+        break;
+    case V4L2_CID_MPEG_VIDEO_MULTI_SLICE_MAX_MB:
+        enc->slice_max_mb = ctrl->value;
+        break;
+    case V4L2_CID_MPEG_VIDEO_MULTI_SLICE_MAX_BYTES:
+        enc->slice_max_bytes = ctrl->value;
+        break;
+    case V4L2_CID_MPEG_VIDEO_MV_H_SEARCH_RANGE:
+        enc->range_x = ctrl->value;
+        break;
+    case V4L2_CID_MPEG_VIDEO_MV_V_SEARCH_RANGE:
+        enc->range_y = ctrl->value;
+        break;
+    case V4L2_CID_MPEG_VIDEO_H264_LOOP_FILTER_MODE:
+        enc->loop_filter = ctrl->value;
+        break;
+    default:
+        /* Cyclic intra refresh among others: the driver has fallbacks */
+        return -1;
+    }
+
+    return 0;
+}
+
+static int swenc_s_ext_ctrls(h264_swenc_p enc, struct v4l2_ext_controls *ctrls)
+{
+    unsigned int i;
+    int ret = 0;
+
+    pthread_mutex_lock(&enc->lock);
+    for (i = 0; i < ctrls->count; i++) {
+        if (swenc_s_ctrl(enc, &ctrls->controls[i]) < 0) {
+            ctrls->error_idx = i;
+            ret = EINVAL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&enc->lock);
+
+    return ret;
+}
+
+static int swenc_s_fmt(h264_swenc_p enc, struct v4l2_format *format)
+{
+    struct v4l2_pix_format_mplane *pix = &format->fmt.pix_mp;
+    int i;
+
+    if (enc->allocated)
+        return EBUSY;
+    if (pix->width < 16 || pix->height < 16 || pix->width > 4096 ||
+            pix->height > 4096 || (pix->width & 1) || (pix->height & 1))
+        return EINVAL;
+
+    enc->width = pix->width;
+    enc->height = pix->height;
+
+    if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+        int min = ((pix->width + 15) / 16) * ((pix->height + 15) / 16) * 384 +
+            4096;
+
+        if (pix->pixelformat != V4L2_PIX_FMT_H264)
+            return EINVAL;
+        if ((int) pix->plane_fmt[0].sizeimage < min)
+            pix->plane_fmt[0].sizeimage = min;
+        enc->coded_size = pix->plane_fmt[0].sizeimage;
+        pix->num_planes = 1;
+    } else if (format->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
+        if (pix->pixelformat != V4L2_PIX_FMT_YUV420M)
+            return EINVAL;
+        pix->num_planes = 3;
+        for (i = 0; i < 3; i++) {
+            pix->plane_fmt[i].bytesperline = i ? pix->width / 2 : pix->width;
+            pix->plane_fmt[i].sizeimage = i ? pix->width * pix->height / 4 :
+                pix->width * pix->height;
+        }
+    } else {
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static int swenc_reqbufs(h264_swenc_p enc, struct v4l2_requestbuffers *reqbufs)
+{
+    /* dma-buf input is refused, the driver falls back to mmap */
+    if (reqbufs->memory != V4L2_MEMORY_MMAP)
+        return EINVAL;
+
+    if (!reqbufs->count)
+        return 0;
+
+    if (!enc->allocated && (!enc->coded_size || swenc_alloc(enc) < 0))
+        return ENOMEM;
+
+    reqbufs->count = 1;
+
+    return 0;
+}
+
+static int swenc_querybuf(h264_swenc_p enc, struct v4l2_buffer *buffer)
+{
+    int i;
+
+    if (!enc->allocated || buffer->index || !buffer->m.planes)
+        return EINVAL;
+
+    if (buffer->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+        buffer->length = 1;
+        buffer->m.planes[0].length = enc->coded_size;
+        buffer->m.planes[0].m.mem_offset = SWENC_CODED_OFFSET;
+    } else {
+        if (buffer->length < 3)
+            return EINVAL;
+        buffer->length = 3;
+        for (i = 0; i < 3; i++) {
+            buffer->m.planes[i].length = enc->input_size[i];
+            buffer->m.planes[i].m.mem_offset = SWENC_INPUT_OFFSET(i);
+        }
+    }
+
+    return 0;
+}
+
+static int swenc_qbuf(h264_swenc_p enc, struct v4l2_buffer *buffer)
+{
+    int *state = buffer->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE ?
+        &enc->output_state : &enc->input_state;
+
+    if (!enc->allocated || buffer->index)
+        return EINVAL;
+
+    pthread_mutex_lock(&enc->lock);
+    if (*state != BUF_FREE) {
+        pthread_mutex_unlock(&enc->lock);
+        return EINVAL;
+    }
+    *state = BUF_QUEUED;
+    swenc_try_start(enc);
+    pthread_mutex_unlock(&enc->lock);
+
+    return 0;
+}
+
+static int swenc_dqbuf(h264_swenc_p enc, struct v4l2_buffer *buffer)
+{
+    int capture = buffer->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    int *state = capture ? &enc->output_state : &enc->input_state;
+    int ret = 0;
+
+    pthread_mutex_lock(&enc->lock);
+    while (*state == BUF_ACTIVE)
+        pthread_cond_wait(&enc->cond, &enc->lock);
+
+    if (*state == BUF_QUEUED) {
+        ret = EAGAIN;
+    } else if (*state == BUF_FREE) {
+        ret = EINVAL;
+    } else {
+        *state = BUF_FREE;
+        buffer->index = 0;
+        if (capture) {
+            buffer->flags &= ~(V4L2_BUF_FLAG_KEYFRAME | V4L2_BUF_FLAG_ERROR);
+            if (enc->frame.intra)
+                buffer->flags |= V4L2_BUF_FLAG_KEYFRAME;
+            if (enc->frame.overflow)
+                buffer->flags |= V4L2_BUF_FLAG_ERROR;
+            if (buffer->m.planes && buffer->length)
+                buffer->m.planes[0].bytesused = enc->frame.coded_bytes;
+        }
+    }
+    pthread_mutex_unlock(&enc->lock);
+
+    return ret;
+}
+
+static int swenc_streamoff(h264_swenc_p enc)
+{
+    pthread_mutex_lock(&enc->lock);
+    while (enc->phase != SWENC_IDLE)
+        pthread_cond_wait(&enc->cond, &enc->lock);
+    enc->input_state = enc->output_state = BUF_FREE;
+    pthread_mutex_unlock(&enc->lock);
+
+    return 0;
+}
+
+int h264_swenc_ioctl(h264_swenc_p enc, unsigned long int cmd, void *arg)
+{
+    int ret;
+
+    switch (cmd) {
+    case VIDIOC_S_FMT:
+        ret = swenc_s_fmt(enc, arg);
+        break;
+    case VIDIOC_REQBUFS:
+        ret = swenc_reqbufs(enc, arg);
+        break;
+    case VIDIOC_QUERYBUF:
+        ret = swenc_querybuf(enc, arg);
+        break;
+    case VIDIOC_STREAMON:
+        ret = 0;
+        break;
+    case VIDIOC_STREAMOFF:
+        ret = swenc_streamoff(enc);
+        break;
+    case VIDIOC_S_EXT_CTRLS:
+        ret = swenc_s_ext_ctrls(enc, arg);
+        break;
+    case VIDIOC_S_PARM: {
+        struct v4l2_streamparm *parm = arg;
+
+        pthread_mutex_lock(&enc->lock);
+        enc->fps_num = parm->parm.output.timeperframe.denominator;
+        enc->fps_den = parm->parm.output.timeperframe.numerator;
+        pthread_mutex_unlock(&enc->lock);
+        ret = 0;
+        break;
+    }
+    case VIDIOC_QBUF:
+        ret = swenc_qbuf(enc, arg);
+        break;
+    case VIDIOC_DQBUF:
+        ret = swenc_dqbuf(enc, arg);
+        break;
+    default:
+        ret = ENOTTY;
+        break;
+    }
+
+    if (ret) {
+        errno = ret;
+        return -1;
+    }
+
+    return 0;
+}
+
+void *h264_swenc_mmap(h264_swenc_p enc, __u32 offset)
+{
+    int i;
+
+    if (!enc->allocated)
+        return MAP_FAILED;
+    if (offset == SWENC_CODED_OFFSET)
+        return enc->coded;
+    for (i = 0; i < 3; i++)
+        if (offset == SWENC_INPUT_OFFSET(i))
+            return enc->input[i];
+
+    return MAP_FAILED;
+}
+
+/* A worker per core, up to SWENC_MAX_THREADS */
+h264_swenc_p h264_swenc_create(void)
+{
+    h264_swenc_p enc = calloc(1, sizeof(*enc));
+    long cpus;
+    int i;
+
+    if (!enc)
+        return NULL;
+
+    enc->frame_rc = 1;
+    enc->qp_i = enc->qp_p = -1;
+    enc->max_qp = 51;
+    enc->range_x = 32;
+    enc->range_y = 16;
+    enc->loop_filter = V4L2_MPEG_VIDEO_H264_LOOP_FILTER_MODE_ENABLED;
+    enc->quality.subpel = 2;
+    enc->quality.intra_4x4 = 1;
+    enc->stream.ref = -1;
+
+    pthread_mutex_init(&enc->lock, NULL);
+    pthread_cond_init(&enc->cond, NULL);
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (i = 0; i < cpus && i < SWENC_MAX_THREADS; i++) {
+        enc->workers[i].enc = enc;
+        if (pthread_create(&enc->workers[i].thread, NULL, swenc_thread,
+                    &enc->workers[i]))
+            break;
+    }
+    enc->num_threads = i;
+
+    if (!enc->num_threads) {
+        h264_swenc_destroy(enc);
+        return NULL;
+    }
+
+    return enc;
+}
+
+void h264_swenc_destroy(h264_swenc_p enc)
+{
+    int i;
+
+    pthread_mutex_lock(&enc->lock);
+    while (enc->phase != SWENC_IDLE)
+        pthread_cond_wait(&enc->cond, &enc->lock);
+    enc->quit = 1;
+    pthread_cond_broadcast(&enc->cond);
+    pthread_mutex_unlock(&enc->lock);
+
+    for (i = 0; i < enc->num_threads; i++)
+        pthread_join(enc->workers[i].thread, NULL);
+
+    swenc_free(enc);
+    pthread_cond_destroy(&enc->cond);
+    pthread_mutex_destroy(&enc->lock);
+    free(enc);
+}
@@ -0,0 +1,572 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "bitstream.h"
+#include "h264_utils.h"
+
+#define NAL_SLICE           1
+#define NAL_SLICE_IDR       5
+#define NAL_SPS             7
+#define NAL_PPS             8
+
+#define SLICE_P             0
+#define SLICE_B             1
+#define SLICE_I             2
+#define SLICE_SP            3
+#define SLICE_SI            4
+
+/* Enough for the slice headers of our own stream */
+#define SLICE_HEADER_MAX    64
+/* Bytes of a parameter set read, enough for one with scaling lists */
+#define PARAMETER_SET_MAX   256
+/* A skip slice header plus its single mb_skip_run */
+#define SKIP_SLICE_MAX      64
+
+static const h264_level_t h264_levels[] = {
+    { 10,    1485,    99,     64 },
+    { 11,    3000,   396,    192 },
+    { 12,    6000,   396,    384 },
+    { 13,   11880,   396,    768 },
+    { 20,   11880,   396,   2000 },
+    { 21,   19800,   792,   4000 },
+    { 22,   20250,  1620,   4000 },
+    { 30,   40500,  1620,  10000 },
+    { 31,  108000,  3600,  14000 },
+    { 32,  216000,  5120,  20000 },
+    { 40,  245760,  8192,  20000 },
+    { 41,  245760,  8192,  50000 },
+    { 42,  522240,  8704,  50000 },
+    { 50,  589824, 22080, 135000 },
+    { 51,  983040, 36864, 240000 },
+    { 52, 2073600, 36864, 240000 },
+};
+
+/**
+ * Lowest level that can carry the stream, or NULL if none can. A frame
+ * rate or bitrate of 0 is not checked.
+ */
+const h264_level_t *h264_find_level(int width, int height,
+        int fps_num, int fps_den, int bitrate)
+{
+    long long mb_width = (width + 15) / 16;
+    long long mb_height = (height + 15) / 16;
+    long long fs = mb_width * mb_height;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(h264_levels) / sizeof(h264_levels[0]); i++) {
+        const h264_level_t *level = &h264_levels[i];
+
+        if (fs > level->max_fs)
+            continue;
+
+        /* Neither side may be longer than sqrt(8 * MaxFS) */
+        if (mb_width * mb_width > 8LL * level->max_fs ||
+                mb_height * mb_height > 8LL * level->max_fs)
+            continue;
+
+        if (fps_num > 0 && fps_den > 0 &&
+                fs * fps_num > (long long) level->max_mbps * fps_den)
+            continue;
+
+        if (bitrate > 0 && bitrate > level->max_br * 1000LL)
+            continue;
+
+        return level;
+    }
+
+    return NULL;
+}
+
+/**
+ * Copy up to out_size bytes of a NAL unit with emulation prevention
+ * removed. Returns the number of bytes written.
+ */
+int h264_unescape(const unsigned char *data, int size,
+        unsigned char *out, int out_size)
+{
+    int i, n = 0, zeros = 0;
+
+    for (i = 0; i < size && n < out_size; i++) {
+        if (zeros >= 2 && data[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros = data[i] ? 0 : zeros + 1;
+        out[n++] = data[i];
+    }
+
+    return n;
+}
+
+/**
+ * Find the first slice NAL of an Annex-B stream and copy up to size bytes
+ * of it, starting at the NAL header, with emulation prevention removed.
+ */
+static int h264_find_slice(unsigned char *data, int size,
+        unsigned char *out, int out_size)
+{
+    int i;
+
+    for (i = 0; i + 3 < size; i++) {
+        int type;
+
+        if (data[i] || data[i + 1] || data[i + 2] != 1)
+            continue;
+
+        type = data[i + 3] & 0x1f;
+        if (type == NAL_SLICE || type == NAL_SLICE_IDR)
+            break;
+    }
+
+    if (i + 3 >= size)
+        return 0;
+
+    return h264_unescape(data + i + 3, size - i - 3, out, out_size);
+}
+
+static void h264_skip_scaling_list(bitstream_p bs, int size)
+{
+    int i, last = 8, next = 8;
+
+    for (i = 0; i < size && next; i++) {
+        next = (last + bs_read_se(bs) + 256) % 256;
+        if (next)
+            last = next;
+    }
+}
+
+static int h264_parse_sps(h264_header_info_p info, bitstream_p bs)
+{
+    int profile_idc, i, n;
+
+    profile_idc = bs_read_bits(bs, 8);
+    bs_read_bits(bs, 16);               /* constraint flags, level_idc */
+    bs_read_ue(bs);                     /* seq_parameter_set_id */
+
+    info->chroma_format_idc = 1;
+    if (profile_idc == 100 || profile_idc == 110 || profile_idc == 122 ||
+            profile_idc == 244 || profile_idc == 44 || profile_idc == 83 ||
+            profile_idc == 86 || profile_idc == 118 || profile_idc == 128) {
+        info->chroma_format_idc = bs_read_ue(bs);
+        if (info->chroma_format_idc == 3)
+            bs_read_bits(bs, 1);        /* separate_colour_plane_flag */
+        bs_read_ue(bs);                 /* bit_depth_luma_minus8 */
+        bs_read_ue(bs);                 /* bit_depth_chroma_minus8 */
+        bs_read_bits(bs, 1);            /* qpprime_y_zero_transform_bypass */
+        if (bs_read_bits(bs, 1)) {      /* seq_scaling_matrix_present */
+            n = info->chroma_format_idc == 3 ? 12 : 8;
+            for (i = 0; i < n; i++)
+                if (bs_read_bits(bs, 1))
+                    h264_skip_scaling_list(bs, i < 6 ? 16 : 64);
+        }
+    }
+
+    info->log2_max_frame_num = bs_read_ue(bs) + 4;
+    info->pic_order_cnt_type = bs_read_ue(bs);
+    if (info->pic_order_cnt_type == 0) {
+        info->log2_max_poc_lsb = bs_read_ue(bs) + 4;
+    } else if (info->pic_order_cnt_type == 1) {
+        info->delta_pic_order_always_zero = bs_read_bits(bs, 1);
+        bs_read_se(bs);                 /* offset_for_non_ref_pic */
+        bs_read_se(bs);                 /* offset_for_top_to_bottom_field */
+        n = bs_read_ue(bs);
+        for (i = 0; i < n && !bs->overrun; i++)
+            bs_read_se(bs);             /* offset_for_ref_frame */
+    }
+
+    bs_read_ue(bs);                     /* max_num_ref_frames */
+    bs_read_bits(bs, 1);                /* gaps_in_frame_num_allowed */
+    bs_read_ue(bs);                     /* pic_width_in_mbs_minus1 */
+    bs_read_ue(bs);                     /* pic_height_in_map_units_minus1 */
+    info->frame_mbs_only = bs_read_bits(bs, 1);
+
+    return bs->overrun ? -1 : 0;
+}
+
+static int h264_parse_pps(h264_header_info_p info, bitstream_p bs)
+{
+    info->pic_parameter_set_id = bs_read_ue(bs);
+    bs_read_ue(bs);                     /* seq_parameter_set_id */
+    info->entropy_coding_mode = bs_read_bits(bs, 1);
+    info->pic_order_present = bs_read_bits(bs, 1);
+
+    /* Slice groups (FMO) are not supported */
+    if (bs_read_ue(bs))
+        return -1;
+
+    info->num_ref_idx_default[0] = bs_read_ue(bs) + 1;
+    info->num_ref_idx_default[1] = bs_read_ue(bs) + 1;
+    info->weighted_pred = bs_read_bits(bs, 1);
+    info->weighted_bipred_idc = bs_read_bits(bs, 2);
+    info->pic_init_qp = bs_read_se(bs) + 26;
+    bs_read_se(bs);                     /* pic_init_qs_minus26 */
+    bs_read_se(bs);                     /* chroma_qp_index_offset */
+    info->deblocking_filter_control_present = bs_read_bits(bs, 1);
+    bs_read_bits(bs, 1);                /* constrained_intra_pred */
+    info->redundant_pic_cnt_present = bs_read_bits(bs, 1);
+
+    return bs->overrun ? -1 : 0;
+}
+
+/**
+ * Read the header syntax of info from the SPS and PPS at the head of an
+ * Annex-B stream, up to its first slice. Only the syntax fields are
+ * set, not the current picture. Returns the H264_HEADERS_* found, or -1
+ * when a parameter set could not be parsed.
+ */
+int h264_parse_parameter_sets(h264_header_info_p info,
+        const unsigned char *data, int size)
+{
+    unsigned char nal[PARAMETER_SET_MAX];
+    bitstream_t bs;
+    int i, n, type, found = 0;
+
+    for (i = 0; i + 3 < size; i++) {
+        if (data[i] || data[i + 1] || data[i + 2] != 1)
+            continue;
+
+        type = data[i + 3] & 0x1f;
+        if (type == NAL_SLICE || type == NAL_SLICE_IDR)
+            break;
+        if (type != NAL_SPS && type != NAL_PPS)
+            continue;
+
+        n = h264_unescape(data + i + 4, size - i - 4, nal, sizeof(nal));
+        bs_init(&bs, nal, n);
+        if (type == NAL_SPS) {
+            if (h264_parse_sps(info, &bs) < 0)
+                return -1;
+            found |= H264_HEADERS_SPS;
+        } else {
+            if (h264_parse_pps(info, &bs) < 0)
+                return -1;
+            found |= H264_HEADERS_PPS;
+        }
+    }
+
+    return found;
+}
+
+static void h264_skip_ref_pic_list_modification(bitstream_p bs)
+{
+    int idc;
+
+    if (!bs_read_bits(bs, 1))
+        return;
+
+    do {
+        idc = bs_read_ue(bs);
+        if (idc <= 2)
+            bs_read_ue(bs);             /* abs_diff_pic_num, long_term_pic_num */
+    } while (idc != 3 && !bs->overrun);
+}
+
+static void h264_skip_pred_weight_table(h264_header_info_p info,
+        h264_slice_header_p hdr, bitstream_p bs)
+{
+    int list, i, j;
+
+    bs_read_ue(bs);                     /* luma_log2_weight_denom */
+    if (info->chroma_format_idc)
+        bs_read_ue(bs);                 /* chroma_log2_weight_denom */
+
+    for (list = 0; list < (hdr->slice_type == SLICE_B ? 2 : 1); list++) {
+        for (i = 0; i < hdr->num_ref_idx_active[list]; i++) {
+            if (bs_read_bits(bs, 1)) {  /* luma_weight_flag */
+                bs_read_se(bs);
+                bs_read_se(bs);
+            }
+            if (info->chroma_format_idc && bs_read_bits(bs, 1)) {
+                for (j = 0; j < 4; j++)
+                    bs_read_se(bs);
+            }
+        }
+    }
+}
+
+static void h264_skip_dec_ref_pic_marking(h264_slice_header_p hdr,
+        bitstream_p bs)
+{
+    int mmco;
+
+    if (hdr->idr) {
+        bs_read_bits(bs, 2);            /* no_output_of_prior_pics, long_term */
+        return;
+    }
+
+    if (!bs_read_bits(bs, 1))           /* adaptive_ref_pic_marking */
+        return;
+
+    do {
+        mmco = bs_read_ue(bs);
+        if (mmco == 1 || mmco == 3)
+            bs_read_ue(bs);
+        if (mmco == 2)
+            bs_read_ue(bs);
+        if (mmco == 3 || mmco == 6)
+            bs_read_ue(bs);
+        if (mmco == 4)
+            bs_read_ue(bs);
+    } while (mmco && !bs->overrun);
+}
+
+/**
+ * Parse the slice header of an unescaped slice NAL, starting at its
+ * header byte. Slice group change cycles (FMO) are not supported.
+ * Returns 0, or -1 when the header does not fit in size.
+ */
+int h264_parse_slice_header(h264_header_info_p info,
+        const unsigned char *nal, int size, h264_slice_header_p hdr)
+{
+    bitstream_t bs;
+    int pos;
+
+    if (size < 2)
+        return -1;
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->nal_ref_idc = (nal[0] >> 5) & 3;
+    hdr->idr = (nal[0] & 0x1f) == NAL_SLICE_IDR;
+
+    bs_init(&bs, (unsigned char *) nal + 1, size - 1);
+
+    hdr->first_mb_in_slice = bs_read_ue(&bs);
+    hdr->slice_type = bs_read_ue(&bs) % 5;
+    hdr->pic_parameter_set_id = bs_read_ue(&bs);
+    hdr->frame_num = bs_read_bits(&bs, info->log2_max_frame_num);
+
+    if (!info->frame_mbs_only) {
+        hdr->field_pic = bs_read_bits(&bs, 1);
+        if (hdr->field_pic)
+            hdr->bottom_field = bs_read_bits(&bs, 1);
+    }
+
+    if (hdr->idr)
+        hdr->idr_pic_id = bs_read_ue(&bs);
+
+    pos = bs.pos;
+    if (info->pic_order_cnt_type == 0) {
+        hdr->pic_order_cnt_lsb = bs_read_bits(&bs, info->log2_max_poc_lsb);
+        if (info->pic_order_present && !hdr->field_pic)
+            hdr->delta_pic_order_cnt_bottom = bs_read_se(&bs);
+    } else if (info->pic_order_cnt_type == 1 &&
+            !info->delta_pic_order_always_zero) {
+        hdr->delta_pic_order_cnt[0] = bs_read_se(&bs);
+        if (info->pic_order_present && !hdr->field_pic)
+            hdr->delta_pic_order_cnt[1] = bs_read_se(&bs);
+    }
+    hdr->pic_order_cnt_bit_size = bs.pos - pos;
+
+    if (info->redundant_pic_cnt_present)
+        hdr->redundant_pic_cnt = bs_read_ue(&bs);
+
+    if (hdr->slice_type == SLICE_B)
+        hdr->direct_spatial_mv_pred = bs_read_bits(&bs, 1);
+
+    hdr->num_ref_idx_active[0] = info->num_ref_idx_default[0];
+    hdr->num_ref_idx_active[1] = info->num_ref_idx_default[1];
+    hdr->num_ref_idx_from_pps[0] = hdr->num_ref_idx_from_pps[1] = 0;
+    if (hdr->slice_type == SLICE_P || hdr->slice_type == SLICE_SP ||
+            hdr->slice_type == SLICE_B) {
+        if (bs_read_bits(&bs, 1)) {     /* num_ref_idx_active_override */
+            hdr->num_ref_idx_active[0] = bs_read_ue(&bs) + 1;
+            if (hdr->slice_type == SLICE_B)
+                hdr->num_ref_idx_active[1] = bs_read_ue(&bs) + 1;
+        } else {
+            hdr->num_ref_idx_from_pps[0] = 1;
+            hdr->num_ref_idx_from_pps[1] = hdr->slice_type == SLICE_B;
+        }
+    }
+
+    if (hdr->slice_type != SLICE_I && hdr->slice_type != SLICE_SI) {
+        h264_skip_ref_pic_list_modification(&bs);
+        if (hdr->slice_type == SLICE_B)
+            h264_skip_ref_pic_list_modification(&bs);
+    }
+
+    if ((info->weighted_pred &&
+                (hdr->slice_type == SLICE_P || hdr->slice_type == SLICE_SP)) ||
+            (info->weighted_bipred_idc == 1 && hdr->slice_type == SLICE_B))
+        h264_skip_pred_weight_table(info, hdr, &bs);
+
+    pos = bs.pos;
+    if (hdr->nal_ref_idc)
+        h264_skip_dec_ref_pic_marking(hdr, &bs);
+    hdr->dec_ref_pic_marking_bit_size = bs.pos - pos;
+
+    if (info->entropy_coding_mode &&
+            hdr->slice_type != SLICE_I && hdr->slice_type != SLICE_SI)
+        hdr->cabac_init_idc = bs_read_ue(&bs);
+
+    hdr->slice_qp_delta = bs_read_se(&bs);
+
+    if (hdr->slice_type == SLICE_SP || hdr->slice_type == SLICE_SI) {
+        if (hdr->slice_type == SLICE_SP)
+            hdr->sp_for_switch = bs_read_bits(&bs, 1);
+        hdr->slice_qs_delta = bs_read_se(&bs);
+    }
+
+    if (info->deblocking_filter_control_present) {
+        hdr->disable_deblocking_filter_idc = bs_read_ue(&bs);
+        if (hdr->disable_deblocking_filter_idc != 1) {
+            hdr->slice_alpha_c0_offset_div2 = bs_read_se(&bs);
+            hdr->slice_beta_offset_div2 = bs_read_se(&bs);
+        }
+    }
+
+    hdr->header_bit_size = bs.pos;
+
+    return bs.overrun ? -1 : 0;
+}
+
+/**
+ * Parse the header of the first slice in an Annex-B stream.
+ */
+int h264_first_slice_header(h264_header_info_p info, unsigned char *data,
+        int size, h264_slice_header_p hdr)
+{
+    unsigned char header[SLICE_HEADER_MAX];
+    int n;
+
+    n = h264_find_slice(data, size, header, sizeof(header));
+    return h264_parse_slice_header(info, header, n, hdr);
+}
+
+/**
+ * Slice QP of the first slice in the stream, or -1 when the header uses
+ * syntax we do not walk (B slices, weighted prediction).
+ */
+int h264_slice_qp(h264_header_info_p info, unsigned char *data, int size)
+{
+    h264_slice_header_t hdr;
+
+    if (h264_first_slice_header(info, data, size, &hdr) < 0)
+        return -1;
+
+    if (hdr.slice_type == SLICE_B)
+        return -1;
+    if (info->weighted_pred &&
+            (hdr.slice_type == SLICE_P || hdr.slice_type == SLICE_SP))
+        return -1;
+
+    return info->pic_init_qp + hdr.slice_qp_delta;
+}
+
+/**
+ * Write a start code and the NAL in rbsp, n bytes, with emulation prevention.
+ * Returns the bytes written, -1 if they do not fit.
+ */
+int h264_escape(const unsigned char *rbsp, int n,
+        unsigned char *data, int size)
+{
+    int i, pos = 4, zeros = 0;
+
+    if (size < 4)
+        return -1;
+
+    data[0] = data[1] = data[2] = 0;
+    data[3] = 1;
+
+    for (i = 0; i < n; i++) {
+        if (pos + 2 > size)
+            return -1;
+        if (zeros >= 2 && rbsp[i] <= 3) {
+            data[pos++] = 3;
+            zeros = 0;
+        }
+        zeros = rbsp[i] ? 0 : zeros + 1;
+        data[pos++] = rbsp[i];
+    }
+
+    return pos;
+}
+
+/**
+ * Write a single P slice made of P_Skip macroblocks only, as an Annex-B
+ * NAL unit. With no neighbours to predict from, every skipped macroblock
+ * gets a zero motion vector, so the picture repeats its reference.
+ * Returns the NAL size, or -1 when the stream setup is not supported
+ * (CABAC, weighted prediction, no H.264 slice parameters).
+ */
+int h264_write_skip_slice(h264_header_info_p info, int num_mbs,
+        unsigned char *data, int size)
+{
+    unsigned char rbsp[SKIP_SLICE_MAX];
+    bitstream_t bs;
+
+    if (!info->slice_valid || info->entropy_coding_mode || info->weighted_pred)
+        return -1;
+
+    bs_init(&bs, rbsp, sizeof(rbsp));
+
+    /* nal_unit_header() */
+    bs_write_bits(&bs, 1, 0);
+    bs_write_bits(&bs, 2, info->nal_ref_idc);
+    bs_write_bits(&bs, 5, NAL_SLICE);
+
+    bs_write_ue(&bs, 0);                    /* first_mb_in_slice */
+    bs_write_ue(&bs, SLICE_P + 5);          /* all slices are P */
+    bs_write_ue(&bs, info->pic_parameter_set_id);
+    bs_write_bits(&bs, info->log2_max_frame_num, info->frame_num);
+
+    if (!info->frame_mbs_only)
+        bs_write_bits(&bs, 1, 0);           /* field_pic_flag */
+
+    if (info->pic_order_cnt_type == 0) {
+        bs_write_bits(&bs, info->log2_max_poc_lsb, info->pic_order_cnt_lsb);
+        if (info->pic_order_present)
+            bs_write_se(&bs, info->delta_pic_order_cnt_bottom);
+    } else if (info->pic_order_cnt_type == 1 &&
+            !info->delta_pic_order_always_zero) {
+        bs_write_se(&bs, info->delta_pic_order_cnt[0]);
+        if (info->pic_order_present)
+            bs_write_se(&bs, info->delta_pic_order_cnt[1]);
+    }
+
+    if (info->redundant_pic_cnt_present)
+        bs_write_ue(&bs, 0);
+
+    bs_write_bits(&bs, 1, 1);               /* num_ref_idx_active_override */
+    bs_write_ue(&bs, 0);                    /* num_ref_idx_l0_active_minus1 */
+    bs_write_bits(&bs, 1, 0);               /* ref_pic_list_modification */
+
+    if (info->nal_ref_idc)
+        bs_write_bits(&bs, 1, 0);           /* adaptive_ref_pic_marking */
+
+    bs_write_se(&bs, 0);                    /* slice_qp_delta */
+
+    if (info->deblocking_filter_control_present)
+        bs_write_ue(&bs, 1);                /* disable_deblocking_filter_idc */
+
+    /* slice_data() */
+    bs_write_ue(&bs, num_mbs);              /* mb_skip_run */
+    bs_write_trailing(&bs);
+
+    if (bs.overrun)
+        return -1;
+
+    return h264_escape(rbsp, bs.pos >> 3, data, size);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+typedef struct bitstream {
+    unsigned char  *data;
+    int             size;       /* in bytes */
+    int             pos;        /* in bits */
+    int             overrun;    /* read or wrote past the end */
+} bitstream_t, *bitstream_p;
+
+void bs_init(bitstream_p bs, void *data, int size);
+unsigned int bs_read_bits(bitstream_p bs, int n);
+unsigned int bs_read_ue(bitstream_p bs);
+int bs_read_se(bitstream_p bs);
+
+void bs_write_bits(bitstream_p bs, int n, unsigned int value);
+void bs_write_ue(bitstream_p bs, unsigned int value);
+void bs_write_se(bitstream_p bs, int value);
+void bs_write_trailing(bitstream_p bs);
+
+#endif /* BITSTREAM_H */
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef H264_SWENC_H
+#define H264_SWENC_H
+
+#include "linux/videodev2.h"
+#include "rk_vepu_plugin.h"
+
+/**
+ * Software H.264 encoder standing in for the VPU on hosts without an
+ * encoder node. It takes the same ioctls the plugin does: one YUV420M
+ * OUTPUT buffer and one H.264 CAPTURE buffer, the private VAENC controls
+ * and the standard MPEG ones, and codes Constrained Baseline with CAVLC.
+ * Frames are coded on a pool of worker threads, so QBUF returns at once
+ * and DQBUF waits like it would on the device.
+ */
+typedef struct h264_swenc h264_swenc_t, *h264_swenc_p;
+
+h264_swenc_p h264_swenc_create(void);
+void h264_swenc_destroy(h264_swenc_p enc);
+int h264_swenc_ioctl(h264_swenc_p enc, unsigned long int cmd, void *arg);
+void *h264_swenc_mmap(h264_swenc_p enc, __u32 offset);
+
+#endif /* H264_SWENC_H */
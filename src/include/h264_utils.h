@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef H264_UTILS_H
+#define H264_UTILS_H
+
+/**
+ * SPS/PPS fields needed to walk slice headers, of our own stream or of
+ * one being decoded.
+ */
+typedef struct h264_header_info {
+    int     log2_max_frame_num;
+    int     pic_order_cnt_type;
+    int     log2_max_poc_lsb;
+    int     delta_pic_order_always_zero;
+    int     frame_mbs_only;
+    int     pic_init_qp;
+    int     pic_order_present;
+    int     redundant_pic_cnt_present;
+    int     weighted_pred;
+    int     entropy_coding_mode;
+    int     deblocking_filter_control_present;
+    int     weighted_bipred_idc;
+    int     chroma_format_idc;
+    /* Active references when a slice does not override them */
+    int     num_ref_idx_default[2];
+
+    /* Current picture, from the PPS and slice parameters */
+    int     pic_parameter_set_id;
+    int     frame_num;
+    int     nal_ref_idc;
+    int     pic_order_cnt_lsb;
+    int     delta_pic_order_cnt_bottom;
+    int     delta_pic_order_cnt[2];
+    /* Set when the slice parameters carried the fields above */
+    int     slice_valid;
+} h264_header_info_t, *h264_header_info_p;
+
+/* Parameter sets found by h264_parse_parameter_sets() */
+#define H264_HEADERS_SPS    1
+#define H264_HEADERS_PPS    2
+#define H264_HEADERS_ALL    (H264_HEADERS_SPS | H264_HEADERS_PPS)
+
+/**
+ * One parsed slice header. The bit sizes are counted in the unescaped NAL,
+ * after its header byte.
+ */
+typedef struct h264_slice_header {
+    int     nal_ref_idc;
+    int     idr;
+    int     first_mb_in_slice;
+    int     slice_type;
+    int     pic_parameter_set_id;
+    int     frame_num;
+    int     field_pic;
+    int     bottom_field;
+    int     idr_pic_id;
+    int     pic_order_cnt_lsb;
+    int     delta_pic_order_cnt_bottom;
+    int     delta_pic_order_cnt[2];
+    int     redundant_pic_cnt;
+    int     direct_spatial_mv_pred;
+    int     num_ref_idx_active[2];
+    /* Set for the lists whose active count is the PPS default */
+    int     num_ref_idx_from_pps[2];
+    int     cabac_init_idc;
+    int     slice_qp_delta;
+    int     sp_for_switch;
+    int     slice_qs_delta;
+    int     disable_deblocking_filter_idc;
+    int     slice_alpha_c0_offset_div2;
+    int     slice_beta_offset_div2;
+
+    int     header_bit_size;
+    int     pic_order_cnt_bit_size;
+    int     dec_ref_pic_marking_bit_size;
+} h264_slice_header_t, *h264_slice_header_p;
+
+/**
+ * Limits of one level from Table A-1.
+ */
+typedef struct h264_level {
+    int     level_idc;
+    int     max_mbps;       /* macroblocks per second */
+    int     max_fs;         /* macroblocks per frame */
+    int     max_br;         /* 1000 bits per second, Baseline and Main */
+} h264_level_t;
+
+const h264_level_t *h264_find_level(int width, int height,
+        int fps_num, int fps_den, int bitrate);
+
+int h264_unescape(const unsigned char *data, int size,
+        unsigned char *out, int out_size);
+
+int h264_parse_parameter_sets(h264_header_info_p info,
+        const unsigned char *data, int size);
+
+int h264_parse_slice_header(h264_header_info_p info,
+        const unsigned char *nal, int size, h264_slice_header_p hdr);
+
+int h264_first_slice_header(h264_header_info_p info, unsigned char *data,
+        int size, h264_slice_header_p hdr);
+
+int h264_slice_qp(h264_header_info_p info, unsigned char *data, int size);
+
+int h264_escape(const unsigned char *rbsp, int n,
+        unsigned char *data, int size);
+
+int h264_write_skip_slice(h264_header_info_p info, int num_mbs,
+        unsigned char *data, int size);
+
+#endif /* H264_UTILS_H */
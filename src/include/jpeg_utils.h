@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef JPEG_UTILS_H
+#define JPEG_UTILS_H
+
+/* Quantization tables are in zig-zag order, as in DQT and VA-API */
+#define JPEG_QUANT_SIZE     64
+
+/**
+ * Baseline 4:2:0 JFIF picture, luma table 0 and chroma table 1.
+ */
+typedef struct jpeg_header_info {
+    int             width;
+    int             height;
+    int             restart_interval;
+    unsigned char   quant[2][JPEG_QUANT_SIZE];
+} jpeg_header_info_t, *jpeg_header_info_p;
+
+void jpeg_default_quant(int quality, unsigned char *luma,
+        unsigned char *chroma);
+
+void jpeg_scale_quant(int quality, unsigned char *table);
+
+int jpeg_write_headers(jpeg_header_info_p info, unsigned char *data,
+        int size);
+
+#endif /* JPEG_UTILS_H */
@@ -23,6 +23,95 @@
 #define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_PPS  (V4L2_CID_CUSTOM_BASE + 5)
 #define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_SLICE (V4L2_CID_CUSTOM_BASE + 6)
 #define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_RC   (V4L2_CID_CUSTOM_BASE + 7)
+#define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_INTRA_AREA (V4L2_CID_CUSTOM_BASE + 8)
+#define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_TARGET_BITS (V4L2_CID_CUSTOM_BASE + 9)
+#define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_DIRTY_AREA (V4L2_CID_CUSTOM_BASE + 10)
+#define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_ROI (V4L2_CID_CUSTOM_BASE + 11)
+/*
+ * One signed QP offset per macroblock in raster order, __s8 each, added
+ * to the frame QP.
+ */
+#define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_QP_MAP (V4L2_CID_CUSTOM_BASE + 12)
+#define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_QUALITY (V4L2_CID_CUSTOM_BASE + 13)
+/*
+ * VP8 encode parameters, the VA-API sequence, picture and quantization
+ * buffers as they are. The VPU returns the first partition followed by
+ * the token partitions, and the frame layout through the read-only
+ * VP8_FRAME control; the uncompressed data chunk is left to userspace.
+ */
+#define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_VP8_SEQ (V4L2_CID_CUSTOM_BASE + 14)
+#define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_VP8_PIC (V4L2_CID_CUSTOM_BASE + 15)
+#define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_VP8_QUANT (V4L2_CID_CUSTOM_BASE + 16)
+#define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_VP8_FRAME (V4L2_CID_CUSTOM_BASE + 17)
+/*
+ * JPEG encode parameters, struct rk_vepu_jpeg. The VPU codes with the
+ * Annex K Huffman tables and returns only the entropy coded data, with
+ * restart markers when enabled; userspace writes the JFIF headers.
+ */
+#define V4L2_CID_PRIVATE_ROCKCHIP_VAENC_JPEG (V4L2_CID_CUSTOM_BASE + 18)
+
+#define RK_VEPU_MAX_DIRTY_AREAS 16
+#define RK_VEPU_MAX_ROI_AREAS 2
+#define RK_VEPU_MIN_ROI_QP_DELTA (-15)
+
+/*
+ * Rectangle of macroblocks, inclusive on all sides. Used by the area
+ * controls above; the area is disabled when enable is 0.
+ */
+struct rk_vepu_area {
+  __u16 enable;
+  __u16 top;
+  __u16 left;
+  __u16 bottom;
+  __u16 right;
+};
+
+/*
+ * Areas of the input changed since the previous frame, the rest of the
+ * picture is an exact repeat.
+ */
+struct rk_vepu_dirty_area {
+  __u32 count;
+  struct rk_vepu_area area[RK_VEPU_MAX_DIRTY_AREAS];
+};
+
+/*
+ * Regions of interest, coded with the frame QP plus qp_delta. The VPU
+ * only lowers the QP, qp_delta is from RK_VEPU_MIN_ROI_QP_DELTA to 0.
+ */
+struct rk_vepu_roi {
+  struct rk_vepu_area area[RK_VEPU_MAX_ROI_AREAS];
+  __s16 qp_delta[RK_VEPU_MAX_ROI_AREAS];
+};
+
+/*
+ * Encoder effort settings not covered by the standard MPEG controls.
+ */
+struct rk_vepu_quality {
+  __u8 subpel;      /* motion refinement: 0 full, 1 half, 2 quarter pel */
+  __u8 intra_4x4;   /* also try the 4x4 intra prediction modes */
+  __u16 reserved;
+};
+
+/*
+ * Layout of the last VP8 frame, read with VP8_FRAME.
+ */
+struct rk_vepu_vp8_frame {
+  __u32 first_partition_size;
+  __u8 key_frame;
+  __u8 reserved[3];
+};
+
+/*
+ * Quantization tables in zig-zag order and the restart interval in MCUs,
+ * 0 for none.
+ */
+struct rk_vepu_jpeg {
+  __u8 luma_quant[64];
+  __u8 chroma_quant[64];
+  __u16 restart_interval;
+  __u16 reserved;
+};
 
 void *plugin_init(int fd);
 void plugin_close(void *dev_ops_priv);
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef ROCKCHIP_ANALYSIS_H
+#define ROCKCHIP_ANALYSIS_H
+
+#include <pthread.h>
+
+/**
+ * Scene change detection on a decimated copy of the luma plane: every
+ * SCENE_ROW_STEP-th row is compared against the previous frame.
+ */
+typedef struct scene_detect {
+    int             enabled;
+    int             width;          /* bytes compared per row */
+    int             stride;         /* of the source luma plane */
+    int             rows;           /* decimated rows */
+
+    unsigned char  *prev;           /* decimated luma of the last frame */
+    int             prev_valid;
+    unsigned int    prev_hist[32];
+
+    double          average_sad;    /* per pixel, running */
+    int             since_cut;      /* frames since the last cut */
+} scene_detect_t, *scene_detect_p;
+
+/**
+ * Duplicate frame detection against a host copy of the last frame sent
+ * to the VPU.
+ */
+typedef struct static_detect {
+    int             enabled;
+    int             size;           /* frame size in bytes */
+    unsigned char  *last;
+    int             last_valid;
+} static_detect_t, *static_detect_p;
+
+/**
+ * Adaptive quantization: a QP offset per macroblock from the log of the
+ * 16x16 luma variance, relative to the frame average. Flat blocks get a
+ * lower QP, busy ones a higher QP. The map is computed by a worker thread
+ * between rockchip_aq_start() and rockchip_aq_wait().
+ */
+typedef struct aq_map {
+    int             enabled;
+    double          strength;
+    int             width;          /* luma stride */
+    int             height;
+    int             mb_width;       /* of the map, partial macroblocks included */
+    int             mb_height;
+
+    signed char    *qp_offset;      /* mb_width * mb_height */
+    float          *energy;         /* log2 variance per macroblock */
+
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    const unsigned char *luma;      /* frame being analysed, NULL when idle */
+    int             quit;
+} aq_map_t, *aq_map_p;
+
+/* Intra16x16PredMode of the best intra prediction */
+enum {
+    STATS_INTRA_VERTICAL = 0,
+    STATS_INTRA_HORIZONTAL = 1,
+    STATS_INTRA_DC = 2,
+};
+
+/**
+ * Statistics of one 16x16 macroblock. Energies are sums of squared
+ * deviations from the mean, costs sums of absolute differences against
+ * the best prediction found.
+ */
+typedef struct mb_stats {
+    unsigned int    energy;
+    unsigned int    energy_8x8[4];  /* raster order */
+    unsigned char   mean;
+    unsigned char   mean_8x8[4];
+    unsigned char   intra_mode;
+    unsigned int    intra_cost;
+    unsigned int    inter_cost;     /* 0 without a reference */
+    short           mv[2];          /* full pel, x then y */
+} mb_stats_t, *mb_stats_p;
+
+/**
+ * Statistics of a frame, partial macroblocks on the right and bottom
+ * edge included. A surface keeps those of its last statistics pass, so
+ * the encoder can take its AQ map and scene cut decision from them
+ * rather than analysing the frame again.
+ */
+typedef struct frame_stats {
+    int             valid;          /* not used by an encoder yet */
+    int             width;
+    int             height;
+    int             mb_width;
+    int             mb_height;
+    int             has_inter;      /* motion searched in a past frame */
+    unsigned long long intra_cost;  /* of the whole frame */
+    unsigned long long inter_cost;
+    mb_stats_p      mb;
+} frame_stats_t, *frame_stats_p;
+
+void rockchip_scene_init(scene_detect_p sd, int enabled, int width, int height);
+
+void rockchip_scene_deinit(scene_detect_p sd);
+
+int rockchip_scene_cut(scene_detect_p sd, const unsigned char *luma);
+
+int rockchip_scene_cut_stats(scene_detect_p sd, const frame_stats_t *fs);
+
+void rockchip_static_init(static_detect_p sd, int enabled, int size);
+
+void rockchip_static_deinit(static_detect_p sd);
+
+int rockchip_static_frame(static_detect_p sd, const unsigned char *frame);
+
+void rockchip_aq_init(aq_map_p aq, double strength, int width, int height);
+
+void rockchip_aq_deinit(aq_map_p aq);
+
+void rockchip_aq_start(aq_map_p aq, const unsigned char *luma);
+
+signed char *rockchip_aq_wait(aq_map_p aq);
+
+int rockchip_aq_from_stats(aq_map_p aq, const frame_stats_t *fs);
+
+void rockchip_frame_stats_deinit(frame_stats_p fs);
+
+int rockchip_frame_stats_compute(frame_stats_p fs, int width, int height,
+        int stride, const unsigned char *luma, const unsigned char *ref);
+
+#endif /* ROCKCHIP_ANALYSIS_H */
@@ -27,10 +27,16 @@
 
 #include <rockchip_drv_video.h>
 
+#define ROCKCHIP_MAX_CODED_SEGMENTS     32
+
 typedef struct coded_buffer_segment
 {
     VACodedBufferSegment base;
     unsigned int mapped;
+    /* Temporal layer of the frame, see rockchip_QueryCodedTemporalId() */
+    unsigned int temporal_id;
+    /* Chained after base when the frame is split into slices */
+    VACodedBufferSegment slices[ROCKCHIP_MAX_CODED_SEGMENTS - 1];
 } coded_buffer_segment_t, *coded_buffer_segment_p;
 
 typedef struct object_buffer {
@@ -43,11 +49,18 @@ typedef struct object_buffer {
     unsigned int        max_num_elements;
     unsigned int        num_elements;
     unsigned int        ref_cnt;
+    /* Counts maps, the application may have written the data since */
+    unsigned int        generation;
 } object_buffer_t, *object_buffer_p;
 
 #define ALIGN(i, n)    (((i) + (n) - 1) & ~((n) - 1))
 #define CODED_BUFFER_HEADER_SIZE    ALIGN(sizeof(coded_buffer_segment_t), 64)
 
+void rockchip_SplitCodedSlices(coded_buffer_segment_p segment);
+
+VAStatus rockchip_QueryCodedTemporalId(VADisplay dpy,
+        VABufferID buf_id, unsigned int *temporal_id);
+
 VAStatus rockchip_CreateBuffer(VADriverContextP ctx, VAContextID context, VABufferType type, unsigned int size, unsigned int num_elements, void *data, VABufferID *buf_id);
 
 VAStatus rockchip_DestroyBuffer(VADriverContextP ctx, VABufferID buffer_id);
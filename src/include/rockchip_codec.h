@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef ROCKCHIP_CODEC_H
+#define ROCKCHIP_CODEC_H
+
+#include <va/va_backend.h>
+#include "linux/videodev2.h"
+
+/* Picture size limits of the VPU */
+#define ROCKCHIP_MIN_WIDTH          96
+#define ROCKCHIP_MIN_HEIGHT         96
+#define ROCKCHIP_MAX_WIDTH          1920
+#define ROCKCHIP_MAX_HEIGHT         1088
+
+/**
+ * One codec backend. The VA entry points shared by every codec look the
+ * backend up from the context and only call through this table.
+ */
+typedef struct rockchip_codec_ops {
+    const char *name;
+
+    /* Validate the context parameters and set up the device */
+    VAStatus (*init)(VADriverContextP ctx, VAContextID context);
+    VAStatus (*deinit)(VADriverContextP ctx, VAContextID context);
+
+    /* vaBeginPicture */
+    VAStatus (*prepare)(VADriverContextP ctx, VAContextID context,
+            VASurfaceID render_target);
+    /* One buffer of vaRenderPicture */
+    VAStatus (*process)(VADriverContextP ctx, VAContextID context,
+            VABufferID buffer);
+    /* vaEndPicture, queues the picture to the device */
+    VAStatus (*submit)(VADriverContextP ctx, VAContextID context);
+    /* Wait for the picture of a surface and hand out the result */
+    VAStatus (*collect)(VADriverContextP ctx, VASurfaceID render_target);
+
+    /* Optional, called before a buffer of the context is mapped */
+    void (*map_buffer)(VADriverContextP ctx, VABufferID buffer);
+
+    /* vaGetConfigAttributes */
+    void (*get_attributes)(VAConfigAttrib *attrib_list, int num_attribs);
+} rockchip_codec_ops_t;
+
+const rockchip_codec_ops_t *rockchip_codec_lookup(VAProfile profile,
+        VAEntrypoint entrypoint);
+
+struct object_context;
+
+/* Count a coded frame, logging frame rate and bitrate once a second */
+void rockchip_codec_statistics(struct object_context *obj_context,
+        unsigned int coded_size);
+
+/**
+ * Decoders give each render target the CAPTURE buffer of its index in the
+ * context. Returns that index, -1 when the surface is not a render target.
+ */
+int rockchip_codec_frame_index(struct object_context *obj_context,
+        VASurfaceID surface);
+
+/* Let surfaces use their CAPTURE buffer as image memory where it fits */
+void rockchip_codec_share_frames(VADriverContextP ctx,
+        struct object_context *obj_context);
+
+/* Give surfaces their own memory back, holding their last picture */
+void rockchip_codec_unshare_frames(VADriverContextP ctx,
+        struct object_context *obj_context);
+
+/**
+ * Open the decoder node of a context, one CAPTURE buffer per render
+ * target. Picture dimensions are validated by the codec.
+ */
+VAStatus rockchip_codec_open_decoder(VADriverContextP ctx,
+        struct object_context *obj_context, __u32 coded_format);
+
+void rockchip_codec_close_decoder(VADriverContextP ctx,
+        struct object_context *obj_context);
+
+/* vaBeginPicture of a decoder: the CAPTURE and OUTPUT buffer to use */
+VAStatus rockchip_codec_begin_frame(VADriverContextP ctx,
+        struct object_context *obj_context, VASurfaceID render_target,
+        int *frame_index, int *bitstream);
+
+/* Queue a picture, its controls going into the bitstream buffer's store */
+VAStatus rockchip_codec_decode_frame(struct object_context *obj_context,
+        int frame_index, int bitstream, int size,
+        struct v4l2_ext_control *ctrls, int count);
+
+/* Wait for the decoded picture of a surface and put it in its image */
+VAStatus rockchip_codec_collect_frame(VADriverContextP ctx,
+        VASurfaceID surface);
+
+int rockchip_codec_profiles(VAProfile *profile_list);
+
+int rockchip_codec_entrypoints(VAProfile profile,
+        VAEntrypoint *entrypoint_list);
+
+#endif /* ROCKCHIP_CODEC_H */
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef ROCKCHIP_CONVERT_H
+#define ROCKCHIP_CONVERT_H
+
+#include <stddef.h>
+#include <va/va.h>
+
+/* Largest downscale, in either direction */
+#define CONVERT_MAX_DOWNSCALE   8
+/* Rounding of odd chroma sizes can take the factor a little over */
+#define CONVERT_MAX_TAPS        (2 * CONVERT_MAX_DOWNSCALE + 3)
+/* Destination rows converted at a time, the unit of work of a thread */
+#define CONVERT_BAND_ROWS       16
+
+enum {
+    CONVERT_YUV_PLANAR,         /* I420, YV12 */
+    CONVERT_YUV_SEMIPLANAR,     /* NV12 */
+    CONVERT_RGB32,              /* RGBA, RGBX, BGRA, BGRX */
+};
+
+/**
+ * Separable resampling filter of one direction: a triangle as wide as
+ * the scale factor, so downscaling averages every source pixel instead
+ * of skipping some. Weights of an output pixel add up to 256.
+ */
+typedef struct convert_filter {
+    int             identity;       /* same size, no filtering */
+    int             taps;
+    int            *start;          /* first source pixel, per output pixel */
+    short          *weight;         /* taps per output pixel */
+} convert_filter_t, *convert_filter_p;
+
+/* A source plane, scaled to the output region */
+typedef struct convert_plane {
+    const unsigned char *src;       /* source rectangle */
+    int             src_pitch;
+    int             channels;       /* interleaved components per pixel */
+    int             width;          /* scaled */
+    int             height;
+    convert_filter_t h;
+    convert_filter_t v;
+} convert_plane_t, *convert_plane_p;
+
+typedef struct convert_format {
+    int             layout;
+    int             order[4];       /* byte of R, G, B and A in a pixel */
+    int             alpha;
+} convert_format_t, *convert_format_p;
+
+typedef struct convert_matrix convert_matrix_t;
+
+/**
+ * One conversion of a source rectangle into the output region of a
+ * destination picture. Source planes are scaled first and keep their
+ * layout, then repacked or color converted into the destination. The
+ * rest of the destination is filled with the background color, if any.
+ */
+typedef struct convert_job {
+    convert_format_t src_format;
+    convert_format_t dst_format;
+    const convert_matrix_t *matrix;
+
+    int             num_planes;
+    convert_plane_t planes[3];      /* Y, U, V; Y, UV or RGB */
+
+    unsigned char  *dst[3];         /* destination planes, same order */
+    int             dst_pitch[3];
+    int             dst_width;
+    int             dst_height;
+    int             x, y, width, height;    /* output region */
+
+    int             fill;           /* paint around the output region */
+    unsigned char   background[4];  /* Y, U, V or an RGB pixel */
+
+    /* Per thread scratch memory */
+    int             ring_size[3];   /* rows kept per plane */
+    int             row_bytes[3];
+    int             tmp_bytes;
+    size_t          scratch_size;
+} convert_job_t, *convert_job_p;
+
+/* Rows of one thread, reused across jobs */
+typedef struct convert_scratch {
+    unsigned char  *buffer;
+    size_t          size;
+
+    unsigned char  *ring[3];
+    int             ring_row[3][CONVERT_MAX_TAPS];
+    unsigned char  *tmp[6];
+
+    int             chroma_row;     /* of chroma[], -1 when none */
+    const unsigned char *chroma[2];
+} convert_scratch_t, *convert_scratch_p;
+
+/**
+ * Set up a conversion between two pictures. The rectangles are in pixels
+ * of the pictures, NULL for all of it. The background is an ARGB color
+ * painted around the output region, or NULL to leave the rest of the
+ * destination untouched. Returns VA_STATUS_ERROR_*
+ * when a format, rectangle or scale factor is not supported.
+ */
+VAStatus rockchip_convert_init(convert_job_p job,
+        const VAImage *src, const unsigned char *src_data,
+        const VARectangle *src_rect, int src_bt709,
+        const VAImage *dst, unsigned char *dst_data,
+        const VARectangle *dst_rect, int dst_bt709,
+        const unsigned int *background);
+
+void rockchip_convert_deinit(convert_job_p job);
+
+/**
+ * Produce destination rows [y0, y1), y0 even. Different threads may do
+ * different rows of a job at once, each with its own scratch. Returns -1
+ * when scratch memory runs out.
+ */
+int rockchip_convert_rows(convert_job_p job, convert_scratch_p scratch,
+        int y0, int y1);
+
+void rockchip_convert_scratch_free(convert_scratch_p scratch);
+
+/* Whole job on the calling thread */
+VAStatus rockchip_convert(convert_job_p job);
+
+#endif /* ROCKCHIP_CONVERT_H */
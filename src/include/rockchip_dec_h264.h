@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef ROCKCHIP_DEC_H264_H
+#define ROCKCHIP_DEC_H264_H
+
+#include <rockchip_drv_video.h>
+#include "linux/videodev2.h"
+#include "h264_utils.h"
+
+/* Slices of one picture, as many as the SLICE_PARAM control carries */
+#define ROCKCHIP_DEC_H264_MAX_SLICES    16
+
+typedef struct decode_params_h264 {
+    struct v4l2_ctrl_h264_sps               sps;
+    struct v4l2_ctrl_h264_pps               pps;
+    struct v4l2_ctrl_h264_scaling_matrix    scaling_matrix;
+    struct v4l2_ctrl_h264_decode_param      decode_param;
+    struct v4l2_ctrl_h264_slice_param
+        slice_param[ROCKCHIP_DEC_H264_MAX_SLICES];
+
+    /* Where each slice is in the slice data buffer rendered after it */
+    unsigned int    slice_offset[ROCKCHIP_DEC_H264_MAX_SLICES];
+    unsigned int    slice_size[ROCKCHIP_DEC_H264_MAX_SLICES];
+    int             num_slices;
+    /* First slice whose data buffer has not been rendered yet */
+    int             first_pending_slice;
+    int             scaling_matrix_present;
+
+    /* Surface of each decode_param.dpb entry */
+    VASurfaceID     dpb_surface[16];
+    int             profile_idc;
+    h264_header_info_t header;
+    /**
+     * PPS num_ref_idx_l0/l1_default_active_minus1, learned from slices
+     * without an override and kept from picture to picture.
+     */
+    int             num_ref_idx_default[2];
+
+    /* CAPTURE buffer of the picture and the OUTPUT buffer it is put in */
+    int             frame_index;
+    int             bitstream;
+    int             bitstream_size;
+} decode_params_h264_t, *decode_params_h264_p;
+
+extern const rockchip_codec_ops_t rockchip_dec_h264_ops;
+
+#endif /* ROCKCHIP_DEC_H264_H */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef ROCKCHIP_DEC_VP8_H
+#define ROCKCHIP_DEC_VP8_H
+
+#include <rockchip_drv_video.h>
+#include <va/va_dec_vp8.h>
+#include "linux/videodev2.h"
+#include "vp8_utils.h"
+
+typedef struct decode_params_vp8 {
+    struct v4l2_ctrl_vp8_frame_hdr frame_hdr;
+    /* Frame tag written in front of the first partition */
+    vp8_frame_header_t header;
+
+    /* Where the frame is in the slice data buffer */
+    unsigned int    slice_offset;
+    unsigned int    slice_size;
+    int             have_slice;
+
+    /* CAPTURE buffer of the frame and the OUTPUT buffer it is put in */
+    int             frame_index;
+    int             bitstream;
+    int             bitstream_size;
+} decode_params_vp8_t, *decode_params_vp8_p;
+
+extern const rockchip_codec_ops_t rockchip_dec_vp8_ops;
+
+#endif /* ROCKCHIP_DEC_VP8_H */
@@ -42,14 +42,38 @@
 #include "rockchip_image.h"
 #include "rockchip_surface.h"
 #include "rockchip_picture.h"
-#include "rockchip_encoder.h"
+#include "rockchip_codec.h"
+#include "rockchip_enc_h264.h"
+#include "rockchip_enc_vp8.h"
+#include "rockchip_enc_jpeg.h"
+#include "rockchip_dec_h264.h"
+#include "rockchip_dec_vp8.h"
+#include "rockchip_vpp.h"
+#include "rockchip_stats.h"
+#include "rockchip_rate_control.h"
+#include "rockchip_analysis.h"
 #include "v4l2_utils.h"
+#include "v4l2_dec_utils.h"
 
 #define ASSERT              assert
 #define EXPORT              __attribute__ ((visibility("default")))
 #define ARRAY_SIZE(x)       (sizeof(x)/sizeof(x[0]))
 #define TIME_TO_MS(tv)      (tv.tv_sec * 1000 + tv.tv_usec / 1000)
 #define DURATION(tv1, tv2)  (TIME_TO_MS(tv2) - TIME_TO_MS(tv1))
+#define TIME_TO_US(tv)      (tv.tv_sec * 1000000LL + tv.tv_usec)
+#define DURATION_US(tv1, tv2)  (TIME_TO_US(tv2) - TIME_TO_US(tv1))
+
+#define LOG(fmt, args...) { \
+    FILE *fp = fopen("/tmp/video.log", "a"); \
+    if (fp) { \
+        fprintf(fp, fmt, ## args); \
+        fclose(fp); \
+    } \
+}
+
+#define LOG_DEINIT()
+
+#define LOG_INIT()
 
 #define INIT_DRIVER_DATA    struct rockchip_driver_data * const driver_data = (struct rockchip_driver_data *) ctx->pDriverData;
 
@@ -79,6 +103,8 @@ struct rockchip_driver_data {
     struct object_heap  surface_heap;
     struct object_heap  image_heap;
     struct object_heap  buffer_heap;
+    /* H.264 contexts on the VPU, which can share uploads by dma-buf */
+    int                 num_shared_encoders;
 };
 
 typedef struct object_config {
@@ -97,6 +123,15 @@ typedef struct {
     int             fps;
     int             bitrate;
     int             intra_ratio;
+
+    /**
+     * VPU encode time, from queuing the input to dequeuing the stream, and
+     * output size per quality level, to compare the presets. Read with
+     * rockchip_QueryEncodeBenchmark().
+     */
+    long long       encode_us[ROCKCHIP_QUALITY_LEVELS + 1];
+    long long       encode_bytes[ROCKCHIP_QUALITY_LEVELS + 1];
+    int             encode_frames[ROCKCHIP_QUALITY_LEVELS + 1];
 } encode_statistics_t, *encode_statistics_p;
 
 typedef struct object_context {
@@ -110,16 +145,37 @@ typedef struct object_context {
     int                 flags;
     VASurfaceID        *render_targets;
     int                 streaming;
+    const rockchip_codec_ops_t *codec;
 
     enc_context_p       enc_ctx;
+    dec_context_p       dec_ctx;
+    /**
+     * Decoders: own memory of each render target whose image now lives
+     * in its CAPTURE buffer, NULL when frames are copied out instead.
+     */
+    void               *surface_data[VIDEO_MAX_FRAME];
     encode_statistics_t statistics;
+    rate_control_t      rc;
+    scene_detect_t      scene;
+    static_detect_t     duplicate;
+    aq_map_t            aq;
 
     union {
         encode_params_h264_t h264_params;
+        encode_params_vp8_t vp8_params;
+        encode_params_jpeg_t jpeg_params;
+        decode_params_h264_t h264_dec_params;
+        decode_params_vp8_t vp8_dec_params;
+        vpp_params_t vpp_params;
+#if VA_CHECK_VERSION(1, 0, 0)
+        stats_params_t stats_params;
+#endif
     };
 
     struct v4l2_ext_control ctrl[5];
 
 } object_context_t, *object_context_p;
 
+VADriverContextP rockchip_DisplayDriverContext(VADisplay dpy);
+
 #endif /* _ROCKCHIP_DRV_VIDEO_H_ */
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ROCKCHIP_ENC_H264_H
+#define ROCKCHIP_ENC_H264_H
+
+#include <rockchip_drv_video.h>
+#include "h264_utils.h"
+#include "rk_vepu_plugin.h"
+
+#define ROCKCHIP_MAX_DIRTY_RECTS    RK_VEPU_MAX_DIRTY_AREAS
+#define ROCKCHIP_MAX_ROI            RK_VEPU_MAX_ROI_AREAS
+
+/* VA quality levels, 1 is the best quality and the slowest */
+#define ROCKCHIP_QUALITY_LEVELS     4
+#define ROCKCHIP_QUALITY_DEFAULT    2
+
+/* Simulcast layers of a context, the full size one included */
+#define ROCKCHIP_MAX_SIMULCAST_LAYERS   3
+
+/**
+ * A smaller copy of the stream, coded on a VPU context of its own from a
+ * downscaled picture into a coded buffer of its own. Its size is half the
+ * size of the layer above.
+ */
+typedef struct simulcast_layer {
+    struct enc_context *enc_ctx;
+    int             width;
+    int             height;
+    /* Downscaled picture, NV12 like the surfaces */
+    VAImage         image;
+    unsigned char  *data;
+    /* Coded buffer for the next picture, VA_INVALID_ID when not coded */
+    VABufferID      coded_buf;
+    /* Coded buffer of the picture queued and not collected yet */
+    VABufferID      pending_buf;
+} simulcast_layer_t, *simulcast_layer_p;
+
+typedef struct encode_params_h264 {
+    VABufferID      coded_buf;
+    int             intra_period;
+
+    /* Adaptive intra refresh, in macroblocks per frame (0: disabled) */
+    int             air_num_mbs;
+    /* Set when the VPU has no cyclic intra refresh and we emulate it */
+    int             air_host;
+    /* Next macroblock column forced intra by the host-side refresh */
+    int             air_column;
+
+    /* Current picture is an I/IDR picture, from the PPS and slices */
+    int             frame_intra;
+    /* Key frame requested for the current picture, by IDR or scene cut */
+    int             force_key_frame;
+
+    /* Slice parameters received for the current picture */
+    int             num_slices;
+    /* Macroblocks in the first slice, used as the slice size */
+    int             slice_mbs;
+    /* Byte limit per slice from VAEncMiscParameterMaxSliceSize (0: none) */
+    int             max_slice_size;
+    /* Multi-slice mode and argument last programmed into the VPU */
+    int             slice_mode;
+    int             slice_arg;
+
+    /* Header syntax from the application's SPS and PPS */
+    h264_header_info_t header;
+    /**
+     * Header syntax of the SPS and PPS the VPU wrote, which may differ
+     * from the application's. stream_headers has H264_HEADERS_SPS and
+     * H264_HEADERS_PPS set once each was seen.
+     */
+    h264_header_info_t stream_header;
+    int             stream_headers;
+    /* Frame size limit in bits from VAEncMiscParameterBufferMaxFrameSize */
+    unsigned int    max_frame_size;
+    /* QP floor for the frame after one over max_frame_size, 0 if none */
+    int             overflow_qp;
+
+    /* Surface encoded but not collected yet, VA_INVALID_ID when none */
+    VASurfaceID     pending_surface;
+
+    /* Current picture repeats the last one and was coded as a skip slice */
+    int             frame_skipped;
+    /**
+     * Slice header of the last picture the VPU coded, which the skip slices
+     * go on from, valid once one was read back. poc_step is the POC lsb
+     * step to it from the picture before, 0 when unknown.
+     */
+    int             last_slice_valid;
+    h264_slice_header_t last_slice;
+    int             poc_step;
+    /* Skip slices coded since the last VPU picture */
+    int             num_skipped;
+
+    /**
+     * Changed areas of the current picture, macroblock aligned, valid
+     * only when the application sent a usable dirty rectangle buffer.
+     */
+    int             dirty_valid;
+    int             num_dirty_rects;
+    VARectangle     dirty_rects[ROCKCHIP_MAX_DIRTY_RECTS];
+    /* The VPU rejected the dirty area hint, stop sending it */
+    int             dirty_hint_failed;
+
+    /**
+     * Temporal layer pattern from VAEncMiscParameterTemporalLayerStructure,
+     * num_layers 0 when there is none. Only layer 0 pictures are used as
+     * references, so any upper layers can be dropped.
+     */
+    int             num_layers;
+    int             layer_period;
+    int             layer_ids[32];
+    /**
+     * Position of the current picture in the pattern, 0 at every IDR or
+     * key frame and when the pattern changes.
+     */
+    int             layer_index;
+    int             temporal_id;
+    /* frame_num of the last reference picture, kept without layers too */
+    int             prev_ref_frame_num;
+
+    /* Quality level programmed into the VPU, 0 for the plugin defaults */
+    int             quality_level;
+
+    /* Regions of interest of the current picture, and the ones last sent */
+    struct rk_vepu_roi roi;
+    struct rk_vepu_roi roi_sent;
+
+    /**
+     * Spatial layers coded from every picture, 1 without simulcast. The
+     * context's own VPU codes layer 0, the others follow in spatial[].
+     */
+    int             num_spatial_layers;
+    simulcast_layer_t spatial[ROCKCHIP_MAX_SIMULCAST_LAYERS - 1];
+    /**
+     * TODO: save more params
+     */
+} encode_params_h264_t, *encode_params_h264_p;
+
+extern const rockchip_codec_ops_t rockchip_enc_h264_ops;
+
+VAStatus rockchip_QueryEncodeBenchmark(VADisplay dpy,
+        VAContextID context, unsigned int quality_level,
+        unsigned int *frames, unsigned int *us_per_frame,
+        unsigned int *bytes_per_frame);
+
+VAStatus rockchip_SetSimulcast(VADisplay dpy, VAContextID context,
+        unsigned int num_layers);
+
+VAStatus rockchip_SetSimulcastCodedBuffer(VADisplay dpy,
+        VAContextID context, unsigned int layer, VABufferID coded_buf);
+
+#endif /* ROCKCHIP_ENC_H264_H */
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef ROCKCHIP_ENC_JPEG_H
+#define ROCKCHIP_ENC_JPEG_H
+
+#include <rockchip_drv_video.h>
+#include <va/va_enc_jpeg.h>
+#include "jpeg_utils.h"
+
+/* Picture size limits of the VPU in JPEG mode */
+#define ROCKCHIP_JPEG_MIN_WIDTH     96
+#define ROCKCHIP_JPEG_MIN_HEIGHT    32
+#define ROCKCHIP_JPEG_MAX_WIDTH     8192
+#define ROCKCHIP_JPEG_MAX_HEIGHT    8192
+
+#define ROCKCHIP_JPEG_QUALITY_DEFAULT   50
+
+typedef struct encode_params_jpeg {
+    VABufferID      coded_buf;
+    /* Surface whose picture is in the VPU, VA_INVALID_ID when none */
+    VASurfaceID     pending_surface;
+    int             quality;
+    /* Tables from the application, Annex K ones otherwise */
+    int             quant_loaded[2];
+    jpeg_header_info_t header;
+} encode_params_jpeg_t, *encode_params_jpeg_p;
+
+extern const rockchip_codec_ops_t rockchip_enc_jpeg_ops;
+
+#endif /* ROCKCHIP_ENC_JPEG_H */
@@ -22,35 +22,27 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
-#ifndef ROCKCHIP_ENCODER_H
-#define ROCKCHIP_ENCODER_H
+
+#ifndef ROCKCHIP_ENC_VP8_H
+#define ROCKCHIP_ENC_VP8_H
 
 #include <rockchip_drv_video.h>
+#include <va/va_enc_vp8.h>
+#include "vp8_utils.h"
 
-typedef struct encode_params_h264 {
+typedef struct encode_params_vp8 {
     VABufferID      coded_buf;
+    /* Surface whose frame is in the VPU, VA_INVALID_ID when none */
+    VASurfaceID     pending_surface;
+    /* Key frame period from the sequence, 0 for key frames on request only */
     int             intra_period;
-    /**
-     * TODO: save more params
-     */
-} encode_params_h264_t, *encode_params_h264_p;
-
-VAStatus rockchip_InitEncoder(VADriverContextP ctx, VAContextID context);
-
-VAStatus rockchip_DeinitEncoder(VADriverContextP ctx, VAContextID context);
-
-VAStatus rockchip_PrepareEncode(VADriverContextP ctx, VAContextID context, VASurfaceID render_target);
-
-VAStatus rockchip_ProcessSPS(VADriverContextP ctx, VAContextID context, VABufferID buffer);
-
-VAStatus rockchip_ProcessPPS(VADriverContextP ctx, VAContextID context, VABufferID buffer);
-
-VAStatus rockchip_ProcessSliceParam(VADriverContextP ctx, VAContextID context, VABufferID buffer);
-
-VAStatus rockchip_ProcessMiscParam(VADriverContextP ctx, VAContextID context, VABufferID buffer);
-
-VAStatus rockchip_DoEncode(VADriverContextP ctx, VAContextID context);
+    /* Frames queued since the last key frame, that one included */
+    int             frames_since_key;
+    int             force_key_frame;
+    /* Frame tag fields of the current picture, sizes from the sequence */
+    vp8_frame_header_t header;
+} encode_params_vp8_t, *encode_params_vp8_p;
 
-VAStatus rockchip_SyncEncoder(VADriverContextP ctx, VASurfaceID render_target);
+extern const rockchip_codec_ops_t rockchip_enc_vp8_ops;
 
-#endif /* ROCKCHIP_ENCODER_H */
+#endif /* ROCKCHIP_ENC_VP8_H */
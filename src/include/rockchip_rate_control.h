@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef ROCKCHIP_RATE_CONTROL_H
+#define ROCKCHIP_RATE_CONTROL_H
+
+#include <rockchip_drv_video.h>
+
+#define ROCKCHIP_QP_MIN     10
+#define ROCKCHIP_QP_MAX     51
+#define ROCKCHIP_QP_DEFAULT 26
+
+#define ROCKCHIP_MAX_TEMPORAL_LAYERS    4
+
+struct rate_control;
+
+/**
+ * Host-side frame level rate control algorithm. frame_qp() picks the QP
+ * of the next frame; the shared rockchip_rc_update() then feeds back the
+ * coded size of that frame.
+ */
+typedef struct rate_control_ops {
+    const char     *name;
+    int (*frame_qp)(struct rate_control *rc, int intra);
+} rate_control_ops_t;
+
+typedef struct rate_control {
+    /* NULL when rate control is left to the VPU */
+    const rate_control_ops_t *ops;
+
+    int             bitrate;        /* bits per second, 0 when unknown */
+    int             target_percentage;
+    int             fps_num;
+    int             fps_den;
+    int             window;         /* frames to spread bit errors over */
+    int             initial_qp;
+    int             crf;            /* base QP of capped CRF */
+
+    /**
+     * Temporal layers, with bitrate and frame rate of each layer counting
+     * the layers below it too, as VA-API passes them. 0 when not given.
+     */
+    int             num_layers;
+    int             temporal_id;    /* layer of the frame being encoded */
+    int             layer_bitrate[ROCKCHIP_MAX_TEMPORAL_LAYERS];
+    int             layer_fps_num[ROCKCHIP_MAX_TEMPORAL_LAYERS];
+    int             layer_fps_den[ROCKCHIP_MAX_TEMPORAL_LAYERS];
+
+    /**
+     * HRD leaky bucket, tracking the decoder side buffer: every frame
+     * drains its coded size and the channel refills bitrate / fps.
+     */
+    int             cpb_size;       /* bits, 0 when no HRD is given */
+    int             cpb_fullness;   /* bits */
+
+    /**
+     * Rate model of P (0) and I (1) frames: complexity = bits * qstep,
+     * smoothed over the frames coded so far, 0 before the first one.
+     */
+    double          complexity[2];
+    int             last_qp[2];
+    /* Coded minus budgeted bits accumulated so far */
+    long long       bit_error;
+
+    /* Frame currently being encoded */
+    int             frame_intra;
+    int             frame_qp;
+    int             frame_average;  /* bits the frame is measured against */
+
+    /* Values last programmed into the VPU */
+    int             vpu_rc_disabled;
+    int             qp[2];
+    int             min_qp;
+    int             max_qp;
+    int             target_bits;
+} rate_control_t, *rate_control_p;
+
+void rockchip_rc_init(rate_control_p rc);
+
+void rockchip_rc_set_mode(rate_control_p rc, unsigned int va_rc_mode);
+
+void rockchip_rc_set_bitrate(rate_control_p rc, int bitrate);
+
+void rockchip_rc_set_params(rate_control_p rc, VAEncMiscParameterRateControl *params);
+
+void rockchip_rc_set_framerate(rate_control_p rc, int temporal_id, int num, int den);
+
+void rockchip_rc_set_layers(rate_control_p rc, int num_layers);
+
+void rockchip_rc_set_hrd(rate_control_p rc, int buffer_size, int initial_fullness);
+
+int rockchip_rc_frame_bits(rate_control_p rc);
+
+int rockchip_rc_target_bits(rate_control_p rc);
+
+void rockchip_rc_qp_range(rate_control_p rc, int *min_qp, int *max_qp);
+
+int rockchip_rc_frame_qp(rate_control_p rc, int intra);
+
+void rockchip_rc_update(rate_control_p rc, int coded_bits);
+
+#endif /* ROCKCHIP_RATE_CONTROL_H */
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef ROCKCHIP_STATS_H
+#define ROCKCHIP_STATS_H
+
+#include <rockchip_drv_video.h>
+
+#if VA_CHECK_VERSION(1, 0, 0)
+#include <va/va_fei_h264.h>
+
+/* Outputs of VAStatsStatisticsParameter, in this order */
+#define STATS_OUTPUT_MV             0
+#define STATS_OUTPUT_STATISTICS     1
+#define STATS_NUM_OUTPUTS           2
+
+typedef struct stats_params {
+    int                 rendered;
+    VASurfaceID         input;
+    VASurfaceID         past;       /* VA_INVALID_SURFACE for none */
+    VABufferID          outputs[STATS_NUM_OUTPUTS];
+    int                 disable_mv_output;
+    int                 disable_statistics_output;
+} stats_params_t, *stats_params_p;
+
+extern const rockchip_codec_ops_t rockchip_stats_ops;
+#endif
+
+#endif /* ROCKCHIP_STATS_H */
@@ -26,12 +26,22 @@
 #define ROCKCHIP_SURFACE_H
 
 #include <rockchip_drv_video.h>
+#include "rockchip_analysis.h"
 
 typedef struct object_surface {
     struct object_base  base;
     VAContextID         context_id;
     VAImage             image;
     VABufferID          coded_buffer;
+    frame_stats_t       stats;      /* of the last VAEntrypointStats pass */
+    /**
+     * The picture as VPU input, shared by the encoders that code it.
+     * Current while upload_valid is set and the image buffer was not
+     * mapped since, see upload_generation.
+     */
+    struct v4l2_frame  *upload;
+    int                 upload_valid;
+    unsigned int        upload_generation;
 } object_surface_t, *object_surface_p;
 
 VAStatus rockchip_CreateSurfaces(VADriverContextP ctx, int width, int height, int format, int num_surfaces, VASurfaceID *surfaces);
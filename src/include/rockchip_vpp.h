@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef ROCKCHIP_VPP_H
+#define ROCKCHIP_VPP_H
+
+#include <pthread.h>
+#include <rockchip_drv_video.h>
+#include <va/va_vpp.h>
+#include <va/va_backend_vpp.h>
+#include "rockchip_convert.h"
+
+#define VPP_MAX_THREADS     4
+
+struct vpp_params;
+
+typedef struct vpp_worker {
+    struct vpp_params  *vpp;
+    pthread_t           thread;
+    convert_scratch_t   scratch;
+} vpp_worker_t, *vpp_worker_p;
+
+/**
+ * Scaling and color conversion on the CPU. A picture is cut in bands of
+ * destination rows that the workers take one at a time; vaEndPicture
+ * returns once they are handed out and vaSyncSurface waits for them.
+ */
+typedef struct vpp_params {
+    /* Pipeline of the picture being rendered */
+    int                 rendered;
+    VASurfaceID         input;
+    VARectangle         input_region;
+    int                 has_input_region;
+    VARectangle         output_region;
+    int                 has_output_region;
+    int                 input_bt709;
+    int                 output_bt709;
+    unsigned int        background;
+
+    convert_job_t       job;
+    VASurfaceID         target;     /* of the job, VA_INVALID_ID when idle */
+
+    int                 num_threads;
+    vpp_worker_t        workers[VPP_MAX_THREADS];
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    int                 bands;
+    int                 next_band;  /* first band no worker has taken */
+    int                 pending;    /* bands not done yet */
+    int                 failed;
+    int                 quit;
+} vpp_params_t, *vpp_params_p;
+
+extern const rockchip_codec_ops_t rockchip_vpp_ops;
+
+VAStatus rockchip_QueryVideoProcFilters(VADriverContextP ctx, VAContextID context, VAProcFilterType *filters, unsigned int *num_filters);
+
+VAStatus rockchip_QueryVideoProcFilterCaps(VADriverContextP ctx, VAContextID context, VAProcFilterType type, void *filter_caps, unsigned int *num_filter_caps);
+
+VAStatus rockchip_QueryVideoProcPipelineCaps(VADriverContextP ctx, VAContextID context, VABufferID *filters, unsigned int num_filters, VAProcPipelineCaps *pipeline_caps);
+
+#endif /* ROCKCHIP_VPP_H */
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef V4L2_DEC_UTILS_H
+#define V4L2_DEC_UTILS_H
+
+#include "linux/videodev2.h"
+
+/* Decoder nodes of the RK3288 VPU */
+#define DEV_NAME_RK3288_DEC_NEW     "rockchip-vpu-dec"
+#define DEV_NAME_RK3288_DEC_LEGACY  "rk3288-vpu-dec"
+
+/* Bitstream buffers, so the next picture can be queued while one decodes */
+#define V4L2_DEC_NUM_BITSTREAMS     4
+
+/**
+ * A stateless decoder node: parsed pictures go in through OUTPUT buffers,
+ * each with the controls of its own configuration store, and come out in
+ * NV12 CAPTURE buffers that stay referenced by index.
+ */
+typedef struct dec_context {
+    int fd;
+    int width;
+    int height;
+    /* OUTPUT pixel format, one of the parsed slice or frame formats */
+    __u32 coded_format;
+    /* OUTPUT buffer size asked for in s_fmt */
+    int bitstream_buffer_size;
+
+    void *bitstream_buffer[V4L2_DEC_NUM_BITSTREAMS];
+    int bitstream_size[V4L2_DEC_NUM_BITSTREAMS];
+    /* The bitstream buffer is owned by the driver */
+    int bitstream_queued[V4L2_DEC_NUM_BITSTREAMS];
+
+    int num_frames;
+    void *frame_buffer[VIDEO_MAX_FRAME];
+    int frame_size;
+    /* Layout from g_fmt, the chroma plane follows pitch * height bytes */
+    int frame_pitch;
+    int frame_height;
+    int frame_queued[VIDEO_MAX_FRAME];
+    /* The last dequeued frame was flagged as corrupted */
+    int frame_error[VIDEO_MAX_FRAME];
+} dec_context_t, *dec_context_p;
+
+dec_context_p v4l2_dec_init(const char *device_path);
+dec_context_p v4l2_dec_init_by_name(const char *name);
+int v4l2_dec_deinit(dec_context_p ctx);
+int v4l2_dec_s_fmt(dec_context_p ctx);
+int v4l2_dec_reqbufs(dec_context_p ctx, int num_frames);
+int v4l2_dec_streamon(dec_context_p ctx);
+int v4l2_dec_streamoff(dec_context_p ctx);
+int v4l2_dec_s_ext_ctrls(dec_context_p ctx, __u32 config_store,
+        struct v4l2_ext_control *ctrls, int count);
+int v4l2_dec_get_bitstream(dec_context_p ctx);
+int v4l2_dec_qbuf_bitstream(dec_context_p ctx, int index, int size,
+        __u32 config_store);
+int v4l2_dec_qbuf_frame(dec_context_p ctx, int index);
+int v4l2_dec_dqbuf_bitstream(dec_context_p ctx);
+int v4l2_dec_dqbuf_frame(dec_context_p ctx);
+
+#endif /* V4L2_DEC_UTILS_H */
@@ -25,25 +25,76 @@
 #ifndef V4l2_UTILS_H
 #define V4l2_UTILS_H
 
+#include <sys/time.h>
 #include "linux/videodev2.h"
 #include "rk_vepu_plugin.h"
+#include "h264_swenc.h"
+
+#ifndef V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME
+#define V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME (V4L2_CID_MPEG_BASE + 229)
+#endif
+
+/* Encoder nodes of the RK3288 VPU */
+#define DEV_NAME_RK3288_NEW     "rockchip-vpu-enc"
+#define DEV_NAME_RK3288_LEGACY  "rk3288-vpu-enc"
+
+/**
+ * Input frame memory allocated on an encoder node of its own and exported
+ * as dma-bufs, so that any encoder context can queue it.
+ */
+typedef struct v4l2_frame {
+    int fd;
+    int width;
+    int height;
+    int dmabuf[3];
+    void *data[3];
+    int size[3];
+} v4l2_frame_t, *v4l2_frame_p;
 
 typedef struct enc_context {
     void *enc;
     int fd;
+    /* Software encoder taking the ioctls when there is no node, fd is -1 */
+    h264_swenc_p sw;
+    /* Node path, to allocate frames on the same device */
+    char device_path[64];
     int width;
     int height;
+    /* CAPTURE pixel format, V4L2_PIX_FMT_H264 unless changed before s_fmt */
+    __u32 coded_format;
+    /* CAPTURE buffer size asked for in s_fmt */
+    int coded_buffer_size;
 
     void *coded_buffer;
     int coded_size;
 
     void *input_buffer[3];
     int input_size[3];
+    /* The input buffer is owned by the driver */
+    int input_queued;
+    /* The input buffer holds a whole frame from an earlier upload */
+    int input_filled;
+
+    /**
+     * V4L2_MEMORY_DMABUF when input frames are queued by dma-buf. The
+     * input buffer is then input_frame, and queued_frame is the frame
+     * of the last queued input: input_frame or a shared one.
+     */
+    int input_memory;
+    v4l2_frame_p input_frame;
+    v4l2_frame_p queued_frame;
+
+    /* When the last input was queued, and the time until its stream came */
+    struct timeval queued_time;
+    long long encode_us;
 
 } enc_context_t, *enc_context_p;
 
+void *v4l2_probe(const char *name, void *(*open_node)(const char *path));
+
 enc_context_p v4l2_init(const char *device_path);
 enc_context_p v4l2_init_by_name(const char *name);
+enc_context_p v4l2_init_software(void);
 int v4l2_deinit(enc_context_p ctx);
 int v4l2_reqbufs(enc_context_p ctx);
 int v4l2_querybuf(enc_context_p ctx);
@@ -51,8 +102,19 @@ int v4l2_s_fmt(enc_context_p ctx);
 int v4l2_streamon(enc_context_p ctx);
 int v4l2_streamoff(enc_context_p ctx);
 int v4l2_s_ext_ctrls(enc_context_p ctx, struct v4l2_ext_controls* ext_ctrls);
+int v4l2_s_ctrl(enc_context_p ctx, __u32 id, __s32 value);
+int v4l2_s_ctrl_ptr(enc_context_p ctx, __u32 id, void *ptr, __u32 size);
+int v4l2_g_ctrl_ptr(enc_context_p ctx, __u32 id, void *ptr, __u32 size);
 int v4l2_s_parm(enc_context_p ctx, struct v4l2_streamparm *parm);
 int v4l2_qbuf_input(enc_context_p ctx, void *data, int size);
+int v4l2_requeue_input(enc_context_p ctx);
+void v4l2_update_input(enc_context_p ctx, void *data,
+        int x, int y, int width, int height);
+int v4l2_use_dmabuf_input(enc_context_p ctx);
+int v4l2_qbuf_input_frame(enc_context_p ctx, v4l2_frame_p frame);
+v4l2_frame_p v4l2_frame_alloc(enc_context_p ctx);
+void v4l2_frame_write(v4l2_frame_p frame, void *data);
+void v4l2_frame_free(v4l2_frame_p frame);
 int v4l2_qbuf_output(enc_context_p ctx);
 int v4l2_dqbuf_input(enc_context_p ctx);
 int v4l2_dqbuf_output(enc_context_p ctx);
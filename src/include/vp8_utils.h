@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef VP8_UTILS_H
+#define VP8_UTILS_H
+
+/* Frame tag, plus the start code and size on key frames */
+#define VP8_FRAME_HEADER_SIZE       10
+#define VP8_INTER_HEADER_SIZE       3
+
+/**
+ * Uncompressed data chunk at the start of every VP8 frame, RFC 6386 9.1.
+ */
+typedef struct vp8_frame_header {
+    int     key_frame;
+    int     version;
+    int     show_frame;
+    int     first_part_size;
+
+    /* Key frames only */
+    int     width;
+    int     height;
+    int     horiz_scale;
+    int     vert_scale;
+} vp8_frame_header_t, *vp8_frame_header_p;
+
+int vp8_write_frame_header(vp8_frame_header_p header,
+        unsigned char *data, int size);
+
+#endif /* VP8_UTILS_H */
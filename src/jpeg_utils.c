@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "jpeg_utils.h"
+
+#define JPEG_SOI    0xd8
+#define JPEG_APP0   0xe0
+#define JPEG_DQT    0xdb
+#define JPEG_SOF0   0xc0
+#define JPEG_DHT    0xc4
+#define JPEG_DRI    0xdd
+#define JPEG_SOS    0xda
+
+/* Natural order position of every zig-zag index */
+static const unsigned char jpeg_zigzag[JPEG_QUANT_SIZE] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+/* Annex K.1 tables, natural order */
+static const unsigned char jpeg_luma_quant[JPEG_QUANT_SIZE] = {
+    16,  11,  10,  16,  24,  40,  51,  61,
+    12,  12,  14,  19,  26,  58,  60,  55,
+    14,  13,  16,  24,  40,  57,  69,  56,
+    14,  17,  22,  29,  51,  87,  80,  62,
+    18,  22,  37,  56,  68, 109, 103,  77,
+    24,  35,  55,  64,  81, 104, 113,  92,
+    49,  64,  78,  87, 103, 121, 120, 101,
+    72,  92,  95,  98, 112, 100, 103,  99,
+};
+
+static const unsigned char jpeg_chroma_quant[JPEG_QUANT_SIZE] = {
+    17,  18,  24,  47,  99,  99,  99,  99,
+    18,  21,  26,  66,  99,  99,  99,  99,
+    24,  26,  56,  99,  99,  99,  99,  99,
+    47,  66,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+};
+
+/**
+ * Annex K.3 Huffman tables, the only ones the VPU codes with: code counts
+ * per length, then the symbols.
+ */
+static const unsigned char jpeg_dc_luma_bits[16] = {
+    0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const unsigned char jpeg_dc_chroma_bits[16] = {
+    0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+};
+
+static const unsigned char jpeg_dc_values[12] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+};
+
+static const unsigned char jpeg_ac_luma_bits[16] = {
+    0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d,
+};
+
+static const unsigned char jpeg_ac_luma_values[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+    0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+    0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+    0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+    0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+    0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+    0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+    0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+    0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+static const unsigned char jpeg_ac_chroma_bits[16] = {
+    0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77,
+};
+
+static const unsigned char jpeg_ac_chroma_values[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+    0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+    0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+    0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+    0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+    0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+    0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+    0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+/**
+ * Scale a table the way libjpeg does, 50 keeps it as it is. Quality is
+ * clamped to 1..100.
+ */
+void jpeg_scale_quant(int quality, unsigned char *table)
+{
+    int scale, value, i;
+
+    if (quality < 1)
+        quality = 1;
+    if (quality > 100)
+        quality = 100;
+
+    scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+    for (i = 0; i < JPEG_QUANT_SIZE; i++) {
+        value = (table[i] * scale + 50) / 100;
+        table[i] = value < 1 ? 1 : value > 255 ? 255 : value;
+    }
+}
+
+/* Annex K tables in zig-zag order, scaled to the quality */
+void jpeg_default_quant(int quality, unsigned char *luma,
+        unsigned char *chroma)
+{
+    int i;
+
+    for (i = 0; i < JPEG_QUANT_SIZE; i++) {
+        luma[i] = jpeg_luma_quant[jpeg_zigzag[i]];
+        chroma[i] = jpeg_chroma_quant[jpeg_zigzag[i]];
+    }
+
+    jpeg_scale_quant(quality, luma);
+    jpeg_scale_quant(quality, chroma);
+}
+
+static unsigned char *jpeg_put_marker(unsigned char *p, int marker,
+        int length)
+{
+    p[0] = 0xff;
+    p[1] = marker;
+    p[2] = length >> 8;
+    p[3] = length & 0xff;
+
+    return p + 4;
+}
+
+static unsigned char *jpeg_put_huffman(unsigned char *p, int table_class,
+        int id, const unsigned char *bits, const unsigned char *values)
+{
+    int count = 0, i;
+
+    *p++ = (table_class << 4) | id;
+    for (i = 0; i < 16; i++) {
+        *p++ = bits[i];
+        count += bits[i];
+    }
+    memcpy(p, values, count);
+
+    return p + count;
+}
+
+/**
+ * Write everything up to the entropy coded data: SOI, the JFIF APP0,
+ * both quantization tables, SOF0, the Huffman tables, DRI when restart
+ * markers are on, and SOS. Returns the size written, or -1 when it does
+ * not fit.
+ */
+int jpeg_write_headers(jpeg_header_info_p info, unsigned char *data,
+        int size)
+{
+    /* SOI + APP0 + DQT + SOF0 + DHT + DRI + SOS */
+    int length = 2 + 18 + 134 + 19 + 4 + 4 * 17 + 2 * 12 + 2 * 162 +
+        6 + 14;
+    unsigned char *p = data;
+    int i;
+
+    if (size < length)
+        return -1;
+
+    *p++ = 0xff;
+    *p++ = JPEG_SOI;
+
+    /* JFIF 1.01, no units, 1:1 aspect, no thumbnail */
+    p = jpeg_put_marker(p, JPEG_APP0, 16);
+    memcpy(p, "JFIF", 5);
+    p += 5;
+    *p++ = 1;
+    *p++ = 1;
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = 1;
+    *p++ = 0;
+    *p++ = 1;
+    *p++ = 0;
+    *p++ = 0;
+
+    p = jpeg_put_marker(p, JPEG_DQT, 2 + 2 * (1 + JPEG_QUANT_SIZE));
+    for (i = 0; i < 2; i++) {
+        *p++ = i;
+        memcpy(p, info->quant[i], JPEG_QUANT_SIZE);
+        p += JPEG_QUANT_SIZE;
+    }
+
+    /* Y 2x2 with table 0, Cb and Cr 1x1 with table 1 */
+    p = jpeg_put_marker(p, JPEG_SOF0, 17);
+    *p++ = 8;
+    *p++ = info->height >> 8;
+    *p++ = info->height & 0xff;
+    *p++ = info->width >> 8;
+    *p++ = info->width & 0xff;
+    *p++ = 3;
+    for (i = 0; i < 3; i++) {
+        *p++ = i + 1;
+        *p++ = i ? 0x11 : 0x22;
+        *p++ = i ? 1 : 0;
+    }
+
+    p = jpeg_put_marker(p, JPEG_DHT, 2 + 4 * 17 + 2 * 12 + 2 * 162);
+    p = jpeg_put_huffman(p, 0, 0, jpeg_dc_luma_bits, jpeg_dc_values);
+    p = jpeg_put_huffman(p, 1, 0, jpeg_ac_luma_bits, jpeg_ac_luma_values);
+    p = jpeg_put_huffman(p, 0, 1, jpeg_dc_chroma_bits, jpeg_dc_values);
+    p = jpeg_put_huffman(p, 1, 1, jpeg_ac_chroma_bits,
+            jpeg_ac_chroma_values);
+
+    if (info->restart_interval) {
+        p = jpeg_put_marker(p, JPEG_DRI, 4);
+        *p++ = info->restart_interval >> 8;
+        *p++ = info->restart_interval & 0xff;
+    }
+
+    p = jpeg_put_marker(p, JPEG_SOS, 12);
+    *p++ = 3;
+    for (i = 0; i < 3; i++) {
+        *p++ = i + 1;
+        *p++ = i ? 0x11 : 0x00;
+    }
+    /* Ss, Se, Ah/Al of a sequential scan */
+    *p++ = 0;
+    *p++ = 63;
+    *p++ = 0;
+
+    return p - data;
+}
@@ -0,0 +1,924 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "rockchip_analysis.h"
+
+#define SCENE_ROW_STEP      4
+#define SCENE_HIST_STEP     4       /* pixels per histogram sample */
+
+/* Mean absolute difference per pixel below which nothing is a cut */
+#define SCENE_MIN_SAD       12.0
+/* How far above the running average a cut has to be */
+#define SCENE_SAD_RATIO     3.0
+/* Fraction of the histogram that has to move, from 0 to 1 */
+#define SCENE_MIN_HIST      0.2
+/* Ignore flashes and fades right after a cut */
+#define SCENE_MIN_DISTANCE  8
+/* Motion compensated cost, relative to intra, from which a frame is a cut */
+#define SCENE_COST_RATIO    0.8
+
+/* Largest QP offset of the adaptive quantization map, either way */
+#define AQ_MAX_OFFSET       8
+
+/* Motion search of the statistics, in full pels */
+#define STATS_SEARCH_RANGE  16
+#define STATS_SEARCH_STEPS  8       /* diamond moves per step size */
+#define STATS_MV_COST       4       /* per pel away from the predictor */
+
+/**
+ * Sum of absolute differences of two rows, n a multiple of 16.
+ */
+static unsigned int scene_row_sad(const unsigned char *a,
+        const unsigned char *b, int n)
+{
+    unsigned int sad = 0;
+    int i;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint32x4_t acc = vdupq_n_u32(0);
+
+    for (i = 0; i < n; i += 16) {
+        uint8x16_t diff = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+
+        acc = vpadalq_u16(acc, vpaddlq_u8(diff));
+    }
+
+    sad = vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) +
+        vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+
+    for (i = 0; i < n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+
+    sad = _mm_cvtsi128_si32(acc) +
+        _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+#else
+    for (i = 0; i < n; i++)
+        sad += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+#endif
+
+    return sad;
+}
+
+void rockchip_scene_init(scene_detect_p sd, int enabled, int width, int height)
+{
+    memset(sd, 0, sizeof(*sd));
+
+    sd->width = width & ~15;
+    sd->stride = width;
+    sd->rows = height / SCENE_ROW_STEP;
+
+    if (!enabled || !sd->width || !sd->rows)
+        return;
+
+    sd->prev = malloc(sd->width * sd->rows);
+    sd->enabled = sd->prev != NULL;
+}
+
+void rockchip_scene_deinit(scene_detect_p sd)
+{
+    free(sd->prev);
+    sd->prev = NULL;
+    sd->enabled = 0;
+}
+
+/**
+ * Compare the luma plane against the previous frame and remember it for
+ * the next call. A cut needs both a jump of the SAD over its running
+ * average and a change of the histogram, which keeps fast motion and
+ * pans, whose histogram barely moves, from triggering.
+ */
+int rockchip_scene_cut(scene_detect_p sd, const unsigned char *luma)
+{
+    unsigned int hist[32];
+    unsigned long long sad = 0;
+    unsigned int hist_diff = 0, samples = 0;
+    double mad, moved;
+    int cut = 0;
+    int i, j;
+
+    if (!sd->enabled)
+        return 0;
+
+    memset(hist, 0, sizeof(hist));
+
+    for (i = 0; i < sd->rows; i++) {
+        const unsigned char *row = luma + i * SCENE_ROW_STEP * sd->stride;
+        unsigned char *prev = sd->prev + i * sd->width;
+
+        if (sd->prev_valid)
+            sad += scene_row_sad(row, prev, sd->width);
+
+        for (j = 0; j < sd->width; j += SCENE_HIST_STEP)
+            hist[row[j] >> 3]++;
+
+        memcpy(prev, row, sd->width);
+    }
+
+    for (i = 0; i < 32; i++) {
+        hist_diff += hist[i] > sd->prev_hist[i] ?
+            hist[i] - sd->prev_hist[i] : sd->prev_hist[i] - hist[i];
+        samples += hist[i];
+    }
+    memcpy(sd->prev_hist, hist, sizeof(hist));
+
+    if (!sd->prev_valid) {
+        sd->prev_valid = 1;
+        return 0;
+    }
+
+    mad = (double) sad / (sd->width * sd->rows);
+    moved = (double) hist_diff / (2 * samples);
+
+    sd->since_cut++;
+
+    if (mad > SCENE_MIN_SAD && mad > SCENE_SAD_RATIO * sd->average_sad &&
+            moved > SCENE_MIN_HIST && sd->since_cut >= SCENE_MIN_DISTANCE) {
+        cut = 1;
+        sd->since_cut = 0;
+        sd->average_sad = mad;
+    } else {
+        sd->average_sad = 0.9 * sd->average_sad + 0.1 * mad;
+    }
+
+    return cut;
+}
+
+/**
+ * Offset of the first 64 byte block that differs, or n when the buffers
+ * are identical. n must be a multiple of 64.
+ */
+static int static_first_diff(const unsigned char *a,
+        const unsigned char *b, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i += 64) {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        uint8x16_t x = veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+
+        x = vorrq_u8(x, veorq_u8(vld1q_u8(a + i + 16), vld1q_u8(b + i + 16)));
+        x = vorrq_u8(x, veorq_u8(vld1q_u8(a + i + 32), vld1q_u8(b + i + 32)));
+        x = vorrq_u8(x, veorq_u8(vld1q_u8(a + i + 48), vld1q_u8(b + i + 48)));
+
+        uint32x4_t w = vreinterpretq_u32_u8(x);
+        if (vgetq_lane_u32(w, 0) | vgetq_lane_u32(w, 1) |
+                vgetq_lane_u32(w, 2) | vgetq_lane_u32(w, 3))
+            break;
+#elif defined(__SSE2__)
+        const __m128i *va = (const __m128i *) (a + i);
+        const __m128i *vb = (const __m128i *) (b + i);
+        __m128i x;
+
+        x = _mm_and_si128(
+                _mm_cmpeq_epi8(_mm_loadu_si128(va), _mm_loadu_si128(vb)),
+                _mm_cmpeq_epi8(_mm_loadu_si128(va + 1), _mm_loadu_si128(vb + 1)));
+        x = _mm_and_si128(x,
+                _mm_cmpeq_epi8(_mm_loadu_si128(va + 2), _mm_loadu_si128(vb + 2)));
+        x = _mm_and_si128(x,
+                _mm_cmpeq_epi8(_mm_loadu_si128(va + 3), _mm_loadu_si128(vb + 3)));
+
+        if (_mm_movemask_epi8(x) != 0xffff)
+            break;
+#else
+        if (memcmp(a + i, b + i, 64))
+            break;
+#endif
+    }
+
+    return i;
+}
+
+void rockchip_static_init(static_detect_p sd, int enabled, int size)
+{
+    memset(sd, 0, sizeof(*sd));
+
+    if (!enabled || size <= 0)
+        return;
+
+    sd->size = size;
+    sd->last = malloc(size);
+    sd->enabled = sd->last != NULL;
+}
+
+void rockchip_static_deinit(static_detect_p sd)
+{
+    free(sd->last);
+    sd->last = NULL;
+    sd->enabled = 0;
+}
+
+/**
+ * Returns 1 when the frame is byte identical to the previous one.
+ * Otherwise the copy is brought up to date, starting at the first block
+ * that differs, so a changed frame costs about one compare or copy pass.
+ */
+int rockchip_static_frame(static_detect_p sd, const unsigned char *frame)
+{
+    int blocks = sd->size & ~63;
+    int diff;
+
+    if (!sd->enabled)
+        return 0;
+
+    if (!sd->last_valid) {
+        memcpy(sd->last, frame, sd->size);
+        sd->last_valid = 1;
+        return 0;
+    }
+
+    diff = static_first_diff(frame, sd->last, blocks);
+    if (diff == blocks &&
+            !memcmp(frame + blocks, sd->last + blocks, sd->size - blocks))
+        return 1;
+
+    memcpy(sd->last + diff, frame + diff, sd->size - diff);
+
+    return 0;
+}
+
+/**
+ * Variance of a 16x16 luma block, times 256.
+ */
+static unsigned int aq_block_variance(const unsigned char *src, int stride)
+{
+    unsigned int sum = 0, sqr = 0;
+    int i;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint16x8_t vsum = vdupq_n_u16(0);
+    uint32x4_t vsqr = vdupq_n_u32(0);
+
+    for (i = 0; i < 16; i++, src += stride) {
+        uint8x16_t pix = vld1q_u8(src);
+        uint16x8_t lo = vmull_u8(vget_low_u8(pix), vget_low_u8(pix));
+        uint16x8_t hi = vmull_u8(vget_high_u8(pix), vget_high_u8(pix));
+
+        vsum = vpadalq_u8(vsum, pix);
+        vsqr = vpadalq_u16(vsqr, lo);
+        vsqr = vpadalq_u16(vsqr, hi);
+    }
+
+    uint32x4_t vsum32 = vpaddlq_u16(vsum);
+    sum = vgetq_lane_u32(vsum32, 0) + vgetq_lane_u32(vsum32, 1) +
+        vgetq_lane_u32(vsum32, 2) + vgetq_lane_u32(vsum32, 3);
+    sqr = vgetq_lane_u32(vsqr, 0) + vgetq_lane_u32(vsqr, 1) +
+        vgetq_lane_u32(vsqr, 2) + vgetq_lane_u32(vsqr, 3);
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i vsum = _mm_setzero_si128();
+    __m128i vsqr = _mm_setzero_si128();
+
+    for (i = 0; i < 16; i++, src += stride) {
+        __m128i pix = _mm_loadu_si128((const __m128i *) src);
+        __m128i lo = _mm_unpacklo_epi8(pix, zero);
+        __m128i hi = _mm_unpackhi_epi8(pix, zero);
+
+        vsum = _mm_add_epi64(vsum, _mm_sad_epu8(pix, zero));
+        vsqr = _mm_add_epi32(vsqr, _mm_madd_epi16(lo, lo));
+        vsqr = _mm_add_epi32(vsqr, _mm_madd_epi16(hi, hi));
+    }
+
+    vsqr = _mm_add_epi32(vsqr, _mm_shuffle_epi32(vsqr, 0x4e));
+    vsqr = _mm_add_epi32(vsqr, _mm_shuffle_epi32(vsqr, 0xb1));
+    sum = _mm_cvtsi128_si32(vsum) +
+        _mm_cvtsi128_si32(_mm_unpackhi_epi64(vsum, vsum));
+    sqr = _mm_cvtsi128_si32(vsqr);
+#else
+    int j;
+
+    for (i = 0; i < 16; i++, src += stride) {
+        for (j = 0; j < 16; j++) {
+            sum += src[j];
+            sqr += src[j] * src[j];
+        }
+    }
+#endif
+
+    return sqr - ((sum * sum) >> 8);
+}
+
+/* Turn the energies of the whole macroblocks into QP offsets */
+static void aq_offsets(aq_map_p aq, double average)
+{
+    int cols = aq->width / 16;
+    int rows = aq->height / 16;
+    int x, y;
+
+    for (y = 0; y < rows; y++) {
+        for (x = 0; x < cols; x++) {
+            int i = y * aq->mb_width + x;
+            int offset = lrint(aq->strength * (aq->energy[i] - average));
+
+            if (offset > AQ_MAX_OFFSET)
+                offset = AQ_MAX_OFFSET;
+            if (offset < -AQ_MAX_OFFSET)
+                offset = -AQ_MAX_OFFSET;
+            aq->qp_offset[i] = offset;
+        }
+    }
+}
+
+static void aq_compute(aq_map_p aq, const unsigned char *luma)
+{
+    int cols = aq->width / 16;
+    int rows = aq->height / 16;
+    double average = 0;
+    int x, y;
+
+    for (y = 0; y < rows; y++) {
+        for (x = 0; x < cols; x++) {
+            unsigned int variance = aq_block_variance(
+                    luma + (y * aq->width + x) * 16, aq->width);
+            float energy = log2f(variance + 1);
+
+            aq->energy[y * aq->mb_width + x] = energy;
+            average += energy;
+        }
+    }
+
+    aq_offsets(aq, average / (cols * rows));
+}
+
+static void *aq_thread(void *arg)
+{
+    aq_map_p aq = arg;
+
+    pthread_mutex_lock(&aq->lock);
+    for (;;) {
+        while (!aq->luma && !aq->quit)
+            pthread_cond_wait(&aq->cond, &aq->lock);
+        if (aq->quit)
+            break;
+
+        pthread_mutex_unlock(&aq->lock);
+        aq_compute(aq, aq->luma);
+        pthread_mutex_lock(&aq->lock);
+
+        aq->luma = NULL;
+        pthread_cond_broadcast(&aq->cond);
+    }
+    pthread_mutex_unlock(&aq->lock);
+
+    return NULL;
+}
+
+/**
+ * Only whole macroblocks are analysed, a partial one on the right or
+ * bottom edge keeps offset 0. strength 0 turns the map off.
+ */
+void rockchip_aq_init(aq_map_p aq, double strength, int width, int height)
+{
+    memset(aq, 0, sizeof(*aq));
+
+    aq->strength = strength;
+    aq->width = width;
+    aq->height = height;
+    aq->mb_width = (width + 15) / 16;
+    aq->mb_height = (height + 15) / 16;
+
+    if (strength <= 0 || width < 16 || height < 16)
+        return;
+
+    aq->qp_offset = calloc(aq->mb_width * aq->mb_height, 1);
+    aq->energy = calloc(aq->mb_width * aq->mb_height, sizeof(float));
+    if (!aq->qp_offset || !aq->energy)
+        goto failed;
+
+    pthread_mutex_init(&aq->lock, NULL);
+    pthread_cond_init(&aq->cond, NULL);
+    if (pthread_create(&aq->thread, NULL, aq_thread, aq)) {
+        pthread_cond_destroy(&aq->cond);
+        pthread_mutex_destroy(&aq->lock);
+        goto failed;
+    }
+
+    aq->enabled = 1;
+    return;
+
+failed:
+    free(aq->qp_offset);
+    free(aq->energy);
+    aq->qp_offset = NULL;
+    aq->energy = NULL;
+}
+
+void rockchip_aq_deinit(aq_map_p aq)
+{
+    if (!aq->enabled)
+        return;
+
+    pthread_mutex_lock(&aq->lock);
+    aq->quit = 1;
+    pthread_cond_broadcast(&aq->cond);
+    pthread_mutex_unlock(&aq->lock);
+    pthread_join(aq->thread, NULL);
+
+    pthread_cond_destroy(&aq->cond);
+    pthread_mutex_destroy(&aq->lock);
+    free(aq->qp_offset);
+    free(aq->energy);
+    aq->qp_offset = NULL;
+    aq->energy = NULL;
+    aq->enabled = 0;
+}
+
+/**
+ * Hand a frame to the worker, after the previous one is done with. The
+ * luma plane has to stay untouched until rockchip_aq_wait().
+ */
+void rockchip_aq_start(aq_map_p aq, const unsigned char *luma)
+{
+    if (!aq->enabled)
+        return;
+
+    pthread_mutex_lock(&aq->lock);
+    while (aq->luma)
+        pthread_cond_wait(&aq->cond, &aq->lock);
+    aq->luma = luma;
+    pthread_cond_broadcast(&aq->cond);
+    pthread_mutex_unlock(&aq->lock);
+}
+
+/* The map of the last started frame, NULL when disabled */
+signed char *rockchip_aq_wait(aq_map_p aq)
+{
+    if (!aq->enabled)
+        return NULL;
+
+    pthread_mutex_lock(&aq->lock);
+    while (aq->luma)
+        pthread_cond_wait(&aq->cond, &aq->lock);
+    pthread_mutex_unlock(&aq->lock);
+
+    return aq->qp_offset;
+}
+
+/**
+ * Fill the map from a statistics pass over the same frame instead of
+ * having the worker analyse it again. Returns -1 when the statistics do
+ * not match the map, the caller then starts the worker as usual.
+ */
+int rockchip_aq_from_stats(aq_map_p aq, const frame_stats_t *fs)
+{
+    int cols = aq->width / 16;
+    int rows = aq->height / 16;
+    double average = 0;
+    int x, y;
+
+    if (!aq->enabled)
+        return 0;
+
+    if (!fs->mb || fs->mb_width != aq->mb_width ||
+            fs->mb_height != aq->mb_height)
+        return -1;
+
+    /* The worker may still be on the previous frame */
+    rockchip_aq_wait(aq);
+
+    for (y = 0; y < rows; y++) {
+        for (x = 0; x < cols; x++) {
+            int i = y * aq->mb_width + x;
+            float energy = log2f(fs->mb[i].energy + 1);
+
+            aq->energy[i] = energy;
+            average += energy;
+        }
+    }
+
+    aq_offsets(aq, average / (cols * rows));
+
+    return 0;
+}
+
+/**
+ * The scene cut decision from the costs of a statistics pass against the
+ * previous frame: a cut is where motion search stops beating intra
+ * prediction over the picture. The decimated copy is not kept up to
+ * date meanwhile, the next frame analysed from pixels starts over.
+ */
+int rockchip_scene_cut_stats(scene_detect_p sd, const frame_stats_t *fs)
+{
+    int cut;
+
+    if (!sd->enabled)
+        return 0;
+
+    sd->prev_valid = 0;
+    sd->since_cut++;
+
+    cut = fs->intra_cost &&
+        fs->inter_cost > SCENE_COST_RATIO * fs->intra_cost &&
+        sd->since_cut >= SCENE_MIN_DISTANCE;
+    if (cut)
+        sd->since_cut = 0;
+
+    return cut;
+}
+
+/**
+ * Sums and sums of squares of the four 8x8 quarters of a 16x16 block,
+ * in raster order.
+ */
+static void stats_block_moments(const unsigned char *src, int stride,
+        unsigned int sum[4], unsigned int sqr[4])
+{
+    int half, i;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (half = 0; half < 2; half++) {
+        uint16x4_t sum_l = vdup_n_u16(0), sum_r = vdup_n_u16(0);
+        uint32x4_t sqr_l = vdupq_n_u32(0), sqr_r = vdupq_n_u32(0);
+
+        for (i = 0; i < 8; i++, src += stride) {
+            uint8x8_t l = vld1_u8(src);
+            uint8x8_t r = vld1_u8(src + 8);
+
+            sum_l = vpadal_u8(sum_l, l);
+            sum_r = vpadal_u8(sum_r, r);
+            sqr_l = vpadalq_u16(sqr_l, vmull_u8(l, l));
+            sqr_r = vpadalq_u16(sqr_r, vmull_u8(r, r));
+        }
+
+        sum[half * 2] = vget_lane_u16(sum_l, 0) + vget_lane_u16(sum_l, 1) +
+            vget_lane_u16(sum_l, 2) + vget_lane_u16(sum_l, 3);
+        sum[half * 2 + 1] = vget_lane_u16(sum_r, 0) +
+            vget_lane_u16(sum_r, 1) + vget_lane_u16(sum_r, 2) +
+            vget_lane_u16(sum_r, 3);
+        sqr[half * 2] = vgetq_lane_u32(sqr_l, 0) + vgetq_lane_u32(sqr_l, 1) +
+            vgetq_lane_u32(sqr_l, 2) + vgetq_lane_u32(sqr_l, 3);
+        sqr[half * 2 + 1] = vgetq_lane_u32(sqr_r, 0) +
+            vgetq_lane_u32(sqr_r, 1) + vgetq_lane_u32(sqr_r, 2) +
+            vgetq_lane_u32(sqr_r, 3);
+    }
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+
+    for (half = 0; half < 2; half++) {
+        __m128i vsum = _mm_setzero_si128();
+        __m128i sqr_l = _mm_setzero_si128();
+        __m128i sqr_r = _mm_setzero_si128();
+
+        for (i = 0; i < 8; i++, src += stride) {
+            __m128i pix = _mm_loadu_si128((const __m128i *) src);
+            __m128i lo = _mm_unpacklo_epi8(pix, zero);
+            __m128i hi = _mm_unpackhi_epi8(pix, zero);
+
+            /* One 64-bit lane per 8 pixel half */
+            vsum = _mm_add_epi64(vsum, _mm_sad_epu8(pix, zero));
+            sqr_l = _mm_add_epi32(sqr_l, _mm_madd_epi16(lo, lo));
+            sqr_r = _mm_add_epi32(sqr_r, _mm_madd_epi16(hi, hi));
+        }
+
+        sqr_l = _mm_add_epi32(sqr_l, _mm_shuffle_epi32(sqr_l, 0x4e));
+        sqr_l = _mm_add_epi32(sqr_l, _mm_shuffle_epi32(sqr_l, 0xb1));
+        sqr_r = _mm_add_epi32(sqr_r, _mm_shuffle_epi32(sqr_r, 0x4e));
+        sqr_r = _mm_add_epi32(sqr_r, _mm_shuffle_epi32(sqr_r, 0xb1));
+
+        sum[half * 2] = _mm_cvtsi128_si32(vsum);
+        sum[half * 2 + 1] = _mm_cvtsi128_si32(_mm_unpackhi_epi64(vsum, vsum));
+        sqr[half * 2] = _mm_cvtsi128_si32(sqr_l);
+        sqr[half * 2 + 1] = _mm_cvtsi128_si32(sqr_r);
+    }
+#else
+    int j;
+
+    memset(sum, 0, 4 * sizeof(*sum));
+    memset(sqr, 0, 4 * sizeof(*sqr));
+
+    for (half = 0; half < 2; half++) {
+        for (i = 0; i < 8; i++, src += stride) {
+            for (j = 0; j < 16; j++) {
+                sum[half * 2 + j / 8] += src[j];
+                sqr[half * 2 + j / 8] += src[j] * src[j];
+            }
+        }
+    }
+#endif
+}
+
+/**
+ * Sum of absolute differences of two 16x16 blocks. A stride of 0 repeats
+ * the first row, which is the vertical intra prediction.
+ */
+static unsigned int stats_sad_16x16(const unsigned char *a, int a_stride,
+        const unsigned char *b, int b_stride)
+{
+    unsigned int sad = 0;
+    int i;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint16x8_t acc = vdupq_n_u16(0);
+
+    for (i = 0; i < 16; i++, a += a_stride, b += b_stride)
+        acc = vpadalq_u8(acc, vabdq_u8(vld1q_u8(a), vld1q_u8(b)));
+
+    uint32x4_t acc32 = vpaddlq_u16(acc);
+    sad = vgetq_lane_u32(acc32, 0) + vgetq_lane_u32(acc32, 1) +
+        vgetq_lane_u32(acc32, 2) + vgetq_lane_u32(acc32, 3);
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+
+    for (i = 0; i < 16; i++, a += a_stride, b += b_stride)
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(
+                    _mm_loadu_si128((const __m128i *) a),
+                    _mm_loadu_si128((const __m128i *) b)));
+
+    sad = _mm_cvtsi128_si32(acc) +
+        _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+#else
+    int j;
+
+    for (i = 0; i < 16; i++, a += a_stride, b += b_stride)
+        for (j = 0; j < 16; j++)
+            sad += a[j] > b[j] ? a[j] - b[j] : b[j] - a[j];
+#endif
+
+    return sad;
+}
+
+/* 16x16 block at (x, y), the edge pixels repeated past the picture */
+static void stats_load_block(unsigned char *dst, const unsigned char *plane,
+        int stride, int width, int height, int x, int y)
+{
+    int i, j;
+
+    for (i = 0; i < 16; i++) {
+        const unsigned char *row =
+            plane + (y + i < height ? y + i : height - 1) * stride;
+
+        for (j = 0; j < 16; j++)
+            dst[i * 16 + j] = row[x + j < width ? x + j : width - 1];
+    }
+}
+
+/**
+ * Best 16x16 intra prediction, vertical, horizontal or DC, predicted from
+ * the source pixels around the block rather than reconstructed ones.
+ */
+static void stats_intra(frame_stats_p fs, mb_stats_p mb,
+        const unsigned char *src, int src_stride,
+        const unsigned char *luma, int stride, int x, int y)
+{
+    unsigned char top[16], pred[256];
+    unsigned int cost, dc = 0;
+    int n = 0, i;
+
+    mb->intra_cost = ~0U;
+
+    if (y > 0) {
+        const unsigned char *row = luma + (y - 1) * stride;
+
+        for (i = 0; i < 16; i++) {
+            top[i] = row[x + i < fs->width ? x + i : fs->width - 1];
+            dc += top[i];
+        }
+        n += 16;
+
+        mb->intra_cost = stats_sad_16x16(src, src_stride, top, 0);
+        mb->intra_mode = STATS_INTRA_VERTICAL;
+    }
+
+    if (x > 0) {
+        for (i = 0; i < 16; i++) {
+            int row = y + i < fs->height ? y + i : fs->height - 1;
+            unsigned char left = luma[row * stride + x - 1];
+
+            memset(pred + i * 16, left, 16);
+            dc += left;
+        }
+        n += 16;
+
+        cost = stats_sad_16x16(src, src_stride, pred, 16);
+        if (cost < mb->intra_cost) {
+            mb->intra_cost = cost;
+            mb->intra_mode = STATS_INTRA_HORIZONTAL;
+        }
+    }
+
+    memset(pred, n ? (dc + n / 2) / n : 128, sizeof(pred));
+    cost = stats_sad_16x16(src, src_stride, pred, 16);
+    if (cost < mb->intra_cost) {
+        mb->intra_cost = cost;
+        mb->intra_mode = STATS_INTRA_DC;
+    }
+}
+
+/**
+ * Full pel motion search: the zero vector and the left (or top)
+ * neighbour's as candidates, then a diamond refined down from a step of
+ * 4 pixels. Blocks partly outside the picture only get the zero vector.
+ */
+static void stats_inter(frame_stats_p fs, mb_stats_p mb,
+        const unsigned char *src, int src_stride,
+        const unsigned char *ref, int stride, int mb_x, int mb_y)
+{
+    static const int diamond[4][2] = { { 0, -1 }, { -1, 0 }, { 1, 0 }, { 0, 1 } };
+    int x = mb_x * 16, y = mb_y * 16;
+    int min_x, max_x, min_y, max_y;
+    int pred_x = 0, pred_y = 0;
+    int best_x, best_y, step, i;
+    unsigned int best_cost, best_sad;
+
+    if (x + 16 > fs->width || y + 16 > fs->height) {
+        unsigned char block[256];
+
+        stats_load_block(block, ref, stride, fs->width, fs->height, x, y);
+        mb->inter_cost = stats_sad_16x16(src, src_stride, block, 16);
+        mb->mv[0] = 0;
+        mb->mv[1] = 0;
+        return;
+    }
+
+    /* The reference block stays inside the picture */
+    min_x = -x > -STATS_SEARCH_RANGE ? -x : -STATS_SEARCH_RANGE;
+    max_x = fs->width - 16 - x < STATS_SEARCH_RANGE ?
+        fs->width - 16 - x : STATS_SEARCH_RANGE;
+    min_y = -y > -STATS_SEARCH_RANGE ? -y : -STATS_SEARCH_RANGE;
+    max_y = fs->height - 16 - y < STATS_SEARCH_RANGE ?
+        fs->height - 16 - y : STATS_SEARCH_RANGE;
+
+    if (mb_x > 0) {
+        pred_x = mb[-1].mv[0];
+        pred_y = mb[-1].mv[1];
+    } else if (mb_y > 0) {
+        pred_x = mb[-fs->mb_width].mv[0];
+        pred_y = mb[-fs->mb_width].mv[1];
+    }
+    pred_x = pred_x < min_x ? min_x : pred_x > max_x ? max_x : pred_x;
+    pred_y = pred_y < min_y ? min_y : pred_y > max_y ? max_y : pred_y;
+
+#define STATS_COST(sad, dx, dy) ((sad) + STATS_MV_COST * \
+        (abs((dx) - pred_x) + abs((dy) - pred_y)))
+
+    best_x = 0;
+    best_y = 0;
+    best_sad = stats_sad_16x16(src, src_stride, ref + y * stride + x, stride);
+    best_cost = STATS_COST(best_sad, 0, 0);
+
+    if (pred_x || pred_y) {
+        unsigned int sad = stats_sad_16x16(src, src_stride,
+                ref + (y + pred_y) * stride + x + pred_x, stride);
+
+        if (STATS_COST(sad, pred_x, pred_y) < best_cost) {
+            best_x = pred_x;
+            best_y = pred_y;
+            best_sad = sad;
+            best_cost = STATS_COST(sad, pred_x, pred_y);
+        }
+    }
+
+    for (step = 4; step > 0; step >>= 1) {
+        int moved = 1, iterations = 0;
+
+        while (moved && iterations++ < STATS_SEARCH_STEPS) {
+            int center_x = best_x, center_y = best_y;
+
+            moved = 0;
+            for (i = 0; i < 4; i++) {
+                int dx = center_x + diamond[i][0] * step;
+                int dy = center_y + diamond[i][1] * step;
+                unsigned int sad;
+
+                if (dx < min_x || dx > max_x || dy < min_y || dy > max_y)
+                    continue;
+
+                sad = stats_sad_16x16(src, src_stride,
+                        ref + (y + dy) * stride + x + dx, stride);
+                if (STATS_COST(sad, dx, dy) < best_cost) {
+                    best_x = dx;
+                    best_y = dy;
+                    best_sad = sad;
+                    best_cost = STATS_COST(sad, dx, dy);
+                    moved = 1;
+                }
+            }
+        }
+    }
+
+#undef STATS_COST
+
+    mb->inter_cost = best_sad;
+    mb->mv[0] = best_x;
+    mb->mv[1] = best_y;
+}
+
+static void stats_macroblock(frame_stats_p fs, const unsigned char *luma,
+        const unsigned char *ref, int stride, int mb_x, int mb_y)
+{
+    mb_stats_p mb = &fs->mb[mb_y * fs->mb_width + mb_x];
+    int x = mb_x * 16, y = mb_y * 16;
+    unsigned char block[256];
+    const unsigned char *src;
+    unsigned int sum[4], sqr[4], total_sum = 0, total_sqr = 0;
+    int src_stride, i;
+
+    if (x + 16 <= fs->width && y + 16 <= fs->height) {
+        src = luma + y * stride + x;
+        src_stride = stride;
+    } else {
+        stats_load_block(block, luma, stride, fs->width, fs->height, x, y);
+        src = block;
+        src_stride = 16;
+    }
+
+    stats_block_moments(src, src_stride, sum, sqr);
+    for (i = 0; i < 4; i++) {
+        mb->energy_8x8[i] = sqr[i] - ((sum[i] * sum[i]) >> 6);
+        mb->mean_8x8[i] = (sum[i] + 32) >> 6;
+        total_sum += sum[i];
+        total_sqr += sqr[i];
+    }
+    mb->energy = total_sqr - ((total_sum * total_sum) >> 8);
+    mb->mean = (total_sum + 128) >> 8;
+
+    stats_intra(fs, mb, src, src_stride, luma, stride, x, y);
+    fs->intra_cost += mb->intra_cost;
+
+    if (ref) {
+        stats_inter(fs, mb, src, src_stride, ref, stride, mb_x, mb_y);
+        fs->inter_cost += mb->inter_cost;
+    } else {
+        mb->inter_cost = 0;
+        mb->mv[0] = 0;
+        mb->mv[1] = 0;
+    }
+}
+
+void rockchip_frame_stats_deinit(frame_stats_p fs)
+{
+    free(fs->mb);
+    memset(fs, 0, sizeof(*fs));
+}
+
+/**
+ * Statistics of every macroblock of a luma plane, with motion search
+ * against ref when it is not NULL. Both planes share the stride.
+ * Returns -1 when out of memory.
+ */
+int rockchip_frame_stats_compute(frame_stats_p fs, int width, int height,
+        int stride, const unsigned char *luma, const unsigned char *ref)
+{
+    int mb_width = (width + 15) / 16;
+    int mb_height = (height + 15) / 16;
+    int x, y;
+
+    if (!fs->mb || fs->mb_width != mb_width || fs->mb_height != mb_height) {
+        rockchip_frame_stats_deinit(fs);
+        fs->mb = malloc(mb_width * mb_height * sizeof(*fs->mb));
+        if (!fs->mb)
+            return -1;
+    }
+
+    fs->width = width;
+    fs->height = height;
+    fs->mb_width = mb_width;
+    fs->mb_height = mb_height;
+    fs->has_inter = ref != NULL;
+    fs->intra_cost = 0;
+    fs->inter_cost = 0;
+
+    for (y = 0; y < mb_height; y++)
+        for (x = 0; x < mb_width; x++)
+            stats_macroblock(fs, luma, ref, stride, x, y);
+
+    fs->valid = 1;
+
+    return 0;
+}
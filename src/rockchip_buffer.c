@@ -50,6 +50,87 @@ void rockchip_destroy_buffer(
     object_heap_free(&driver_data->buffer_heap, (object_base_p)obj_buffer);
 }
 
+/**
+ * Split the Annex-B stream in segment->base into one segment per slice NAL.
+ * Parameter sets and SEI ahead of the first slice stay in the first
+ * segment, so each segment can be sent as a packet on its own.
+ */
+void rockchip_SplitCodedSlices(coded_buffer_segment_p segment)
+{
+    unsigned char *data = segment->base.buf;
+    unsigned int size = segment->base.size;
+    VACodedBufferSegment *cur = &segment->base;
+    unsigned int start = 0;
+    int num_slices = 0;
+    int num_segments = 1;
+    unsigned int i;
+
+    segment->base.next = NULL;
+
+    for (i = 0; i + 3 < size; i++) {
+        int nal_type;
+        unsigned int nal_start;
+
+        if (data[i] || data[i + 1] || data[i + 2] != 1)
+            continue;
+
+        nal_type = data[i + 3] & 0x1f;
+        nal_start = (i > 0 && !data[i - 1]) ? i - 1 : i;
+        i += 2;
+
+        /* Coded slice of a non-IDR or IDR picture */
+        if (nal_type != 1 && nal_type != 5)
+            continue;
+
+        if (num_slices++ == 0 ||
+                num_segments == ROCKCHIP_MAX_CODED_SEGMENTS)
+            continue;
+
+        cur->size = nal_start - start;
+        cur->next = &segment->slices[num_segments - 1];
+
+        cur = cur->next;
+        cur->size = 0;
+        cur->bit_offset = 0;
+        cur->status = 0;
+        cur->reserved = 0;
+        cur->buf = data + nal_start;
+        cur->next = NULL;
+
+        start = nal_start;
+        num_segments++;
+    }
+
+    cur->size = size - start;
+}
+
+/**
+ * Temporal layer of the frame last coded into a coded buffer, 0 unless the
+ * application sent a VAEncMiscParameterTypeTemporalLayerStructure. This is
+ * not part of the VA API: applications look it up in the driver with
+ * dlsym() and call it once vaMapBuffer() on the coded buffer returned.
+ */
+EXPORT VAStatus rockchip_QueryCodedTemporalId(VADisplay dpy,
+        VABufferID buf_id, unsigned int *temporal_id)
+{
+    VADriverContextP ctx = rockchip_DisplayDriverContext(dpy);
+    object_buffer_p obj_buffer;
+
+    if (!ctx)
+        return VA_STATUS_ERROR_INVALID_DISPLAY;
+    if (!temporal_id)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    INIT_DRIVER_DATA
+    obj_buffer = BUFFER(buf_id);
+    if (!obj_buffer || obj_buffer->type != VAEncCodedBufferType)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    *temporal_id = ((coded_buffer_segment_p) obj_buffer->buffer_data)->temporal_id;
+
+    return VA_STATUS_SUCCESS;
+}
+
 VAStatus rockchip_CreateBuffer(
     VADriverContextP ctx,
     VAContextID context,
@@ -75,6 +156,19 @@ VAStatus rockchip_CreateBuffer(
     case VAEncPictureParameterBufferType:
     case VAEncSequenceParameterBufferType:
     case VAEncSliceParameterBufferType:
+    case VAQMatrixBufferType:
+    case VAHuffmanTableBufferType:
+    case VAPictureParameterBufferType:
+    case VAIQMatrixBufferType:
+    case VASliceParameterBufferType:
+    case VASliceDataBufferType:
+    case VAProbabilityBufferType:
+    case VAProcPipelineParameterBufferType:
+#if VA_CHECK_VERSION(1, 0, 0)
+    case VAStatsStatisticsParameterBufferType:
+    case VAStatsStatisticsBufferType:
+    case VAStatsMVBufferType:
+#endif
         /* Ok */
         break;
     default:
@@ -91,6 +185,7 @@ VAStatus rockchip_CreateBuffer(
 
     obj_buffer->buffer_data = NULL;
     obj_buffer->ref_cnt = 1;
+    obj_buffer->generation = 0;
 
     /**
      * TODO: use dma buf for some buffer types
@@ -109,9 +204,11 @@ VAStatus rockchip_CreateBuffer(
             segment->base.size = size - CODED_BUFFER_HEADER_SIZE;
             segment->base.bit_offset = 0;
             segment->base.status = 0;
+            segment->base.reserved = 0;
             segment->base.buf =
                 obj_buffer->buffer_data + CODED_BUFFER_HEADER_SIZE;
             segment->base.next = NULL;
+            segment->temporal_id = 0;
         } else if (data) {
             memcpy(obj_buffer->buffer_data, data, size * num_elements);
         }
@@ -180,11 +277,16 @@ VAStatus rockchip_MapBuffer(
         return vaStatus;
     }
 
+    object_context_p obj_context = CONTEXT(obj_buffer->va_context);
+    if (obj_context && obj_context->codec->map_buffer)
+        obj_context->codec->map_buffer(ctx, buf_id);
+
     if (NULL != obj_buffer->buffer_data) {
         *pbuf = obj_buffer->buffer_data;
         vaStatus = VA_STATUS_SUCCESS;
 
         ++obj_buffer->ref_cnt;
+        ++obj_buffer->generation;
     }
     return vaStatus;
 }
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rockchip_drv_video.h"
+
+/* Every supported profile and entrypoint, in the order they are listed */
+static const struct {
+    VAProfile                   profile;
+    VAEntrypoint                entrypoint;
+    const rockchip_codec_ops_t *ops;
+} rockchip_codecs[] = {
+    { VAProfileH264Main, VAEntrypointEncSlice, &rockchip_enc_h264_ops },
+    { VAProfileH264Baseline, VAEntrypointEncSlice, &rockchip_enc_h264_ops },
+    { VAProfileH264ConstrainedBaseline, VAEntrypointEncSlice,
+        &rockchip_enc_h264_ops },
+    { VAProfileVP8Version0_3, VAEntrypointEncSlice, &rockchip_enc_vp8_ops },
+    { VAProfileJPEGBaseline, VAEntrypointEncPicture, &rockchip_enc_jpeg_ops },
+    { VAProfileH264Main, VAEntrypointVLD, &rockchip_dec_h264_ops },
+    { VAProfileH264High, VAEntrypointVLD, &rockchip_dec_h264_ops },
+    { VAProfileH264ConstrainedBaseline, VAEntrypointVLD,
+        &rockchip_dec_h264_ops },
+    { VAProfileVP8Version0_3, VAEntrypointVLD, &rockchip_dec_vp8_ops },
+    { VAProfileNone, VAEntrypointVideoProc, &rockchip_vpp_ops },
+#if VA_CHECK_VERSION(1, 0, 0)
+    { VAProfileH264Main, VAEntrypointStats, &rockchip_stats_ops },
+    { VAProfileH264Baseline, VAEntrypointStats, &rockchip_stats_ops },
+    { VAProfileH264ConstrainedBaseline, VAEntrypointStats,
+        &rockchip_stats_ops },
+#endif
+};
+
+const rockchip_codec_ops_t *rockchip_codec_lookup(VAProfile profile,
+        VAEntrypoint entrypoint)
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(rockchip_codecs); i++) {
+        if (rockchip_codecs[i].profile == profile &&
+                rockchip_codecs[i].entrypoint == entrypoint)
+            return rockchip_codecs[i].ops;
+    }
+
+    return NULL;
+}
+
+int rockchip_codec_profiles(VAProfile *profile_list)
+{
+    unsigned int i;
+    int j, num_profiles = 0;
+
+    for (i = 0; i < ARRAY_SIZE(rockchip_codecs); i++) {
+        for (j = 0; j < num_profiles; j++) {
+            if (profile_list[j] == rockchip_codecs[i].profile)
+                break;
+        }
+        if (j == num_profiles)
+            profile_list[num_profiles++] = rockchip_codecs[i].profile;
+    }
+
+    return num_profiles;
+}
+
+int rockchip_codec_entrypoints(VAProfile profile,
+        VAEntrypoint *entrypoint_list)
+{
+    unsigned int i;
+    int num_entrypoints = 0;
+
+    for (i = 0; i < ARRAY_SIZE(rockchip_codecs); i++) {
+        if (rockchip_codecs[i].profile == profile)
+            entrypoint_list[num_entrypoints++] = rockchip_codecs[i].entrypoint;
+    }
+
+    return num_entrypoints;
+}
+
+void rockchip_codec_statistics(object_context_p obj_context,
+        unsigned int coded_size)
+{
+    encode_statistics_p statistics = &obj_context->statistics;
+    struct timeval tm;
+
+    statistics->frames ++;
+    statistics->stream_bytes += coded_size;
+
+    gettimeofday(&tm, NULL);
+    if (tm.tv_sec != statistics->tm.tv_sec) {
+        int duration = DURATION(statistics->tm, tm);
+
+        if (statistics->fps != statistics->frames) {
+            statistics->fps = statistics->frames;
+            LOG("fps:%d\n", statistics->fps * 1000 / duration);
+        }
+        if (statistics->bitrate != statistics->stream_bytes) {
+            statistics->bitrate = statistics->stream_bytes;
+            LOG("bitrate(KB/S):%d\n",
+                    (statistics->bitrate >> 10) * 1000 / duration);
+        }
+        statistics->frames = 0;
+        statistics->stream_bytes = 0;
+        statistics->tm = tm;
+    }
+}
+
+int rockchip_codec_frame_index(object_context_p obj_context,
+        VASurfaceID surface)
+{
+    int i;
+
+    for (i = 0; i < obj_context->num_render_targets; i++) {
+        if (obj_context->render_targets[i] == surface)
+            return i;
+    }
+
+    return -1;
+}
+
+/* The CAPTURE layout must be the NV12 image one for the surface to use it */
+static int rockchip_codec_frame_fits(dec_context_p dec_ctx, VAImage *image)
+{
+    return dec_ctx->frame_pitch == image->pitches[0] &&
+        dec_ctx->frame_pitch == image->pitches[1] &&
+        dec_ctx->frame_pitch * dec_ctx->frame_height == image->offsets[1] &&
+        dec_ctx->frame_size >= image->data_size;
+}
+
+void rockchip_codec_share_frames(VADriverContextP ctx,
+        object_context_p obj_context)
+{
+    INIT_DRIVER_DATA
+    dec_context_p dec_ctx = obj_context->dec_ctx;
+    int i, shared = 0;
+
+    for (i = 0; i < obj_context->num_render_targets; i++) {
+        object_surface_p obj_surface;
+        object_buffer_p obj_buffer;
+
+        obj_context->surface_data[i] = NULL;
+
+        obj_surface = SURFACE(obj_context->render_targets[i]);
+        if (!obj_surface ||
+                !rockchip_codec_frame_fits(dec_ctx, &obj_surface->image))
+            continue;
+
+        obj_buffer = BUFFER(obj_surface->image.buf);
+        if (!obj_buffer)
+            continue;
+
+        obj_context->surface_data[i] = obj_buffer->buffer_data;
+        obj_buffer->buffer_data = dec_ctx->frame_buffer[i];
+        shared++;
+    }
+
+    LOG("%d of %d surfaces share their frame buffer\n", shared,
+            obj_context->num_render_targets);
+}
+
+void rockchip_codec_unshare_frames(VADriverContextP ctx,
+        object_context_p obj_context)
+{
+    INIT_DRIVER_DATA
+    int i;
+
+    for (i = 0; i < obj_context->num_render_targets; i++) {
+        object_surface_p obj_surface;
+        object_buffer_p obj_buffer;
+
+        if (!obj_context->surface_data[i])
+            continue;
+
+        obj_surface = SURFACE(obj_context->render_targets[i]);
+        obj_buffer = obj_surface ? BUFFER(obj_surface->image.buf) : NULL;
+        if (obj_buffer) {
+            memcpy(obj_context->surface_data[i], obj_buffer->buffer_data,
+                    obj_surface->image.data_size);
+            obj_buffer->buffer_data = obj_context->surface_data[i];
+        }
+        obj_context->surface_data[i] = NULL;
+    }
+}
+
+/* Copy a decoded frame into an NV12 image of another layout */
+static void rockchip_codec_copy_frame(dec_context_p dec_ctx, int index,
+        VAImage *image, unsigned char *data)
+{
+    unsigned char *src = dec_ctx->frame_buffer[index];
+    int width = image->width < dec_ctx->frame_pitch ?
+        image->width : dec_ctx->frame_pitch;
+    int height = image->height < dec_ctx->frame_height ?
+        image->height : dec_ctx->frame_height;
+    int row;
+
+    for (row = 0; row < height; row++)
+        memcpy(data + image->offsets[0] + row * image->pitches[0],
+                src + row * dec_ctx->frame_pitch, width);
+
+    src += dec_ctx->frame_pitch * dec_ctx->frame_height;
+    for (row = 0; row < height / 2; row++)
+        memcpy(data + image->offsets[1] + row * image->pitches[1],
+                src + row * dec_ctx->frame_pitch, width);
+}
+
+VAStatus rockchip_codec_collect_frame(VADriverContextP ctx,
+        VASurfaceID surface)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+    object_buffer_p obj_buffer;
+    dec_context_p dec_ctx;
+    int index;
+
+    obj_surface = SURFACE(surface);
+    ASSERT(obj_surface);
+
+    if (obj_surface->context_id == VA_INVALID_ID)
+        return VA_STATUS_SUCCESS;
+
+    obj_context = CONTEXT(obj_surface->context_id);
+    ASSERT(obj_context);
+
+    dec_ctx = obj_context->dec_ctx;
+
+    index = rockchip_codec_frame_index(obj_context, surface);
+    if (index < 0)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+
+    /* Pictures complete in decode order, earlier ones come out first */
+    while (dec_ctx->frame_queued[index]) {
+        if (v4l2_dec_dqbuf_frame(dec_ctx) < 0)
+            return VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+
+    obj_surface->context_id = VA_INVALID_ID;
+
+    if (dec_ctx->frame_error[index])
+        LOG("surface %d decoded with errors\n", surface);
+
+    if (!obj_context->surface_data[index]) {
+        obj_buffer = BUFFER(obj_surface->image.buf);
+        ASSERT(obj_buffer);
+
+        rockchip_codec_copy_frame(dec_ctx, index, &obj_surface->image,
+                obj_buffer->buffer_data);
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus rockchip_codec_open_decoder(VADriverContextP ctx,
+        object_context_p obj_context, __u32 coded_format)
+{
+    /* Every render target gets a CAPTURE buffer of its own */
+    if (obj_context->num_render_targets < 1 ||
+            obj_context->num_render_targets > VIDEO_MAX_FRAME)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    memset(obj_context->surface_data, 0, sizeof(obj_context->surface_data));
+
+    obj_context->dec_ctx = v4l2_dec_init_by_name(DEV_NAME_RK3288_DEC_NEW);
+    if (!obj_context->dec_ctx) {
+        obj_context->dec_ctx =
+            v4l2_dec_init_by_name(DEV_NAME_RK3288_DEC_LEGACY);
+        if (!obj_context->dec_ctx)
+            return VA_STATUS_ERROR_UNKNOWN;
+    }
+
+    obj_context->dec_ctx->width = obj_context->picture_width;
+    obj_context->dec_ctx->height = obj_context->picture_height;
+    obj_context->dec_ctx->coded_format = coded_format;
+    obj_context->streaming = 0;
+    memset(&obj_context->statistics, 0, sizeof(obj_context->statistics));
+    gettimeofday(&obj_context->statistics.tm, NULL);
+
+    if (v4l2_dec_s_fmt(obj_context->dec_ctx) < 0 ||
+            v4l2_dec_reqbufs(obj_context->dec_ctx,
+                obj_context->num_render_targets) < 0) {
+        rockchip_codec_close_decoder(ctx, obj_context);
+        return VA_STATUS_ERROR_UNKNOWN;
+    }
+
+    rockchip_codec_share_frames(ctx, obj_context);
+
+    return VA_STATUS_SUCCESS;
+}
+
+void rockchip_codec_close_decoder(VADriverContextP ctx,
+        object_context_p obj_context)
+{
+    if (!obj_context->dec_ctx)
+        return;
+
+    v4l2_dec_streamoff(obj_context->dec_ctx);
+    rockchip_codec_unshare_frames(ctx, obj_context);
+    v4l2_dec_deinit(obj_context->dec_ctx);
+    obj_context->dec_ctx = NULL;
+}
+
+VAStatus rockchip_codec_begin_frame(VADriverContextP ctx,
+        object_context_p obj_context, VASurfaceID render_target,
+        int *frame_index, int *bitstream)
+{
+    INIT_DRIVER_DATA
+    object_surface_p obj_surface;
+    int index;
+
+    obj_surface = SURFACE(render_target);
+    ASSERT(obj_surface);
+
+    index = rockchip_codec_frame_index(obj_context, render_target);
+    if (index < 0)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+
+    /* Decoding into a surface again before it was synced */
+    if (obj_context->dec_ctx->frame_queued[index])
+        rockchip_codec_collect_frame(ctx, render_target);
+
+    *bitstream = v4l2_dec_get_bitstream(obj_context->dec_ctx);
+    if (*bitstream < 0)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    *frame_index = index;
+
+    obj_context->current_render_target = obj_surface->base.id;
+    obj_surface->context_id = obj_context->context_id;
+    obj_surface->stats.valid = 0;
+    obj_surface->upload_valid = 0;
+
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus rockchip_codec_decode_frame(object_context_p obj_context,
+        int frame_index, int bitstream, int size,
+        struct v4l2_ext_control *ctrls, int count)
+{
+    dec_context_p dec_ctx = obj_context->dec_ctx;
+    /* Store 0 is the current one, each bitstream buffer has its own */
+    __u32 config_store = bitstream + 1;
+
+    if (!obj_context->streaming) {
+        if (v4l2_dec_streamon(dec_ctx) < 0)
+            return VA_STATUS_ERROR_UNKNOWN;
+
+        obj_context->streaming = 1;
+    }
+
+    if (v4l2_dec_s_ext_ctrls(dec_ctx, config_store, ctrls, count) < 0)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    if (v4l2_dec_qbuf_frame(dec_ctx, frame_index) < 0)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    if (v4l2_dec_qbuf_bitstream(dec_ctx, bitstream, size, config_store) < 0)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    rockchip_codec_statistics(obj_context, size);
+
+    obj_context->current_render_target = -1;
+
+    return VA_STATUS_SUCCESS;
+}
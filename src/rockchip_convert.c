@@ -0,0 +1,1050 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "rockchip_convert.h"
+
+#define ROW_ALIGN(n)        (((n) + 15) & ~15)
+
+/**
+ * Limited range BT.601 and BT.709. YUV to RGB in 6 bit fixed point, the
+ * luma gain of 1.164 being 74.5 for both; RGB to YUV in 8 bit fixed point.
+ */
+struct convert_matrix {
+    short   rv, gu, gv, bu;
+    short   yr, yg, yb;
+    short   ur, ug, ub;
+    short   vr, vg, vb;
+};
+
+static const convert_matrix_t convert_bt601 = {
+    102, 25, 52, 129,
+    66, 129, 25,
+    -38, -74, 112,
+    112, -94, -18,
+};
+
+static const convert_matrix_t convert_bt709 = {
+    115, 14, 34, 135,
+    47, 157, 16,
+    -26, -86, 112,
+    112, -102, -10,
+};
+
+static inline unsigned char convert_clamp(int value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static inline unsigned char convert_luma(int r, int g, int b,
+        const convert_matrix_t *m)
+{
+    return ((m->yr * r + m->yg * g + m->yb * b + 128) >> 8) + 16;
+}
+
+/**
+ * Layout of a picture, and which of its planes holds Y, U and V. Returns
+ * the number of planes, 0 for formats that are not supported.
+ */
+static int convert_image_format(const VAImage *image,
+        convert_format_p format, int *plane)
+{
+    static const int rgba[4] = { 0, 1, 2, 3 };
+    static const int bgra[4] = { 2, 1, 0, 3 };
+
+    memset(format, 0, sizeof(*format));
+
+    switch (image->format.fourcc) {
+    case VA_FOURCC_NV12:
+        format->layout = CONVERT_YUV_SEMIPLANAR;
+        plane[0] = 0;
+        plane[1] = 1;
+        return 2;
+#ifdef VA_FOURCC_I420
+    case VA_FOURCC_I420:
+#endif
+    case VA_FOURCC_IYUV:
+        format->layout = CONVERT_YUV_PLANAR;
+        plane[0] = 0;
+        plane[1] = 1;
+        plane[2] = 2;
+        return 3;
+    case VA_FOURCC_YV12:
+        format->layout = CONVERT_YUV_PLANAR;
+        plane[0] = 0;
+        plane[1] = 2;
+        plane[2] = 1;
+        return 3;
+    case VA_FOURCC_RGBA:
+    case VA_FOURCC_RGBX:
+        format->layout = CONVERT_RGB32;
+        memcpy(format->order, rgba, sizeof(rgba));
+        format->alpha = image->format.fourcc == VA_FOURCC_RGBA;
+        plane[0] = 0;
+        return 1;
+    case VA_FOURCC_BGRA:
+    case VA_FOURCC_BGRX:
+        format->layout = CONVERT_RGB32;
+        memcpy(format->order, bgra, sizeof(bgra));
+        format->alpha = image->format.fourcc == VA_FOURCC_BGRA;
+        plane[0] = 0;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int convert_rect(VARectangle *out, const VARectangle *rect,
+        const VAImage *image)
+{
+    if (!rect) {
+        out->x = 0;
+        out->y = 0;
+        out->width = image->width;
+        out->height = image->height;
+        return 0;
+    }
+
+    if (rect->x < 0 || rect->y < 0 || !rect->width || !rect->height ||
+            rect->x + rect->width > image->width ||
+            rect->y + rect->height > image->height)
+        return -1;
+
+    *out = *rect;
+
+    return 0;
+}
+
+static int convert_filter_init(convert_filter_p f, int src_len, int dst_len)
+{
+    double scale = (double) src_len / dst_len;
+    double support = scale > 1 ? scale : 1;
+    int taps, i, k;
+
+    memset(f, 0, sizeof(*f));
+
+    if (src_len == dst_len) {
+        f->identity = 1;
+        return 0;
+    }
+
+    taps = 2 * (int) ceil(support) + 1;
+    if (taps > src_len)
+        taps = src_len;
+    if (taps > CONVERT_MAX_TAPS)
+        return -1;
+
+    f->taps = taps;
+    f->start = malloc(dst_len * sizeof(*f->start));
+    f->weight = malloc(dst_len * taps * sizeof(*f->weight));
+    if (!f->start || !f->weight)
+        return -1;
+
+    for (i = 0; i < dst_len; i++) {
+        double center = (i + 0.5) * scale - 0.5;
+        int left = (int) floor(center - support) + 1;
+        int start = left;
+        double w[CONVERT_MAX_TAPS], total = 0;
+        short *weight = f->weight + i * taps;
+        int sum = 0, largest = 0;
+
+        if (start > src_len - taps)
+            start = src_len - taps;
+        if (start < 0)
+            start = 0;
+
+        /* Taps past an edge fold onto the edge pixel */
+        memset(w, 0, sizeof(w));
+        for (k = left; k < left + taps; k++) {
+            double weight = 1 - fabs(k - center) / support;
+            int j = k < 0 ? 0 : k >= src_len ? src_len - 1 : k;
+
+            if (weight <= 0)
+                continue;
+            w[j - start] += weight;
+            total += weight;
+        }
+
+        for (k = 0; k < taps; k++) {
+            weight[k] = lrint(w[k] * 256 / total);
+            sum += weight[k];
+            if (weight[k] > weight[largest])
+                largest = k;
+        }
+        weight[largest] += 256 - sum;
+
+        f->start[i] = start;
+    }
+
+    return 0;
+}
+
+static void convert_filter_deinit(convert_filter_p f)
+{
+    free(f->start);
+    free(f->weight);
+    f->start = NULL;
+    f->weight = NULL;
+}
+
+static void convert_hfilter(unsigned char *dst, const unsigned char *src,
+        const convert_filter_t *f, int width, int channels)
+{
+    int x, c, k;
+
+    for (x = 0; x < width; x++) {
+        const unsigned char *s = src + f->start[x] * channels;
+        const short *w = f->weight + x * f->taps;
+
+        for (c = 0; c < channels; c++) {
+            int sum = 128;
+
+            for (k = 0; k < f->taps; k++)
+                sum += s[k * channels + c] * w[k];
+            *dst++ = sum >> 8;
+        }
+    }
+}
+
+/**
+ * Weighted sum of rows, n bytes each. The weights add up to 256, a single
+ * one may be 256 itself, so the products take 16 bit lanes but the sums
+ * still fit 16 bits.
+ */
+static void convert_vfilter(unsigned char *dst, const unsigned char **rows,
+        const short *weight, int taps, int n)
+{
+    int x = 0, k;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; x + 16 <= n; x += 16) {
+        uint16x8_t lo = vdupq_n_u16(128);
+        uint16x8_t hi = vdupq_n_u16(128);
+
+        for (k = 0; k < taps; k++) {
+            uint8x16_t pix = vld1q_u8(rows[k] + x);
+
+            lo = vmlaq_n_u16(lo, vmovl_u8(vget_low_u8(pix)), weight[k]);
+            hi = vmlaq_n_u16(hi, vmovl_u8(vget_high_u8(pix)), weight[k]);
+        }
+
+        vst1q_u8(dst + x, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+    }
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+
+    for (; x + 16 <= n; x += 16) {
+        __m128i lo = _mm_set1_epi16(128);
+        __m128i hi = _mm_set1_epi16(128);
+
+        for (k = 0; k < taps; k++) {
+            __m128i pix = _mm_loadu_si128((const __m128i *) (rows[k] + x));
+            __m128i w = _mm_set1_epi16(weight[k]);
+
+            lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(pix, zero), w));
+            hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(pix, zero), w));
+        }
+
+        _mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(
+                    _mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+#endif
+
+    for (; x < n; x++) {
+        unsigned int sum = 128;
+
+        for (k = 0; k < taps; k++)
+            sum += rows[k][x] * weight[k];
+        dst[x] = sum >> 8;
+    }
+}
+
+static void convert_deinterleave(unsigned char *u, unsigned char *v,
+        const unsigned char *uv, int n)
+{
+    int i = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t pix = vld2q_u8(uv + 2 * i);
+
+        vst1q_u8(u + i, pix.val[0]);
+        vst1q_u8(v + i, pix.val[1]);
+    }
+#elif defined(__SSE2__)
+    __m128i mask = _mm_set1_epi16(0xff);
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (uv + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (uv + 2 * i + 16));
+
+        _mm_storeu_si128((__m128i *) (u + i), _mm_packus_epi16(
+                    _mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *) (v + i), _mm_packus_epi16(
+                    _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#endif
+
+    for (; i < n; i++) {
+        u[i] = uv[2 * i];
+        v[i] = uv[2 * i + 1];
+    }
+}
+
+static void convert_interleave(unsigned char *uv, const unsigned char *u,
+        const unsigned char *v, int n)
+{
+    int i = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t pix;
+
+        pix.val[0] = vld1q_u8(u + i);
+        pix.val[1] = vld1q_u8(v + i);
+        vst2q_u8(uv + 2 * i, pix);
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (u + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (v + i));
+
+        _mm_storeu_si128((__m128i *) (uv + 2 * i), _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i *) (uv + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+    }
+#endif
+
+    for (; i < n; i++) {
+        uv[2 * i] = u[i];
+        uv[2 * i + 1] = v[i];
+    }
+}
+
+/**
+ * One row of RGB pixels from a luma row and a chroma row of half the
+ * width. The vector paths saturate where the plain one clamps, which
+ * gives the same pixels.
+ */
+static void convert_yuv_to_rgb(unsigned char *dst, const unsigned char *y,
+        const unsigned char *u, const unsigned char *v, int width,
+        const convert_matrix_t *m, const int *order)
+{
+    int x = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t luma = vld1q_u8(y + x);
+        uint8x8_t cu = vld1_u8(u + x / 2);
+        uint8x8_t cv = vld1_u8(v + x / 2);
+        uint8x8x2_t du = vzip_u8(cu, cu);
+        uint8x8x2_t dv = vzip_u8(cv, cv);
+        uint8x8_t r[2], g[2], b[2];
+        uint8x16x4_t pix;
+        int h;
+
+        for (h = 0; h < 2; h++) {
+            uint8x8_t l8 = h ? vget_high_u8(luma) : vget_low_u8(luma);
+            int16x8_t c = vreinterpretq_s16_u16(vsubl_u8(l8, vdup_n_u8(16)));
+            int16x8_t d = vreinterpretq_s16_u16(vsubl_u8(du.val[h], vdup_n_u8(128)));
+            int16x8_t e = vreinterpretq_s16_u16(vsubl_u8(dv.val[h], vdup_n_u8(128)));
+            int16x8_t l = vaddq_s16(vmulq_n_s16(c, 74), vshrq_n_s16(c, 1));
+
+            r[h] = vqrshrun_n_s16(vqaddq_s16(l, vmulq_n_s16(e, m->rv)), 6);
+            g[h] = vqrshrun_n_s16(vqsubq_s16(vqsubq_s16(l,
+                            vmulq_n_s16(d, m->gu)), vmulq_n_s16(e, m->gv)), 6);
+            b[h] = vqrshrun_n_s16(vqaddq_s16(l, vmulq_n_s16(d, m->bu)), 6);
+        }
+
+        pix.val[order[0]] = vcombine_u8(r[0], r[1]);
+        pix.val[order[1]] = vcombine_u8(g[0], g[1]);
+        pix.val[order[2]] = vcombine_u8(b[0], b[1]);
+        pix.val[order[3]] = vdupq_n_u8(0xff);
+        vst4q_u8(dst + 4 * x, pix);
+    }
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i round = _mm_set1_epi16(32);
+    __m128i k16 = _mm_set1_epi16(16);
+    __m128i k128 = _mm_set1_epi16(128);
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i c, d, e, l, r, g, b, lo, hi, ch[4];
+        int cu, cv;
+
+        memcpy(&cu, u + x / 2, 4);
+        memcpy(&cv, v + x / 2, 4);
+
+        c = _mm_sub_epi16(_mm_unpacklo_epi8(
+                    _mm_loadl_epi64((const __m128i *) (y + x)), zero), k16);
+        d = _mm_cvtsi32_si128(cu);
+        d = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(d, d), zero), k128);
+        e = _mm_cvtsi32_si128(cv);
+        e = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(e, e), zero), k128);
+        l = _mm_add_epi16(_mm_mullo_epi16(c, _mm_set1_epi16(74)),
+                _mm_srai_epi16(c, 1));
+
+        r = _mm_adds_epi16(l, _mm_mullo_epi16(e, _mm_set1_epi16(m->rv)));
+        g = _mm_subs_epi16(_mm_subs_epi16(l,
+                    _mm_mullo_epi16(d, _mm_set1_epi16(m->gu))),
+                _mm_mullo_epi16(e, _mm_set1_epi16(m->gv)));
+        b = _mm_adds_epi16(l, _mm_mullo_epi16(d, _mm_set1_epi16(m->bu)));
+        r = _mm_srai_epi16(_mm_adds_epi16(r, round), 6);
+        g = _mm_srai_epi16(_mm_adds_epi16(g, round), 6);
+        b = _mm_srai_epi16(_mm_adds_epi16(b, round), 6);
+
+        ch[order[0]] = _mm_packus_epi16(r, r);
+        ch[order[1]] = _mm_packus_epi16(g, g);
+        ch[order[2]] = _mm_packus_epi16(b, b);
+        ch[order[3]] = _mm_set1_epi8(-1);
+
+        lo = _mm_unpacklo_epi8(ch[0], ch[1]);
+        hi = _mm_unpacklo_epi8(ch[2], ch[3]);
+        _mm_storeu_si128((__m128i *) (dst + 4 * x), _mm_unpacklo_epi16(lo, hi));
+        _mm_storeu_si128((__m128i *) (dst + 4 * x + 16), _mm_unpackhi_epi16(lo, hi));
+    }
+#endif
+
+    for (; x < width; x++) {
+        int c = y[x] - 16, d = u[x / 2] - 128, e = v[x / 2] - 128;
+        int l = c * 74 + (c >> 1);
+        unsigned char *pix = dst + 4 * x;
+
+        pix[order[0]] = convert_clamp((l + m->rv * e + 32) >> 6);
+        pix[order[1]] = convert_clamp((l - m->gu * d - m->gv * e + 32) >> 6);
+        pix[order[2]] = convert_clamp((l + m->bu * d + 32) >> 6);
+        pix[order[3]] = 0xff;
+    }
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+static inline uint8x16_t convert_luma_neon(uint8x16_t r, uint8x16_t g,
+        uint8x16_t b, const convert_matrix_t *m)
+{
+    uint16x8_t lo = vmull_u8(vget_low_u8(r), vdup_n_u8(m->yr));
+    uint16x8_t hi = vmull_u8(vget_high_u8(r), vdup_n_u8(m->yr));
+
+    lo = vmlal_u8(lo, vget_low_u8(g), vdup_n_u8(m->yg));
+    hi = vmlal_u8(hi, vget_high_u8(g), vdup_n_u8(m->yg));
+    lo = vmlal_u8(lo, vget_low_u8(b), vdup_n_u8(m->yb));
+    hi = vmlal_u8(hi, vget_high_u8(b), vdup_n_u8(m->yb));
+
+    return vaddq_u8(vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)),
+            vdupq_n_u8(16));
+}
+
+/* Average of 2x2 pixels of a component, as 8 signed lanes */
+static inline int16x8_t convert_average_neon(uint8x16_t a, uint8x16_t b)
+{
+    return vreinterpretq_s16_u16(vrshrq_n_u16(
+                vpadalq_u8(vpaddlq_u8(a), b), 2));
+}
+
+static inline uint8x8_t convert_chroma_neon(int16x8_t r, int16x8_t g,
+        int16x8_t b, short cr, short cg, short cb)
+{
+    int16x8_t c = vmlaq_n_s16(vmlaq_n_s16(vmulq_n_s16(r, cr), g, cg), b, cb);
+
+    return vqmovun_s16(vaddq_s16(vrshrq_n_s16(c, 8), vdupq_n_s16(128)));
+}
+#elif defined(__SSE2__)
+static inline __m128i convert_luma_sse2(const __m128i *c,
+        const convert_matrix_t *m)
+{
+    __m128i sum;
+
+    sum = _mm_add_epi16(_mm_mullo_epi16(c[0], _mm_set1_epi16(m->yr)),
+            _mm_mullo_epi16(c[1], _mm_set1_epi16(m->yg)));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(c[2], _mm_set1_epi16(m->yb)));
+    sum = _mm_add_epi16(_mm_srli_epi16(
+                _mm_add_epi16(sum, _mm_set1_epi16(128)), 8), _mm_set1_epi16(16));
+
+    return _mm_packus_epi16(sum, sum);
+}
+
+static inline int convert_chroma_sse2(const __m128i *c,
+        short cr, short cg, short cb)
+{
+    __m128i sum;
+
+    sum = _mm_add_epi16(_mm_mullo_epi16(c[0], _mm_set1_epi16(cr)),
+            _mm_mullo_epi16(c[1], _mm_set1_epi16(cg)));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(c[2], _mm_set1_epi16(cb)));
+    sum = _mm_add_epi16(_mm_srai_epi16(
+                _mm_add_epi16(sum, _mm_set1_epi16(128)), 8), _mm_set1_epi16(128));
+
+    return _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+}
+#endif
+
+/**
+ * Two luma rows and one chroma row from two rows of RGB pixels, width
+ * even. Chroma is taken from the average of each 2x2 block.
+ */
+static void convert_rgb_to_yuv(unsigned char *y0, unsigned char *y1,
+        unsigned char *u, unsigned char *v,
+        const unsigned char *rgb0, const unsigned char *rgb1, int width,
+        const convert_matrix_t *m, const int *order)
+{
+    int x = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t p0 = vld4q_u8(rgb0 + 4 * x);
+        uint8x16x4_t p1 = vld4q_u8(rgb1 + 4 * x);
+        int16x8_t r, g, b;
+
+        vst1q_u8(y0 + x, convert_luma_neon(p0.val[order[0]],
+                    p0.val[order[1]], p0.val[order[2]], m));
+        vst1q_u8(y1 + x, convert_luma_neon(p1.val[order[0]],
+                    p1.val[order[1]], p1.val[order[2]], m));
+
+        r = convert_average_neon(p0.val[order[0]], p1.val[order[0]]);
+        g = convert_average_neon(p0.val[order[1]], p1.val[order[1]]);
+        b = convert_average_neon(p0.val[order[2]], p1.val[order[2]]);
+        vst1_u8(u + x / 2, convert_chroma_neon(r, g, b, m->ur, m->ug, m->ub));
+        vst1_u8(v + x / 2, convert_chroma_neon(r, g, b, m->vr, m->vg, m->vb));
+    }
+#elif defined(__SSE2__)
+    __m128i mask = _mm_set1_epi32(0xff);
+    __m128i one = _mm_set1_epi16(1);
+    __m128i two = _mm_set1_epi32(2);
+    __m128i zero = _mm_setzero_si128();
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *) (rgb0 + 4 * x));
+        __m128i b0 = _mm_loadu_si128((const __m128i *) (rgb0 + 4 * x + 16));
+        __m128i a1 = _mm_loadu_si128((const __m128i *) (rgb1 + 4 * x));
+        __m128i b1 = _mm_loadu_si128((const __m128i *) (rgb1 + 4 * x + 16));
+        __m128i c0[3], c1[3], avg[3];
+        int i, chroma;
+
+        for (i = 0; i < 3; i++) {
+            __m128i shift = _mm_cvtsi32_si128(8 * order[i]);
+
+            c0[i] = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(a0, shift), mask),
+                    _mm_and_si128(_mm_srl_epi32(b0, shift), mask));
+            c1[i] = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(a1, shift), mask),
+                    _mm_and_si128(_mm_srl_epi32(b1, shift), mask));
+            avg[i] = _mm_madd_epi16(_mm_add_epi16(c0[i], c1[i]), one);
+            avg[i] = _mm_packs_epi32(_mm_srli_epi32(
+                        _mm_add_epi32(avg[i], two), 2), zero);
+        }
+
+        _mm_storel_epi64((__m128i *) (y0 + x), convert_luma_sse2(c0, m));
+        _mm_storel_epi64((__m128i *) (y1 + x), convert_luma_sse2(c1, m));
+
+        chroma = convert_chroma_sse2(avg, m->ur, m->ug, m->ub);
+        memcpy(u + x / 2, &chroma, 4);
+        chroma = convert_chroma_sse2(avg, m->vr, m->vg, m->vb);
+        memcpy(v + x / 2, &chroma, 4);
+    }
+#endif
+
+    for (; x < width; x += 2) {
+        const unsigned char *pix[4] = {
+            rgb0 + 4 * x, rgb0 + 4 * x + 4, rgb1 + 4 * x, rgb1 + 4 * x + 4,
+        };
+        int r = 0, g = 0, b = 0, i;
+
+        for (i = 0; i < 4; i++) {
+            unsigned char *luma = (i < 2 ? y0 : y1) + x + (i & 1);
+
+            *luma = convert_luma(pix[i][order[0]], pix[i][order[1]],
+                    pix[i][order[2]], m);
+            r += pix[i][order[0]];
+            g += pix[i][order[1]];
+            b += pix[i][order[2]];
+        }
+        r = (r + 2) >> 2;
+        g = (g + 2) >> 2;
+        b = (b + 2) >> 2;
+
+        u[x / 2] = ((m->ur * r + m->ug * g + m->ub * b + 128) >> 8) + 128;
+        v[x / 2] = ((m->vr * r + m->vg * g + m->vb * b + 128) >> 8) + 128;
+    }
+}
+
+static void convert_rgb_swizzle(unsigned char *dst, const unsigned char *src,
+        int width, const convert_format_t *from, const convert_format_t *to)
+{
+    int x, i;
+
+    for (x = 0; x < width; x++, src += 4, dst += 4) {
+        for (i = 0; i < 3; i++)
+            dst[to->order[i]] = src[from->order[i]];
+        dst[to->order[3]] = from->alpha ? src[from->order[3]] : 0xff;
+    }
+}
+
+VAStatus rockchip_convert_init(convert_job_p job,
+        const VAImage *src, const unsigned char *src_data,
+        const VARectangle *src_rect, int src_bt709,
+        const VAImage *dst, unsigned char *dst_data,
+        const VARectangle *dst_rect, int dst_bt709,
+        const unsigned int *background)
+{
+    const convert_matrix_t *matrix;
+    VARectangle s, d;
+    int src_plane[3], dst_plane[3];
+    int src_yuv, dst_yuv, num_dst, i;
+    int r, g, b;
+
+    memset(job, 0, sizeof(*job));
+
+    job->num_planes = convert_image_format(src, &job->src_format, src_plane);
+    num_dst = convert_image_format(dst, &job->dst_format, dst_plane);
+    if (!job->num_planes || !num_dst)
+        return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+
+    if (convert_rect(&s, src_rect, src) || convert_rect(&d, dst_rect, dst))
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    src_yuv = job->src_format.layout != CONVERT_RGB32;
+    dst_yuv = job->dst_format.layout != CONVERT_RGB32;
+
+    /* The output region of 4:2:0 pictures starts and ends on chroma */
+    if (dst_yuv) {
+        int x1 = (d.x + d.width) & ~1;
+        int y1 = (d.y + d.height) & ~1;
+
+        d.x &= ~1;
+        d.y &= ~1;
+        if (x1 <= d.x || y1 <= d.y)
+            return VA_STATUS_ERROR_INVALID_PARAMETER;
+        d.width = x1 - d.x;
+        d.height = y1 - d.y;
+    }
+
+    if (s.width > d.width * CONVERT_MAX_DOWNSCALE ||
+            s.height > d.height * CONVERT_MAX_DOWNSCALE)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    job->x = d.x;
+    job->y = d.y;
+    job->width = d.width;
+    job->height = d.height;
+    job->dst_width = dst->width;
+    job->dst_height = dst->height;
+    job->fill = background && (d.x || d.y || d.width != dst->width ||
+        d.height != dst->height);
+
+    for (i = 0; i < num_dst; i++) {
+        job->dst[i] = dst_data + dst->offsets[dst_plane[i]];
+        job->dst_pitch[i] = dst->pitches[dst_plane[i]];
+    }
+
+    /* YUV to YUV keeps the values, whatever the two standards */
+    job->matrix = (src_yuv && !dst_yuv ? src_bt709 : dst_bt709) ?
+        &convert_bt709 : &convert_bt601;
+
+    for (i = 0; i < job->num_planes; i++) {
+        convert_plane_p plane = &job->planes[i];
+        int sub = i > 0;
+        int sx = s.x >> sub;
+        int sy = s.y >> sub;
+        int sw = ((s.x + s.width + sub) >> sub) - sx;
+        int sh = ((s.y + s.height + sub) >> sub) - sy;
+        int pitch = src->pitches[src_plane[i]];
+
+        if (!src_yuv)
+            plane->channels = 4;
+        else if (job->src_format.layout == CONVERT_YUV_SEMIPLANAR && i == 1)
+            plane->channels = 2;
+        else
+            plane->channels = 1;
+
+        plane->src = src_data + src->offsets[src_plane[i]] + sy * pitch +
+            sx * plane->channels;
+        plane->src_pitch = pitch;
+        plane->width = (d.width + sub) >> sub;
+        plane->height = (d.height + sub) >> sub;
+
+        if (convert_filter_init(&plane->h, sw, plane->width) ||
+                convert_filter_init(&plane->v, sh, plane->height)) {
+            rockchip_convert_deinit(job);
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+
+        job->row_bytes[i] = ROW_ALIGN(plane->width * plane->channels);
+        if (!plane->h.identity && !plane->v.identity)
+            job->ring_size[i] = plane->v.taps;
+        job->scratch_size += job->ring_size[i] * job->row_bytes[i];
+    }
+
+    job->tmp_bytes = ROW_ALIGN(d.width * 4);
+    job->scratch_size += 6 * job->tmp_bytes;
+
+    if (!job->fill)
+        return VA_STATUS_SUCCESS;
+
+    r = (*background >> 16) & 0xff;
+    g = (*background >> 8) & 0xff;
+    b = *background & 0xff;
+    if (dst_yuv) {
+        matrix = dst_bt709 ? &convert_bt709 : &convert_bt601;
+        job->background[0] = convert_luma(r, g, b, matrix);
+        job->background[1] = ((matrix->ur * r + matrix->ug * g +
+                    matrix->ub * b + 128) >> 8) + 128;
+        job->background[2] = ((matrix->vr * r + matrix->vg * g +
+                    matrix->vb * b + 128) >> 8) + 128;
+    } else {
+        job->background[job->dst_format.order[0]] = r;
+        job->background[job->dst_format.order[1]] = g;
+        job->background[job->dst_format.order[2]] = b;
+        job->background[job->dst_format.order[3]] =
+            job->dst_format.alpha ? *background >> 24 : 0xff;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+void rockchip_convert_deinit(convert_job_p job)
+{
+    int i;
+
+    for (i = 0; i < job->num_planes; i++) {
+        convert_filter_deinit(&job->planes[i].h);
+        convert_filter_deinit(&job->planes[i].v);
+    }
+}
+
+static int convert_scratch_init(convert_job_p job, convert_scratch_p s)
+{
+    unsigned char *p;
+    int i, j;
+
+    if (s->size < job->scratch_size) {
+        free(s->buffer);
+        s->buffer = malloc(job->scratch_size);
+        s->size = s->buffer ? job->scratch_size : 0;
+        if (!s->buffer)
+            return -1;
+    }
+
+    p = s->buffer;
+    for (i = 0; i < job->num_planes; i++) {
+        s->ring[i] = p;
+        p += job->ring_size[i] * job->row_bytes[i];
+        for (j = 0; j < job->ring_size[i]; j++)
+            s->ring_row[i][j] = -1;
+    }
+    for (i = 0; i < 6; i++) {
+        s->tmp[i] = p;
+        p += job->tmp_bytes;
+    }
+    s->chroma_row = -1;
+
+    return 0;
+}
+
+void rockchip_convert_scratch_free(convert_scratch_p s)
+{
+    free(s->buffer);
+    s->buffer = NULL;
+    s->size = 0;
+}
+
+static const unsigned char *convert_hrow(convert_plane_p plane,
+        unsigned char *out, int row)
+{
+    const unsigned char *src = plane->src + row * plane->src_pitch;
+
+    if (plane->h.identity)
+        return src;
+
+    convert_hfilter(out, src, &plane->h, plane->width, plane->channels);
+
+    return out;
+}
+
+/**
+ * Row of a plane scaled both ways, put in out unless it is a source row
+ * as it is. Horizontally scaled source rows stay in a ring for the next
+ * output rows that need them.
+ */
+static const unsigned char *convert_scaled_row(convert_job_p job,
+        convert_scratch_p s, int p, int row, unsigned char *out)
+{
+    convert_plane_p plane = &job->planes[p];
+    const unsigned char *rows[CONVERT_MAX_TAPS];
+    short weight[CONVERT_MAX_TAPS];
+    const short *w;
+    int start, taps = 0, k;
+
+    if (plane->v.identity)
+        return convert_hrow(plane, out, row);
+
+    start = plane->v.start[row];
+    w = plane->v.weight + row * plane->v.taps;
+
+    for (k = 0; k < plane->v.taps; k++) {
+        int src_row = start + k;
+
+        if (!w[k])
+            continue;
+        if (w[k] == 256)
+            return convert_hrow(plane, out, src_row);
+
+        if (plane->h.identity) {
+            rows[taps] = plane->src + src_row * plane->src_pitch;
+        } else {
+            int slot = src_row % job->ring_size[p];
+            unsigned char *line = s->ring[p] + slot * job->row_bytes[p];
+
+            if (s->ring_row[p][slot] != src_row) {
+                convert_hrow(plane, line, src_row);
+                s->ring_row[p][slot] = src_row;
+            }
+            rows[taps] = line;
+        }
+        weight[taps++] = w[k];
+    }
+
+    convert_vfilter(out, rows, weight, taps, plane->width * plane->channels);
+
+    return out;
+}
+
+static void convert_fill(unsigned char *dst, const unsigned char *pixel,
+        int size, int n)
+{
+    int i;
+
+    if (size == 1) {
+        memset(dst, pixel[0], n);
+        return;
+    }
+
+    for (i = 0; i < n; i++, dst += size)
+        memcpy(dst, pixel, size);
+}
+
+/* Background over pixels [x0, x1) of a destination row */
+static void convert_fill_row(convert_job_p job, int y, int x0, int x1)
+{
+    const unsigned char *bg = job->background;
+
+    if (x1 <= x0)
+        return;
+
+    if (job->dst_format.layout == CONVERT_RGB32) {
+        convert_fill(job->dst[0] + y * job->dst_pitch[0] + x0 * 4, bg, 4,
+                x1 - x0);
+        return;
+    }
+
+    convert_fill(job->dst[0] + y * job->dst_pitch[0] + x0, bg, 1, x1 - x0);
+    if (y & 1)
+        return;
+
+    y /= 2;
+    x0 /= 2;
+    x1 = (x1 + 1) / 2;
+    if (job->dst_format.layout == CONVERT_YUV_SEMIPLANAR) {
+        convert_fill(job->dst[1] + y * job->dst_pitch[1] + x0 * 2, bg + 1, 2,
+                x1 - x0);
+    } else {
+        convert_fill(job->dst[1] + y * job->dst_pitch[1] + x0, bg + 1, 1,
+                x1 - x0);
+        convert_fill(job->dst[2] + y * job->dst_pitch[2] + x0, bg + 2, 1,
+                x1 - x0);
+    }
+}
+
+/* YUV to YUV: scale the planes, repack the chroma between layouts */
+static void convert_yuv_row(convert_job_p job, convert_scratch_p s,
+        int y, int row)
+{
+    unsigned char *dst = job->dst[0] + y * job->dst_pitch[0] + job->x;
+    int cw = job->planes[1].width;
+    const unsigned char *src, *u, *v;
+    int i;
+
+    src = convert_scaled_row(job, s, 0, row, dst);
+    if (src != dst)
+        memcpy(dst, src, job->width);
+
+    if (row & 1)
+        return;
+
+    y /= 2;
+    row /= 2;
+
+    if (job->src_format.layout == job->dst_format.layout) {
+        for (i = 1; i < job->num_planes; i++) {
+            int channels = job->planes[i].channels;
+
+            dst = job->dst[i] + y * job->dst_pitch[i] + job->x / 2 * channels;
+            src = convert_scaled_row(job, s, i, row, dst);
+            if (src != dst)
+                memcpy(dst, src, cw * channels);
+        }
+    } else if (job->src_format.layout == CONVERT_YUV_SEMIPLANAR) {
+        src = convert_scaled_row(job, s, 1, row, s->tmp[2]);
+        convert_deinterleave(job->dst[1] + y * job->dst_pitch[1] + job->x / 2,
+                job->dst[2] + y * job->dst_pitch[2] + job->x / 2, src, cw);
+    } else {
+        u = convert_scaled_row(job, s, 1, row, s->tmp[2]);
+        v = convert_scaled_row(job, s, 2, row, s->tmp[3]);
+        convert_interleave(job->dst[1] + y * job->dst_pitch[1] + job->x,
+                u, v, cw);
+    }
+}
+
+static void convert_yuv_to_rgb_row(convert_job_p job, convert_scratch_p s,
+        int y, int row)
+{
+    unsigned char *dst = job->dst[0] + y * job->dst_pitch[0] + job->x * 4;
+    const unsigned char *luma;
+
+    luma = convert_scaled_row(job, s, 0, row, s->tmp[0]);
+
+    /* Both rows of a chroma row use it */
+    if (s->chroma_row != row / 2) {
+        s->chroma_row = row / 2;
+        if (job->src_format.layout == CONVERT_YUV_SEMIPLANAR) {
+            const unsigned char *uv;
+
+            uv = convert_scaled_row(job, s, 1, row / 2, s->tmp[2]);
+            convert_deinterleave(s->tmp[4], s->tmp[5], uv,
+                    job->planes[1].width);
+            s->chroma[0] = s->tmp[4];
+            s->chroma[1] = s->tmp[5];
+        } else {
+            s->chroma[0] = convert_scaled_row(job, s, 1, row / 2, s->tmp[2]);
+            s->chroma[1] = convert_scaled_row(job, s, 2, row / 2, s->tmp[3]);
+        }
+    }
+
+    convert_yuv_to_rgb(dst, luma, s->chroma[0], s->chroma[1], job->width,
+            job->matrix, job->dst_format.order);
+}
+
+/* Both rows of a chroma row at once, row even */
+static void convert_rgb_to_yuv_rows(convert_job_p job, convert_scratch_p s,
+        int y, int row)
+{
+    unsigned char *y0 = job->dst[0] + y * job->dst_pitch[0] + job->x;
+    const unsigned char *rgb0, *rgb1;
+    unsigned char *u, *v;
+
+    rgb0 = convert_scaled_row(job, s, 0, row, s->tmp[0]);
+    rgb1 = convert_scaled_row(job, s, 0, row + 1, s->tmp[1]);
+
+    y /= 2;
+    if (job->dst_format.layout == CONVERT_YUV_SEMIPLANAR) {
+        u = s->tmp[4];
+        v = s->tmp[5];
+    } else {
+        u = job->dst[1] + y * job->dst_pitch[1] + job->x / 2;
+        v = job->dst[2] + y * job->dst_pitch[2] + job->x / 2;
+    }
+
+    convert_rgb_to_yuv(y0, y0 + job->dst_pitch[0], u, v, rgb0, rgb1,
+            job->width, job->matrix, job->src_format.order);
+
+    if (job->dst_format.layout == CONVERT_YUV_SEMIPLANAR)
+        convert_interleave(job->dst[1] + y * job->dst_pitch[1] + job->x,
+                u, v, job->width / 2);
+}
+
+static void convert_rgb_row(convert_job_p job, convert_scratch_p s,
+        int y, int row)
+{
+    unsigned char *dst = job->dst[0] + y * job->dst_pitch[0] + job->x * 4;
+    const convert_format_t *from = &job->src_format;
+    const convert_format_t *to = &job->dst_format;
+    const unsigned char *src;
+    int copy;
+
+    copy = !memcmp(from->order, to->order, sizeof(from->order)) &&
+        (from->alpha || !to->alpha);
+
+    src = convert_scaled_row(job, s, 0, row, copy ? dst : s->tmp[0]);
+    if (!copy)
+        convert_rgb_swizzle(dst, src, job->width, from, to);
+    else if (src != dst)
+        memcpy(dst, src, job->width * 4);
+}
+
+int rockchip_convert_rows(convert_job_p job, convert_scratch_p scratch,
+        int y0, int y1)
+{
+    int src_yuv = job->src_format.layout != CONVERT_RGB32;
+    int dst_yuv = job->dst_format.layout != CONVERT_RGB32;
+    int y;
+
+    if (convert_scratch_init(job, scratch))
+        return -1;
+
+    if (y1 > job->dst_height)
+        y1 = job->dst_height;
+
+    for (y = y0; y < y1; y++) {
+        int row = y - job->y;
+
+        if (row < 0 || row >= job->height) {
+            if (job->fill)
+                convert_fill_row(job, y, 0, job->dst_width);
+            continue;
+        }
+
+        if (job->fill) {
+            convert_fill_row(job, y, 0, job->x);
+            convert_fill_row(job, y, job->x + job->width, job->dst_width);
+        }
+
+        if (src_yuv && dst_yuv)
+            convert_yuv_row(job, scratch, y, row);
+        else if (src_yuv)
+            convert_yuv_to_rgb_row(job, scratch, y, row);
+        else if (dst_yuv && !(row & 1))
+            convert_rgb_to_yuv_rows(job, scratch, y, row);
+        else if (!dst_yuv)
+            convert_rgb_row(job, scratch, y, row);
+    }
+
+    return 0;
+}
+
+VAStatus rockchip_convert(convert_job_p job)
+{
+    convert_scratch_t scratch;
+    int ret;
+
+    memset(&scratch, 0, sizeof(scratch));
+    ret = rockchip_convert_rows(job, &scratch, 0, job->dst_height);
+    rockchip_convert_scratch_free(&scratch);
+
+    return ret ? VA_STATUS_ERROR_ALLOCATION_FAILED : VA_STATUS_SUCCESS;
+}
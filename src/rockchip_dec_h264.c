@@ -0,0 +1,727 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rockchip_drv_video.h"
+
+/**
+ * H.264 decoding on the VPU decoder node. The node is stateless: the
+ * driver turns the VA parameter buffers into SPS, PPS, slice and decode
+ * controls, writes the slices into an OUTPUT buffer and picks the DPB
+ * entries and initial reference lists the hardware works from. Each
+ * render target decodes into the CAPTURE buffer of its index.
+ */
+
+/* Enough for a slice header with full prediction weight tables */
+#define SLICE_HEADER_MAX        1024
+
+/* Reference list entry pointing at no DPB entry */
+#define DPB_NO_ENTRY            0xff
+
+static const unsigned char start_code[3] = { 0, 0, 1 };
+
+static VAStatus rockchip_DeinitDecoder(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    rockchip_codec_close_decoder(ctx, obj_context);
+
+    LOG_DEINIT();
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_InitDecoder(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_config_p obj_config;
+    decode_params_h264_p params;
+    int width, height;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_config = CONFIG(obj_context->config_id);
+    ASSERT(obj_config);
+
+    width = obj_context->picture_width;
+    height = obj_context->picture_height;
+
+    /* Validate picture dimensions */
+    if (width < ROCKCHIP_MIN_WIDTH || width > ROCKCHIP_MAX_WIDTH ||
+            height < ROCKCHIP_MIN_HEIGHT || height > ROCKCHIP_MAX_HEIGHT)
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+
+    LOG_INIT();
+
+    params = &obj_context->h264_dec_params;
+    memset(params, 0, sizeof(*params));
+    switch (obj_config->profile) {
+    case VAProfileH264High:
+        params->profile_idc = 100;
+        break;
+    case VAProfileH264Main:
+        params->profile_idc = 77;
+        break;
+    default:
+        params->profile_idc = 66;
+        break;
+    }
+
+    LOG("h264 decode resolution:%dx%d, %d surfaces\n", width, height,
+            obj_context->num_render_targets);
+
+    return rockchip_codec_open_decoder(ctx, obj_context,
+            V4L2_PIX_FMT_H264_SLICE);
+}
+
+static VAStatus rockchip_PrepareDecode(
+        VADriverContextP ctx,
+        VAContextID context,
+        VASurfaceID render_target)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    decode_params_h264_p params;
+    VAStatus status;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    params = &obj_context->h264_dec_params;
+
+    status = rockchip_codec_begin_frame(ctx, obj_context, render_target,
+            &params->frame_index, &params->bitstream);
+    if (status != VA_STATUS_SUCCESS)
+        return status;
+
+    params->bitstream_size = 0;
+    params->num_slices = 0;
+    params->first_pending_slice = 0;
+    params->scaling_matrix_present = 0;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* Order count of a field, or of the field of a frame that comes first */
+static int rockchip_PictureOrderCount(VAPictureH264 *pic)
+{
+    if (pic->flags & VA_PICTURE_H264_TOP_FIELD)
+        return pic->TopFieldOrderCnt;
+    if (pic->flags & VA_PICTURE_H264_BOTTOM_FIELD)
+        return pic->BottomFieldOrderCnt;
+
+    return pic->TopFieldOrderCnt < pic->BottomFieldOrderCnt ?
+        pic->TopFieldOrderCnt : pic->BottomFieldOrderCnt;
+}
+
+/**
+ * Append the selected DPB entries to a reference list, in ascending key
+ * order. Returns the new list length.
+ */
+static int rockchip_AppendRefs(__u8 *list, int n, const int *keys,
+        const int *selected)
+{
+    int start = n;
+    int i, j;
+
+    for (i = 0; i < 16; i++) {
+        if (!selected[i])
+            continue;
+
+        for (j = n; j > start && keys[list[j - 1]] > keys[i]; j--)
+            list[j] = list[j - 1];
+        list[j] = i;
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * Initial reference lists of 8.2.4.2 for P and B frames. The hardware
+ * applies the slice modifications to them itself.
+ */
+static void rockchip_BuildRefLists(decode_params_h264_p params, int poc)
+{
+    struct v4l2_ctrl_h264_decode_param *dec = &params->decode_param;
+    int short_term[16], long_term[16], before[16], after[16];
+    int pic_num[16], pic_num_desc[16], poc_asc[16], poc_desc[16];
+    int i, n;
+
+    for (i = 0; i < 16; i++) {
+        struct v4l2_h264_dpb_entry *entry = &dec->dpb[i];
+        int active = entry->flags & V4L2_H264_DPB_ENTRY_FLAG_ACTIVE;
+        int is_long = entry->flags & V4L2_H264_DPB_ENTRY_FLAG_LONG_TERM;
+
+        /* Short term PicNum goes negative past a frame_num wrap */
+        pic_num[i] = (__s16) entry->pic_num;
+        pic_num_desc[i] = -pic_num[i];
+        poc_asc[i] = entry->top_field_order_cnt <
+            entry->bottom_field_order_cnt ?
+            entry->top_field_order_cnt : entry->bottom_field_order_cnt;
+        poc_desc[i] = -poc_asc[i];
+
+        short_term[i] = active && !is_long;
+        long_term[i] = active && is_long;
+        before[i] = short_term[i] && poc_asc[i] < poc;
+        after[i] = short_term[i] && poc_asc[i] > poc;
+    }
+
+    memset(dec->ref_pic_list_p0, DPB_NO_ENTRY, sizeof(dec->ref_pic_list_p0));
+    memset(dec->ref_pic_list_b0, DPB_NO_ENTRY, sizeof(dec->ref_pic_list_b0));
+    memset(dec->ref_pic_list_b1, DPB_NO_ENTRY, sizeof(dec->ref_pic_list_b1));
+
+    /* P: short term by descending PicNum, then long term ascending */
+    n = rockchip_AppendRefs(dec->ref_pic_list_p0, 0, pic_num_desc, short_term);
+    rockchip_AppendRefs(dec->ref_pic_list_p0, n, pic_num, long_term);
+
+    /* B list 0: closest earlier pictures first, then the later ones */
+    n = rockchip_AppendRefs(dec->ref_pic_list_b0, 0, poc_desc, before);
+    n = rockchip_AppendRefs(dec->ref_pic_list_b0, n, poc_asc, after);
+    rockchip_AppendRefs(dec->ref_pic_list_b0, n, pic_num, long_term);
+
+    /* B list 1: closest later pictures first, then the earlier ones */
+    n = rockchip_AppendRefs(dec->ref_pic_list_b1, 0, poc_asc, after);
+    n = rockchip_AppendRefs(dec->ref_pic_list_b1, n, poc_desc, before);
+    n = rockchip_AppendRefs(dec->ref_pic_list_b1, n, pic_num, long_term);
+
+    /* Lists longer than one entry must differ, swap the first two */
+    if (n > 1 && !memcmp(dec->ref_pic_list_b0, dec->ref_pic_list_b1, n)) {
+        __u8 tmp = dec->ref_pic_list_b1[0];
+
+        dec->ref_pic_list_b1[0] = dec->ref_pic_list_b1[1];
+        dec->ref_pic_list_b1[1] = tmp;
+    }
+}
+
+/* Entry of decode_param.dpb holding a VA reference picture */
+static __u8 rockchip_DpbEntry(decode_params_h264_p params, VAPictureH264 *pic)
+{
+    int i;
+
+    if (pic->flags & VA_PICTURE_H264_INVALID)
+        return DPB_NO_ENTRY;
+
+    for (i = 0; i < 16; i++) {
+        if (params->dpb_surface[i] == pic->picture_id)
+            return i;
+    }
+
+    return DPB_NO_ENTRY;
+}
+
+static VAStatus rockchip_ProcessPicture(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    decode_params_h264_p params = &obj_context->h264_dec_params;
+    struct v4l2_ctrl_h264_sps *sps = &params->sps;
+    struct v4l2_ctrl_h264_pps *pps = &params->pps;
+    struct v4l2_ctrl_h264_decode_param *dec = &params->decode_param;
+    h264_header_info_p header = &params->header;
+    VAPictureParameterBufferH264 *pic;
+    int max_frame_num, i;
+
+    if (obj_buffer->buffer_size != sizeof(*pic))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    pic = (VAPictureParameterBufferH264 *) obj_buffer->buffer_data;
+
+    if ((pic->picture_width_in_mbs_minus1 + 1) * 16 >
+            ((obj_context->picture_width + 15) & ~15) ||
+            (pic->picture_height_in_mbs_minus1 + 1) * 16 >
+            ((obj_context->picture_height + 15) & ~15))
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+
+    /* 8 bit 4:2:0 without slice groups */
+    if (pic->bit_depth_luma_minus8 || pic->bit_depth_chroma_minus8 ||
+            pic->seq_fields.bits.chroma_format_idc != 1 ||
+            pic->num_slice_groups_minus1)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    /**
+     * Only frames: the DPB entries carry one PicNum per frame, while field
+     * pictures number every reference field on its own, by parity.
+     */
+    if (pic->CurrPic.flags &
+            (VA_PICTURE_H264_TOP_FIELD | VA_PICTURE_H264_BOTTOM_FIELD)) {
+        LOG("h264 field pictures are not supported\n");
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(sps, 0, sizeof(*sps));
+    sps->profile_idc = params->profile_idc;
+    if (params->profile_idc == 66)
+        sps->constraint_set_flags = V4L2_H264_SPS_CONSTRAINT_SET1_FLAG;
+    sps->chroma_format_idc = pic->seq_fields.bits.chroma_format_idc;
+    sps->log2_max_frame_num_minus4 =
+        pic->seq_fields.bits.log2_max_frame_num_minus4;
+    sps->pic_order_cnt_type = pic->seq_fields.bits.pic_order_cnt_type;
+    sps->log2_max_pic_order_cnt_lsb_minus4 =
+        pic->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4;
+    sps->max_num_ref_frames = pic->num_ref_frames;
+    sps->pic_width_in_mbs_minus1 = pic->picture_width_in_mbs_minus1;
+    if (pic->seq_fields.bits.frame_mbs_only_flag) {
+        sps->pic_height_in_map_units_minus1 =
+            pic->picture_height_in_mbs_minus1;
+        sps->flags |= V4L2_H264_SPS_FLAG_FRAME_MBS_ONLY;
+    } else {
+        sps->pic_height_in_map_units_minus1 =
+            (pic->picture_height_in_mbs_minus1 + 1) / 2 - 1;
+    }
+    if (pic->seq_fields.bits.delta_pic_order_always_zero_flag)
+        sps->flags |= V4L2_H264_SPS_FLAG_DELTA_PIC_ORDER_ALWAYS_ZERO;
+    if (pic->seq_fields.bits.gaps_in_frame_num_value_allowed_flag)
+        sps->flags |= V4L2_H264_SPS_FLAG_GAPS_IN_FRAME_NUM_VALUE_ALLOWED;
+    if (pic->seq_fields.bits.mb_adaptive_frame_field_flag)
+        sps->flags |= V4L2_H264_SPS_FLAG_MB_ADAPTIVE_FRAME_FIELD;
+    if (pic->seq_fields.bits.direct_8x8_inference_flag)
+        sps->flags |= V4L2_H264_SPS_FLAG_DIRECT_8X8_INFERENCE;
+
+    memset(pps, 0, sizeof(*pps));
+    pps->weighted_bipred_idc = pic->pic_fields.bits.weighted_bipred_idc;
+    pps->pic_init_qp_minus26 = pic->pic_init_qp_minus26;
+    pps->pic_init_qs_minus26 = pic->pic_init_qs_minus26;
+    pps->chroma_qp_index_offset = pic->chroma_qp_index_offset;
+    pps->second_chroma_qp_index_offset = pic->second_chroma_qp_index_offset;
+    if (pic->pic_fields.bits.entropy_coding_mode_flag)
+        pps->flags |= V4L2_H264_PPS_FLAG_ENTROPY_CODING_MODE;
+    if (pic->pic_fields.bits.pic_order_present_flag)
+        pps->flags |= V4L2_H264_PPS_FLAG_BOTTOM_FIELD_PIC_ORDER_IN_FRAME_PRESENT;
+    if (pic->pic_fields.bits.weighted_pred_flag)
+        pps->flags |= V4L2_H264_PPS_FLAG_WEIGHTED_PRED;
+    if (pic->pic_fields.bits.deblocking_filter_control_present_flag)
+        pps->flags |= V4L2_H264_PPS_FLAG_DEBLOCKING_FILTER_CONTROL_PRESENT;
+    if (pic->pic_fields.bits.constrained_intra_pred_flag)
+        pps->flags |= V4L2_H264_PPS_FLAG_CONSTRAINED_INTRA_PRED;
+    if (pic->pic_fields.bits.redundant_pic_cnt_present_flag)
+        pps->flags |= V4L2_H264_PPS_FLAG_REDUNDANT_PIC_CNT_PRESENT;
+    if (pic->pic_fields.bits.transform_8x8_mode_flag)
+        pps->flags |= V4L2_H264_PPS_FLAG_TRANSFORM_8X8_MODE;
+
+    /* What the slice headers need to be walked */
+    memset(header, 0, sizeof(*header));
+    header->log2_max_frame_num =
+        pic->seq_fields.bits.log2_max_frame_num_minus4 + 4;
+    header->pic_order_cnt_type = pic->seq_fields.bits.pic_order_cnt_type;
+    header->log2_max_poc_lsb =
+        pic->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4 + 4;
+    header->delta_pic_order_always_zero =
+        pic->seq_fields.bits.delta_pic_order_always_zero_flag;
+    header->frame_mbs_only = pic->seq_fields.bits.frame_mbs_only_flag;
+    header->chroma_format_idc = pic->seq_fields.bits.chroma_format_idc;
+    header->pic_init_qp = pic->pic_init_qp_minus26 + 26;
+    header->pic_order_present = pic->pic_fields.bits.pic_order_present_flag;
+    header->redundant_pic_cnt_present =
+        pic->pic_fields.bits.redundant_pic_cnt_present_flag;
+    header->weighted_pred = pic->pic_fields.bits.weighted_pred_flag;
+    header->weighted_bipred_idc = pic->pic_fields.bits.weighted_bipred_idc;
+    header->entropy_coding_mode =
+        pic->pic_fields.bits.entropy_coding_mode_flag;
+    header->deblocking_filter_control_present =
+        pic->pic_fields.bits.deblocking_filter_control_present_flag;
+    header->frame_num = pic->frame_num;
+
+    /* Reference frames of VA become the DPB entries, by CAPTURE index */
+    memset(dec, 0, sizeof(*dec));
+    dec->top_field_order_cnt = pic->CurrPic.TopFieldOrderCnt;
+    dec->bottom_field_order_cnt = pic->CurrPic.BottomFieldOrderCnt;
+
+    max_frame_num = 1 << header->log2_max_frame_num;
+    for (i = 0; i < 16; i++) {
+        VAPictureH264 *ref = &pic->ReferenceFrames[i];
+        struct v4l2_h264_dpb_entry *entry = &dec->dpb[i];
+        int index;
+
+        params->dpb_surface[i] = VA_INVALID_SURFACE;
+
+        if ((ref->flags & VA_PICTURE_H264_INVALID) ||
+                !(ref->flags & (VA_PICTURE_H264_SHORT_TERM_REFERENCE |
+                        VA_PICTURE_H264_LONG_TERM_REFERENCE)))
+            continue;
+
+        index = rockchip_codec_frame_index(obj_context, ref->picture_id);
+        if (index < 0) {
+            LOG("reference surface %d is not a render target\n",
+                    ref->picture_id);
+            continue;
+        }
+
+        params->dpb_surface[i] = ref->picture_id;
+        entry->buf_index = index;
+        entry->frame_num = ref->frame_idx;
+        entry->top_field_order_cnt = ref->TopFieldOrderCnt;
+        entry->bottom_field_order_cnt = ref->BottomFieldOrderCnt;
+        entry->flags = V4L2_H264_DPB_ENTRY_FLAG_ACTIVE;
+
+        if (ref->flags & VA_PICTURE_H264_LONG_TERM_REFERENCE) {
+            entry->flags |= V4L2_H264_DPB_ENTRY_FLAG_LONG_TERM;
+            entry->pic_num = ref->frame_idx;
+        } else if (ref->frame_idx > pic->frame_num) {
+            entry->pic_num = ref->frame_idx - max_frame_num;
+        } else {
+            entry->pic_num = ref->frame_idx;
+        }
+    }
+
+    rockchip_BuildRefLists(params, rockchip_PictureOrderCount(&pic->CurrPic));
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessIQMatrix(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    decode_params_h264_p params = &obj_context->h264_dec_params;
+    VAIQMatrixBufferH264 *iq;
+
+    if (obj_buffer->buffer_size != sizeof(*iq))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    iq = (VAIQMatrixBufferH264 *) obj_buffer->buffer_data;
+
+    /* 8x8 lists for chroma only exist in 4:4:4, which is not decoded */
+    memset(&params->scaling_matrix, 16, sizeof(params->scaling_matrix));
+    memcpy(params->scaling_matrix.scaling_list_4x4, iq->ScalingList4x4,
+            sizeof(iq->ScalingList4x4));
+    memcpy(params->scaling_matrix.scaling_list_8x8, iq->ScalingList8x8,
+            sizeof(iq->ScalingList8x8));
+    params->scaling_matrix_present = 1;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessSliceParam(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    decode_params_h264_p params = &obj_context->h264_dec_params;
+    VASliceParameterBufferH264 *va_slice;
+    unsigned int i;
+    int j;
+
+    if (obj_buffer->buffer_size !=
+            sizeof(*va_slice) * obj_buffer->num_elements)
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    va_slice = (VASliceParameterBufferH264 *) obj_buffer->buffer_data;
+
+    for (i = 0; i < obj_buffer->num_elements; i++, va_slice++) {
+        struct v4l2_ctrl_h264_slice_param *slice;
+        struct v4l2_h264_pred_weight_table *weights;
+
+        if (params->num_slices == ROCKCHIP_DEC_H264_MAX_SLICES)
+            return VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+
+        slice = &params->slice_param[params->num_slices];
+        memset(slice, 0, sizeof(*slice));
+
+        slice->first_mb_in_slice = va_slice->first_mb_in_slice;
+        slice->slice_type = va_slice->slice_type % 5;
+        slice->cabac_init_idc = va_slice->cabac_init_idc;
+        slice->slice_qp_delta = va_slice->slice_qp_delta;
+        slice->disable_deblocking_filter_idc =
+            va_slice->disable_deblocking_filter_idc;
+        slice->slice_alpha_c0_offset_div2 =
+            va_slice->slice_alpha_c0_offset_div2;
+        slice->slice_beta_offset_div2 = va_slice->slice_beta_offset_div2;
+        slice->num_ref_idx_l0_active_minus1 =
+            va_slice->num_ref_idx_l0_active_minus1;
+        slice->num_ref_idx_l1_active_minus1 =
+            va_slice->num_ref_idx_l1_active_minus1;
+        if (va_slice->direct_spatial_mv_pred_flag)
+            slice->flags |= V4L2_SLICE_FLAG_DIRECT_SPATIAL_MV_PRED;
+
+        memset(slice->ref_pic_list0, DPB_NO_ENTRY,
+                sizeof(slice->ref_pic_list0));
+        memset(slice->ref_pic_list1, DPB_NO_ENTRY,
+                sizeof(slice->ref_pic_list1));
+        for (j = 0; j <= va_slice->num_ref_idx_l0_active_minus1; j++)
+            slice->ref_pic_list0[j] =
+                rockchip_DpbEntry(params, &va_slice->RefPicList0[j]);
+        for (j = 0; j <= va_slice->num_ref_idx_l1_active_minus1; j++)
+            slice->ref_pic_list1[j] =
+                rockchip_DpbEntry(params, &va_slice->RefPicList1[j]);
+
+        weights = &slice->pred_weight_table;
+        weights->luma_log2_weight_denom = va_slice->luma_log2_weight_denom;
+        weights->chroma_log2_weight_denom =
+            va_slice->chroma_log2_weight_denom;
+        for (j = 0; j < 32; j++) {
+            weights->weight_factors[0].luma_weight[j] =
+                va_slice->luma_weight_l0[j];
+            weights->weight_factors[0].luma_offset[j] =
+                va_slice->luma_offset_l0[j];
+            weights->weight_factors[0].chroma_weight[j][0] =
+                va_slice->chroma_weight_l0[j][0];
+            weights->weight_factors[0].chroma_weight[j][1] =
+                va_slice->chroma_weight_l0[j][1];
+            weights->weight_factors[0].chroma_offset[j][0] =
+                va_slice->chroma_offset_l0[j][0];
+            weights->weight_factors[0].chroma_offset[j][1] =
+                va_slice->chroma_offset_l0[j][1];
+
+            weights->weight_factors[1].luma_weight[j] =
+                va_slice->luma_weight_l1[j];
+            weights->weight_factors[1].luma_offset[j] =
+                va_slice->luma_offset_l1[j];
+            weights->weight_factors[1].chroma_weight[j][0] =
+                va_slice->chroma_weight_l1[j][0];
+            weights->weight_factors[1].chroma_weight[j][1] =
+                va_slice->chroma_weight_l1[j][1];
+            weights->weight_factors[1].chroma_offset[j][0] =
+                va_slice->chroma_offset_l1[j][0];
+            weights->weight_factors[1].chroma_offset[j][1] =
+                va_slice->chroma_offset_l1[j][1];
+        }
+
+        params->slice_offset[params->num_slices] =
+            va_slice->slice_data_offset;
+        params->slice_size[params->num_slices] = va_slice->slice_data_size;
+        params->num_slices++;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+/**
+ * Copy the slices of the last slice parameters into the bitstream buffer,
+ * each behind a start code, and fill in what the decoder wants from their
+ * headers.
+ */
+static VAStatus rockchip_ProcessSliceData(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    decode_params_h264_p params = &obj_context->h264_dec_params;
+    dec_context_p dec_ctx = obj_context->dec_ctx;
+    unsigned char *bitstream = dec_ctx->bitstream_buffer[params->bitstream];
+    int room = dec_ctx->bitstream_size[params->bitstream];
+    unsigned char header[SLICE_HEADER_MAX];
+    int i;
+
+    for (i = params->first_pending_slice; i < params->num_slices; i++) {
+        struct v4l2_ctrl_h264_slice_param *slice = &params->slice_param[i];
+        unsigned char *nal;
+        h264_slice_header_t hdr;
+        int size, n;
+
+        if (params->slice_offset[i] + params->slice_size[i] >
+                obj_buffer->buffer_size)
+            return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+        nal = (unsigned char *) obj_buffer->buffer_data +
+            params->slice_offset[i];
+        size = params->slice_size[i];
+
+        /* Some applications pass the start code along */
+        if (size > 3 && !nal[0] && !nal[1] && nal[2] == 1) {
+            nal += 3;
+            size -= 3;
+        } else if (size > 4 && !nal[0] && !nal[1] && !nal[2] && nal[3] == 1) {
+            nal += 4;
+            size -= 4;
+        }
+
+        if (params->bitstream_size + (int) sizeof(start_code) + size > room) {
+            LOG("h264 slices do not fit in the bitstream buffer\n");
+            return VA_STATUS_ERROR_NOT_ENOUGH_BUFFER;
+        }
+
+        memcpy(bitstream + params->bitstream_size, start_code,
+                sizeof(start_code));
+        memcpy(bitstream + params->bitstream_size + sizeof(start_code),
+                nal, size);
+        params->bitstream_size += sizeof(start_code) + size;
+
+        /* Without an override the slice uses the PPS defaults VA resolved */
+        params->header.num_ref_idx_default[0] =
+            slice->num_ref_idx_l0_active_minus1 + 1;
+        params->header.num_ref_idx_default[1] =
+            slice->num_ref_idx_l1_active_minus1 + 1;
+
+        n = h264_unescape(nal, size, header, sizeof(header));
+        if (h264_parse_slice_header(&params->header, header, n, &hdr) < 0)
+            return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+        slice->size = sizeof(start_code) + size;
+        slice->header_bit_size = hdr.header_bit_size;
+        slice->pic_parameter_set_id = hdr.pic_parameter_set_id;
+        slice->frame_num = hdr.frame_num;
+        slice->idr_pic_id = hdr.idr_pic_id;
+        slice->pic_order_cnt_lsb = hdr.pic_order_cnt_lsb;
+        slice->delta_pic_order_cnt_bottom = hdr.delta_pic_order_cnt_bottom;
+        slice->delta_pic_order_cnt0 = hdr.delta_pic_order_cnt[0];
+        slice->delta_pic_order_cnt1 = hdr.delta_pic_order_cnt[1];
+        slice->redundant_pic_cnt = hdr.redundant_pic_cnt;
+        slice->dec_ref_pic_marking_bit_size = hdr.dec_ref_pic_marking_bit_size;
+        slice->pic_order_cnt_bit_size = hdr.pic_order_cnt_bit_size;
+        slice->slice_qs_delta = hdr.slice_qs_delta;
+        if (hdr.field_pic)
+            slice->flags |= V4L2_SLICE_FLAG_FIELD_PIC;
+        if (hdr.bottom_field)
+            slice->flags |= V4L2_SLICE_FLAG_BOTTOM_FIELD;
+        if (hdr.sp_for_switch)
+            slice->flags |= V4L2_SLICE_FLAG_SP_FOR_SWITCH;
+
+        /**
+         * VA does not pass the PPS defaults on, but a slice without an
+         * override uses them: what VA resolved for it is the default.
+         */
+        if (hdr.num_ref_idx_from_pps[0])
+            params->num_ref_idx_default[0] = hdr.num_ref_idx_active[0] - 1;
+        if (hdr.num_ref_idx_from_pps[1])
+            params->num_ref_idx_default[1] = hdr.num_ref_idx_active[1] - 1;
+        params->pps.num_ref_idx_l0_default_active_minus1 =
+            params->num_ref_idx_default[0];
+        params->pps.num_ref_idx_l1_default_active_minus1 =
+            params->num_ref_idx_default[1];
+
+        if (i == 0) {
+            params->pps.pic_parameter_set_id = hdr.pic_parameter_set_id;
+            params->decode_param.idr_pic_flag = hdr.idr;
+            params->decode_param.nal_ref_idc = hdr.nal_ref_idc;
+        }
+    }
+
+    params->first_pending_slice = params->num_slices;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessBuffer(
+        VADriverContextP ctx,
+        VAContextID context,
+        VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    switch (obj_buffer->type) {
+    case VAPictureParameterBufferType:
+        return rockchip_ProcessPicture(obj_context, obj_buffer);
+    case VAIQMatrixBufferType:
+        return rockchip_ProcessIQMatrix(obj_context, obj_buffer);
+    case VASliceParameterBufferType:
+        return rockchip_ProcessSliceParam(obj_context, obj_buffer);
+    case VASliceDataBufferType:
+        return rockchip_ProcessSliceData(obj_context, obj_buffer);
+    default:
+        return VA_STATUS_ERROR_UNKNOWN;
+    }
+}
+
+static VAStatus rockchip_DoDecode(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    decode_params_h264_p params;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    params = &obj_context->h264_dec_params;
+
+    /* Every slice needs its data */
+    if (!params->num_slices ||
+            params->first_pending_slice != params->num_slices)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    params->decode_param.num_slices = params->num_slices;
+    if (params->scaling_matrix_present)
+        params->pps.flags |= V4L2_H264_PPS_FLAG_PIC_SCALING_MATRIX_PRESENT;
+
+    memset(obj_context->ctrl, 0, sizeof(obj_context->ctrl));
+    obj_context->ctrl[0].id = V4L2_CID_MPEG_VIDEO_H264_SPS;
+    obj_context->ctrl[0].ptr = &params->sps;
+    obj_context->ctrl[0].size = sizeof(params->sps);
+    obj_context->ctrl[1].id = V4L2_CID_MPEG_VIDEO_H264_PPS;
+    obj_context->ctrl[1].ptr = &params->pps;
+    obj_context->ctrl[1].size = sizeof(params->pps);
+    obj_context->ctrl[2].id = V4L2_CID_MPEG_VIDEO_H264_SCALING_MATRIX;
+    obj_context->ctrl[2].ptr = &params->scaling_matrix;
+    obj_context->ctrl[2].size = sizeof(params->scaling_matrix);
+    obj_context->ctrl[3].id = V4L2_CID_MPEG_VIDEO_H264_SLICE_PARAM;
+    obj_context->ctrl[3].ptr = params->slice_param;
+    obj_context->ctrl[3].size = sizeof(params->slice_param);
+    obj_context->ctrl[4].id = V4L2_CID_MPEG_VIDEO_H264_DECODE_PARAM;
+    obj_context->ctrl[4].ptr = &params->decode_param;
+    obj_context->ctrl[4].size = sizeof(params->decode_param);
+
+    return rockchip_codec_decode_frame(obj_context, params->frame_index,
+            params->bitstream, params->bitstream_size, obj_context->ctrl, 5);
+}
+
+static void rockchip_GetAttributes(
+        VAConfigAttrib *attrib_list,
+        int num_attribs)
+{
+    int i;
+
+    for (i = 0; i < num_attribs; i++) {
+        switch (attrib_list[i].type) {
+        case VAConfigAttribRTFormat:
+            attrib_list[i].value = VA_RT_FORMAT_YUV420;
+            break;
+#if VA_CHECK_VERSION(0, 37, 0)
+        case VAConfigAttribMaxPictureWidth:
+            attrib_list[i].value = ROCKCHIP_MAX_WIDTH;
+            break;
+        case VAConfigAttribMaxPictureHeight:
+            attrib_list[i].value = ROCKCHIP_MAX_HEIGHT;
+            break;
+#endif
+        default:
+            attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
+            break;
+        }
+    }
+}
+
+const rockchip_codec_ops_t rockchip_dec_h264_ops = {
+    .name           = "h264 decoder",
+    .init           = rockchip_InitDecoder,
+    .deinit         = rockchip_DeinitDecoder,
+    .prepare        = rockchip_PrepareDecode,
+    .process        = rockchip_ProcessBuffer,
+    .submit         = rockchip_DoDecode,
+    .collect        = rockchip_codec_collect_frame,
+    .get_attributes = rockchip_GetAttributes,
+};
@@ -0,0 +1,426 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rockchip_drv_video.h"
+
+/**
+ * VP8 decoding on the VPU decoder node. VA hands over the frame header
+ * already parsed, so the driver only copies it into the frame header
+ * control and puts the frame tag back in front of the partitions. Frames
+ * land in the CAPTURE buffers shared with the surfaces, as for H.264.
+ */
+
+static VAStatus rockchip_DeinitDecoder(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    rockchip_codec_close_decoder(ctx, obj_context);
+
+    LOG_DEINIT();
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_InitDecoder(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    int width, height;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    width = obj_context->picture_width;
+    height = obj_context->picture_height;
+
+    /* Validate picture dimensions */
+    if (width < ROCKCHIP_MIN_WIDTH || width > ROCKCHIP_MAX_WIDTH ||
+            height < ROCKCHIP_MIN_HEIGHT || height > ROCKCHIP_MAX_HEIGHT)
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+
+    LOG_INIT();
+
+    memset(&obj_context->vp8_dec_params, 0,
+            sizeof(obj_context->vp8_dec_params));
+
+    LOG("vp8 decode resolution:%dx%d, %d surfaces\n", width, height,
+            obj_context->num_render_targets);
+
+    return rockchip_codec_open_decoder(ctx, obj_context,
+            V4L2_PIX_FMT_VP8_FRAME);
+}
+
+static VAStatus rockchip_PrepareDecode(
+        VADriverContextP ctx,
+        VAContextID context,
+        VASurfaceID render_target)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    decode_params_vp8_p params;
+    VAStatus status;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    params = &obj_context->vp8_dec_params;
+
+    status = rockchip_codec_begin_frame(ctx, obj_context, render_target,
+            &params->frame_index, &params->bitstream);
+    if (status != VA_STATUS_SUCCESS)
+        return status;
+
+    memset(&params->frame_hdr, 0, sizeof(params->frame_hdr));
+    memset(&params->header, 0, sizeof(params->header));
+    params->bitstream_size = 0;
+    params->have_slice = 0;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* CAPTURE index of a reference frame, VIDEO_MAX_FRAME when there is none */
+static __u32 rockchip_ReferenceFrame(object_context_p obj_context,
+        VASurfaceID surface)
+{
+    int index = rockchip_codec_frame_index(obj_context, surface);
+
+    return index < 0 ? VIDEO_MAX_FRAME : index;
+}
+
+static VAStatus rockchip_ProcessPicture(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    decode_params_vp8_p params = &obj_context->vp8_dec_params;
+    struct v4l2_ctrl_vp8_frame_hdr *hdr = &params->frame_hdr;
+    VAPictureParameterBufferVP8 *pic;
+
+    if (obj_buffer->buffer_size != sizeof(*pic))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    pic = (VAPictureParameterBufferVP8 *) obj_buffer->buffer_data;
+
+    if (pic->frame_width > obj_context->picture_width ||
+            pic->frame_height > obj_context->picture_height)
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+
+    /* Both follow frame_type, 0 for key frames */
+    hdr->key_frame = pic->pic_fields.bits.key_frame;
+    hdr->version = pic->pic_fields.bits.version;
+    hdr->width = pic->frame_width;
+    hdr->height = pic->frame_height;
+
+    /* VA passes segment levels already resolved, use absolute values */
+    if (pic->pic_fields.bits.segmentation_enabled) {
+        hdr->sgmnt_hdr.flags |= V4L2_VP8_SEGMNT_HDR_FLAG_ENABLED;
+        if (pic->pic_fields.bits.update_mb_segmentation_map)
+            hdr->sgmnt_hdr.flags |= V4L2_VP8_SEGMNT_HDR_FLAG_UPDATE_MAP;
+        if (pic->pic_fields.bits.update_segment_feature_data)
+            hdr->sgmnt_hdr.flags |=
+                V4L2_VP8_SEGMNT_HDR_FLAG_UPDATE_FEATURE_DATA;
+    }
+    hdr->sgmnt_hdr.segment_feature_mode = 1;
+    memcpy(hdr->sgmnt_hdr.segment_probs, pic->mb_segment_tree_probs,
+            sizeof(hdr->sgmnt_hdr.segment_probs));
+    memcpy(hdr->sgmnt_hdr.lf_update, pic->loop_filter_level,
+            sizeof(hdr->sgmnt_hdr.lf_update));
+
+    hdr->lf_hdr.type = pic->pic_fields.bits.filter_type;
+    hdr->lf_hdr.level = pic->pic_fields.bits.loop_filter_disable ?
+        0 : pic->loop_filter_level[0];
+    hdr->lf_hdr.sharpness_level = pic->pic_fields.bits.sharpness_level;
+    memcpy(hdr->lf_hdr.ref_frm_delta_magnitude,
+            pic->loop_filter_deltas_ref_frame,
+            sizeof(hdr->lf_hdr.ref_frm_delta_magnitude));
+    memcpy(hdr->lf_hdr.mb_mode_delta_magnitude,
+            pic->loop_filter_deltas_mode,
+            sizeof(hdr->lf_hdr.mb_mode_delta_magnitude));
+    if (pic->pic_fields.bits.loop_filter_adj_enable)
+        hdr->lf_hdr.flags |= V4L2_VP8_LF_HDR_ADJ_ENABLE;
+    if (pic->pic_fields.bits.mode_ref_lf_delta_update)
+        hdr->lf_hdr.flags |= V4L2_VP8_LF_HDR_DELTA_UPDATE;
+
+    memcpy(hdr->entropy_hdr.y_mode_probs, pic->y_mode_probs,
+            sizeof(hdr->entropy_hdr.y_mode_probs));
+    memcpy(hdr->entropy_hdr.uv_mode_probs, pic->uv_mode_probs,
+            sizeof(hdr->entropy_hdr.uv_mode_probs));
+    memcpy(hdr->entropy_hdr.mv_probs, pic->mv_probs,
+            sizeof(hdr->entropy_hdr.mv_probs));
+
+    hdr->sign_bias_golden = pic->pic_fields.bits.sign_bias_golden;
+    hdr->sign_bias_alternate = pic->pic_fields.bits.sign_bias_alternate;
+    hdr->prob_skip_false = pic->prob_skip_false;
+    hdr->prob_intra = pic->prob_intra;
+    hdr->prob_last = pic->prob_last;
+    hdr->prob_gf = pic->prob_gf;
+
+    hdr->bool_dec_range = pic->bool_coder_ctx.range;
+    hdr->bool_dec_value = pic->bool_coder_ctx.value;
+    hdr->bool_dec_count = pic->bool_coder_ctx.count;
+
+    hdr->last_frame = rockchip_ReferenceFrame(obj_context,
+            pic->last_ref_frame);
+    hdr->golden_frame = rockchip_ReferenceFrame(obj_context,
+            pic->golden_ref_frame);
+    hdr->alt_frame = rockchip_ReferenceFrame(obj_context,
+            pic->alt_ref_frame);
+
+    /* VA does not pass show_frame, it makes no difference to decoding */
+    hdr->flags = V4L2_VP8_FRAME_HDR_FLAG_SHOW_FRAME;
+    if (pic->pic_fields.bits.mb_no_coeff_skip)
+        hdr->flags |= V4L2_VP8_FRAME_HDR_FLAG_MB_NO_SKIP_COEFF;
+
+    params->header.key_frame = !pic->pic_fields.bits.key_frame;
+    params->header.version = pic->pic_fields.bits.version;
+    params->header.show_frame = 1;
+    params->header.width = pic->frame_width;
+    params->header.height = pic->frame_height;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessIQMatrix(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    struct v4l2_ctrl_vp8_frame_hdr *hdr = &obj_context->vp8_dec_params.frame_hdr;
+    VAIQMatrixBufferVP8 *iq;
+    int i;
+
+    if (obj_buffer->buffer_size != sizeof(*iq))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    iq = (VAIQMatrixBufferVP8 *) obj_buffer->buffer_data;
+
+    /**
+     * VA gives the final index of each coefficient type per segment: y_ac,
+     * y_dc, y2_dc, y2_ac, uv_dc, uv_ac. Turn segment 0 back into the
+     * base index and deltas, the other segments into absolute indices.
+     */
+    hdr->quant_hdr.y_ac_qi = iq->quantization_index[0][0];
+    hdr->quant_hdr.y_dc_delta =
+        iq->quantization_index[0][1] - iq->quantization_index[0][0];
+    hdr->quant_hdr.y2_dc_delta =
+        iq->quantization_index[0][2] - iq->quantization_index[0][0];
+    hdr->quant_hdr.y2_ac_delta =
+        iq->quantization_index[0][3] - iq->quantization_index[0][0];
+    hdr->quant_hdr.uv_dc_delta =
+        iq->quantization_index[0][4] - iq->quantization_index[0][0];
+    hdr->quant_hdr.uv_ac_delta =
+        iq->quantization_index[0][5] - iq->quantization_index[0][0];
+
+    for (i = 0; i < 4; i++)
+        hdr->sgmnt_hdr.quant_update[i] = iq->quantization_index[i][0];
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessProbability(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    struct v4l2_ctrl_vp8_frame_hdr *hdr = &obj_context->vp8_dec_params.frame_hdr;
+    VAProbabilityDataBufferVP8 *prob;
+
+    if (obj_buffer->buffer_size != sizeof(*prob))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    prob = (VAProbabilityDataBufferVP8 *) obj_buffer->buffer_data;
+
+    memcpy(hdr->entropy_hdr.coeff_probs, prob->dct_coeff_probs,
+            sizeof(hdr->entropy_hdr.coeff_probs));
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessSliceParam(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    decode_params_vp8_p params = &obj_context->vp8_dec_params;
+    struct v4l2_ctrl_vp8_frame_hdr *hdr = &params->frame_hdr;
+    VASliceParameterBufferVP8 *slice;
+    int i;
+
+    /* A VP8 frame is a single slice */
+    if (obj_buffer->buffer_size != sizeof(*slice) || params->have_slice)
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    slice = (VASliceParameterBufferVP8 *) obj_buffer->buffer_data;
+
+    if (slice->num_of_partitions < 2 || slice->num_of_partitions > 9)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    /**
+     * The first partition size VA passes leaves out the bytes of the
+     * frame header that were already parsed.
+     */
+    params->header.first_part_size = slice->partition_size[0] +
+        (slice->macroblock_offset + 7) / 8;
+    hdr->first_part_size = params->header.first_part_size;
+    hdr->macroblock_bit_offset = slice->macroblock_offset;
+
+    hdr->num_dct_parts = slice->num_of_partitions - 1;
+    for (i = 0; i < hdr->num_dct_parts; i++)
+        hdr->dct_part_sizes[i] = slice->partition_size[i + 1];
+
+    params->slice_offset = slice->slice_data_offset;
+    params->slice_size = slice->slice_data_size;
+    params->have_slice = 1;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/**
+ * Put the frame together in the bitstream buffer: the frame tag, then the
+ * partitions as they are in the slice data.
+ */
+static VAStatus rockchip_ProcessSliceData(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    decode_params_vp8_p params = &obj_context->vp8_dec_params;
+    dec_context_p dec_ctx = obj_context->dec_ctx;
+    unsigned char *bitstream = dec_ctx->bitstream_buffer[params->bitstream];
+    int room = dec_ctx->bitstream_size[params->bitstream];
+    int tag_size;
+
+    if (!params->have_slice)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    if (params->slice_offset + params->slice_size > obj_buffer->buffer_size)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    tag_size = vp8_write_frame_header(&params->header, bitstream, room);
+    if (tag_size < 0 || tag_size + (int) params->slice_size > room) {
+        LOG("vp8 frame does not fit in the bitstream buffer\n");
+        return VA_STATUS_ERROR_NOT_ENOUGH_BUFFER;
+    }
+
+    memcpy(bitstream + tag_size,
+            (unsigned char *) obj_buffer->buffer_data + params->slice_offset,
+            params->slice_size);
+
+    params->frame_hdr.first_part_offset = tag_size;
+    params->bitstream_size = tag_size + params->slice_size;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessBuffer(
+        VADriverContextP ctx,
+        VAContextID context,
+        VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    switch (obj_buffer->type) {
+    case VAPictureParameterBufferType:
+        return rockchip_ProcessPicture(obj_context, obj_buffer);
+    case VAIQMatrixBufferType:
+        return rockchip_ProcessIQMatrix(obj_context, obj_buffer);
+    case VAProbabilityBufferType:
+        return rockchip_ProcessProbability(obj_context, obj_buffer);
+    case VASliceParameterBufferType:
+        return rockchip_ProcessSliceParam(obj_context, obj_buffer);
+    case VASliceDataBufferType:
+        return rockchip_ProcessSliceData(obj_context, obj_buffer);
+    default:
+        return VA_STATUS_ERROR_UNKNOWN;
+    }
+}
+
+static VAStatus rockchip_DoDecode(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    decode_params_vp8_p params;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    params = &obj_context->vp8_dec_params;
+
+    if (!params->bitstream_size)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    memset(obj_context->ctrl, 0, sizeof(obj_context->ctrl));
+    obj_context->ctrl[0].id = V4L2_CID_MPEG_VIDEO_VP8_FRAME_HDR;
+    obj_context->ctrl[0].ptr = &params->frame_hdr;
+    obj_context->ctrl[0].size = sizeof(params->frame_hdr);
+
+    return rockchip_codec_decode_frame(obj_context, params->frame_index,
+            params->bitstream, params->bitstream_size, obj_context->ctrl, 1);
+}
+
+static void rockchip_GetAttributes(
+        VAConfigAttrib *attrib_list,
+        int num_attribs)
+{
+    int i;
+
+    for (i = 0; i < num_attribs; i++) {
+        switch (attrib_list[i].type) {
+        case VAConfigAttribRTFormat:
+            attrib_list[i].value = VA_RT_FORMAT_YUV420;
+            break;
+#if VA_CHECK_VERSION(0, 37, 0)
+        case VAConfigAttribMaxPictureWidth:
+            attrib_list[i].value = ROCKCHIP_MAX_WIDTH;
+            break;
+        case VAConfigAttribMaxPictureHeight:
+            attrib_list[i].value = ROCKCHIP_MAX_HEIGHT;
+            break;
+#endif
+        default:
+            attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
+            break;
+        }
+    }
+}
+
+const rockchip_codec_ops_t rockchip_dec_vp8_ops = {
+    .name           = "vp8 decoder",
+    .init           = rockchip_InitDecoder,
+    .deinit         = rockchip_DeinitDecoder,
+    .prepare        = rockchip_PrepareDecode,
+    .process        = rockchip_ProcessBuffer,
+    .submit         = rockchip_DoDecode,
+    .collect        = rockchip_codec_collect_frame,
+    .get_attributes = rockchip_GetAttributes,
+};
@@ -38,11 +38,7 @@ VAStatus rockchip_QueryConfigProfiles(
     int *num_profiles           /* out */
 )
 {
-    int i = 0;
-
-    profile_list[i++] = VAProfileH264Main;
-    profile_list[i++] = VAProfileH264Baseline;
-    profile_list[i++] = VAProfileH264ConstrainedBaseline;
+    int i = rockchip_codec_profiles(profile_list);
 
     /* If the assert fails then ROCKCHIP_MAX_PROFILES needs to be bigger */
     ASSERT(i <= ROCKCHIP_MAX_PROFILES);
@@ -65,17 +61,7 @@ VAStatus rockchip_QueryConfigEntrypoints(
         return VA_STATUS_ERROR_INVALID_PARAMETER;
     }
 
-    switch (profile) {
-    case VAProfileH264Main:
-    case VAProfileH264Baseline:
-    case VAProfileH264ConstrainedBaseline:
-        *num_entrypoints = 1;
-        entrypoint_list[0] = VAEntrypointEncSlice;
-        break;
-    default:
-        *num_entrypoints = 0;
-        break;
-    }
+    *num_entrypoints = rockchip_codec_entrypoints(profile, entrypoint_list);
 
     /* If the assert fails then ROCKCHIP_MAX_ENTRYPOINTS needs to be bigger */
     ASSERT(*num_entrypoints <= ROCKCHIP_MAX_ENTRYPOINTS);
@@ -90,32 +76,15 @@ VAStatus rockchip_GetConfigAttributes(
     int num_attribs
 )
 {
-    int i;
+    const rockchip_codec_ops_t *codec;
 
-    /**
-     * TODO: Set real attrs
-     */
-    for (i = 0; i < num_attribs; i++) {
-        switch (attrib_list[i].type) {
-        case VAConfigAttribRTFormat:
-            attrib_list[i].value = VA_RT_FORMAT_YUV420;
-            break;
-        case VAConfigAttribRateControl:
-            attrib_list[i].value = VA_RC_VBR | VA_RC_CQP | VA_RC_VBR_CONSTRAINED | VA_RC_CBR | VA_RC_VCM | VA_RC_NONE;
-            break;
-        case VAConfigAttribEncPackedHeaders:
-            attrib_list[i].value =
-                VA_ENC_PACKED_HEADER_SEQUENCE | VA_ENC_PACKED_HEADER_PICTURE |
-                VA_ENC_PACKED_HEADER_SLICE | VA_ENC_PACKED_HEADER_MISC |
-                VA_ENC_PACKED_HEADER_RAW_DATA;
-            break;
-        default:
-            /* Do nothing */
-            attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
-            break;
-        }
+    codec = rockchip_codec_lookup(profile, entrypoint);
+    if (NULL == codec) {
+        return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
     }
 
+    codec->get_attributes(attrib_list, num_attribs);
+
     return VA_STATUS_SUCCESS;
 }
 
@@ -151,24 +120,18 @@ VAStatus rockchip_CreateConfig(
 {
     INIT_DRIVER_DATA
     VAStatus vaStatus;
+    VAEntrypoint entrypoints[ROCKCHIP_MAX_ENTRYPOINTS];
     int configID;
     object_config_p obj_config;
     int i;
 
     /* Validate profile & entrypoint */
-    switch (profile) {
-    case VAProfileH264Main:
-    case VAProfileH264Baseline:
-    case VAProfileH264ConstrainedBaseline:
-        if (VAEntrypointEncSlice == entrypoint) {
-            vaStatus = VA_STATUS_SUCCESS;
-        } else {
-            vaStatus = VA_STATUS_ERROR_UNSUPPORTED_ENTRYPOINT;
-        }
-        break;
-    default:
+    if (rockchip_codec_lookup(profile, entrypoint)) {
+        vaStatus = VA_STATUS_SUCCESS;
+    } else if (rockchip_codec_entrypoints(profile, entrypoints) > 0) {
+        vaStatus = VA_STATUS_ERROR_UNSUPPORTED_ENTRYPOINT;
+    } else {
         vaStatus = VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
-        break;
     }
 
     if (VA_STATUS_SUCCESS != vaStatus) {
@@ -378,6 +341,7 @@ VAStatus rockchip_CreateContext(
     INIT_DRIVER_DATA
     VAStatus vaStatus = VA_STATUS_SUCCESS;
     object_config_p obj_config;
+    const rockchip_codec_ops_t *codec;
     int i;
 
     obj_config = CONFIG(config_id);
@@ -386,8 +350,15 @@ VAStatus rockchip_CreateContext(
         return vaStatus;
     }
 
+    codec = rockchip_codec_lookup(obj_config->profile,
+            obj_config->entrypoint);
+    if (NULL == codec) {
+        vaStatus = VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+        return vaStatus;
+    }
+
     /* Validate flag */
-    /* Validate picture dimensions */
+    /* Picture dimensions are validated by the codec */
 
     int contextID = object_heap_allocate( &driver_data->context_heap );
     object_context_p obj_context = CONTEXT(contextID);
@@ -417,8 +388,10 @@ VAStatus rockchip_CreateContext(
         obj_context->render_targets[i] = render_targets[i];
     }
     obj_context->flags = flag;
+    obj_context->codec = codec;
 
-    vaStatus = rockchip_InitEncoder(ctx, contextID);
+    if (VA_STATUS_SUCCESS == vaStatus)
+        vaStatus = codec->init(ctx, contextID);
 
     /* Error recovery */
     if (VA_STATUS_SUCCESS != vaStatus) {
@@ -443,7 +416,7 @@ VAStatus rockchip_DestroyContext(
     object_context_p obj_context = CONTEXT(context);
     ASSERT(obj_context);
 
-    rockchip_DeinitEncoder(ctx, context);
+    obj_context->codec->deinit(ctx, context);
 
     obj_context->context_id = -1;
     obj_context->config_id = -1;
@@ -463,6 +436,24 @@ VAStatus rockchip_DestroyContext(
     return VA_STATUS_SUCCESS;
 }
 
+/**
+ * Driver context of a display, for the entry points applications call
+ * directly rather than through libva. NULL when the driver is not set up.
+ */
+VADriverContextP rockchip_DisplayDriverContext(VADisplay dpy)
+{
+    VADriverContextP ctx;
+
+    if (!dpy)
+        return NULL;
+
+    ctx = ((VADisplayContextP) dpy)->pDriverContext;
+    if (!ctx || !ctx->pDriverData)
+        return NULL;
+
+    return ctx;
+}
+
 /*
  * Query display attributes
  * The caller must provide a "attr_list" array that can hold at
@@ -627,7 +618,17 @@ EXPORT VAStatus __vaDriverInit_0_32(VADriverContextP ctx)
     vtable->vaUnlockSurface = rockchip_UnlockSurface;
     vtable->vaBufferInfo = rockchip_BufferInfo;
 
-    driver_data = (struct rockchip_driver_data *) malloc( sizeof(*driver_data) );
+    if (ctx->vtable_vpp) {
+        struct VADriverVTableVPP * const vtable_vpp = ctx->vtable_vpp;
+
+        vtable_vpp->vaQueryVideoProcFilters = rockchip_QueryVideoProcFilters;
+        vtable_vpp->vaQueryVideoProcFilterCaps =
+            rockchip_QueryVideoProcFilterCaps;
+        vtable_vpp->vaQueryVideoProcPipelineCaps =
+            rockchip_QueryVideoProcPipelineCaps;
+    }
+
+    driver_data = (struct rockchip_driver_data *) calloc( 1, sizeof(*driver_data) );
     ctx->pDriverData = (void *) driver_data;
 
     result = object_heap_init( &driver_data->config_heap, sizeof(struct object_config), CONFIG_ID_OFFSET );
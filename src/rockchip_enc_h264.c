@@ -0,0 +1,2059 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <math.h>
+
+#include "rockchip_drv_video.h"
+
+/**
+ * Quality levels, best first. Search range and sub-pixel refinement
+ * dominate the VPU time; deblocking only goes off at the fastest level.
+ */
+static const struct {
+    int                     mv_h_range;
+    int                     mv_v_range;
+    int                     loop_filter;
+    struct rk_vepu_quality  vepu;
+} rockchip_quality_presets[ROCKCHIP_QUALITY_LEVELS] = {
+    { 64, 32, V4L2_MPEG_VIDEO_H264_LOOP_FILTER_MODE_ENABLED,  { 2, 1 } },
+    { 32, 16, V4L2_MPEG_VIDEO_H264_LOOP_FILTER_MODE_ENABLED,  { 2, 1 } },
+    { 16, 16, V4L2_MPEG_VIDEO_H264_LOOP_FILTER_MODE_ENABLED,  { 1, 1 } },
+    { 16,  8, V4L2_MPEG_VIDEO_H264_LOOP_FILTER_MODE_DISABLED, { 0, 0 } },
+};
+
+/**
+ * Frames the VPU coded at a quality level of an encode context, with their
+ * average encode time and size, to compare the presets. Level 0 counts the
+ * frames coded with the plugin defaults. This is not part of the VA API:
+ * applications look it up in the driver with dlsym().
+ */
+EXPORT VAStatus rockchip_QueryEncodeBenchmark(VADisplay dpy,
+        VAContextID context, unsigned int quality_level,
+        unsigned int *frames, unsigned int *us_per_frame,
+        unsigned int *bytes_per_frame)
+{
+    VADriverContextP ctx = rockchip_DisplayDriverContext(dpy);
+    object_context_p obj_context;
+    encode_statistics_p statistics;
+    int n;
+
+    if (!ctx)
+        return VA_STATUS_ERROR_INVALID_DISPLAY;
+    if (quality_level > ROCKCHIP_QUALITY_LEVELS || !frames ||
+            !us_per_frame || !bytes_per_frame)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    INIT_DRIVER_DATA
+    obj_context = CONTEXT(context);
+    if (!obj_context || obj_context->codec != &rockchip_enc_h264_ops)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+
+    statistics = &obj_context->statistics;
+    n = statistics->encode_frames[quality_level];
+    *frames = n;
+    *us_per_frame = n ? statistics->encode_us[quality_level] / n : 0;
+    *bytes_per_frame = n ? statistics->encode_bytes[quality_level] / n : 0;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/**
+ * An encoder context on the VPU, or on the software encoder when there is
+ * no encoder node or ROCKCHIP_VA_SOFTWARE is set.
+ */
+static enc_context_p rockchip_OpenEncoder(void)
+{
+    enc_context_p enc_ctx = NULL;
+
+    if (!getenv("ROCKCHIP_VA_SOFTWARE")) {
+        enc_ctx = v4l2_init_by_name(DEV_NAME_RK3288_NEW);
+        if (!enc_ctx)
+            enc_ctx = v4l2_init_by_name(DEV_NAME_RK3288_LEGACY);
+        if (enc_ctx)
+            return enc_ctx;
+        LOG("no VPU encoder node, using the software encoder\n");
+    }
+
+    return v4l2_init_software();
+}
+
+/**
+ * Simulcast, turned on per context with rockchip_SetSimulcast(), codes
+ * every picture as up to ROCKCHIP_MAX_SIMULCAST_LAYERS streams, each at
+ * half the size of the one above, on VPU contexts of their own. The
+ * smaller layers are downscaled from the layer above and get the
+ * sequence, picture and rate control parameters of layer 0, scaled to
+ * their size. Each goes to a coded buffer of its own, given with
+ * rockchip_SetSimulcastCodedBuffer(). Per-picture tools (intra refresh,
+ * ROI, dirty rectangles, QP maps, slice and frame size limits) only apply
+ * to layer 0.
+ */
+static enc_context_p rockchip_LayerContext(object_context_p obj_context,
+        int layer)
+{
+    if (!layer)
+        return obj_context->enc_ctx;
+
+    return obj_context->h264_params.spatial[layer - 1].enc_ctx;
+}
+
+/* Bit rates are shared out by picture area */
+static unsigned int rockchip_LayerBitrate(object_context_p obj_context,
+        int layer, unsigned int bits)
+{
+    simulcast_layer_p spatial = &obj_context->h264_params.spatial[layer - 1];
+
+    return (unsigned long long) bits * spatial->width * spatial->height /
+        (obj_context->picture_width * obj_context->picture_height);
+}
+
+static int rockchip_InitSimulcast(object_context_p obj_context,
+        int num_layers)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    int width = obj_context->picture_width;
+    int height = obj_context->picture_height;
+    int i;
+
+    params->num_spatial_layers = 1;
+
+    for (i = 1; i < num_layers; i++) {
+        simulcast_layer_p layer = &params->spatial[i - 1];
+        VAImage *image = &layer->image;
+        enc_context_p enc_ctx;
+
+        width = (width / 2) & ~1;
+        height = (height / 2) & ~1;
+        if (width < ROCKCHIP_MIN_WIDTH || height < ROCKCHIP_MIN_HEIGHT)
+            break;
+
+        enc_ctx = rockchip_OpenEncoder();
+        if (!enc_ctx)
+            return -1;
+
+        memset(layer, 0, sizeof(*layer));
+        layer->enc_ctx = enc_ctx;
+        layer->coded_buf = VA_INVALID_ID;
+        layer->pending_buf = VA_INVALID_ID;
+        params->num_spatial_layers++;
+
+        enc_ctx->width = layer->width = width;
+        enc_ctx->height = layer->height = height;
+
+        image->format.fourcc = VA_FOURCC_NV12;
+        image->format.byte_order = VA_LSB_FIRST;
+        image->format.bits_per_pixel = 12;
+        image->image_id = VA_INVALID_ID;
+        image->buf = VA_INVALID_ID;
+        image->width = width;
+        image->height = height;
+        image->num_planes = 2;
+        image->pitches[0] = width;
+        image->offsets[0] = 0;
+        image->pitches[1] = width;
+        image->offsets[1] = width * height;
+        image->data_size = width * height * 3 / 2;
+
+        layer->data = malloc(image->data_size);
+        if (!layer->data)
+            return -1;
+
+        if (v4l2_s_fmt(enc_ctx) < 0 || v4l2_reqbufs(enc_ctx) < 0 ||
+                v4l2_querybuf(enc_ctx) < 0)
+            return -1;
+
+        LOG("simulcast layer %d: %dx%d\n", i, width, height);
+    }
+
+    return 0;
+}
+
+static void rockchip_DeinitSimulcast(object_context_p obj_context)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    int i;
+
+    for (i = 1; i < params->num_spatial_layers; i++) {
+        simulcast_layer_p layer = &params->spatial[i - 1];
+
+        if (obj_context->streaming)
+            v4l2_streamoff(layer->enc_ctx);
+        v4l2_deinit(layer->enc_ctx);
+        free(layer->data);
+    }
+
+    params->num_spatial_layers = 1;
+}
+
+/**
+ * The SPS of a smaller layer: its size in macroblocks with the cropping
+ * of an odd size, its share of the bit rate, and a level that fits.
+ */
+static void rockchip_SimulcastSPS(object_context_p obj_context,
+        const VAEncSequenceParameterBufferH264 *sps, int fps_num, int fps_den)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    VAEncSequenceParameterBufferH264 layer_sps;
+    const h264_level_t *level;
+    int i;
+
+    for (i = 1; i < params->num_spatial_layers; i++) {
+        simulcast_layer_p layer = &params->spatial[i - 1];
+        int crop_right = ALIGN(layer->width, 16) - layer->width;
+        int crop_bottom = ALIGN(layer->height, 16) - layer->height;
+
+        layer_sps = *sps;
+        layer_sps.picture_width_in_mbs = ALIGN(layer->width, 16) / 16;
+        layer_sps.picture_height_in_mbs = ALIGN(layer->height, 16) / 16;
+        layer_sps.bits_per_second =
+            rockchip_LayerBitrate(obj_context, i, sps->bits_per_second);
+
+        /* In chroma samples, 4:2:0 progressive */
+        layer_sps.frame_cropping_flag = crop_right || crop_bottom;
+        layer_sps.frame_crop_left_offset = 0;
+        layer_sps.frame_crop_top_offset = 0;
+        layer_sps.frame_crop_right_offset = crop_right / 2;
+        layer_sps.frame_crop_bottom_offset = crop_bottom / 2;
+
+        level = h264_find_level(layer->width, layer->height,
+                fps_num, fps_den, layer_sps.bits_per_second);
+        if (level && layer_sps.level_idc < level->level_idc)
+            layer_sps.level_idc = level->level_idc;
+
+        v4l2_s_ctrl_ptr(layer->enc_ctx, V4L2_CID_PRIVATE_ROCKCHIP_VAENC_SPS,
+                &layer_sps, sizeof(layer_sps));
+    }
+}
+
+/* The smaller layers are coded as one slice */
+static void rockchip_SimulcastSlice(object_context_p obj_context,
+        const VAEncSliceParameterBufferH264 *slice_param)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    VAEncSliceParameterBufferH264 slice;
+    int i;
+
+    for (i = 1; i < params->num_spatial_layers; i++) {
+        simulcast_layer_p layer = &params->spatial[i - 1];
+        int mb_width = ALIGN(layer->width, 16) / 16;
+        int mb_height = ALIGN(layer->height, 16) / 16;
+
+        slice = *slice_param;
+        slice.macroblock_address = 0;
+        slice.num_macroblocks = mb_width * mb_height;
+
+        v4l2_s_ctrl_ptr(layer->enc_ctx, V4L2_CID_PRIVATE_ROCKCHIP_VAENC_SLICE,
+                &slice, sizeof(slice));
+    }
+}
+
+/* Rate control parameters of layer 0, with the layer's bit rate */
+static void rockchip_SimulcastRateControl(object_context_p obj_context,
+        const VAEncMiscParameterRateControl *rate_control)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    VAEncMiscParameterRateControl layer_rc;
+    int i;
+
+    for (i = 1; i < params->num_spatial_layers; i++) {
+        layer_rc = *rate_control;
+        layer_rc.bits_per_second = rockchip_LayerBitrate(obj_context, i,
+                rate_control->bits_per_second);
+
+        v4l2_s_ctrl_ptr(params->spatial[i - 1].enc_ctx,
+                V4L2_CID_PRIVATE_ROCKCHIP_VAENC_RC,
+                &layer_rc, sizeof(layer_rc));
+    }
+}
+
+/**
+ * Downscale the picture for the smaller layers and queue them right
+ * behind layer 0, so the VPU codes all of them back to back. Each layer
+ * is scaled while the VPU is busy with the one above. Layers given no
+ * coded buffer for the picture are scaled only when a smaller one needs
+ * them, and are not coded.
+ */
+static void rockchip_SubmitSimulcast(object_context_p obj_context,
+        object_surface_p obj_surface, object_buffer_p obj_buffer)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    const VAImage *src = &obj_surface->image;
+    const unsigned char *src_data = obj_buffer->buffer_data;
+    VARectangle src_rect = { 0, 0,
+        obj_context->picture_width, obj_context->picture_height };
+    convert_job_t job;
+    int i;
+
+    for (i = 1; i < params->num_spatial_layers; i++) {
+        simulcast_layer_p layer = &params->spatial[i - 1];
+        VAStatus status;
+
+        status = rockchip_convert_init(&job, src, src_data, &src_rect, 0,
+                &layer->image, layer->data, NULL, 0, NULL);
+        if (status == VA_STATUS_SUCCESS) {
+            status = rockchip_convert(&job);
+            rockchip_convert_deinit(&job);
+        }
+        if (status != VA_STATUS_SUCCESS) {
+            LOG("simulcast layer %d: downscale failed\n", i);
+            break;
+        }
+
+        src = &layer->image;
+        src_data = layer->data;
+        src_rect.width = layer->width;
+        src_rect.height = layer->height;
+
+        if (layer->coded_buf == VA_INVALID_ID)
+            continue;
+
+        if (layer->enc_ctx->input_queued)
+            v4l2_dqbuf_input(layer->enc_ctx);
+
+        if (v4l2_qbuf_input(layer->enc_ctx, layer->data,
+                    layer->image.data_size) < 0)
+            break;
+        layer->pending_buf = layer->coded_buf;
+        layer->coded_buf = VA_INVALID_ID;
+    }
+}
+
+/**
+ * Copy the stream of each smaller layer into its own coded buffer. A
+ * stream that does not fit is cut short.
+ */
+static void rockchip_CollectSimulcast(object_context_p obj_context,
+        VADriverContextP ctx)
+{
+    INIT_DRIVER_DATA
+    encode_params_h264_p params = &obj_context->h264_params;
+    int i;
+
+    for (i = 1; i < params->num_spatial_layers; i++) {
+        simulcast_layer_p layer = &params->spatial[i - 1];
+        enc_context_p enc_ctx = layer->enc_ctx;
+        object_buffer_p obj_buffer;
+        coded_buffer_segment_p segment;
+        unsigned int size;
+
+        if (layer->pending_buf == VA_INVALID_ID)
+            continue;
+        obj_buffer = BUFFER(layer->pending_buf);
+        layer->pending_buf = VA_INVALID_ID;
+
+        if (v4l2_dqbuf_output(enc_ctx) < 0)
+            continue;
+
+        if (obj_buffer) {
+            segment = (coded_buffer_segment_p) obj_buffer->buffer_data;
+            size = enc_ctx->coded_size;
+            if (size > obj_buffer->buffer_size - CODED_BUFFER_HEADER_SIZE) {
+                size = obj_buffer->buffer_size - CODED_BUFFER_HEADER_SIZE;
+                LOG("simulcast layer %d: no room in the coded buffer\n", i);
+            }
+
+            memcpy(segment->base.buf, enc_ctx->coded_buffer, size);
+            segment->base.size = size;
+            segment->base.status = 0;
+            segment->base.next = NULL;
+            segment->temporal_id = params->temporal_id;
+        }
+
+        v4l2_qbuf_output(enc_ctx);
+    }
+}
+
+/**
+ * Code every picture of an H.264 encode context as num_layers streams,
+ * the context's own size and num_layers - 1 smaller ones, as far as they
+ * stay above the minimum size. It must be called before the first
+ * vaBeginPicture() of the context; 1 turns simulcast off again. This is
+ * not part of the VA API: applications look it up in the driver with
+ * dlsym().
+ */
+EXPORT VAStatus rockchip_SetSimulcast(VADisplay dpy, VAContextID context,
+        unsigned int num_layers)
+{
+    VADriverContextP ctx = rockchip_DisplayDriverContext(dpy);
+    object_context_p obj_context;
+
+    if (!ctx)
+        return VA_STATUS_ERROR_INVALID_DISPLAY;
+    if (!num_layers || num_layers > ROCKCHIP_MAX_SIMULCAST_LAYERS)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    INIT_DRIVER_DATA
+    obj_context = CONTEXT(context);
+    if (!obj_context || obj_context->codec != &rockchip_enc_h264_ops)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    if (obj_context->streaming || obj_context->current_render_target != -1)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    rockchip_DeinitSimulcast(obj_context);
+    if (rockchip_InitSimulcast(obj_context, num_layers) < 0) {
+        rockchip_DeinitSimulcast(obj_context);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+/**
+ * Coded buffer for a smaller simulcast layer of the current picture, set
+ * between vaBeginPicture() and vaEndPicture(). Layer 0 goes to the coded
+ * buffer of the picture parameters as usual. A layer given no coded
+ * buffer is not coded for the picture. Not part of the VA API either.
+ */
+EXPORT VAStatus rockchip_SetSimulcastCodedBuffer(VADisplay dpy,
+        VAContextID context, unsigned int layer, VABufferID coded_buf)
+{
+    VADriverContextP ctx = rockchip_DisplayDriverContext(dpy);
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+
+    if (!ctx)
+        return VA_STATUS_ERROR_INVALID_DISPLAY;
+
+    INIT_DRIVER_DATA
+    obj_context = CONTEXT(context);
+    if (!obj_context || obj_context->codec != &rockchip_enc_h264_ops)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    if (!layer ||
+            layer >= (unsigned int) obj_context->h264_params.num_spatial_layers)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    obj_buffer = BUFFER(coded_buf);
+    if (!obj_buffer || obj_buffer->type != VAEncCodedBufferType ||
+            obj_buffer->va_context != context)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    obj_context->h264_params.spatial[layer - 1].coded_buf = coded_buf;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_DeinitEncoder(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    if (!obj_context->enc_ctx->sw)
+        driver_data->num_shared_encoders--;
+
+    rockchip_DeinitSimulcast(obj_context);
+    v4l2_streamoff(obj_context->enc_ctx);
+    v4l2_deinit(obj_context->enc_ctx);
+    rockchip_scene_deinit(&obj_context->scene);
+    rockchip_static_deinit(&obj_context->duplicate);
+    rockchip_aq_deinit(&obj_context->aq);
+
+    LOG_DEINIT();
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_InitEncoder(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_config_p obj_config;
+    const char *aq_strength;
+    int i;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    /* Validate picture dimensions */
+    if (obj_context->picture_width < ROCKCHIP_MIN_WIDTH ||
+            obj_context->picture_width > ROCKCHIP_MAX_WIDTH ||
+            obj_context->picture_height < ROCKCHIP_MIN_HEIGHT ||
+            obj_context->picture_height > ROCKCHIP_MAX_HEIGHT ||
+            (obj_context->picture_width & 1) ||
+            (obj_context->picture_height & 1))
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+
+    if (!h264_find_level(obj_context->picture_width,
+                obj_context->picture_height, 0, 0, 0))
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+
+    LOG_INIT();
+
+    obj_context->enc_ctx = rockchip_OpenEncoder();
+    if (!obj_context->enc_ctx)
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    if (!obj_context->enc_ctx->sw)
+        driver_data->num_shared_encoders++;
+
+    obj_context->enc_ctx->width = obj_context->picture_width;
+    obj_context->enc_ctx->height = obj_context->picture_height;
+    obj_context->streaming = 0;
+    memset(&obj_context->h264_params, 0, sizeof(obj_context->h264_params));
+    memset(&obj_context->statistics, 0, sizeof(obj_context->statistics));
+    obj_context->h264_params.pending_surface = VA_INVALID_ID;
+    rockchip_rc_init(&obj_context->rc);
+    rockchip_scene_init(&obj_context->scene,
+            getenv("ROCKCHIP_VA_SCENE_CUT") != NULL,
+            obj_context->picture_width, obj_context->picture_height);
+    rockchip_static_init(&obj_context->duplicate,
+            getenv("ROCKCHIP_VA_SKIP_STATIC") != NULL,
+            obj_context->picture_width * obj_context->picture_height * 3 / 2);
+    aq_strength = getenv("ROCKCHIP_VA_AQ");
+    rockchip_aq_init(&obj_context->aq, aq_strength ? atof(aq_strength) : 0,
+            obj_context->picture_width, obj_context->picture_height);
+
+    obj_config = CONFIG(obj_context->config_id);
+    ASSERT(obj_config);
+
+    for (i = 0; i < obj_config->attrib_count; i++) {
+        if (obj_config->attrib_list[i].type == VAConfigAttribRateControl)
+            rockchip_rc_set_mode(&obj_context->rc,
+                    obj_config->attrib_list[i].value);
+    }
+
+    LOG("resolution:%dx%d\n",
+            obj_context->picture_width, obj_context->picture_height);
+    gettimeofday(&obj_context->statistics.tm, NULL);
+
+    if (v4l2_s_fmt(obj_context->enc_ctx) < 0)
+        goto failed_v4l2;
+
+    if (v4l2_reqbufs(obj_context->enc_ctx) < 0)
+        goto failed_v4l2;
+
+    if (v4l2_querybuf(obj_context->enc_ctx) < 0)
+        goto failed_v4l2;
+
+    /* Simulcast is off until rockchip_SetSimulcast() */
+    obj_context->h264_params.num_spatial_layers = 1;
+
+    return VA_STATUS_SUCCESS;
+
+failed_v4l2:
+    rockchip_DeinitEncoder(ctx, context);
+
+    return VA_STATUS_ERROR_UNKNOWN;
+}
+static VAStatus rockchip_PrepareEncode(
+        VADriverContextP ctx,
+        VAContextID context,
+        VASurfaceID render_target)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+    object_buffer_p obj_buffer;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_surface = SURFACE(render_target);
+    ASSERT(obj_surface);
+
+    obj_context->current_render_target = obj_surface->base.id;
+    obj_surface->context_id = context;
+
+    /**
+     * The surface is complete by now, analyse it while buffers come in,
+     * unless a statistics pass over it already did
+     */
+    obj_buffer = BUFFER(obj_surface->image.buf);
+    if (obj_surface->stats.valid &&
+            !rockchip_aq_from_stats(&obj_context->aq, &obj_surface->stats))
+        ;
+    else if (obj_buffer)
+        rockchip_aq_start(&obj_context->aq, obj_buffer->buffer_data);
+
+    obj_context->h264_params.num_slices = 0;
+    obj_context->h264_params.frame_intra = 0;
+    obj_context->h264_params.force_key_frame = 0;
+    obj_context->h264_params.frame_skipped = 0;
+    obj_context->h264_params.dirty_valid = 0;
+    memset(&obj_context->h264_params.roi, 0,
+            sizeof(obj_context->h264_params.roi));
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessSPS(VADriverContextP ctx, VAContextID context, VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+    h264_header_info_p header;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+   
+    obj_buffer = BUFFER(buffer);
+    ASSERT(obj_buffer);
+
+    ASSERT(obj_buffer->type == VAEncSequenceParameterBufferType);
+    ASSERT(obj_buffer->num_elements == 1);
+    ASSERT(obj_buffer->buffer_size == sizeof(VAEncSequenceParameterBufferH264));
+
+    if ((obj_buffer->num_elements != 1) ||
+        (obj_buffer->buffer_size != sizeof(VAEncSequenceParameterBufferH264))) {
+        return VA_STATUS_ERROR_UNKNOWN;
+    }
+
+    VAEncSequenceParameterBufferH264 *sps, sps_fixed;
+    const h264_level_t *level;
+    int fps_num = 0, fps_den = 0;
+
+    sps = (VAEncSequenceParameterBufferH264 *) obj_buffer->buffer_data;
+
+    /* VA signals frame rate as time_scale / (2 * num_units_in_tick) */
+    if (sps->vui_parameters_present_flag &&
+            sps->vui_fields.bits.timing_info_present_flag &&
+            sps->num_units_in_tick) {
+        fps_num = sps->time_scale;
+        fps_den = 2 * sps->num_units_in_tick;
+    }
+
+    level = h264_find_level(sps->picture_width_in_mbs * 16,
+            sps->picture_height_in_mbs * 16, fps_num, fps_den,
+            sps->bits_per_second);
+    if (!level) {
+        LOG("%dx%d MBs at %d/%d fps, %u bps fits no H.264 level\n",
+                sps->picture_width_in_mbs, sps->picture_height_in_mbs,
+                fps_num, fps_den, sps->bits_per_second);
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    /* Never signal a level the stream does not conform to */
+    sps_fixed = *sps;
+    if (sps_fixed.level_idc < level->level_idc) {
+        LOG("raising level_idc %d to %d\n", sps_fixed.level_idc,
+                level->level_idc);
+        sps_fixed.level_idc = level->level_idc;
+    }
+    sps = &sps_fixed;
+
+    obj_context->h264_params.intra_period = sps->intra_period;
+
+    header = &obj_context->h264_params.header;
+    header->log2_max_frame_num =
+        sps->seq_fields.bits.log2_max_frame_num_minus4 + 4;
+    header->pic_order_cnt_type = sps->seq_fields.bits.pic_order_cnt_type;
+    header->log2_max_poc_lsb =
+        sps->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4 + 4;
+    header->delta_pic_order_always_zero =
+        sps->seq_fields.bits.delta_pic_order_always_zero_flag;
+    header->frame_mbs_only = sps->seq_fields.bits.frame_mbs_only_flag;
+    header->chroma_format_idc = sps->seq_fields.bits.chroma_format_idc;
+
+    struct v4l2_ext_controls *ext_ctrls;
+
+    obj_context->ctrl[0].id = V4L2_CID_PRIVATE_ROCKCHIP_VAENC_SPS;
+    obj_context->ctrl[0].ptr = sps;
+    obj_context->ctrl[0].size = sizeof(*sps);
+
+    ext_ctrls = calloc(1, sizeof(*ext_ctrls));
+    ext_ctrls->ctrl_class = 0;
+    ext_ctrls->count = 1;
+    ext_ctrls->controls = &obj_context->ctrl[0];
+
+    v4l2_s_ext_ctrls(obj_context->enc_ctx, ext_ctrls);
+
+    free(ext_ctrls);
+
+    rockchip_SimulcastSPS(obj_context, sps, fps_num, fps_den);
+
+    return VA_STATUS_SUCCESS;
+}
+
+/**
+ * Place the picture in the temporal layer pattern. Upper layer pictures
+ * are turned into non-reference pictures, so frame_num is renumbered the
+ * way H.264 counts it: one past the last reference picture.
+ */
+static void rockchip_SetTemporalLayer(object_context_p obj_context,
+        VAEncPictureParameterBufferH264 *pps)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    int max_frame_num = 1 << params->header.log2_max_frame_num;
+
+    if (pps->pic_fields.bits.idr_pic_flag) {
+        params->layer_index = 0;
+        params->temporal_id = 0;
+        params->prev_ref_frame_num = 0;
+        pps->frame_num = 0;
+        return;
+    }
+
+    params->temporal_id =
+        params->layer_ids[params->layer_index % params->layer_period];
+
+    pps->pic_fields.bits.reference_pic_flag = params->temporal_id == 0;
+
+    pps->frame_num = (params->prev_ref_frame_num + 1) % max_frame_num;
+    if (pps->pic_fields.bits.reference_pic_flag)
+        params->prev_ref_frame_num = pps->frame_num;
+}
+
+static VAStatus rockchip_ProcessPPS(VADriverContextP ctx, VAContextID context, VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+    h264_header_info_p header;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+   
+    obj_buffer = BUFFER(buffer);
+    ASSERT(obj_buffer);
+
+    ASSERT(obj_buffer->type == VAEncPictureParameterBufferType);
+
+    if ((obj_buffer->num_elements != 1) ||
+        (obj_buffer->buffer_size != sizeof(VAEncPictureParameterBufferH264))) {
+        return VA_STATUS_ERROR_UNKNOWN;
+    }
+
+    VAEncPictureParameterBufferH264 *pps;
+    pps = (VAEncPictureParameterBufferH264 *) obj_buffer->buffer_data;
+
+    VAEncPictureParameterBufferH264 layer_pps;
+    encode_params_h264_p params = &obj_context->h264_params;
+    int i;
+
+    params->temporal_id = 0;
+    if (params->num_layers > 1) {
+        layer_pps = *pps;
+        rockchip_SetTemporalLayer(obj_context, &layer_pps);
+        pps = &layer_pps;
+    } else if (params->num_skipped && params->last_slice_valid &&
+            !pps->pic_fields.bits.idr_pic_flag) {
+        /* frame_num goes on from the skip slices, not the application's count */
+        layer_pps = *pps;
+        layer_pps.frame_num = (params->last_slice.frame_num + 1) %
+            (1 << params->stream_header.log2_max_frame_num);
+        pps = &layer_pps;
+    }
+    obj_context->rc.temporal_id = params->temporal_id;
+
+    /* Follow frame_num, for a layer pattern that starts mid-stream */
+    if (params->num_layers <= 1 && (pps->pic_fields.bits.reference_pic_flag ||
+                pps->pic_fields.bits.idr_pic_flag))
+        params->prev_ref_frame_num = pps->frame_num;
+
+    struct v4l2_ext_controls *ext_ctrls;
+
+    obj_context->ctrl[0].id = V4L2_CID_PRIVATE_ROCKCHIP_VAENC_PPS;
+    obj_context->ctrl[0].ptr = pps;
+    obj_context->ctrl[0].size = sizeof(*pps);
+
+    ext_ctrls = calloc(1, sizeof(*ext_ctrls));
+    ext_ctrls->ctrl_class = 0;
+    ext_ctrls->count = 1;
+    ext_ctrls->controls = &obj_context->ctrl[0];
+
+    v4l2_s_ext_ctrls(obj_context->enc_ctx, ext_ctrls);
+    free(ext_ctrls);
+
+    for (i = 1; i < params->num_spatial_layers; i++)
+        v4l2_s_ctrl_ptr(params->spatial[i - 1].enc_ctx,
+                V4L2_CID_PRIVATE_ROCKCHIP_VAENC_PPS, pps, sizeof(*pps));
+
+    obj_context->h264_params.coded_buf = pps->coded_buf;
+
+    header = &obj_context->h264_params.header;
+    header->pic_init_qp = pps->pic_init_qp;
+    header->pic_order_present = pps->pic_fields.bits.pic_order_present_flag;
+    header->redundant_pic_cnt_present =
+        pps->pic_fields.bits.redundant_pic_cnt_present_flag;
+    header->weighted_pred = pps->pic_fields.bits.weighted_pred_flag;
+    header->weighted_bipred_idc = pps->pic_fields.bits.weighted_bipred_idc;
+    header->num_ref_idx_default[0] = pps->num_ref_idx_l0_active_minus1 + 1;
+    header->num_ref_idx_default[1] = pps->num_ref_idx_l1_active_minus1 + 1;
+    header->entropy_coding_mode = pps->pic_fields.bits.entropy_coding_mode_flag;
+    header->deblocking_filter_control_present =
+        pps->pic_fields.bits.deblocking_filter_control_present_flag;
+    header->pic_parameter_set_id = pps->pic_parameter_set_id;
+    /**
+     * Do not count on the plugin following idr_pic_flag, an IDR asked for
+     * in the middle of its GOP (a PLI from a receiver) would otherwise
+     * come out as a P frame.
+     */
+    if (pps->pic_fields.bits.idr_pic_flag) {
+        obj_context->h264_params.frame_intra = 1;
+        obj_context->h264_params.force_key_frame = 1;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessSliceParam(VADriverContextP ctx, VAContextID context, VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+    encode_params_h264_p params;
+    VAEncSliceParameterBufferH264 slice_h264;
+    int first_slice, element_size;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+   
+    obj_buffer = BUFFER(buffer);
+    ASSERT(obj_buffer);
+
+    ASSERT(obj_buffer->type == VAEncSliceParameterBufferType);
+
+    if (!obj_buffer->num_elements)
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    params = &obj_context->h264_params;
+    first_slice = !params->num_slices;
+    params->num_slices += obj_buffer->num_elements;
+
+    /**
+     * A picture may carry several slice parameter buffers, each with one
+     * or more elements. The VPU only does equally sized slices, so the
+     * first slice decides the slice size for the whole picture.
+     */
+    if (!first_slice)
+        return VA_STATUS_SUCCESS;
+
+    /* Legacy slice parameters are converted, the plugin takes the H.264 ones */
+    element_size = obj_buffer->buffer_size / obj_buffer->num_elements;
+    if (element_size == sizeof(VAEncSliceParameterBufferH264)) {
+        slice_h264 = *(VAEncSliceParameterBufferH264 *) obj_buffer->buffer_data;
+        params->slice_mbs = slice_h264.num_macroblocks;
+        /* slice_type 2 and 7 are I slices */
+        if (slice_h264.slice_type % 5 == 2)
+            params->frame_intra = 1;
+    } else if (element_size == sizeof(VAEncSliceParameterBuffer)) {
+        VAEncSliceParameterBuffer *slice =
+            (VAEncSliceParameterBuffer *) obj_buffer->buffer_data;
+        int mb_width = ALIGN(obj_context->picture_width, 16) / 16;
+
+        params->slice_mbs = slice->slice_height * mb_width;
+
+        memset(&slice_h264, 0, sizeof(slice_h264));
+        slice_h264.macroblock_address = slice->start_row_number * mb_width;
+        slice_h264.num_macroblocks = params->slice_mbs;
+        slice_h264.slice_type = slice->slice_flags.bits.is_intra ? 2 : 0;
+        slice_h264.disable_deblocking_filter_idc =
+            slice->slice_flags.bits.disable_deblocking_filter_idc;
+    } else {
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    }
+
+    v4l2_s_ctrl_ptr(obj_context->enc_ctx, V4L2_CID_PRIVATE_ROCKCHIP_VAENC_SLICE,
+            &slice_h264, sizeof(slice_h264));
+
+    rockchip_SimulcastSlice(obj_context, &slice_h264);
+
+    return VA_STATUS_SUCCESS;
+}
+
+#if VA_CHECK_VERSION(0, 40, 0)
+/**
+ * Keep a macroblock aligned copy of the dirty rectangles, the array they
+ * point to belongs to the application. Anything we cannot use falls back
+ * to a full upload.
+ */
+static void rockchip_SetDirtyRects(object_context_p obj_context,
+        VAEncMiscParameterBufferDirtyRect *dirty_rect)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    int width = obj_context->picture_width;
+    int height = obj_context->picture_height;
+    unsigned int i;
+
+    params->dirty_valid = 0;
+    params->num_dirty_rects = 0;
+
+    if (!dirty_rect->num_roi_rectangle || !dirty_rect->roi_rectangle ||
+            dirty_rect->num_roi_rectangle > ROCKCHIP_MAX_DIRTY_RECTS)
+        return;
+
+    for (i = 0; i < dirty_rect->num_roi_rectangle; i++) {
+        VARectangle *rect = &dirty_rect->roi_rectangle[i];
+        int left = rect->x > 0 ? rect->x & ~15 : 0;
+        int top = rect->y > 0 ? rect->y & ~15 : 0;
+        int right = ALIGN(rect->x + rect->width, 16);
+        int bottom = ALIGN(rect->y + rect->height, 16);
+
+        if (right > width)
+            right = width;
+        if (bottom > height)
+            bottom = height;
+        if (right <= left || bottom <= top)
+            continue;
+
+        rect = &params->dirty_rects[params->num_dirty_rects++];
+        rect->x = left;
+        rect->y = top;
+        rect->width = right - left;
+        rect->height = bottom - top;
+    }
+
+    params->dirty_valid = 1;
+}
+#endif
+
+/**
+ * Convert the application's regions of interest into the VPU's two ROI
+ * areas. When more are given, the ones asking for the largest QP drop
+ * win. Priorities are taken as that many QP steps down. Positive deltas
+ * cannot be expressed and are dropped.
+ */
+static void rockchip_SetRoi(object_context_p obj_context,
+        VAEncMiscParameterBufferROI *roi)
+{
+    struct rk_vepu_roi *out = &obj_context->h264_params.roi;
+    int mb_width = ALIGN(obj_context->picture_width, 16) / 16;
+    int mb_height = ALIGN(obj_context->picture_height, 16) / 16;
+    unsigned int i;
+    int j, k, n = 0;
+
+    memset(out, 0, sizeof(*out));
+
+    if (!roi->roi)
+        return;
+
+    for (i = 0; i < roi->num_roi; i++) {
+        VARectangle *rect = &roi->roi[i].roi_rectangle;
+        int delta = roi->roi[i].roi_value;
+        struct rk_vepu_area area;
+
+#if VA_CHECK_VERSION(1, 0, 0)
+        if (!roi->roi_flags.bits.roi_value_is_qp_delta) {
+            delta = -delta;
+        } else
+#endif
+        {
+            if (delta < roi->min_delta_qp)
+                delta = roi->min_delta_qp;
+            if (delta > roi->max_delta_qp)
+                delta = roi->max_delta_qp;
+        }
+        if (delta < RK_VEPU_MIN_ROI_QP_DELTA)
+            delta = RK_VEPU_MIN_ROI_QP_DELTA;
+        if (delta >= 0)
+            continue;
+
+        area.enable = 1;
+        area.left = rect->x > 0 ? rect->x / 16 : 0;
+        area.top = rect->y > 0 ? rect->y / 16 : 0;
+        area.right = (rect->x + rect->width + 15) / 16 - 1;
+        area.bottom = (rect->y + rect->height + 15) / 16 - 1;
+        if (area.right >= mb_width)
+            area.right = mb_width - 1;
+        if (area.bottom >= mb_height)
+            area.bottom = mb_height - 1;
+        if (area.right < area.left || area.bottom < area.top)
+            continue;
+
+        /* Insert sorted by delta, most negative first */
+        for (j = 0; j < n && out->qp_delta[j] <= delta; j++)
+            ;
+        if (j >= ROCKCHIP_MAX_ROI)
+            continue;
+
+        for (k = (n < ROCKCHIP_MAX_ROI ? n : ROCKCHIP_MAX_ROI - 1); k > j; k--) {
+            out->area[k] = out->area[k - 1];
+            out->qp_delta[k] = out->qp_delta[k - 1];
+        }
+        out->area[j] = area;
+        out->qp_delta[j] = delta;
+        if (n < ROCKCHIP_MAX_ROI)
+            n++;
+    }
+}
+
+#if VA_CHECK_VERSION(0, 40, 0)
+/**
+ * A single layer or a pattern we cannot follow turns temporal layering
+ * off. A pattern other than the current one starts over with the next
+ * picture, frame_num going on from the last reference picture.
+ */
+static void rockchip_SetLayerStructure(object_context_p obj_context,
+        VAEncMiscParameterTemporalLayerStructure *layers)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    int num_layers = 0, layer_ids[32];
+    unsigned int i;
+
+    if (layers->number_of_layers < 2 ||
+            layers->number_of_layers > ROCKCHIP_MAX_TEMPORAL_LAYERS ||
+            !layers->periodicity || layers->periodicity > 32)
+        goto done;
+
+    for (i = 0; i < layers->periodicity; i++) {
+        if (layers->layer_id[i] >= layers->number_of_layers)
+            goto done;
+        layer_ids[i] = layers->layer_id[i];
+    }
+
+    num_layers = layers->number_of_layers;
+
+    /* Applications may send the same structure again with every sequence */
+    if (num_layers == params->num_layers &&
+            (int) layers->periodicity == params->layer_period &&
+            !memcmp(layer_ids, params->layer_ids, i * sizeof(layer_ids[0])))
+        return;
+
+    memcpy(params->layer_ids, layer_ids, i * sizeof(layer_ids[0]));
+    params->layer_period = layers->periodicity;
+
+done:
+    if (num_layers == params->num_layers && !num_layers)
+        return;
+
+    params->num_layers = num_layers;
+    params->layer_index = 0;
+    rockchip_rc_set_layers(&obj_context->rc, params->num_layers);
+}
+#endif
+
+/**
+ * Program the preset of a VA quality level, 0 selecting our default.
+ * Controls the VPU does not have are skipped, the rest still applies.
+ */
+static void rockchip_SetQualityLevel(object_context_p obj_context,
+        unsigned int level)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    enc_context_p enc_ctx;
+    int i;
+
+    if (level == 0)
+        level = ROCKCHIP_QUALITY_DEFAULT;
+    if (level > ROCKCHIP_QUALITY_LEVELS)
+        level = ROCKCHIP_QUALITY_LEVELS;
+    if (level == params->quality_level)
+        return;
+
+    for (i = 0; i < params->num_spatial_layers; i++) {
+        enc_ctx = rockchip_LayerContext(obj_context, i);
+
+        v4l2_s_ctrl(enc_ctx, V4L2_CID_MPEG_VIDEO_MV_H_SEARCH_RANGE,
+                rockchip_quality_presets[level - 1].mv_h_range);
+        v4l2_s_ctrl(enc_ctx, V4L2_CID_MPEG_VIDEO_MV_V_SEARCH_RANGE,
+                rockchip_quality_presets[level - 1].mv_v_range);
+        v4l2_s_ctrl(enc_ctx, V4L2_CID_MPEG_VIDEO_H264_LOOP_FILTER_MODE,
+                rockchip_quality_presets[level - 1].loop_filter);
+        v4l2_s_ctrl_ptr(enc_ctx, V4L2_CID_PRIVATE_ROCKCHIP_VAENC_QUALITY,
+                (void *) &rockchip_quality_presets[level - 1].vepu,
+                sizeof(struct rk_vepu_quality));
+    }
+
+    LOG("quality level:%d\n", level);
+    params->quality_level = level;
+}
+
+static VAStatus rockchip_ProcessMiscParam(VADriverContextP ctx, VAContextID context, VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+   
+    obj_buffer = BUFFER(buffer);
+    ASSERT(obj_buffer);
+
+    VAEncMiscParameterFrameRate *frame_rate;
+    VAEncMiscParameterRateControl *rate_control;
+    VAEncMiscParameterAIR *air;
+    VAEncMiscParameterMaxSliceSize *max_slice_size;
+    VAEncMiscParameterHRD *hrd;
+    VAEncMiscParameterBufferMaxFrameSize *max_frame_size;
+#if VA_CHECK_VERSION(0, 40, 0)
+    VAEncMiscParameterBufferDirtyRect *dirty_rect;
+#endif
+    VAEncMiscParameterBufferROI *roi;
+    VAEncMiscParameterBufferQualityLevel *quality_level;
+#if VA_CHECK_VERSION(0, 40, 0)
+    VAEncMiscParameterTemporalLayerStructure *layers;
+#endif
+    int temporal_id = 0;
+    int i;
+
+    ASSERT(obj_buffer->type == VAEncMiscParameterBufferType);
+
+    VAEncMiscParameterBuffer *misc_param;
+    misc_param = (VAEncMiscParameterBuffer *) obj_buffer->buffer_data;
+
+    /**
+     * TODO: Do real controls
+     */
+    switch (misc_param->type) {
+    case VAEncMiscParameterTypeFrameRate:
+        frame_rate = (VAEncMiscParameterFrameRate *)misc_param->data;
+
+        /* Fractional rates come as (denominator << 16 | numerator) */
+        int fps_num = frame_rate->framerate & 0xffff;
+        int fps_den = (frame_rate->framerate >> 16) ? : 1;
+
+#if VA_CHECK_VERSION(0, 40, 0)
+        temporal_id = frame_rate->framerate_flags.bits.temporal_id;
+#endif
+        rockchip_rc_set_framerate(&obj_context->rc, temporal_id,
+                fps_num, fps_den);
+
+        /* The VPU runs at the rate of the whole stream, the top layer */
+        if (temporal_id + 1 < obj_context->h264_params.num_layers)
+            break;
+
+	struct v4l2_streamparm parms;
+	memset(&parms, 0, sizeof(parms));
+	parms.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	// Note that we are provided "frames per second" but V4L2 expects "time per
+	// frame"; hence we provide the reciprocal of the framerate here.
+	parms.parm.output.timeperframe.numerator = fps_den;
+	parms.parm.output.timeperframe.denominator = fps_num;
+
+	v4l2_s_parm(obj_context->enc_ctx, &parms);
+        for (i = 1; i < obj_context->h264_params.num_spatial_layers; i++)
+            v4l2_s_parm(obj_context->h264_params.spatial[i - 1].enc_ctx,
+                    &parms);
+
+        break;
+    case VAEncMiscParameterTypeRateControl:
+        rate_control = (VAEncMiscParameterRateControl *)misc_param->data;
+
+        rockchip_rc_set_params(&obj_context->rc, rate_control);
+
+#if VA_CHECK_VERSION(0, 40, 0)
+        temporal_id = rate_control->rc_flags.bits.temporal_id;
+#endif
+        if (temporal_id + 1 < obj_context->h264_params.num_layers)
+            break;
+
+        struct v4l2_ext_controls *ext_ctrls;
+
+        obj_context->ctrl[0].id = V4L2_CID_PRIVATE_ROCKCHIP_VAENC_RC;
+        obj_context->ctrl[0].ptr = rate_control;
+        obj_context->ctrl[0].size = sizeof(*rate_control);
+
+        ext_ctrls = calloc(1, sizeof(*ext_ctrls));
+        ext_ctrls->ctrl_class = 0;
+        ext_ctrls->count = 1;
+        ext_ctrls->controls = &obj_context->ctrl[0];
+
+        v4l2_s_ext_ctrls(obj_context->enc_ctx, ext_ctrls);
+        free(ext_ctrls);
+
+        rockchip_SimulcastRateControl(obj_context, rate_control);
+
+        break;
+    case VAEncMiscParameterTypeAIR:
+        air = (VAEncMiscParameterAIR *)misc_param->data;
+
+        /**
+         * The VPU refreshes a fixed number of macroblocks per frame, so
+         * air_threshold and air_auto have nothing to map to.
+         */
+        obj_context->h264_params.air_num_mbs = air->air_num_mbs;
+        obj_context->h264_params.air_column = 0;
+
+        if (v4l2_s_ctrl(obj_context->enc_ctx,
+                    V4L2_CID_MPEG_VIDEO_CYCLIC_INTRA_REFRESH_MB,
+                    air->air_num_mbs) < 0) {
+            /* Fall back to cycling a forced intra area from the host */
+            obj_context->h264_params.air_host = 1;
+        }
+        break;
+    case VAEncMiscParameterTypeMaxSliceSize:
+        max_slice_size = (VAEncMiscParameterMaxSliceSize *)misc_param->data;
+
+        /* In bytes, applied by rockchip_UpdateSliceMode() */
+        obj_context->h264_params.max_slice_size = max_slice_size->max_slice_size;
+        break;
+    case VAEncMiscParameterTypeHRD:
+        hrd = (VAEncMiscParameterHRD *)misc_param->data;
+
+        rockchip_rc_set_hrd(&obj_context->rc,
+                hrd->buffer_size, hrd->initial_buffer_fullness);
+
+        /* In kilobytes */
+        v4l2_s_ctrl(obj_context->enc_ctx, V4L2_CID_MPEG_VIDEO_H264_CPB_SIZE,
+                hrd->buffer_size / 8192);
+        for (i = 1; i < obj_context->h264_params.num_spatial_layers; i++)
+            v4l2_s_ctrl(obj_context->h264_params.spatial[i - 1].enc_ctx,
+                    V4L2_CID_MPEG_VIDEO_H264_CPB_SIZE,
+                    rockchip_LayerBitrate(obj_context, i,
+                        hrd->buffer_size) / 8192);
+        break;
+    case VAEncMiscParameterTypeMaxFrameSize:
+        /* This one carries its own type field, so map the whole buffer */
+        max_frame_size =
+            (VAEncMiscParameterBufferMaxFrameSize *)obj_buffer->buffer_data;
+
+        /* In bits, checked by rockchip_CollectFrame() */
+        obj_context->h264_params.max_frame_size = max_frame_size->max_frame_size;
+        break;
+#if VA_CHECK_VERSION(0, 40, 0)
+    case VAEncMiscParameterTypeDirtyRect:
+        dirty_rect = (VAEncMiscParameterBufferDirtyRect *)misc_param->data;
+
+        rockchip_SetDirtyRects(obj_context, dirty_rect);
+        break;
+#endif
+#if VA_CHECK_VERSION(0, 40, 0)
+    case VAEncMiscParameterTypeTemporalLayerStructure:
+        layers = (VAEncMiscParameterTemporalLayerStructure *)misc_param->data;
+
+        rockchip_SetLayerStructure(obj_context, layers);
+        break;
+#endif
+    case VAEncMiscParameterTypeQualityLevel:
+        quality_level = (VAEncMiscParameterBufferQualityLevel *)misc_param->data;
+
+        rockchip_SetQualityLevel(obj_context, quality_level->quality_level);
+        break;
+    case VAEncMiscParameterTypeROI:
+        roi = (VAEncMiscParameterBufferROI *)misc_param->data;
+
+        rockchip_SetRoi(obj_context, roi);
+        break;
+    default:
+        return VA_STATUS_ERROR_UNKNOWN;
+        break;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+/**
+ * Host-side intra refresh: force a band of macroblock columns to intra
+ * and move it across the picture by one band per frame, so every
+ * macroblock gets refreshed once per (mb_width / band) frames.
+ */
+static void rockchip_UpdateIntraRefresh(object_context_p obj_context)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    struct rk_vepu_area area;
+    int mb_width = ALIGN(obj_context->picture_width, 16) / 16;
+    int mb_height = ALIGN(obj_context->picture_height, 16) / 16;
+    int columns;
+
+    if (!params->air_host)
+        return;
+
+    memset(&area, 0, sizeof(area));
+
+    if (params->air_num_mbs > 0) {
+        columns = (params->air_num_mbs + mb_height - 1) / mb_height;
+        if (columns > mb_width)
+            columns = mb_width;
+
+        if (params->air_column + columns > mb_width)
+            params->air_column = 0;
+
+        area.enable = 1;
+        area.top = 0;
+        area.bottom = mb_height - 1;
+        area.left = params->air_column;
+        area.right = params->air_column + columns - 1;
+
+        params->air_column += columns;
+    } else {
+        /* Refresh turned off, send a disabled area once */
+        params->air_host = 0;
+    }
+
+    v4l2_s_ctrl_ptr(obj_context->enc_ctx,
+            V4L2_CID_PRIVATE_ROCKCHIP_VAENC_INTRA_AREA,
+            &area, sizeof(area));
+}
+
+/**
+ * Program the slice layout of the next frame. A byte limit takes priority
+ * over the macroblock count from the slice parameters. Fails when the
+ * plugin rejects the layout, rather than coding the frame with another.
+ */
+static int rockchip_UpdateSliceMode(object_context_p obj_context)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    int mode, arg, ret = 0;
+
+    if (params->max_slice_size > 0) {
+        mode = V4L2_MPEG_VIDEO_MULTI_SICE_MODE_MAX_BYTES;
+        arg = params->max_slice_size;
+    } else if (params->num_slices > 1 && params->slice_mbs > 0) {
+        mode = V4L2_MPEG_VIDEO_MULTI_SICE_MODE_MAX_MB;
+        arg = params->slice_mbs;
+    } else {
+        mode = V4L2_MPEG_VIDEO_MULTI_SLICE_MODE_SINGLE;
+        arg = 0;
+    }
+
+    if (mode == params->slice_mode && arg == params->slice_arg)
+        return 0;
+
+    if (mode == V4L2_MPEG_VIDEO_MULTI_SICE_MODE_MAX_BYTES)
+        ret = v4l2_s_ctrl(obj_context->enc_ctx,
+                V4L2_CID_MPEG_VIDEO_MULTI_SLICE_MAX_BYTES, arg);
+    else if (mode == V4L2_MPEG_VIDEO_MULTI_SICE_MODE_MAX_MB)
+        ret = v4l2_s_ctrl(obj_context->enc_ctx,
+                V4L2_CID_MPEG_VIDEO_MULTI_SLICE_MAX_MB, arg);
+
+    if (ret < 0 || v4l2_s_ctrl(obj_context->enc_ctx,
+                V4L2_CID_MPEG_VIDEO_MULTI_SLICE_MODE, mode) < 0) {
+        LOG("slice mode %d (%d) rejected\n", mode, arg);
+        return -1;
+    }
+
+    params->slice_mode = mode;
+    params->slice_arg = arg;
+
+    return 0;
+}
+
+/**
+ * Send the regions of interest when they differ from the last frame,
+ * including once more with everything disabled when they go away.
+ */
+static void rockchip_UpdateRoi(object_context_p obj_context)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+
+    if (!memcmp(&params->roi, &params->roi_sent, sizeof(params->roi)))
+        return;
+
+    v4l2_s_ctrl_ptr(obj_context->enc_ctx, V4L2_CID_PRIVATE_ROCKCHIP_VAENC_ROI,
+            &params->roi, sizeof(params->roi));
+    params->roi_sent = params->roi;
+}
+
+/**
+ * Pick up the adaptive quantization map of this picture. When the VPU
+ * does not take it, analysis is turned off for the rest of the stream.
+ */
+static void rockchip_UpdateQpMap(object_context_p obj_context)
+{
+    aq_map_p aq = &obj_context->aq;
+    signed char *map;
+
+    map = rockchip_aq_wait(aq);
+    if (!map)
+        return;
+
+    if (v4l2_s_ctrl_ptr(obj_context->enc_ctx,
+                V4L2_CID_PRIVATE_ROCKCHIP_VAENC_QP_MAP,
+                map, aq->mb_width * aq->mb_height) < 0) {
+        LOG("qp map not supported, adaptive quantization off\n");
+        rockchip_aq_deinit(aq);
+    }
+}
+
+/**
+ * With a host-side algorithm, program the QP it picked for this picture
+ * and keep the VPU's own frame rate control out of the way. Otherwise
+ * feed the HRD model into the VPU rate control: a size hint for the next
+ * frame and QP clamps that keep the buffer away from under/overflow.
+ */
+static void rockchip_UpdateRateControl(object_context_p obj_context)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    rate_control_p rc = &obj_context->rc;
+    int intra = params->frame_intra;
+    int floor_qp = params->overflow_qp;
+    int min_qp, max_qp, target_bits, qp;
+
+    /* The raised QP after an oversized frame holds for one frame */
+    params->overflow_qp = 0;
+
+    qp = rockchip_rc_frame_qp(rc, intra);
+    if (qp >= 0) {
+        if (qp < floor_qp)
+            qp = floor_qp;
+
+        if (!rc->vpu_rc_disabled) {
+            v4l2_s_ctrl(obj_context->enc_ctx,
+                    V4L2_CID_MPEG_VIDEO_FRAME_RC_ENABLE, 0);
+            rc->vpu_rc_disabled = 1;
+        }
+
+        if (qp != rc->qp[intra]) {
+            v4l2_s_ctrl(obj_context->enc_ctx, intra ?
+                    V4L2_CID_MPEG_VIDEO_H264_I_FRAME_QP :
+                    V4L2_CID_MPEG_VIDEO_H264_P_FRAME_QP, qp);
+            rc->qp[intra] = qp;
+        }
+        return;
+    }
+
+    if (rc->cpb_size && rc->bitrate) {
+        rockchip_rc_qp_range(rc, &min_qp, &max_qp);
+        target_bits = rockchip_rc_target_bits(rc);
+    } else if (floor_qp || rc->min_qp) {
+        /* No HRD, only the floor to set or to take back */
+        min_qp = ROCKCHIP_QP_MIN;
+        max_qp = ROCKCHIP_QP_MAX;
+        target_bits = rc->target_bits;
+    } else {
+        return;
+    }
+
+    if (floor_qp > min_qp)
+        min_qp = floor_qp < max_qp ? floor_qp : max_qp;
+
+    if (min_qp != rc->min_qp) {
+        v4l2_s_ctrl(obj_context->enc_ctx,
+                V4L2_CID_MPEG_VIDEO_H264_MIN_QP, min_qp);
+        rc->min_qp = min_qp;
+    }
+
+    if (max_qp != rc->max_qp) {
+        v4l2_s_ctrl(obj_context->enc_ctx,
+                V4L2_CID_MPEG_VIDEO_H264_MAX_QP, max_qp);
+        rc->max_qp = max_qp;
+    }
+
+    if (target_bits != rc->target_bits) {
+        v4l2_s_ctrl(obj_context->enc_ctx,
+                V4L2_CID_PRIVATE_ROCKCHIP_VAENC_TARGET_BITS, target_bits);
+        rc->target_bits = target_bits;
+    }
+}
+
+/**
+ * The frame came out larger than the max frame size. It cannot be coded
+ * again: the VPU has already taken it as its reference and advanced
+ * frame_num and POC. So the next frame gets a QP floor instead, sized from
+ * the overshoot, roughly 6 QP per halving of the frame.
+ */
+static void rockchip_LimitFrameSize(object_context_p obj_context,
+        unsigned int coded_bits)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    rate_control_p rc = &obj_context->rc;
+    enc_context_p enc_ctx = obj_context->enc_ctx;
+    int qp = -1;
+
+    if (params->stream_headers == H264_HEADERS_ALL)
+        qp = h264_slice_qp(&params->stream_header, enc_ctx->coded_buffer,
+                enc_ctx->coded_size);
+    if (qp < 0)
+        qp = rc->qp[params->frame_intra] ? rc->qp[params->frame_intra] :
+            ROCKCHIP_QP_DEFAULT;
+
+    qp += (int) ceil(6.0 * log2((double) coded_bits /
+                params->max_frame_size)) + 1;
+    if (qp > ROCKCHIP_QP_MAX)
+        qp = ROCKCHIP_QP_MAX;
+
+    params->overflow_qp = qp;
+}
+
+/**
+ * Keep the slice header of the picture the VPU just coded, for the skip
+ * slices that may follow it.
+ */
+static void rockchip_ReadStreamSlice(object_context_p obj_context)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    enc_context_p enc_ctx = obj_context->enc_ctx;
+    h264_slice_header_t hdr;
+    int max_poc_lsb;
+
+    if (params->stream_headers != H264_HEADERS_ALL ||
+            h264_first_slice_header(&params->stream_header,
+                enc_ctx->coded_buffer, enc_ctx->coded_size, &hdr) < 0) {
+        params->last_slice_valid = 0;
+        params->poc_step = 0;
+        return;
+    }
+
+    max_poc_lsb = 1 << params->stream_header.log2_max_poc_lsb;
+    if (params->last_slice_valid && !hdr.idr)
+        params->poc_step = (hdr.pic_order_cnt_lsb -
+                params->last_slice.pic_order_cnt_lsb + max_poc_lsb) % max_poc_lsb;
+    else
+        params->poc_step = 0;
+
+    params->last_slice = hdr;
+    params->last_slice_valid = 1;
+    params->num_skipped = 0;
+}
+
+/**
+ * Have the VPU code the picture as a key frame. This only affects the
+ * one frame: the VPU keeps counting its GOP and the rate control state
+ * is left as it is.
+ */
+static void rockchip_ForceKeyFrame(object_context_p obj_context)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    int i;
+
+    for (i = 0; i < params->num_spatial_layers; i++) {
+        if (v4l2_s_ctrl(rockchip_LayerContext(obj_context, i),
+                    V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME, 1) < 0)
+            LOG("force key frame failed\n");
+    }
+
+    params->force_key_frame = 0;
+    params->frame_intra = 1;
+
+    /* The key frame restarts the temporal layer pattern, as an IDR does */
+    params->layer_index = 1;
+    params->temporal_id = 0;
+    params->prev_ref_frame_num = 0;
+    obj_context->rc.temporal_id = 0;
+}
+
+/**
+ * Code a picture identical to the last one as a single all-skip P slice,
+ * written straight into the coded buffer without going through the VPU.
+ * The slice goes between two VPU pictures, so its frame_num and POC go on
+ * from the last picture the VPU coded, and it is not a reference so that
+ * the VPU's next picture is still numbered right. It repeats the VPU's
+ * reference, which is the last picture only when that one is a reference.
+ */
+static int rockchip_EncodeSkipFrame(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    h264_slice_header_p last = &params->last_slice;
+    coded_buffer_segment_p segment;
+    h264_header_info_t info;
+    int num_mbs = (ALIGN(obj_context->picture_width, 16) / 16) *
+        (ALIGN(obj_context->picture_height, 16) / 16);
+    int size;
+
+    if (!obj_buffer)
+        return -1;
+
+    if (!params->last_slice_valid || !last->nal_ref_idc)
+        return -1;
+
+    info = params->stream_header;
+    info.nal_ref_idc = 0;
+    info.pic_parameter_set_id = last->pic_parameter_set_id;
+    info.frame_num = (last->frame_num + 1) % (1 << info.log2_max_frame_num);
+
+    switch (info.pic_order_cnt_type) {
+    case 0:
+        /* Strictly between the last POC and the one the VPU uses next */
+        if (params->num_skipped + 1 >= params->poc_step)
+            return -1;
+        info.pic_order_cnt_lsb = (last->pic_order_cnt_lsb +
+                params->num_skipped + 1) % (1 << info.log2_max_poc_lsb);
+        info.delta_pic_order_cnt_bottom = last->delta_pic_order_cnt_bottom;
+        break;
+    case 2:
+        /* The POC comes from frame_num, two skips in a row would share it */
+        if (params->num_skipped)
+            return -1;
+        break;
+    default:
+        return -1;
+    }
+    info.slice_valid = 1;
+
+    segment = (coded_buffer_segment_p) obj_buffer->buffer_data;
+    size = h264_write_skip_slice(&info, num_mbs, segment->base.buf,
+            obj_buffer->buffer_size - CODED_BUFFER_HEADER_SIZE);
+    if (size < 0)
+        return -1;
+
+    segment->base.size = size;
+    segment->base.status = 0;
+    segment->base.next = NULL;
+    params->frame_skipped = 1;
+    params->num_skipped++;
+    params->prev_ref_frame_num = last->frame_num;
+
+    return 0;
+}
+
+/**
+ * Queue the input after copying only the dirty rectangles over the last
+ * frame, which is still in the input buffer. The rectangles also go to
+ * the VPU as a hint that the rest of the picture did not change.
+ */
+static int rockchip_UploadDirtyRects(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    encode_params_h264_p params = &obj_context->h264_params;
+    struct rk_vepu_dirty_area hint;
+    int i;
+
+    memset(&hint, 0, sizeof(hint));
+
+    for (i = 0; i < params->num_dirty_rects; i++) {
+        VARectangle *rect = &params->dirty_rects[i];
+
+        v4l2_update_input(obj_context->enc_ctx, obj_buffer->buffer_data,
+                rect->x, rect->y, rect->width, rect->height);
+
+        hint.area[i].enable = 1;
+        hint.area[i].left = rect->x / 16;
+        hint.area[i].top = rect->y / 16;
+        hint.area[i].right = (rect->x + rect->width - 1) / 16;
+        hint.area[i].bottom = (rect->y + rect->height - 1) / 16;
+    }
+    hint.count = params->num_dirty_rects;
+
+    if (!params->dirty_hint_failed &&
+            v4l2_s_ctrl_ptr(obj_context->enc_ctx,
+                V4L2_CID_PRIVATE_ROCKCHIP_VAENC_DIRTY_AREA,
+                &hint, sizeof(hint)) < 0)
+        params->dirty_hint_failed = 1;
+
+    return v4l2_requeue_input(obj_context->enc_ctx);
+}
+
+/**
+ * Queue the upload of the surface when it is current, so that several
+ * contexts coding one surface share a single copy of it. With upload
+ * set, a surface without one is uploaded first, as long as another
+ * encoder could use it. Returns -1 when the context has to upload the
+ * picture into its own buffer.
+ */
+static int rockchip_QueueSharedUpload(VADriverContextP ctx,
+        object_context_p obj_context, object_surface_p obj_surface,
+        object_buffer_p obj_buffer, int upload)
+{
+    INIT_DRIVER_DATA
+    enc_context_p enc_ctx = obj_context->enc_ctx;
+    v4l2_frame_p frame = obj_surface->upload;
+
+    if (enc_ctx->input_memory != V4L2_MEMORY_DMABUF)
+        return -1;
+
+    /* Still mapped, the application may be writing to it */
+    if (obj_buffer->ref_cnt > 1)
+        return -1;
+
+    if (frame && (frame->width != enc_ctx->width ||
+                frame->height != enc_ctx->height))
+        return -1;
+
+    if (!obj_surface->upload_valid ||
+            obj_surface->upload_generation != obj_buffer->generation) {
+        if (!upload || driver_data->num_shared_encoders < 2)
+            return -1;
+
+        if (!frame) {
+            frame = v4l2_frame_alloc(enc_ctx);
+            if (!frame)
+                return -1;
+            obj_surface->upload = frame;
+        }
+
+        v4l2_frame_write(frame, obj_buffer->buffer_data);
+        obj_surface->upload_valid = 1;
+        obj_surface->upload_generation = obj_buffer->generation;
+    }
+
+    return v4l2_qbuf_input_frame(enc_ctx, frame);
+}
+
+struct timeval last_tv;
+struct timeval tv;
+
+void log_time(char *msg)
+{
+    if (getenv("LOG_TIME")) {
+        gettimeofday(&tv, NULL);
+        if (msg)
+            printf("%s: %ld ms\n", msg, DURATION(last_tv, tv));
+        last_tv = tv;
+    }
+}
+
+static VAStatus rockchip_DoEncode(
+    VADriverContextP ctx,
+    VAContextID context
+)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+    int stats_valid, i;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_surface = SURFACE(obj_context->current_render_target);
+    ASSERT(obj_surface);
+
+    object_buffer_p obj_buffer = BUFFER(obj_surface->image.buf);
+    ASSERT(obj_buffer);
+
+    if (!obj_context->streaming) {
+        /**
+         * Input by dma-buf, so that uploads can be shared, once there is
+         * another context to share them with. Contexts that started
+         * earlier keep their own buffer.
+         */
+        if (driver_data->num_shared_encoders >= 2)
+            v4l2_use_dmabuf_input(obj_context->enc_ctx);
+
+        for (i = 0; i < obj_context->h264_params.num_spatial_layers; i++) {
+            enc_context_p enc_ctx = rockchip_LayerContext(obj_context, i);
+
+            if (v4l2_streamon(enc_ctx) < 0)
+                return VA_STATUS_ERROR_UNKNOWN;
+
+            if (v4l2_qbuf_output(enc_ctx) < 0)
+                return VA_STATUS_ERROR_UNKNOWN;
+        }
+
+        obj_context->streaming = 1;
+    }
+
+    obj_surface->coded_buffer = obj_context->h264_params.coded_buf;
+    obj_context->h264_params.pending_surface = obj_surface->base.id;
+    obj_context->h264_params.layer_index++;
+
+    /* Statistics of the surface serve this one picture */
+    stats_valid = obj_surface->stats.valid;
+    obj_surface->stats.valid = 0;
+
+    /* A skip slice only stands in for layer 0 */
+    if (obj_context->h264_params.num_spatial_layers == 1 &&
+            rockchip_static_frame(&obj_context->duplicate, obj_buffer->buffer_data) &&
+            !obj_context->h264_params.frame_intra &&
+            !rockchip_EncodeSkipFrame(obj_context,
+                BUFFER(obj_context->h264_params.coded_buf))) {
+        obj_context->current_render_target = -1;
+        return VA_STATUS_SUCCESS;
+    }
+
+    if (obj_context->enc_ctx->input_queued) {
+        log_time("before dq input");
+        v4l2_dqbuf_input(obj_context->enc_ctx);
+    }
+
+    if (stats_valid && obj_surface->stats.has_inter ?
+            rockchip_scene_cut_stats(&obj_context->scene, &obj_surface->stats) :
+            rockchip_scene_cut(&obj_context->scene, obj_buffer->buffer_data)) {
+        LOG("scene cut\n");
+        obj_context->h264_params.force_key_frame = 1;
+    }
+
+    if (obj_context->h264_params.force_key_frame)
+        rockchip_ForceKeyFrame(obj_context);
+
+    rockchip_UpdateIntraRefresh(obj_context);
+    if (rockchip_UpdateSliceMode(obj_context) < 0) {
+        obj_context->h264_params.pending_surface = VA_INVALID_ID;
+        obj_context->current_render_target = -1;
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+    rockchip_UpdateRoi(obj_context);
+    rockchip_UpdateQpMap(obj_context);
+    rockchip_UpdateRateControl(obj_context);
+
+    log_time("start encode");
+    /**
+     * A copy another context already made beats even a partial one. The
+     * dirty rectangles are relative to our own buffer, so they come next.
+     */
+    if (!rockchip_QueueSharedUpload(ctx, obj_context, obj_surface,
+                obj_buffer, 0))
+        log_time("shared input");
+    else if (obj_context->h264_params.dirty_valid &&
+            obj_context->enc_ctx->input_filled)
+        rockchip_UploadDirtyRects(obj_context, obj_buffer);
+    else if (rockchip_QueueSharedUpload(ctx, obj_context, obj_surface,
+                obj_buffer, 1) < 0)
+        v4l2_qbuf_input(obj_context->enc_ctx, obj_buffer->buffer_data,
+                obj_buffer->buffer_size);
+    rockchip_SubmitSimulcast(obj_context, obj_surface, obj_buffer);
+    log_time("after queue input");
+
+    obj_context->current_render_target = -1;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/**
+ * Wait for the VPU and copy the stream into the coded buffer, flagging a
+ * frame over the size limit. Returns the coded size.
+ */
+static unsigned int rockchip_CollectFrame(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    coded_buffer_segment_p segment =
+        (coded_buffer_segment_p) obj_buffer->buffer_data;
+
+    log_time("before dque out");
+    v4l2_dqbuf_output(obj_context->enc_ctx);
+    log_time("after encode");
+
+    encode_params_h264_p params = &obj_context->h264_params;
+    enc_context_p enc_ctx = obj_context->enc_ctx;
+    int headers;
+
+    /* Keep the header syntax the VPU actually wrote */
+    headers = h264_parse_parameter_sets(&params->stream_header,
+            enc_ctx->coded_buffer, enc_ctx->coded_size);
+    if (headers > 0)
+        params->stream_headers |= headers;
+    rockchip_ReadStreamSlice(obj_context);
+
+    segment->base.status = (1 << 24) & VA_CODED_BUF_STATUS_NUMBER_PASSES_MASK;
+    if (params->max_frame_size &&
+            enc_ctx->coded_size * 8 > params->max_frame_size) {
+        segment->base.status |= VA_CODED_BUF_STATUS_FRAME_SIZE_OVERFLOW;
+        rockchip_LimitFrameSize(obj_context, enc_ctx->coded_size * 8);
+        LOG("frame of %d bytes over the limit, next qp >= %d\n",
+                enc_ctx->coded_size, params->overflow_qp);
+    }
+
+    unsigned int coded_size = obj_context->enc_ctx->coded_size;
+    if (coded_size > obj_buffer->buffer_size - CODED_BUFFER_HEADER_SIZE)
+        coded_size = obj_buffer->buffer_size - CODED_BUFFER_HEADER_SIZE;
+
+    memcpy(segment->base.buf, obj_context->enc_ctx->coded_buffer, coded_size);
+    segment->base.size = coded_size;
+    segment->base.next = NULL;
+
+    if (obj_context->h264_params.slice_mode !=
+            V4L2_MPEG_VIDEO_MULTI_SLICE_MODE_SINGLE)
+        rockchip_SplitCodedSlices(segment);
+
+    v4l2_qbuf_output(obj_context->enc_ctx);
+
+    return coded_size;
+}
+
+static VAStatus rockchip_SyncEncoder(
+        VADriverContextP ctx,
+        VASurfaceID render_target)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+
+    obj_surface = SURFACE(render_target);
+    ASSERT(obj_surface);
+
+    /* Already collected, by an earlier sync or by mapping the coded buffer */
+    if (obj_surface->context_id == VA_INVALID_ID)
+        return VA_STATUS_SUCCESS;
+
+    obj_context = CONTEXT(obj_surface->context_id);
+    ASSERT(obj_context);
+
+    object_buffer_p obj_buffer = BUFFER(obj_surface->coded_buffer);
+    ASSERT(obj_buffer);
+
+    obj_context->h264_params.pending_surface = VA_INVALID_ID;
+
+    coded_buffer_segment_p segment =
+        (coded_buffer_segment_p) obj_buffer->buffer_data;
+
+    unsigned int coded_size;
+    if (obj_context->h264_params.frame_skipped)
+        coded_size = segment->base.size;
+    else
+        coded_size = rockchip_CollectFrame(obj_context, obj_buffer);
+
+    rockchip_CollectSimulcast(obj_context, ctx);
+
+    encode_statistics_p statistics = &obj_context->statistics;
+
+    if (!obj_context->h264_params.frame_skipped) {
+        int level = obj_context->h264_params.quality_level;
+
+        statistics->encode_us[level] += obj_context->enc_ctx->encode_us;
+        statistics->encode_bytes[level] += coded_size;
+        statistics->encode_frames[level]++;
+    }
+
+    segment->temporal_id = obj_context->h264_params.temporal_id;
+
+    rockchip_rc_update(&obj_context->rc, coded_size * 8);
+
+    if (statistics->intra_ratio != obj_context->h264_params.intra_period) {
+        statistics->intra_ratio = obj_context->h264_params.intra_period;
+        LOG("intra_ratio:%d\n", statistics->intra_ratio);
+    }
+
+    rockchip_codec_statistics(obj_context, coded_size);
+
+    obj_surface->context_id = VA_INVALID_ID;
+    obj_surface->coded_buffer = VA_INVALID_ID;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/**
+ * Mapping a coded buffer whose frame is still in flight waits for that
+ * frame, so applications can skip vaSyncSurface. The V4L2 encoder only
+ * returns whole frames, so the segment chain, one per slice in
+ * multi-slice mode, is complete by the time the map returns. The coded
+ * buffers of the smaller simulcast layers wait for the same frame.
+ */
+static void rockchip_SyncCodedBuffer(VADriverContextP ctx, VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+    object_buffer_p obj_buffer;
+    int pending, i;
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer || obj_buffer->type != VAEncCodedBufferType)
+        return;
+
+    obj_context = CONTEXT(obj_buffer->va_context);
+    if (!obj_context ||
+            obj_context->h264_params.pending_surface == VA_INVALID_ID)
+        return;
+
+    obj_surface = SURFACE(obj_context->h264_params.pending_surface);
+    if (!obj_surface)
+        return;
+
+    pending = obj_surface->coded_buffer == buffer;
+    for (i = 1; i < obj_context->h264_params.num_spatial_layers; i++)
+        if (obj_context->h264_params.spatial[i - 1].pending_buf == buffer)
+            pending = 1;
+
+    if (pending)
+        rockchip_SyncEncoder(ctx, obj_surface->base.id);
+}
+
+static void rockchip_GetAttributes(
+        VAConfigAttrib *attrib_list,
+        int num_attribs)
+{
+    int i;
+
+    for (i = 0; i < num_attribs; i++) {
+        switch (attrib_list[i].type) {
+        case VAConfigAttribRTFormat:
+            attrib_list[i].value = VA_RT_FORMAT_YUV420;
+            break;
+        case VAConfigAttribRateControl:
+            attrib_list[i].value = VA_RC_VBR | VA_RC_CQP | VA_RC_VBR_CONSTRAINED | VA_RC_CBR | VA_RC_VCM | VA_RC_NONE;
+#ifdef VA_RC_ICQ
+            attrib_list[i].value |= VA_RC_ICQ;
+#endif
+            break;
+        case VAConfigAttribEncPackedHeaders:
+            attrib_list[i].value =
+                VA_ENC_PACKED_HEADER_SEQUENCE | VA_ENC_PACKED_HEADER_PICTURE |
+                VA_ENC_PACKED_HEADER_SLICE | VA_ENC_PACKED_HEADER_MISC |
+                VA_ENC_PACKED_HEADER_RAW_DATA;
+            break;
+        case VAConfigAttribEncMaxSlices:
+            attrib_list[i].value = ROCKCHIP_MAX_CODED_SEGMENTS;
+            break;
+        case VAConfigAttribEncSliceStructure:
+            /* Equally sized slices only, in macroblocks */
+            attrib_list[i].value = VA_ENC_SLICE_STRUCTURE_EQUAL_ROWS;
+            break;
+#if VA_CHECK_VERSION(0, 37, 0)
+        case VAConfigAttribMaxPictureWidth:
+            attrib_list[i].value = ROCKCHIP_MAX_WIDTH;
+            break;
+        case VAConfigAttribMaxPictureHeight:
+            attrib_list[i].value = ROCKCHIP_MAX_HEIGHT;
+            break;
+#endif
+        case VAConfigAttribEncQualityRange:
+            attrib_list[i].value = ROCKCHIP_QUALITY_LEVELS;
+            break;
+        case VAConfigAttribEncIntraRefresh:
+            attrib_list[i].value = VA_ENC_INTRA_REFRESH_ROLLING_COLUMN;
+            break;
+        case VAConfigAttribEncROI:
+        {
+            VAConfigAttribValEncROI roi;
+
+            roi.value = 0;
+            roi.bits.num_roi_regions = ROCKCHIP_MAX_ROI;
+            roi.bits.roi_rc_qp_delta_support = 1;
+            attrib_list[i].value = roi.value;
+            break;
+        }
+#if VA_CHECK_VERSION(0, 40, 0)
+        case VAConfigAttribEncDirtyRect:
+            attrib_list[i].value = ROCKCHIP_MAX_DIRTY_RECTS;
+            break;
+#endif
+        default:
+            /* Do nothing */
+            attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
+            break;
+        }
+    }
+
+}
+
+static VAStatus rockchip_ProcessBuffer(
+        VADriverContextP ctx,
+        VAContextID context,
+        VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_buffer_p obj_buffer;
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    switch (obj_buffer->type) {
+    case VAEncSequenceParameterBufferType:
+        return rockchip_ProcessSPS(ctx, context, buffer);
+    case VAEncPictureParameterBufferType:
+        return rockchip_ProcessPPS(ctx, context, buffer);
+    case VAEncSliceParameterBufferType:
+        return rockchip_ProcessSliceParam(ctx, context, buffer);
+    case VAEncMiscParameterBufferType:
+        return rockchip_ProcessMiscParam(ctx, context, buffer);
+    case VAEncPackedHeaderParameterBufferType:
+    case VAEncPackedHeaderDataBufferType:
+        /**
+         * Ignore these
+         */
+        return VA_STATUS_SUCCESS;
+    default:
+        return VA_STATUS_ERROR_UNKNOWN;
+    }
+}
+
+const rockchip_codec_ops_t rockchip_enc_h264_ops = {
+    .name           = "h264 encoder",
+    .init           = rockchip_InitEncoder,
+    .deinit         = rockchip_DeinitEncoder,
+    .prepare        = rockchip_PrepareEncode,
+    .process        = rockchip_ProcessBuffer,
+    .submit         = rockchip_DoEncode,
+    .collect        = rockchip_SyncEncoder,
+    .map_buffer     = rockchip_SyncCodedBuffer,
+    .get_attributes = rockchip_GetAttributes,
+};
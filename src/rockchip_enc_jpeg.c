@@ -0,0 +1,461 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rockchip_drv_video.h"
+
+/**
+ * Baseline JPEG on the VEPU, for thumbnails and MJPEG from the same
+ * surfaces as the video encoders. The surface goes up through the same
+ * OUTPUT path as H.264; the VPU returns the entropy coded data and the
+ * driver wraps it in JFIF headers and EOI.
+ */
+
+static VAStatus rockchip_DeinitEncoder(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    v4l2_streamoff(obj_context->enc_ctx);
+    v4l2_deinit(obj_context->enc_ctx);
+
+    LOG_DEINIT();
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_InitEncoder(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    int width, height;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    width = obj_context->picture_width;
+    height = obj_context->picture_height;
+
+    /* Validate picture dimensions */
+    if (width < ROCKCHIP_JPEG_MIN_WIDTH || width > ROCKCHIP_JPEG_MAX_WIDTH ||
+            height < ROCKCHIP_JPEG_MIN_HEIGHT ||
+            height > ROCKCHIP_JPEG_MAX_HEIGHT ||
+            (width & 1) || (height & 1))
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+
+    LOG_INIT();
+
+    obj_context->enc_ctx = v4l2_init_by_name(DEV_NAME_RK3288_NEW);
+    if (!obj_context->enc_ctx) {
+        obj_context->enc_ctx = v4l2_init_by_name(DEV_NAME_RK3288_LEGACY);
+        if (!obj_context->enc_ctx)
+            return VA_STATUS_ERROR_UNKNOWN;
+    }
+
+    obj_context->enc_ctx->width = width;
+    obj_context->enc_ctx->height = height;
+    obj_context->enc_ctx->coded_format = V4L2_PIX_FMT_JPEG;
+    /* Room for a picture that hardly compresses */
+    if (obj_context->enc_ctx->coded_buffer_size < width * height * 3 / 2)
+        obj_context->enc_ctx->coded_buffer_size = width * height * 3 / 2;
+    obj_context->streaming = 0;
+    memset(&obj_context->jpeg_params, 0, sizeof(obj_context->jpeg_params));
+    memset(&obj_context->statistics, 0, sizeof(obj_context->statistics));
+    obj_context->jpeg_params.pending_surface = VA_INVALID_ID;
+    obj_context->jpeg_params.quality = ROCKCHIP_JPEG_QUALITY_DEFAULT;
+    obj_context->jpeg_params.header.width = width;
+    obj_context->jpeg_params.header.height = height;
+
+    LOG("jpeg resolution:%dx%d\n", width, height);
+    gettimeofday(&obj_context->statistics.tm, NULL);
+
+    if (v4l2_s_fmt(obj_context->enc_ctx) < 0)
+        goto failed_v4l2;
+
+    if (v4l2_reqbufs(obj_context->enc_ctx) < 0)
+        goto failed_v4l2;
+
+    if (v4l2_querybuf(obj_context->enc_ctx) < 0)
+        goto failed_v4l2;
+
+    return VA_STATUS_SUCCESS;
+
+failed_v4l2:
+    rockchip_DeinitEncoder(ctx, context);
+
+    return VA_STATUS_ERROR_UNKNOWN;
+}
+
+static VAStatus rockchip_PrepareEncode(
+        VADriverContextP ctx,
+        VAContextID context,
+        VASurfaceID render_target)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_surface = SURFACE(render_target);
+    ASSERT(obj_surface);
+
+    obj_context->current_render_target = obj_surface->base.id;
+    obj_surface->context_id = context;
+
+    obj_context->jpeg_params.quant_loaded[0] = 0;
+    obj_context->jpeg_params.quant_loaded[1] = 0;
+    obj_context->jpeg_params.header.restart_interval = 0;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessPicture(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    encode_params_jpeg_p params = &obj_context->jpeg_params;
+    VAEncPictureParameterBufferJPEG *pic;
+
+    if (obj_buffer->buffer_size != sizeof(*pic))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    pic = (VAEncPictureParameterBufferJPEG *) obj_buffer->buffer_data;
+
+    if (pic->picture_width != obj_context->picture_width ||
+            pic->picture_height != obj_context->picture_height)
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+
+    /* Baseline, 8 bit, one interleaved 4:2:0 scan */
+    if (pic->pic_flags.bits.profile != 0 ||
+            pic->pic_flags.bits.progressive ||
+            pic->pic_flags.bits.differential ||
+            pic->sample_bit_depth != 8 ||
+            pic->num_components != 3 ||
+            pic->num_scan != 1)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    params->coded_buf = pic->coded_buf;
+    params->quality = pic->quality ? pic->quality :
+        ROCKCHIP_JPEG_QUALITY_DEFAULT;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessQuant(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    encode_params_jpeg_p params = &obj_context->jpeg_params;
+    VAQMatrixBufferJPEG *quant;
+
+    if (obj_buffer->buffer_size != sizeof(*quant))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    quant = (VAQMatrixBufferJPEG *) obj_buffer->buffer_data;
+
+    if (quant->load_lum_quantiser_matrix) {
+        memcpy(params->header.quant[0], quant->lum_quantiser_matrix,
+                JPEG_QUANT_SIZE);
+        params->quant_loaded[0] = 1;
+    }
+
+    if (quant->load_chroma_quantiser_matrix) {
+        memcpy(params->header.quant[1], quant->chroma_quantiser_matrix,
+                JPEG_QUANT_SIZE);
+        params->quant_loaded[1] = 1;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessSliceParam(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    VAEncSliceParameterBufferJPEG *slice;
+
+    if (obj_buffer->buffer_size != sizeof(*slice))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    slice = (VAEncSliceParameterBufferJPEG *) obj_buffer->buffer_data;
+
+    /* Components use the tables the headers assign them, as on the VPU */
+    obj_context->jpeg_params.header.restart_interval = slice->restart_interval;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessBuffer(
+        VADriverContextP ctx,
+        VAContextID context,
+        VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    switch (obj_buffer->type) {
+    case VAEncPictureParameterBufferType:
+        return rockchip_ProcessPicture(obj_context, obj_buffer);
+    case VAQMatrixBufferType:
+        return rockchip_ProcessQuant(obj_context, obj_buffer);
+    case VAEncSliceParameterBufferType:
+        return rockchip_ProcessSliceParam(obj_context, obj_buffer);
+    case VAHuffmanTableBufferType:
+        /**
+         * The VPU only codes with the Annex K tables, which are also the
+         * ones written to the DHT, so the stream stays consistent.
+         */
+    case VAEncPackedHeaderParameterBufferType:
+    case VAEncPackedHeaderDataBufferType:
+        return VA_STATUS_SUCCESS;
+    default:
+        return VA_STATUS_ERROR_UNKNOWN;
+    }
+}
+
+static VAStatus rockchip_DoEncode(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+    object_buffer_p obj_buffer;
+    encode_params_jpeg_p params;
+    struct rk_vepu_jpeg vepu;
+    unsigned char luma[JPEG_QUANT_SIZE], chroma[JPEG_QUANT_SIZE];
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_surface = SURFACE(obj_context->current_render_target);
+    ASSERT(obj_surface);
+
+    obj_buffer = BUFFER(obj_surface->image.buf);
+    ASSERT(obj_buffer);
+
+    params = &obj_context->jpeg_params;
+
+    if (!obj_context->streaming) {
+        if (v4l2_streamon(obj_context->enc_ctx) < 0)
+            return VA_STATUS_ERROR_UNKNOWN;
+
+        if (v4l2_qbuf_output(obj_context->enc_ctx) < 0)
+            return VA_STATUS_ERROR_UNKNOWN;
+
+        obj_context->streaming = 1;
+    }
+
+    /* Tables as loaded or Annex K ones, both scaled by the quality */
+    jpeg_default_quant(ROCKCHIP_JPEG_QUALITY_DEFAULT, luma, chroma);
+    if (!params->quant_loaded[0])
+        memcpy(params->header.quant[0], luma, JPEG_QUANT_SIZE);
+    if (!params->quant_loaded[1])
+        memcpy(params->header.quant[1], chroma, JPEG_QUANT_SIZE);
+    jpeg_scale_quant(params->quality, params->header.quant[0]);
+    jpeg_scale_quant(params->quality, params->header.quant[1]);
+
+    memset(&vepu, 0, sizeof(vepu));
+    memcpy(vepu.luma_quant, params->header.quant[0], JPEG_QUANT_SIZE);
+    memcpy(vepu.chroma_quant, params->header.quant[1], JPEG_QUANT_SIZE);
+    vepu.restart_interval = params->header.restart_interval;
+
+    if (v4l2_s_ctrl_ptr(obj_context->enc_ctx,
+                V4L2_CID_PRIVATE_ROCKCHIP_VAENC_JPEG,
+                &vepu, sizeof(vepu)) < 0)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    obj_surface->coded_buffer = params->coded_buf;
+    params->pending_surface = obj_surface->base.id;
+
+    if (obj_context->enc_ctx->input_queued)
+        v4l2_dqbuf_input(obj_context->enc_ctx);
+
+    v4l2_qbuf_input(obj_context->enc_ctx, obj_buffer->buffer_data,
+            obj_buffer->buffer_size);
+
+    obj_context->current_render_target = -1;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/**
+ * Wait for the VPU and write the JFIF file into the coded buffer. Returns
+ * the coded size, 0 when the picture did not fit.
+ */
+static unsigned int rockchip_CollectPicture(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    enc_context_p enc_ctx = obj_context->enc_ctx;
+    coded_buffer_segment_p segment =
+        (coded_buffer_segment_p) obj_buffer->buffer_data;
+    int room = obj_buffer->buffer_size - CODED_BUFFER_HEADER_SIZE;
+    unsigned char *p = segment->base.buf;
+    int header_size;
+
+    v4l2_dqbuf_output(enc_ctx);
+
+    segment->base.status = 0;
+    segment->base.size = 0;
+    segment->base.next = NULL;
+
+    header_size = jpeg_write_headers(&obj_context->jpeg_params.header,
+            p, room);
+    if (header_size < 0 || header_size + enc_ctx->coded_size + 2 > room) {
+        LOG("jpeg coded buffer too small\n");
+        v4l2_qbuf_output(enc_ctx);
+        return 0;
+    }
+
+    memcpy(p + header_size, enc_ctx->coded_buffer, enc_ctx->coded_size);
+    p += header_size + enc_ctx->coded_size;
+    *p++ = 0xff;
+    *p++ = 0xd9;
+
+    segment->base.size = p - (unsigned char *) segment->base.buf;
+
+    v4l2_qbuf_output(enc_ctx);
+
+    return segment->base.size;
+}
+
+static VAStatus rockchip_SyncEncoder(
+        VADriverContextP ctx,
+        VASurfaceID render_target)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+    object_buffer_p obj_buffer;
+    unsigned int coded_size;
+
+    obj_surface = SURFACE(render_target);
+    ASSERT(obj_surface);
+
+    /* Already collected, by an earlier sync or by mapping the coded buffer */
+    if (obj_surface->context_id == VA_INVALID_ID)
+        return VA_STATUS_SUCCESS;
+
+    obj_context = CONTEXT(obj_surface->context_id);
+    ASSERT(obj_context);
+
+    obj_buffer = BUFFER(obj_surface->coded_buffer);
+    ASSERT(obj_buffer);
+
+    obj_context->jpeg_params.pending_surface = VA_INVALID_ID;
+
+    coded_size = rockchip_CollectPicture(obj_context, obj_buffer);
+
+    rockchip_codec_statistics(obj_context, coded_size);
+
+    obj_surface->context_id = VA_INVALID_ID;
+    obj_surface->coded_buffer = VA_INVALID_ID;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* Mapping a coded buffer waits for its picture, as for H.264 */
+static void rockchip_SyncCodedBuffer(VADriverContextP ctx, VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+    object_buffer_p obj_buffer;
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer || obj_buffer->type != VAEncCodedBufferType)
+        return;
+
+    obj_context = CONTEXT(obj_buffer->va_context);
+    if (!obj_context ||
+            obj_context->jpeg_params.pending_surface == VA_INVALID_ID)
+        return;
+
+    obj_surface = SURFACE(obj_context->jpeg_params.pending_surface);
+    if (obj_surface && obj_surface->coded_buffer == buffer)
+        rockchip_SyncEncoder(ctx, obj_surface->base.id);
+}
+
+static void rockchip_GetAttributes(
+        VAConfigAttrib *attrib_list,
+        int num_attribs)
+{
+    VAConfigAttribValEncJPEG jpeg;
+    int i;
+
+    for (i = 0; i < num_attribs; i++) {
+        switch (attrib_list[i].type) {
+        case VAConfigAttribRTFormat:
+            attrib_list[i].value = VA_RT_FORMAT_YUV420;
+            break;
+        case VAConfigAttribEncPackedHeaders:
+            attrib_list[i].value = VA_ENC_PACKED_HEADER_NONE;
+            break;
+        case VAConfigAttribEncJPEG:
+            jpeg.value = 0;
+            jpeg.bits.max_num_components = 3;
+            jpeg.bits.max_num_scans = 1;
+            jpeg.bits.max_num_huffman_tables = 2;
+            jpeg.bits.max_num_quantization_tables = 2;
+            attrib_list[i].value = jpeg.value;
+            break;
+#if VA_CHECK_VERSION(0, 37, 0)
+        case VAConfigAttribMaxPictureWidth:
+            attrib_list[i].value = ROCKCHIP_JPEG_MAX_WIDTH;
+            break;
+        case VAConfigAttribMaxPictureHeight:
+            attrib_list[i].value = ROCKCHIP_JPEG_MAX_HEIGHT;
+            break;
+#endif
+        default:
+            attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
+            break;
+        }
+    }
+}
+
+const rockchip_codec_ops_t rockchip_enc_jpeg_ops = {
+    .name           = "jpeg encoder",
+    .init           = rockchip_InitEncoder,
+    .deinit         = rockchip_DeinitEncoder,
+    .prepare        = rockchip_PrepareEncode,
+    .process        = rockchip_ProcessBuffer,
+    .submit         = rockchip_DoEncode,
+    .collect        = rockchip_SyncEncoder,
+    .map_buffer     = rockchip_SyncCodedBuffer,
+    .get_attributes = rockchip_GetAttributes,
+};
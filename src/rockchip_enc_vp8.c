@@ -0,0 +1,499 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rockchip_drv_video.h"
+
+/**
+ * VP8 encoding on the VEPU. The plugin takes the VA-API parameter
+ * buffers as they are and keeps the reference and probability state; the
+ * driver only adds the uncompressed data chunk in front of the
+ * partitions the VPU returns.
+ */
+
+static VAStatus rockchip_DeinitEncoder(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    v4l2_streamoff(obj_context->enc_ctx);
+    v4l2_deinit(obj_context->enc_ctx);
+
+    LOG_DEINIT();
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_InitEncoder(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    /* Validate picture dimensions */
+    if (obj_context->picture_width < ROCKCHIP_MIN_WIDTH ||
+            obj_context->picture_width > ROCKCHIP_MAX_WIDTH ||
+            obj_context->picture_height < ROCKCHIP_MIN_HEIGHT ||
+            obj_context->picture_height > ROCKCHIP_MAX_HEIGHT ||
+            (obj_context->picture_width & 1) ||
+            (obj_context->picture_height & 1))
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+
+    LOG_INIT();
+
+    obj_context->enc_ctx = v4l2_init_by_name(DEV_NAME_RK3288_NEW);
+    if (!obj_context->enc_ctx) {
+        obj_context->enc_ctx = v4l2_init_by_name(DEV_NAME_RK3288_LEGACY);
+        if (!obj_context->enc_ctx)
+            return VA_STATUS_ERROR_UNKNOWN;
+    }
+
+    obj_context->enc_ctx->width = obj_context->picture_width;
+    obj_context->enc_ctx->height = obj_context->picture_height;
+    obj_context->enc_ctx->coded_format = V4L2_PIX_FMT_VP8;
+    obj_context->streaming = 0;
+    memset(&obj_context->vp8_params, 0, sizeof(obj_context->vp8_params));
+    memset(&obj_context->statistics, 0, sizeof(obj_context->statistics));
+    obj_context->vp8_params.pending_surface = VA_INVALID_ID;
+    obj_context->vp8_params.header.width = obj_context->picture_width;
+    obj_context->vp8_params.header.height = obj_context->picture_height;
+    obj_context->vp8_params.header.show_frame = 1;
+
+    LOG("vp8 resolution:%dx%d\n",
+            obj_context->picture_width, obj_context->picture_height);
+    gettimeofday(&obj_context->statistics.tm, NULL);
+
+    if (v4l2_s_fmt(obj_context->enc_ctx) < 0)
+        goto failed_v4l2;
+
+    if (v4l2_reqbufs(obj_context->enc_ctx) < 0)
+        goto failed_v4l2;
+
+    if (v4l2_querybuf(obj_context->enc_ctx) < 0)
+        goto failed_v4l2;
+
+    return VA_STATUS_SUCCESS;
+
+failed_v4l2:
+    rockchip_DeinitEncoder(ctx, context);
+
+    return VA_STATUS_ERROR_UNKNOWN;
+}
+
+static VAStatus rockchip_PrepareEncode(
+        VADriverContextP ctx,
+        VAContextID context,
+        VASurfaceID render_target)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_surface = SURFACE(render_target);
+    ASSERT(obj_surface);
+
+    obj_context->current_render_target = obj_surface->base.id;
+    obj_surface->context_id = context;
+
+    obj_context->vp8_params.force_key_frame = 0;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessSequence(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    encode_params_vp8_p params = &obj_context->vp8_params;
+    VAEncSequenceParameterBufferVP8 *seq;
+
+    if (obj_buffer->buffer_size != sizeof(*seq))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    seq = (VAEncSequenceParameterBufferVP8 *) obj_buffer->buffer_data;
+
+    if (seq->frame_width != obj_context->picture_width ||
+            seq->frame_height != obj_context->picture_height)
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+
+    params->intra_period = seq->intra_period;
+    params->header.width = seq->frame_width;
+    params->header.height = seq->frame_height;
+    params->header.horiz_scale = seq->frame_width_scale & 0x3;
+    params->header.vert_scale = seq->frame_height_scale & 0x3;
+
+    if (v4l2_s_ctrl_ptr(obj_context->enc_ctx,
+                V4L2_CID_PRIVATE_ROCKCHIP_VAENC_VP8_SEQ,
+                seq, sizeof(*seq)) < 0)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessPicture(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    encode_params_vp8_p params = &obj_context->vp8_params;
+    VAEncPictureParameterBufferVP8 *pic;
+
+    if (obj_buffer->buffer_size != sizeof(*pic))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    pic = (VAEncPictureParameterBufferVP8 *) obj_buffer->buffer_data;
+
+    params->coded_buf = pic->coded_buf;
+    params->header.version = pic->pic_flags.bits.version;
+    params->header.show_frame = pic->pic_flags.bits.show_frame;
+
+    /* frame_type is 0 for key frames */
+    if (pic->pic_flags.bits.frame_type == 0 || pic->ref_flags.bits.force_kf)
+        params->force_key_frame = 1;
+
+    if (v4l2_s_ctrl_ptr(obj_context->enc_ctx,
+                V4L2_CID_PRIVATE_ROCKCHIP_VAENC_VP8_PIC,
+                pic, sizeof(*pic)) < 0)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessQuant(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    VAQMatrixBufferVP8 *quant;
+
+    if (obj_buffer->buffer_size != sizeof(*quant))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    quant = (VAQMatrixBufferVP8 *) obj_buffer->buffer_data;
+
+    if (v4l2_s_ctrl_ptr(obj_context->enc_ctx,
+                V4L2_CID_PRIVATE_ROCKCHIP_VAENC_VP8_QUANT,
+                quant, sizeof(*quant)) < 0)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessMiscParam(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    VAEncMiscParameterBuffer *misc_param;
+    VAEncMiscParameterFrameRate *frame_rate;
+    VAEncMiscParameterRateControl *rate_control;
+    VAEncMiscParameterHRD *hrd;
+    struct v4l2_streamparm parms;
+
+    misc_param = (VAEncMiscParameterBuffer *) obj_buffer->buffer_data;
+
+    switch (misc_param->type) {
+    case VAEncMiscParameterTypeFrameRate:
+        frame_rate = (VAEncMiscParameterFrameRate *)misc_param->data;
+
+        /* Fractional rates come as (denominator << 16 | numerator) */
+        memset(&parms, 0, sizeof(parms));
+        parms.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        parms.parm.output.timeperframe.numerator =
+            (frame_rate->framerate >> 16) ? : 1;
+        parms.parm.output.timeperframe.denominator =
+            frame_rate->framerate & 0xffff;
+
+        v4l2_s_parm(obj_context->enc_ctx, &parms);
+        break;
+    case VAEncMiscParameterTypeRateControl:
+        rate_control = (VAEncMiscParameterRateControl *)misc_param->data;
+
+        v4l2_s_ctrl_ptr(obj_context->enc_ctx,
+                V4L2_CID_PRIVATE_ROCKCHIP_VAENC_RC,
+                rate_control, sizeof(*rate_control));
+        break;
+    case VAEncMiscParameterTypeHRD:
+        hrd = (VAEncMiscParameterHRD *)misc_param->data;
+
+        /* In kilobytes */
+        v4l2_s_ctrl(obj_context->enc_ctx, V4L2_CID_MPEG_VIDEO_VBV_SIZE,
+                hrd->buffer_size / 8192);
+        break;
+    default:
+        return VA_STATUS_ERROR_UNKNOWN;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessBuffer(
+        VADriverContextP ctx,
+        VAContextID context,
+        VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    switch (obj_buffer->type) {
+    case VAEncSequenceParameterBufferType:
+        return rockchip_ProcessSequence(obj_context, obj_buffer);
+    case VAEncPictureParameterBufferType:
+        return rockchip_ProcessPicture(obj_context, obj_buffer);
+    case VAQMatrixBufferType:
+        return rockchip_ProcessQuant(obj_context, obj_buffer);
+    case VAEncMiscParameterBufferType:
+        return rockchip_ProcessMiscParam(obj_context, obj_buffer);
+    default:
+        return VA_STATUS_ERROR_UNKNOWN;
+    }
+}
+
+static VAStatus rockchip_DoEncode(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+    object_buffer_p obj_buffer;
+    encode_params_vp8_p params;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+    params = &obj_context->vp8_params;
+
+    obj_surface = SURFACE(obj_context->current_render_target);
+    ASSERT(obj_surface);
+
+    obj_buffer = BUFFER(obj_surface->image.buf);
+    ASSERT(obj_buffer);
+
+    if (!obj_context->streaming) {
+        if (v4l2_streamon(obj_context->enc_ctx) < 0)
+            return VA_STATUS_ERROR_UNKNOWN;
+
+        if (v4l2_qbuf_output(obj_context->enc_ctx) < 0)
+            return VA_STATUS_ERROR_UNKNOWN;
+
+        obj_context->streaming = 1;
+    }
+
+    obj_surface->coded_buffer = obj_context->vp8_params.coded_buf;
+    obj_context->vp8_params.pending_surface = obj_surface->base.id;
+
+    if (obj_context->enc_ctx->input_queued)
+        v4l2_dqbuf_input(obj_context->enc_ctx);
+
+    if (params->intra_period &&
+            params->frames_since_key >= params->intra_period)
+        params->force_key_frame = 1;
+
+    if (params->force_key_frame &&
+            v4l2_s_ctrl(obj_context->enc_ctx,
+                V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME, 1) < 0)
+        LOG("force key frame failed\n");
+    params->frames_since_key = params->force_key_frame ? 1 :
+        params->frames_since_key + 1;
+
+    v4l2_qbuf_input(obj_context->enc_ctx, obj_buffer->buffer_data,
+            obj_buffer->buffer_size);
+
+    obj_context->current_render_target = -1;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/**
+ * Wait for the VPU and write the frame into the coded buffer: the
+ * uncompressed data chunk first, then the partitions as they came.
+ * Returns the coded size, 0 when the frame did not fit.
+ */
+static unsigned int rockchip_CollectFrame(object_context_p obj_context,
+        object_buffer_p obj_buffer)
+{
+    encode_params_vp8_p params = &obj_context->vp8_params;
+    enc_context_p enc_ctx = obj_context->enc_ctx;
+    coded_buffer_segment_p segment =
+        (coded_buffer_segment_p) obj_buffer->buffer_data;
+    unsigned int room = obj_buffer->buffer_size - CODED_BUFFER_HEADER_SIZE;
+    unsigned int coded_size;
+    struct rk_vepu_vp8_frame frame;
+    int header_size;
+
+    v4l2_dqbuf_output(enc_ctx);
+
+    memset(&frame, 0, sizeof(frame));
+    if (v4l2_g_ctrl_ptr(enc_ctx, V4L2_CID_PRIVATE_ROCKCHIP_VAENC_VP8_FRAME,
+                &frame, sizeof(frame)) < 0) {
+        LOG("no vp8 frame layout\n");
+        segment->base.status = 0;
+        segment->base.size = 0;
+        segment->base.next = NULL;
+        v4l2_qbuf_output(enc_ctx);
+        return 0;
+    }
+
+    params->header.key_frame = frame.key_frame;
+    /* The VPU may also code a key frame on its own */
+    if (frame.key_frame)
+        params->frames_since_key = 1;
+    params->header.first_part_size = frame.first_partition_size;
+
+    segment->base.status = 0;
+    segment->base.size = 0;
+    segment->base.next = NULL;
+
+    /* A frame cut short or without its header is of no use to anyone */
+    header_size = vp8_write_frame_header(&params->header,
+            segment->base.buf, room);
+    coded_size = enc_ctx->coded_size;
+    if (header_size < 0 || coded_size > room - header_size) {
+        LOG("vp8 coded buffer too small\n");
+        segment->base.status = VA_CODED_BUF_STATUS_FRAME_SIZE_OVERFLOW;
+        v4l2_qbuf_output(enc_ctx);
+        return 0;
+    }
+
+    memcpy(segment->base.buf + header_size, enc_ctx->coded_buffer,
+            coded_size);
+    segment->base.size = header_size + coded_size;
+
+    v4l2_qbuf_output(enc_ctx);
+
+    return segment->base.size;
+}
+
+static VAStatus rockchip_SyncEncoder(
+        VADriverContextP ctx,
+        VASurfaceID render_target)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+    object_buffer_p obj_buffer;
+    unsigned int coded_size;
+
+    obj_surface = SURFACE(render_target);
+    ASSERT(obj_surface);
+
+    /* Already collected, by an earlier sync or by mapping the coded buffer */
+    if (obj_surface->context_id == VA_INVALID_ID)
+        return VA_STATUS_SUCCESS;
+
+    obj_context = CONTEXT(obj_surface->context_id);
+    ASSERT(obj_context);
+
+    obj_buffer = BUFFER(obj_surface->coded_buffer);
+    ASSERT(obj_buffer);
+
+    obj_context->vp8_params.pending_surface = VA_INVALID_ID;
+
+    coded_size = rockchip_CollectFrame(obj_context, obj_buffer);
+
+    rockchip_codec_statistics(obj_context, coded_size);
+
+    obj_surface->context_id = VA_INVALID_ID;
+    obj_surface->coded_buffer = VA_INVALID_ID;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* Mapping a coded buffer waits for its frame, as for H.264 */
+static void rockchip_SyncCodedBuffer(VADriverContextP ctx, VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+    object_buffer_p obj_buffer;
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer || obj_buffer->type != VAEncCodedBufferType)
+        return;
+
+    obj_context = CONTEXT(obj_buffer->va_context);
+    if (!obj_context ||
+            obj_context->vp8_params.pending_surface == VA_INVALID_ID)
+        return;
+
+    obj_surface = SURFACE(obj_context->vp8_params.pending_surface);
+    if (obj_surface && obj_surface->coded_buffer == buffer)
+        rockchip_SyncEncoder(ctx, obj_surface->base.id);
+}
+
+static void rockchip_GetAttributes(
+        VAConfigAttrib *attrib_list,
+        int num_attribs)
+{
+    int i;
+
+    for (i = 0; i < num_attribs; i++) {
+        switch (attrib_list[i].type) {
+        case VAConfigAttribRTFormat:
+            attrib_list[i].value = VA_RT_FORMAT_YUV420;
+            break;
+        case VAConfigAttribRateControl:
+            attrib_list[i].value = VA_RC_CBR | VA_RC_VBR;
+            break;
+        case VAConfigAttribEncPackedHeaders:
+            attrib_list[i].value = VA_ENC_PACKED_HEADER_NONE;
+            break;
+#if VA_CHECK_VERSION(0, 37, 0)
+        case VAConfigAttribMaxPictureWidth:
+            attrib_list[i].value = ROCKCHIP_MAX_WIDTH;
+            break;
+        case VAConfigAttribMaxPictureHeight:
+            attrib_list[i].value = ROCKCHIP_MAX_HEIGHT;
+            break;
+#endif
+        default:
+            attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
+            break;
+        }
+    }
+}
+
+const rockchip_codec_ops_t rockchip_enc_vp8_ops = {
+    .name           = "vp8 encoder",
+    .init           = rockchip_InitEncoder,
+    .deinit         = rockchip_DeinitEncoder,
+    .prepare        = rockchip_PrepareEncode,
+    .process        = rockchip_ProcessBuffer,
+    .submit         = rockchip_DoEncode,
+    .collect        = rockchip_SyncEncoder,
+    .map_buffer     = rockchip_SyncCodedBuffer,
+    .get_attributes = rockchip_GetAttributes,
+};
@@ -28,6 +28,14 @@ static VAImageFormat rockchip_SupportedImageFormat[] = {
     { VA_FOURCC_IYUV, VA_LSB_FIRST, 12, },
     { VA_FOURCC_YV12, VA_LSB_FIRST, 12, },
     { VA_FOURCC_NV12, VA_LSB_FIRST, 12, },
+    { VA_FOURCC_BGRA, VA_LSB_FIRST, 32, 32,
+        0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 },
+    { VA_FOURCC_BGRX, VA_LSB_FIRST, 32, 24,
+        0x00ff0000, 0x0000ff00, 0x000000ff, 0 },
+    { VA_FOURCC_RGBA, VA_LSB_FIRST, 32, 32,
+        0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000 },
+    { VA_FOURCC_RGBX, VA_LSB_FIRST, 32, 24,
+        0x000000ff, 0x0000ff00, 0x00ff0000, 0 },
 };
 
 VAStatus rockchip_QueryImageFormats(
@@ -110,6 +118,18 @@ VAStatus rockchip_CreateImage(
         image->component_order[2] = 'V';
         image->component_order[3] = '\0';
         break;
+    case VA_FOURCC_BGRA:
+    case VA_FOURCC_BGRX:
+    case VA_FOURCC_RGBA:
+    case VA_FOURCC_RGBX:
+        image->num_planes = 1;
+        image->pitches[0] = width * 4;
+        image->offsets[0] = 0;
+        image->data_size = width * height * 4;
+        image->num_palette_entries = 0;
+        image->entry_bytes = 0;
+        memcpy(image->component_order, &format->fourcc, 4);
+        break;
     default:
         goto error;
     }
@@ -209,7 +229,32 @@ VAStatus rockchip_GetImage(
     if (!obj_image)
         return VA_STATUS_ERROR_INVALID_IMAGE;
 
-    return VA_STATUS_ERROR_UNIMPLEMENTED;
+    VAImage *src = &obj_surface->image;
+    VAImage *dst = &obj_image->image;
+    VARectangle src_rect = { x, y, width, height };
+    VARectangle dst_rect = { 0, 0, width, height };
+    convert_job_t job;
+    VAStatus va_status;
+
+    /* The surface may still be decoded or processed */
+    va_status = rockchip_SyncSurface(ctx, surface);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
+    object_buffer_p src_buffer = BUFFER(src->buf);
+    object_buffer_p dst_buffer = BUFFER(dst->buf);
+    if (!src_buffer || !dst_buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    va_status = rockchip_convert_init(&job, src, src_buffer->buffer_data,
+            &src_rect, 0, dst, dst_buffer->buffer_data, &dst_rect, 0, NULL);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
+    va_status = rockchip_convert(&job);
+    rockchip_convert_deinit(&job);
+
+    return va_status;
 }
 
 VAStatus
@@ -238,23 +283,34 @@ rockchip_PutImage(
 
     VAImage *src = &obj_image->image;
     VAImage *dst = &obj_surface->image;
+    VARectangle src_rect = { src_x, src_y, src_width, src_height };
+    VARectangle dst_rect = { dest_x, dest_y, dest_width, dest_height };
+    convert_job_t job;
+    VAStatus va_status;
 
-    /**
-     * TODO: support more format
-     */
-    if (src->format.fourcc != dst->format.fourcc) {
-        return VA_STATUS_ERROR_UNIMPLEMENTED;
-    }
+    /* Don't write under a decoder or VPP still filling the surface */
+    va_status = rockchip_SyncSurface(ctx, surface);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
 
     void *src_buf, *dst_buf;
 
+    obj_surface->stats.valid = 0;
+    obj_surface->upload_valid = 0;
+
     rockchip_MapBuffer(ctx, src->buf, &src_buf);
     rockchip_MapBuffer(ctx, dst->buf, &dst_buf);
 
-    memcpy(dst_buf, src_buf, src->data_size);
+    /* Scaled and converted with the VPP kernels, the rest is left alone */
+    va_status = rockchip_convert_init(&job, src, src_buf, &src_rect, 0,
+            dst, dst_buf, &dst_rect, 0, NULL);
+    if (va_status == VA_STATUS_SUCCESS) {
+        va_status = rockchip_convert(&job);
+        rockchip_convert_deinit(&job);
+    }
 
     rockchip_UnmapBuffer(ctx, src->buf);
     rockchip_UnmapBuffer(ctx, dst->buf);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
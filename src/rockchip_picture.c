@@ -30,7 +30,20 @@ VAStatus rockchip_BeginPicture(
     VASurfaceID render_target
 )
 {
-    return rockchip_PrepareEncode(ctx, context, render_target);
+    INIT_DRIVER_DATA
+    object_context_p obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    /* Another context, a decoder or VPP, may still be writing the surface */
+    object_surface_p obj_surface = SURFACE(render_target);
+    if (obj_surface && obj_surface->context_id != VA_INVALID_ID &&
+            obj_surface->context_id != context) {
+        VAStatus vaStatus = rockchip_SyncSurface(ctx, render_target);
+        if (vaStatus != VA_STATUS_SUCCESS)
+            return vaStatus;
+    }
+
+    return obj_context->codec->prepare(ctx, context, render_target);
 }
 
 VAStatus rockchip_RenderPicture(
@@ -42,33 +55,12 @@ VAStatus rockchip_RenderPicture(
 {
     INIT_DRIVER_DATA
     VAStatus vaStatus = VA_STATUS_SUCCESS;
+    object_context_p obj_context = CONTEXT(context);
+    ASSERT(obj_context);
 
     int i;
     for (i = 0; i < num_buffers; i++) {
-        object_buffer_p obj_buffer = BUFFER(buffers[i]);
-
-        switch (obj_buffer->type) {
-        case VAEncSequenceParameterBufferType:
-            vaStatus = rockchip_ProcessSPS(ctx, context, buffers[i]);
-            break;
-        case VAEncPictureParameterBufferType:
-            vaStatus = rockchip_ProcessPPS(ctx, context, buffers[i]);
-            break;
-        case VAEncSliceParameterBufferType:
-            vaStatus = rockchip_ProcessSliceParam(ctx, context, buffers[i]);
-            break;
-        case VAEncMiscParameterBufferType:
-            vaStatus = rockchip_ProcessMiscParam(ctx, context, buffers[i]);
-            break;
-        case VAEncPackedHeaderParameterBufferType:
-        case VAEncPackedHeaderDataBufferType:
-            /**
-             * Ignore these
-             */
-            break;
-        default:
-            vaStatus = VA_STATUS_ERROR_UNKNOWN;
-        }
+        vaStatus = obj_context->codec->process(ctx, context, buffers[i]);
         if (vaStatus != VA_STATUS_SUCCESS) {
             break;
         }
@@ -82,5 +74,9 @@ VAStatus rockchip_EndPicture(
     VAContextID context
 )
 {
-    return rockchip_DoEncode(ctx, context);
+    INIT_DRIVER_DATA
+    object_context_p obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    return obj_context->codec->submit(ctx, context);
 }
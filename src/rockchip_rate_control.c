@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rockchip_drv_video.h"
+
+#include <math.h>
+
+/* An I frame gets this many times the average frame budget */
+#define RC_INTRA_RATIO      3
+
+/* Largest QP step between two frames of the same type */
+#define RC_CBR_MAX_DELTA    4
+#define RC_VBR_MAX_DELTA    2
+
+/* An empty or full HRD buffer narrows the QP range by this fraction */
+#define RC_HRD_QP_SHIFT     5
+
+static double rc_qstep(int qp)
+{
+    return pow(2.0, (qp - 4) / 6.0);
+}
+
+static int rc_clip_qp(int qp)
+{
+    if (qp < ROCKCHIP_QP_MIN)
+        return ROCKCHIP_QP_MIN;
+    if (qp > ROCKCHIP_QP_MAX)
+        return ROCKCHIP_QP_MAX;
+    return qp;
+}
+
+/**
+ * QP the rate model predicts for coding a frame of this type in bits. No
+ * bits at all, with the HRD buffer about to run dry, takes the top QP.
+ */
+static int rc_qp_for_bits(rate_control_p rc, int intra, int bits)
+{
+    if (rc->complexity[intra] <= 0)
+        return rc->last_qp[intra];
+    if (bits <= 0)
+        return ROCKCHIP_QP_MAX;
+
+    return rc_clip_qp(lrint(4 + 6 * log2(rc->complexity[intra] / bits)));
+}
+
+static int rc_limit_delta(rate_control_p rc, int intra, int qp, int max_delta)
+{
+    /* Nothing to be smooth against before the first frame of a type */
+    if (rc->complexity[intra] <= 0)
+        return qp;
+
+    if (qp > rc->last_qp[intra] + max_delta)
+        return rc->last_qp[intra] + max_delta;
+    if (qp < rc->last_qp[intra] - max_delta)
+        return rc->last_qp[intra] - max_delta;
+    return qp;
+}
+
+/**
+ * Budget of the next frame with the accumulated error paid back. The
+ * error itself is counted against the average frame_bits, so the extra
+ * bits of I frames are won back from the following P frames.
+ */
+static int rc_frame_budget(rate_control_p rc, int intra, int frame_bits, int window)
+{
+    long long budget = frame_bits;
+
+    rc->frame_average = frame_bits;
+
+    if (intra)
+        budget *= RC_INTRA_RATIO;
+
+    budget -= rc->bit_error / window;
+    if (budget < frame_bits / 4)
+        budget = frame_bits / 4;
+
+    /* Whatever the algorithm, never drain the HRD buffer */
+    if (rc->cpb_size && budget > rc->cpb_fullness - rc->cpb_size / 10)
+        budget = rc->cpb_fullness - rc->cpb_size / 10;
+
+    return budget;
+}
+
+/* CBR: hit the budget every frame, reacting quickly */
+static int rc_cbr_frame_qp(rate_control_p rc, int intra)
+{
+    int budget = rc_frame_budget(rc, intra,
+            rockchip_rc_frame_bits(rc), rc->window);
+
+    return rc_limit_delta(rc, intra,
+            rc_qp_for_bits(rc, intra, budget), RC_CBR_MAX_DELTA);
+}
+
+/**
+ * VBR: bits_per_second is the peak and target_percentage of it the
+ * average; errors are spread over a longer window and QP moves slowly.
+ */
+static int rc_vbr_frame_qp(rate_control_p rc, int intra)
+{
+    int frame_bits = (long long) rockchip_rc_frame_bits(rc) *
+        rc->target_percentage / 100;
+    int budget = rc_frame_budget(rc, intra, frame_bits, rc->window * 4);
+
+    return rc_limit_delta(rc, intra,
+            rc_qp_for_bits(rc, intra, budget), RC_VBR_MAX_DELTA);
+}
+
+/**
+ * Capped CRF: code at the constant quality QP unless the model predicts
+ * the frame would break the bitrate cap, then raise QP just enough.
+ */
+static int rc_crf_frame_qp(rate_control_p rc, int intra)
+{
+    int qp = intra ? rc->crf - 3 : rc->crf;
+    int budget, cap_qp;
+
+    if (!rc->bitrate) {
+        rc->frame_average = 0;
+        return rc_clip_qp(qp);
+    }
+
+    budget = rc_frame_budget(rc, intra, rockchip_rc_frame_bits(rc), rc->window);
+
+    cap_qp = rc_qp_for_bits(rc, intra, budget);
+    if (rc->complexity[intra] > 0 && cap_qp > qp)
+        qp = cap_qp;
+
+    return rc_clip_qp(qp);
+}
+
+static const rate_control_ops_t rc_cbr_ops = {
+    .name = "cbr",
+    .frame_qp = rc_cbr_frame_qp,
+};
+
+static const rate_control_ops_t rc_vbr_ops = {
+    .name = "vbr",
+    .frame_qp = rc_vbr_frame_qp,
+};
+
+static const rate_control_ops_t rc_crf_ops = {
+    .name = "capped-crf",
+    .frame_qp = rc_crf_frame_qp,
+};
+
+void rockchip_rc_init(rate_control_p rc)
+{
+    memset(rc, 0, sizeof(*rc));
+
+    rc->fps_num = 30;
+    rc->fps_den = 1;
+    rc->target_percentage = 100;
+    rc->window = 30;
+    rc->initial_qp = ROCKCHIP_QP_DEFAULT;
+    rc->crf = ROCKCHIP_QP_DEFAULT;
+    rc->last_qp[0] = rc->last_qp[1] = ROCKCHIP_QP_DEFAULT;
+}
+
+void rockchip_rc_set_mode(rate_control_p rc, unsigned int va_rc_mode)
+{
+    switch (va_rc_mode) {
+    case VA_RC_CBR:
+        rc->ops = &rc_cbr_ops;
+        break;
+    case VA_RC_VBR:
+    case VA_RC_VBR_CONSTRAINED:
+        rc->ops = &rc_vbr_ops;
+        break;
+#ifdef VA_RC_ICQ
+    case VA_RC_ICQ:
+        rc->ops = &rc_crf_ops;
+        break;
+#endif
+    default:
+        /* CQP and the rest stay with the VPU */
+        rc->ops = NULL;
+        break;
+    }
+}
+
+void rockchip_rc_set_bitrate(rate_control_p rc, int bitrate)
+{
+    rc->bitrate = bitrate;
+}
+
+/* The top layer with a rate set carries the rate of the whole stream */
+static int rc_top_layer(rate_control_p rc)
+{
+    int i;
+
+    for (i = ROCKCHIP_MAX_TEMPORAL_LAYERS - 1; i > 0; i--) {
+        if (rc->layer_bitrate[i] > 0 || rc->layer_fps_num[i] > 0)
+            break;
+    }
+
+    return i;
+}
+
+void rockchip_rc_set_params(rate_control_p rc, VAEncMiscParameterRateControl *params)
+{
+    int temporal_id = 0;
+
+#if VA_CHECK_VERSION(0, 40, 0)
+    temporal_id = params->rc_flags.bits.temporal_id;
+#endif
+    if (temporal_id >= ROCKCHIP_MAX_TEMPORAL_LAYERS)
+        return;
+
+    rc->layer_bitrate[temporal_id] = params->bits_per_second;
+    if (temporal_id < rc_top_layer(rc))
+        return;
+
+    rockchip_rc_set_bitrate(rc, params->bits_per_second);
+
+    if (params->target_percentage > 0 && params->target_percentage <= 100)
+        rc->target_percentage = params->target_percentage;
+
+    /* window_size is in milliseconds */
+    if (params->window_size > 0)
+        rc->window = (long long) params->window_size * rc->fps_num /
+            (rc->fps_den * 1000) ? : 1;
+
+    if (params->initial_qp > 0) {
+        rc->initial_qp = rc_clip_qp(params->initial_qp);
+        rc->crf = rc->initial_qp;
+        if (rc->complexity[0] <= 0)
+            rc->last_qp[0] = rc->initial_qp;
+        if (rc->complexity[1] <= 0)
+            rc->last_qp[1] = rc->initial_qp;
+    }
+
+#if VA_CHECK_VERSION(1, 0, 0)
+    if (params->ICQ_quality_factor > 0)
+        rc->crf = rc_clip_qp(params->ICQ_quality_factor);
+#endif
+
+    if (params->rc_flags.bits.reset) {
+        rc->bit_error = 0;
+        rc->complexity[0] = rc->complexity[1] = 0;
+    }
+}
+
+void rockchip_rc_set_framerate(rate_control_p rc, int temporal_id, int num, int den)
+{
+    if (num <= 0 || den <= 0 || temporal_id >= ROCKCHIP_MAX_TEMPORAL_LAYERS)
+        return;
+
+    rc->layer_fps_num[temporal_id] = num;
+    rc->layer_fps_den[temporal_id] = den;
+    if (temporal_id < rc_top_layer(rc))
+        return;
+
+    rc->fps_num = num;
+    rc->fps_den = den;
+}
+
+void rockchip_rc_set_layers(rate_control_p rc, int num_layers)
+{
+    rc->num_layers = num_layers;
+    rc->temporal_id = 0;
+}
+
+void rockchip_rc_set_hrd(rate_control_p rc, int buffer_size, int initial_fullness)
+{
+    rc->cpb_size = buffer_size;
+    rc->cpb_fullness = initial_fullness;
+
+    if (rc->cpb_fullness <= 0 || rc->cpb_fullness > rc->cpb_size)
+        rc->cpb_fullness = rc->cpb_size / 2;
+}
+
+/**
+ * Average bits available per frame at the configured bitrate. With
+ * temporal layers, a frame gets what its own layer adds to the layer
+ * below, divided by the frames that layer adds.
+ */
+int rockchip_rc_frame_bits(rate_control_p rc)
+{
+    int tid = rc->temporal_id;
+
+    if (rc->num_layers > 1 && tid < rc->num_layers &&
+            rc->layer_bitrate[tid] > 0 && rc->layer_fps_num[tid] > 0) {
+        double bits = rc->layer_bitrate[tid];
+        double fps = (double) rc->layer_fps_num[tid] / rc->layer_fps_den[tid];
+
+        if (tid > 0 && rc->layer_fps_num[tid - 1] > 0) {
+            bits -= rc->layer_bitrate[tid - 1];
+            fps -= (double) rc->layer_fps_num[tid - 1] / rc->layer_fps_den[tid - 1];
+        }
+
+        if (bits > 0 && fps > 0)
+            return bits / fps;
+    }
+
+    return (long long) rc->bitrate * rc->fps_den / rc->fps_num;
+}
+
+/**
+ * Size hint for the next frame: the average frame budget, pulled towards
+ * a half full buffer over a few frames, and never more than the buffer
+ * holds so the decoder cannot underflow.
+ */
+int rockchip_rc_target_bits(rate_control_p rc)
+{
+    int frame_bits = rockchip_rc_frame_bits(rc);
+    int target;
+
+    if (!rc->cpb_size || !frame_bits)
+        return frame_bits;
+
+    target = frame_bits + (rc->cpb_fullness - rc->cpb_size / 2) / 8;
+
+    if (target > rc->cpb_fullness - rc->cpb_size / 10)
+        target = rc->cpb_fullness - rc->cpb_size / 10;
+    if (target < frame_bits / 4)
+        target = frame_bits / 4;
+
+    return target;
+}
+
+/**
+ * Narrow the allowed QP range as the buffer drifts away from half full:
+ * an emptying buffer raises the minimum QP, a filling one lowers the
+ * maximum, each by up to a fifth of the full range.
+ */
+void rockchip_rc_qp_range(rate_control_p rc, int *min_qp, int *max_qp)
+{
+    int level;
+
+    *min_qp = ROCKCHIP_QP_MIN;
+    *max_qp = ROCKCHIP_QP_MAX;
+
+    if (!rc->cpb_size || !rc->bitrate)
+        return;
+
+    level = (long long) rc->cpb_fullness * 100 / rc->cpb_size;
+
+    if (level < 50)
+        *min_qp += (50 - level) * (ROCKCHIP_QP_MAX - ROCKCHIP_QP_MIN) /
+            (50 * RC_HRD_QP_SHIFT);
+    else
+        *max_qp -= (level - 50) * (ROCKCHIP_QP_MAX - ROCKCHIP_QP_MIN) /
+            (50 * RC_HRD_QP_SHIFT);
+}
+
+/**
+ * QP for the next frame from the host algorithm, clamped by the HRD
+ * model, or -1 when rate control is left to the VPU.
+ */
+int rockchip_rc_frame_qp(rate_control_p rc, int intra)
+{
+    int min_qp, max_qp, qp;
+
+    if (!rc->ops || (!rc->bitrate && rc->ops != &rc_crf_ops))
+        return -1;
+
+    intra = !!intra;
+    qp = rc->ops->frame_qp(rc, intra);
+
+    rockchip_rc_qp_range(rc, &min_qp, &max_qp);
+    if (qp < min_qp)
+        qp = min_qp;
+    if (qp > max_qp)
+        qp = max_qp;
+
+    rc->frame_intra = intra;
+    rc->frame_qp = qp;
+
+    return qp;
+}
+
+void rockchip_rc_update(rate_control_p rc, int coded_bits)
+{
+    if (rc->ops && rc->frame_qp > 0 && coded_bits > 0) {
+        int intra = rc->frame_intra;
+        double complexity = coded_bits * rc_qstep(rc->frame_qp);
+
+        if (rc->complexity[intra] > 0)
+            rc->complexity[intra] = (rc->complexity[intra] * 3 + complexity) / 4;
+        else
+            rc->complexity[intra] = complexity;
+        rc->last_qp[intra] = rc->frame_qp;
+
+        /* Keep the debt bounded so one bad scene cannot starve the rest */
+        if (rc->frame_average > 0) {
+            long long limit = (long long) rc->bitrate * 2;
+
+            rc->bit_error += coded_bits - rc->frame_average;
+            if (rc->bit_error > limit)
+                rc->bit_error = limit;
+            if (rc->bit_error < -limit)
+                rc->bit_error = -limit;
+        }
+
+        rc->frame_qp = 0;
+    }
+
+    if (!rc->cpb_size)
+        return;
+
+    rc->cpb_fullness -= coded_bits;
+    if (rc->cpb_fullness < 0)
+        rc->cpb_fullness = 0;
+
+    rc->cpb_fullness += rockchip_rc_frame_bits(rc);
+    if (rc->cpb_fullness > rc->cpb_size)
+        rc->cpb_fullness = rc->cpb_size;
+}
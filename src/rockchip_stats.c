@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rockchip_drv_video.h"
+
+#if VA_CHECK_VERSION(1, 0, 0)
+
+/* Per pixel variance up to which a macroblock is reported flat */
+#define STATS_FLAT_VARIANCE     2
+
+static VAStatus rockchip_InitStats(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    LOG_INIT();
+
+    memset(&obj_context->stats_params, 0, sizeof(obj_context->stats_params));
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_DeinitStats(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    LOG_DEINIT();
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_PrepareStats(
+        VADriverContextP ctx,
+        VAContextID context,
+        VASurfaceID render_target)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    if (!SURFACE(render_target))
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+
+    obj_context->current_render_target = render_target;
+    obj_context->stats_params.rendered = 0;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessStatsParam(stats_params_p params,
+        object_buffer_p obj_buffer)
+{
+    VAStatsStatisticsParameterH264 *param;
+    VAStatsStatisticsParameter *stats;
+    int i;
+
+    if (obj_buffer->buffer_size != sizeof(*param))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    param = (VAStatsStatisticsParameterH264 *) obj_buffer->buffer_data;
+    stats = &param->stats_params;
+
+    /* Frames only, with at most the previous one as reference */
+    if (stats->input.flags &
+            (VA_PICTURE_STATS_TOP_FIELD | VA_PICTURE_STATS_BOTTOM_FIELD))
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    if (stats->num_past_references > 1 || stats->num_future_references)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    if (stats->num_past_references && !stats->past_references)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    params->input = stats->input.picture_id;
+    params->past = stats->num_past_references ?
+        stats->past_references[0].picture_id : VA_INVALID_SURFACE;
+
+    /* The array is the application's, keep the IDs */
+    for (i = 0; i < STATS_NUM_OUTPUTS; i++)
+        params->outputs[i] = stats->outputs ? stats->outputs[i] : VA_INVALID_ID;
+
+    params->disable_mv_output = param->disable_mv_output;
+    params->disable_statistics_output = param->disable_statistics_output;
+    params->rendered = 1;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessBuffer(
+        VADriverContextP ctx,
+        VAContextID context,
+        VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    switch (obj_buffer->type) {
+    case VAStatsStatisticsParameterBufferType:
+        return rockchip_ProcessStatsParam(&obj_context->stats_params,
+                obj_buffer);
+    default:
+        return VA_STATUS_ERROR_UNSUPPORTED_BUFFERTYPE;
+    }
+}
+
+/* Luma plane of a YUV surface, NULL for RGB ones */
+static const unsigned char *rockchip_StatsLuma(
+        VADriverContextP ctx,
+        object_surface_p obj_surface)
+{
+    INIT_DRIVER_DATA
+    object_buffer_p obj_buffer;
+
+    switch (obj_surface->image.format.fourcc) {
+    case VA_FOURCC_NV12:
+    case VA_FOURCC_YV12:
+    case VA_FOURCC_IYUV:
+        break;
+    default:
+        return NULL;
+    }
+
+    obj_buffer = BUFFER(obj_surface->image.buf);
+    if (!obj_buffer)
+        return NULL;
+
+    return (const unsigned char *) obj_buffer->buffer_data +
+        obj_surface->image.offsets[0];
+}
+
+/* One motion vector per 4x4 block, in quarter pels */
+static VAStatus rockchip_WriteStatsMV(
+        VADriverContextP ctx,
+        const frame_stats_t *fs,
+        VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_buffer_p obj_buffer;
+    VAMotionVector *mv;
+    int mbs = fs->mb_width * fs->mb_height;
+    int i, j;
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer || obj_buffer->type != VAStatsMVBufferType ||
+            obj_buffer->buffer_size < mbs * 16 * sizeof(*mv))
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    mv = (VAMotionVector *) obj_buffer->buffer_data;
+    for (i = 0; i < mbs; i++) {
+        for (j = 0; j < 16; j++, mv++) {
+            mv->mv0[0] = fs->mb[i].mv[0] * 4;
+            mv->mv0[1] = fs->mb[i].mv[1] * 4;
+            mv->mv1[0] = 0;
+            mv->mv1[1] = 0;
+        }
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+/**
+ * Variances are per pixel. Without a transform there are no coefficient
+ * counts, and the inter fields are 0 without a past reference.
+ */
+static VAStatus rockchip_WriteStatistics(
+        VADriverContextP ctx,
+        const frame_stats_t *fs,
+        VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_buffer_p obj_buffer;
+    VAStatsStatisticsH264 *out;
+    int mbs = fs->mb_width * fs->mb_height;
+    int i, j;
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer || obj_buffer->type != VAStatsStatisticsBufferType ||
+            obj_buffer->buffer_size < mbs * sizeof(*out))
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    out = (VAStatsStatisticsH264 *) obj_buffer->buffer_data;
+    memset(out, 0, mbs * sizeof(*out));
+
+    for (i = 0; i < mbs; i++, out++) {
+        const mb_stats_t *mb = &fs->mb[i];
+
+        out->best_inter_distortion0 = mb->inter_cost;
+        out->best_intra_distortion = mb->intra_cost;
+        out->best_intra_mode = mb->intra_mode;
+        out->variance_16x16 = mb->energy >> 8;
+        out->pixel_average_16x16 = mb->mean;
+        for (j = 0; j < 4; j++) {
+            out->variance_8x8[j] = mb->energy_8x8[j] >> 6;
+            out->pixel_average_8x8[j] = mb->mean_8x8[j];
+        }
+        out->mb_is_flat = out->variance_16x16 <= STATS_FLAT_VARIANCE;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+/**
+ * The statistics are computed right away on the CPU and kept on the
+ * input surface as well, for an encoder to pick up.
+ */
+static VAStatus rockchip_DoStats(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface, obj_past = NULL;
+    const unsigned char *luma, *ref = NULL;
+    stats_params_p params;
+    VAStatus status;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    params = &obj_context->stats_params;
+    if (!params->rendered)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    obj_context->current_render_target = -1;
+
+    obj_surface = SURFACE(params->input);
+    if (!obj_surface)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+
+    if (params->past != VA_INVALID_SURFACE) {
+        obj_past = SURFACE(params->past);
+        if (!obj_past)
+            return VA_STATUS_ERROR_INVALID_SURFACE;
+        if (obj_past->image.width != obj_surface->image.width ||
+                obj_past->image.height != obj_surface->image.height ||
+                obj_past->image.pitches[0] != obj_surface->image.pitches[0])
+            return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    /* Decoders or VPP may still be writing the pictures */
+    status = rockchip_SyncSurface(ctx, params->input);
+    if (status == VA_STATUS_SUCCESS && obj_past)
+        status = rockchip_SyncSurface(ctx, params->past);
+    if (status != VA_STATUS_SUCCESS)
+        return status;
+
+    luma = rockchip_StatsLuma(ctx, obj_surface);
+    if (obj_past)
+        ref = rockchip_StatsLuma(ctx, obj_past);
+    if (!luma || (obj_past && !ref))
+        return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+
+    if (rockchip_frame_stats_compute(&obj_surface->stats,
+                obj_surface->image.width, obj_surface->image.height,
+                obj_surface->image.pitches[0], luma, ref) < 0)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    if (!params->disable_mv_output &&
+            params->outputs[STATS_OUTPUT_MV] != VA_INVALID_ID) {
+        status = rockchip_WriteStatsMV(ctx, &obj_surface->stats,
+                params->outputs[STATS_OUTPUT_MV]);
+        if (status != VA_STATUS_SUCCESS)
+            return status;
+    }
+
+    if (!params->disable_statistics_output &&
+            params->outputs[STATS_OUTPUT_STATISTICS] != VA_INVALID_ID) {
+        status = rockchip_WriteStatistics(ctx, &obj_surface->stats,
+                params->outputs[STATS_OUTPUT_STATISTICS]);
+        if (status != VA_STATUS_SUCCESS)
+            return status;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* Nothing is ever left in flight */
+static VAStatus rockchip_SyncStats(
+        VADriverContextP ctx,
+        VASurfaceID render_target)
+{
+    return VA_STATUS_SUCCESS;
+}
+
+static void rockchip_GetAttributes(
+        VAConfigAttrib *attrib_list,
+        int num_attribs)
+{
+    VAConfigAttribValStats stats;
+    int i;
+
+    for (i = 0; i < num_attribs; i++) {
+        switch (attrib_list[i].type) {
+        case VAConfigAttribRTFormat:
+            attrib_list[i].value = VA_RT_FORMAT_YUV420;
+            break;
+        case VAConfigAttribStats:
+            stats.value = 0;
+            stats.bits.max_num_past_references = 1;
+            stats.bits.max_num_future_references = 0;
+            stats.bits.num_outputs = STATS_NUM_OUTPUTS;
+            attrib_list[i].value = stats.value;
+            break;
+        default:
+            attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
+            break;
+        }
+    }
+}
+
+const rockchip_codec_ops_t rockchip_stats_ops = {
+    .name           = "statistics",
+    .init           = rockchip_InitStats,
+    .deinit         = rockchip_DeinitStats,
+    .prepare        = rockchip_PrepareStats,
+    .process        = rockchip_ProcessBuffer,
+    .submit         = rockchip_DoStats,
+    .collect        = rockchip_SyncStats,
+    .get_attributes = rockchip_GetAttributes,
+};
+
+#endif
@@ -37,8 +37,17 @@ VAStatus rockchip_CreateSurfaces(
     VAStatus vaStatus = VA_STATUS_SUCCESS;
     int i;
 
-    /* We only support one format */
-    if (VA_RT_FORMAT_YUV420 != format) {
+    VAImageFormat image_format = { VA_FOURCC_NV12, VA_LSB_FIRST, 12 };
+
+    switch (format) {
+    case VA_RT_FORMAT_YUV420:
+        break;
+    case VA_RT_FORMAT_RGB32:
+        /* Only video processing reads or writes these */
+        image_format = (VAImageFormat) { VA_FOURCC_BGRX, VA_LSB_FIRST, 32,
+            24, 0x00ff0000, 0x0000ff00, 0x000000ff, 0 };
+        break;
+    default:
         return VA_STATUS_ERROR_UNSUPPORTED_RT_FORMAT;
     }
 
@@ -51,10 +60,6 @@ VAStatus rockchip_CreateSurfaces(
         }
         surfaces[i] = surfaceID;
 
-        /**
-         * TODO: Support multi formats
-         */
-        VAImageFormat image_format = { VA_FOURCC_NV12, VA_LSB_FIRST, 12 };
         vaStatus = rockchip_CreateImage(ctx, &image_format,
                 width, height, &obj_surface->image);
         if (VA_STATUS_SUCCESS != vaStatus)
@@ -62,6 +67,9 @@ VAStatus rockchip_CreateSurfaces(
 
         obj_surface->context_id = VA_INVALID_ID;
         obj_surface->coded_buffer = VA_INVALID_ID;
+        memset(&obj_surface->stats, 0, sizeof(obj_surface->stats));
+        obj_surface->upload = NULL;
+        obj_surface->upload_valid = 0;
     }
 
     /* Error recovery */
@@ -91,6 +99,8 @@ VAStatus rockchip_DestroySurfaces(
         ASSERT(obj_surface);
 
         rockchip_DestroyImage(ctx, obj_surface->image.image_id);
+        rockchip_frame_stats_deinit(&obj_surface->stats);
+        v4l2_frame_free(obj_surface->upload);
 
         object_heap_free( &driver_data->surface_heap,
                           (object_base_p) obj_surface);
@@ -102,7 +112,19 @@ VAStatus rockchip_SyncSurface(
     VASurfaceID render_target
 )
 {
-    return rockchip_SyncEncoder(ctx, render_target);
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface = SURFACE(render_target);
+    ASSERT(obj_surface);
+
+    /* Nothing in flight for this surface */
+    if (obj_surface->context_id == VA_INVALID_ID)
+        return VA_STATUS_SUCCESS;
+
+    obj_context = CONTEXT(obj_surface->context_id);
+    ASSERT(obj_context);
+
+    return obj_context->codec->collect(ctx, render_target);
 }
 
 VAStatus rockchip_QuerySurfaceStatus(
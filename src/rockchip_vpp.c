@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <unistd.h>
+
+#include "rockchip_drv_video.h"
+
+static void *rockchip_VppThread(void *arg)
+{
+    vpp_worker_p worker = arg;
+    vpp_params_p vpp = worker->vpp;
+
+    pthread_mutex_lock(&vpp->lock);
+    for (;;) {
+        int band, ret;
+
+        while (vpp->next_band >= vpp->bands && !vpp->quit)
+            pthread_cond_wait(&vpp->cond, &vpp->lock);
+        if (vpp->quit)
+            break;
+
+        band = vpp->next_band++;
+        pthread_mutex_unlock(&vpp->lock);
+        ret = rockchip_convert_rows(&vpp->job, &worker->scratch,
+                band * CONVERT_BAND_ROWS, (band + 1) * CONVERT_BAND_ROWS);
+        pthread_mutex_lock(&vpp->lock);
+
+        if (ret)
+            vpp->failed = 1;
+        if (--vpp->pending == 0)
+            pthread_cond_broadcast(&vpp->cond);
+    }
+    pthread_mutex_unlock(&vpp->lock);
+
+    return NULL;
+}
+
+/* Wait for the picture in flight, if any, and let go of its surface */
+static VAStatus rockchip_WaitVpp(
+        VADriverContextP ctx,
+        object_context_p obj_context)
+{
+    INIT_DRIVER_DATA
+    vpp_params_p vpp = &obj_context->vpp_params;
+    object_surface_p obj_surface;
+    int failed;
+
+    if (vpp->target == VA_INVALID_ID)
+        return VA_STATUS_SUCCESS;
+
+    pthread_mutex_lock(&vpp->lock);
+    while (vpp->pending)
+        pthread_cond_wait(&vpp->cond, &vpp->lock);
+    failed = vpp->failed;
+    pthread_mutex_unlock(&vpp->lock);
+
+    rockchip_convert_deinit(&vpp->job);
+
+    obj_surface = SURFACE(vpp->target);
+    if (obj_surface && obj_surface->context_id == obj_context->context_id)
+        obj_surface->context_id = VA_INVALID_ID;
+    vpp->target = VA_INVALID_ID;
+
+    return failed ? VA_STATUS_ERROR_OPERATION_FAILED : VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_DeinitVpp(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    vpp_params_p vpp;
+    int i;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    vpp = &obj_context->vpp_params;
+
+    rockchip_WaitVpp(ctx, obj_context);
+
+    pthread_mutex_lock(&vpp->lock);
+    vpp->quit = 1;
+    pthread_cond_broadcast(&vpp->cond);
+    pthread_mutex_unlock(&vpp->lock);
+
+    for (i = 0; i < vpp->num_threads; i++) {
+        pthread_join(vpp->workers[i].thread, NULL);
+        rockchip_convert_scratch_free(&vpp->workers[i].scratch);
+    }
+
+    pthread_cond_destroy(&vpp->cond);
+    pthread_mutex_destroy(&vpp->lock);
+
+    LOG_DEINIT();
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* A worker per core, up to VPP_MAX_THREADS; none converts on the caller */
+static VAStatus rockchip_InitVpp(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    vpp_params_p vpp;
+    long cpus;
+    int i;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    LOG_INIT();
+
+    vpp = &obj_context->vpp_params;
+    memset(vpp, 0, sizeof(*vpp));
+    vpp->target = VA_INVALID_ID;
+
+    pthread_mutex_init(&vpp->lock, NULL);
+    pthread_cond_init(&vpp->cond, NULL);
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (i = 0; i < cpus && i < VPP_MAX_THREADS; i++) {
+        vpp->workers[i].vpp = vpp;
+        if (pthread_create(&vpp->workers[i].thread, NULL,
+                    rockchip_VppThread, &vpp->workers[i]))
+            break;
+    }
+    vpp->num_threads = i;
+
+    LOG("vpp with %d threads\n", vpp->num_threads);
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_PrepareVpp(
+        VADriverContextP ctx,
+        VAContextID context,
+        VASurfaceID render_target)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    VAStatus status;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    if (!SURFACE(render_target))
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+
+    /* The workers only do one picture at a time */
+    status = rockchip_WaitVpp(ctx, obj_context);
+    if (status != VA_STATUS_SUCCESS)
+        LOG("vpp of the previous picture failed\n");
+
+    obj_context->current_render_target = render_target;
+    obj_context->vpp_params.rendered = 0;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessPipeline(vpp_params_p vpp,
+        object_buffer_p obj_buffer)
+{
+    VAProcPipelineParameterBuffer *pipeline;
+
+    if (obj_buffer->buffer_size != sizeof(*pipeline))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    pipeline = (VAProcPipelineParameterBuffer *) obj_buffer->buffer_data;
+
+    if (pipeline->num_filters)
+        return VA_STATUS_ERROR_INVALID_FILTER_CHAIN;
+
+    vpp->input = pipeline->surface;
+
+    /* The regions are the application's, keep a copy */
+    vpp->has_input_region = pipeline->surface_region != NULL;
+    if (vpp->has_input_region)
+        vpp->input_region = *pipeline->surface_region;
+    vpp->has_output_region = pipeline->output_region != NULL;
+    if (vpp->has_output_region)
+        vpp->output_region = *pipeline->output_region;
+
+    vpp->input_bt709 =
+        pipeline->surface_color_standard == VAProcColorStandardBT709;
+    vpp->output_bt709 =
+        pipeline->output_color_standard == VAProcColorStandardBT709;
+    vpp->background = pipeline->output_background_color;
+    vpp->rendered = 1;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_ProcessBuffer(
+        VADriverContextP ctx,
+        VAContextID context,
+        VABufferID buffer)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    obj_buffer = BUFFER(buffer);
+    if (!obj_buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    switch (obj_buffer->type) {
+    case VAProcPipelineParameterBufferType:
+        return rockchip_ProcessPipeline(&obj_context->vpp_params, obj_buffer);
+    default:
+        return VA_STATUS_ERROR_UNSUPPORTED_BUFFERTYPE;
+    }
+}
+
+static VAStatus rockchip_DoVpp(
+        VADriverContextP ctx,
+        VAContextID context)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p src, dst;
+    object_buffer_p src_buffer, dst_buffer;
+    vpp_params_p vpp;
+    VAStatus status;
+
+    obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    vpp = &obj_context->vpp_params;
+    if (!vpp->rendered)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    src = SURFACE(vpp->input);
+    dst = SURFACE(obj_context->current_render_target);
+    if (!src || !dst || src == dst)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+
+    /* The input may still be decoded or processed by another context */
+    status = rockchip_SyncSurface(ctx, vpp->input);
+    if (status != VA_STATUS_SUCCESS)
+        return status;
+
+    src_buffer = BUFFER(src->image.buf);
+    dst_buffer = BUFFER(dst->image.buf);
+    if (!src_buffer || !dst_buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    status = rockchip_convert_init(&vpp->job,
+            &src->image, src_buffer->buffer_data,
+            vpp->has_input_region ? &vpp->input_region : NULL,
+            vpp->input_bt709,
+            &dst->image, dst_buffer->buffer_data,
+            vpp->has_output_region ? &vpp->output_region : NULL,
+            vpp->output_bt709, &vpp->background);
+    if (status != VA_STATUS_SUCCESS)
+        return status;
+
+    obj_context->current_render_target = -1;
+    dst->stats.valid = 0;
+    dst->upload_valid = 0;
+
+    if (!vpp->num_threads) {
+        status = rockchip_convert(&vpp->job);
+        rockchip_convert_deinit(&vpp->job);
+        return status;
+    }
+
+    pthread_mutex_lock(&vpp->lock);
+    vpp->failed = 0;
+    vpp->bands = (dst->image.height + CONVERT_BAND_ROWS - 1) /
+        CONVERT_BAND_ROWS;
+    vpp->next_band = 0;
+    vpp->pending = vpp->bands;
+    pthread_cond_broadcast(&vpp->cond);
+    pthread_mutex_unlock(&vpp->lock);
+
+    vpp->target = dst->base.id;
+    dst->context_id = context;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus rockchip_SyncVpp(
+        VADriverContextP ctx,
+        VASurfaceID render_target)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context;
+    object_surface_p obj_surface;
+
+    obj_surface = SURFACE(render_target);
+    ASSERT(obj_surface);
+
+    obj_context = CONTEXT(obj_surface->context_id);
+    ASSERT(obj_context);
+
+    return rockchip_WaitVpp(ctx, obj_context);
+}
+
+static void rockchip_GetAttributes(
+        VAConfigAttrib *attrib_list,
+        int num_attribs)
+{
+    int i;
+
+    for (i = 0; i < num_attribs; i++) {
+        switch (attrib_list[i].type) {
+        case VAConfigAttribRTFormat:
+            attrib_list[i].value = VA_RT_FORMAT_YUV420 | VA_RT_FORMAT_RGB32;
+            break;
+        default:
+            attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
+            break;
+        }
+    }
+}
+
+const rockchip_codec_ops_t rockchip_vpp_ops = {
+    .name           = "vpp",
+    .init           = rockchip_InitVpp,
+    .deinit         = rockchip_DeinitVpp,
+    .prepare        = rockchip_PrepareVpp,
+    .process        = rockchip_ProcessBuffer,
+    .submit         = rockchip_DoVpp,
+    .collect        = rockchip_SyncVpp,
+    .get_attributes = rockchip_GetAttributes,
+};
+
+/* Scaling and color conversion only, no filters */
+VAStatus rockchip_QueryVideoProcFilters(
+    VADriverContextP ctx,
+    VAContextID context,
+    VAProcFilterType *filters,
+    unsigned int *num_filters
+)
+{
+    *num_filters = 0;
+
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus rockchip_QueryVideoProcFilterCaps(
+    VADriverContextP ctx,
+    VAContextID context,
+    VAProcFilterType type,
+    void *filter_caps,
+    unsigned int *num_filter_caps
+)
+{
+    return VA_STATUS_ERROR_UNSUPPORTED_FILTER;
+}
+
+VAStatus rockchip_QueryVideoProcPipelineCaps(
+    VADriverContextP ctx,
+    VAContextID context,
+    VABufferID *filters,
+    unsigned int num_filters,
+    VAProcPipelineCaps *pipeline_caps
+)
+{
+    static VAProcColorStandardType color_standards[] = {
+        VAProcColorStandardBT601,
+        VAProcColorStandardBT709,
+    };
+
+    if (num_filters)
+        return VA_STATUS_ERROR_INVALID_FILTER_CHAIN;
+
+    pipeline_caps->pipeline_flags = 0;
+    pipeline_caps->filter_flags = 0;
+    pipeline_caps->num_forward_references = 0;
+    pipeline_caps->num_backward_references = 0;
+    pipeline_caps->input_color_standards = color_standards;
+    pipeline_caps->num_input_color_standards = ARRAY_SIZE(color_standards);
+    pipeline_caps->output_color_standards = color_standards;
+    pipeline_caps->num_output_color_standards = ARRAY_SIZE(color_standards);
+
+    return VA_STATUS_SUCCESS;
+}
@@ -0,0 +1,378 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/errno.h>
+
+#include "v4l2_utils.h"
+#include "v4l2_dec_utils.h"
+
+#define PRINT(fmt, args...) \
+    printf("%s[%d] " fmt "\n", __func__, __LINE__, ## args)
+
+#define IOCTL(type, arg) ioctl(ctx->fd, type, arg)
+
+#define IOCTL_OR_ERROR_RETURN_VALUE(type, arg, value, type_str) \
+    do {                                                        \
+        if (IOCTL(type, arg) != 0) {                            \
+            PRINT("ioctl() failed: " type_str);                 \
+            return value;                                       \
+        }                                                       \
+    } while (0)
+
+#define IOCTL_OR_ERROR_RETURN(type, arg) \
+    IOCTL_OR_ERROR_RETURN_VALUE(type, arg, -1, #type)
+
+#define IOCTL_OR_LOG_ERROR(type, arg)        \
+    do {                                     \
+        if (IOCTL(type, arg) != 0)           \
+            PRINT("ioctl() failed: " #type); \
+    } while (0)
+
+/* How long to wait for the VPU to hand back a buffer */
+#define V4L2_DEC_DQBUF_TIMEOUT_MS   2000
+#define V4L2_DEC_POLL_MS            100
+
+dec_context_p v4l2_dec_init(const char *device_path) {
+    int fd = open(device_path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+    if (fd <= 0) {
+        PRINT("failed to open %s", device_path);
+        return NULL;
+    }
+    PRINT(" got %s", device_path);
+
+    dec_context_t *ctx = (dec_context_t *) calloc(1, sizeof(dec_context_t));
+    if (ctx == NULL) {
+        close(fd);
+        return NULL;
+    }
+    ctx->fd = fd;
+    ctx->coded_format = V4L2_PIX_FMT_H264_SLICE;
+    ctx->bitstream_buffer_size = 1024 * 1024;
+
+    return ctx;
+}
+
+static void *v4l2_open_decoder(const char *path) {
+    return v4l2_dec_init(path);
+}
+
+dec_context_p v4l2_dec_init_by_name(const char *name) {
+    return v4l2_probe(name, v4l2_open_decoder);
+}
+
+int v4l2_dec_deinit(dec_context_p ctx) {
+    struct v4l2_requestbuffers reqbufs;
+    int i;
+
+    for (i = 0; i < V4L2_DEC_NUM_BITSTREAMS; i++) {
+        if (ctx->bitstream_buffer[i])
+            munmap(ctx->bitstream_buffer[i], ctx->bitstream_size[i]);
+    }
+    for (i = 0; i < ctx->num_frames; i++) {
+        if (ctx->frame_buffer[i])
+            munmap(ctx->frame_buffer[i], ctx->frame_size);
+    }
+
+    memset(&reqbufs, 0, sizeof(reqbufs));
+    reqbufs.count = 0;
+    reqbufs.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    reqbufs.memory = V4L2_MEMORY_MMAP;
+    IOCTL_OR_LOG_ERROR(VIDIOC_REQBUFS, &reqbufs);
+
+    memset(&reqbufs, 0, sizeof(reqbufs));
+    reqbufs.count = 0;
+    reqbufs.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    reqbufs.memory = V4L2_MEMORY_MMAP;
+    IOCTL_OR_LOG_ERROR(VIDIOC_REQBUFS, &reqbufs);
+
+    close(ctx->fd);
+    free(ctx);
+
+    return 0;
+}
+
+int v4l2_dec_s_fmt(dec_context_p ctx) {
+    struct v4l2_format format;
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    format.fmt.pix_mp.width = ctx->width;
+    format.fmt.pix_mp.height = ctx->height;
+    format.fmt.pix_mp.pixelformat = ctx->coded_format;
+    format.fmt.pix_mp.plane_fmt[0].sizeimage = ctx->bitstream_buffer_size;
+    format.fmt.pix_mp.num_planes = 1;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_S_FMT, &format);
+
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    format.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_NV12;
+    format.fmt.pix_mp.width = ctx->width;
+    format.fmt.pix_mp.height = ctx->height;
+    format.fmt.pix_mp.num_planes = 1;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_S_FMT, &format);
+
+    /* The decoder pads the frame to whole macroblocks */
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_G_FMT, &format);
+
+    if (format.fmt.pix_mp.pixelformat != V4L2_PIX_FMT_NV12 ||
+            format.fmt.pix_mp.num_planes != 1) {
+        PRINT("decoder does not output single plane NV12");
+        return -1;
+    }
+    ctx->frame_pitch = format.fmt.pix_mp.plane_fmt[0].bytesperline;
+    ctx->frame_height = format.fmt.pix_mp.height;
+
+    return 0;
+}
+
+int v4l2_dec_reqbufs(dec_context_p ctx, int num_frames) {
+    struct v4l2_requestbuffers reqbufs;
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    struct v4l2_buffer buffer;
+    int i;
+
+    memset(&reqbufs, 0, sizeof(reqbufs));
+    reqbufs.count = V4L2_DEC_NUM_BITSTREAMS;
+    reqbufs.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    reqbufs.memory = V4L2_MEMORY_MMAP;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_REQBUFS, &reqbufs);
+    if (reqbufs.count != V4L2_DEC_NUM_BITSTREAMS) {
+        PRINT("got %d bitstream buffers", reqbufs.count);
+        return -1;
+    }
+
+    memset(&reqbufs, 0, sizeof(reqbufs));
+    reqbufs.count = num_frames;
+    reqbufs.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    reqbufs.memory = V4L2_MEMORY_MMAP;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_REQBUFS, &reqbufs);
+    /* Every render target needs a buffer of its own */
+    if (reqbufs.count != num_frames) {
+        PRINT("got %d of %d frame buffers", reqbufs.count, num_frames);
+        return -1;
+    }
+
+    for (i = 0; i < V4L2_DEC_NUM_BITSTREAMS; i++) {
+        memset(&buffer, 0, sizeof(buffer));
+        memset(planes, 0, sizeof(planes));
+        buffer.index = i;
+        buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.m.planes = planes;
+        buffer.length = 1;
+        IOCTL_OR_ERROR_RETURN(VIDIOC_QUERYBUF, &buffer);
+
+        ctx->bitstream_size[i] = buffer.m.planes[0].length;
+        ctx->bitstream_buffer[i] = mmap(NULL, ctx->bitstream_size[i],
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED, ctx->fd,
+                buffer.m.planes[0].m.mem_offset);
+        if (ctx->bitstream_buffer[i] == MAP_FAILED) {
+            ctx->bitstream_buffer[i] = NULL;
+            PRINT("create bitstream buffer[%d]: mmap() failed", i);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < num_frames; i++) {
+        memset(&buffer, 0, sizeof(buffer));
+        memset(planes, 0, sizeof(planes));
+        buffer.index = i;
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.m.planes = planes;
+        buffer.length = 1;
+        IOCTL_OR_ERROR_RETURN(VIDIOC_QUERYBUF, &buffer);
+
+        ctx->frame_size = buffer.m.planes[0].length;
+        ctx->frame_buffer[i] = mmap(NULL, ctx->frame_size,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED, ctx->fd,
+                buffer.m.planes[0].m.mem_offset);
+        if (ctx->frame_buffer[i] == MAP_FAILED) {
+            ctx->frame_buffer[i] = NULL;
+            PRINT("create frame buffer[%d]: mmap() failed", i);
+            return -1;
+        }
+        ctx->num_frames = i + 1;
+    }
+
+    return 0;
+}
+
+int v4l2_dec_streamon(dec_context_p ctx) {
+    __u32 type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_STREAMON, &type);
+
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_STREAMON, &type);
+
+    return 0;
+}
+
+int v4l2_dec_streamoff(dec_context_p ctx) {
+    __u32 type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_STREAMOFF, &type);
+
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_STREAMOFF, &type);
+
+    memset(ctx->bitstream_queued, 0, sizeof(ctx->bitstream_queued));
+    memset(ctx->frame_queued, 0, sizeof(ctx->frame_queued));
+
+    return 0;
+}
+
+/**
+ * Set controls into a configuration store, applied when the bitstream
+ * buffer queued with the same store is decoded.
+ */
+int v4l2_dec_s_ext_ctrls(dec_context_p ctx, __u32 config_store,
+        struct v4l2_ext_control *ctrls, int count) {
+    struct v4l2_ext_controls ext_ctrls;
+    memset(&ext_ctrls, 0, sizeof(ext_ctrls));
+    ext_ctrls.config_store = config_store;
+    ext_ctrls.count = count;
+    ext_ctrls.controls = ctrls;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_S_EXT_CTRLS, &ext_ctrls);
+
+    return 0;
+}
+
+/**
+ * Index of a bitstream buffer the next picture can be written to, taking
+ * one back from the driver when all of them are queued.
+ */
+int v4l2_dec_get_bitstream(dec_context_p ctx) {
+    int i;
+
+    for (i = 0; i < V4L2_DEC_NUM_BITSTREAMS; i++) {
+        if (!ctx->bitstream_queued[i])
+            return i;
+    }
+
+    return v4l2_dec_dqbuf_bitstream(ctx);
+}
+
+int v4l2_dec_qbuf_bitstream(dec_context_p ctx, int index, int size,
+        __u32 config_store) {
+    struct v4l2_buffer qbuf;
+    struct v4l2_plane qbuf_planes[VIDEO_MAX_PLANES];
+    memset(&qbuf, 0, sizeof(qbuf));
+    memset(qbuf_planes, 0, sizeof(qbuf_planes));
+    qbuf.index = index;
+    qbuf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    qbuf.memory = V4L2_MEMORY_MMAP;
+    qbuf.m.planes = qbuf_planes;
+    qbuf.m.planes[0].bytesused = size;
+    qbuf.length = 1;
+    qbuf.config_store = config_store;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_QBUF, &qbuf);
+    ctx->bitstream_queued[index] = 1;
+
+    return 0;
+}
+
+int v4l2_dec_qbuf_frame(dec_context_p ctx, int index) {
+    struct v4l2_buffer qbuf;
+    struct v4l2_plane qbuf_planes[VIDEO_MAX_PLANES];
+    memset(&qbuf, 0, sizeof(qbuf));
+    memset(qbuf_planes, 0, sizeof(qbuf_planes));
+    qbuf.index = index;
+    qbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    qbuf.memory = V4L2_MEMORY_MMAP;
+    qbuf.m.planes = qbuf_planes;
+    qbuf.length = 1;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_QBUF, &qbuf);
+    ctx->frame_queued[index] = 1;
+    ctx->frame_error[index] = 0;
+
+    return 0;
+}
+
+/**
+ * Wait for a buffer of the queue type, returning its v4l2_buffer. Gives
+ * up with -1 when the driver reports an error or nothing comes back
+ * within V4L2_DEC_DQBUF_TIMEOUT_MS, a hung VPU then fails the picture
+ * instead of the application.
+ */
+static int v4l2_dec_dqbuf(dec_context_p ctx, __u32 type,
+        struct v4l2_buffer *dqbuf) {
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    struct timeval start, now;
+
+    memset(dqbuf, 0, sizeof(*dqbuf));
+    memset(&planes, 0, sizeof(planes));
+    dqbuf->type = type;
+    dqbuf->memory = V4L2_MEMORY_MMAP;
+    dqbuf->m.planes = planes;
+    dqbuf->length = 1;
+
+    gettimeofday(&start, NULL);
+    while (IOCTL(VIDIOC_DQBUF, dqbuf) != 0) {
+        if (errno == EAGAIN) {
+            struct pollfd pfd;
+            int ret;
+
+            gettimeofday(&now, NULL);
+            if ((now.tv_sec - start.tv_sec) * 1000 +
+                    (now.tv_usec - start.tv_usec) / 1000 >=
+                    V4L2_DEC_DQBUF_TIMEOUT_MS) {
+                PRINT("VIDIOC_DQBUF timed out");
+                return -1;
+            }
+
+            pfd.fd = ctx->fd;
+            pfd.events = type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE ?
+                POLLIN : POLLOUT;
+            pfd.revents = 0;
+            ret = poll(&pfd, 1, V4L2_DEC_POLL_MS);
+            if (ret < 0 && errno != EINTR) {
+                PRINT("poll() failed");
+                return -1;
+            }
+            /* Nothing queued on the other side, no buffer is coming */
+            if (ret > 0 && (pfd.revents & POLLERR)) {
+                PRINT("poll() error on the decoder");
+                return -1;
+            }
+            continue;
+        }
+        PRINT("ioctl() failed: VIDIOC_DQBUF");
+        return -1;
+    }
+    dqbuf->m.planes = NULL;
+
+    return 0;
+}
+
+int v4l2_dec_dqbuf_bitstream(dec_context_p ctx) {
+    struct v4l2_buffer dqbuf;
+
+    if (v4l2_dec_dqbuf(ctx, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, &dqbuf) < 0)
+        return -1;
+
+    ctx->bitstream_queued[dqbuf.index] = 0;
+
+    return dqbuf.index;
+}
+
+int v4l2_dec_dqbuf_frame(dec_context_p ctx) {
+    struct v4l2_buffer dqbuf;
+
+    if (v4l2_dec_dqbuf(ctx, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, &dqbuf) < 0)
+        return -1;
+
+    ctx->frame_queued[dqbuf.index] = 0;
+    ctx->frame_error[dqbuf.index] = !!(dqbuf.flags & V4L2_BUF_FLAG_ERROR);
+
+    return dqbuf.index;
+}
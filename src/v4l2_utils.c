@@ -17,7 +17,9 @@
 #define PRINT(fmt, args...) \
     printf("%s[%d] " fmt "\n", __func__, __LINE__, ## args)
 
-#define IOCTL(type, arg) plugin_ioctl(ctx->enc, ctx->fd, type, arg)
+#define IOCTL(type, arg)                                \
+    (ctx->sw ? h264_swenc_ioctl(ctx->sw, type, arg) :   \
+     plugin_ioctl(ctx->enc, ctx->fd, type, arg))
 
 #define IOCTL_OR_ERROR_RETURN_VALUE(type, arg, value, type_str) \
     do {                                                        \
@@ -49,6 +51,10 @@ enc_context_p v4l2_init(const char *device_path) {
     if (ctx == NULL)
         goto failed_ctx;
     ctx->fd = fd;
+    snprintf(ctx->device_path, sizeof(ctx->device_path), "%s", device_path);
+    ctx->coded_format = V4L2_PIX_FMT_H264;
+    ctx->input_memory = V4L2_MEMORY_MMAP;
+    ctx->coded_buffer_size = 2 * 1024 * 1024;
 
     ctx->enc = plugin_init(ctx->fd);
     if (!ctx->enc)
@@ -64,11 +70,15 @@ failed_plugin:
     return NULL;
 }
 
-enc_context_p v4l2_init_by_name(const char *name) {
+/**
+ * Call open_node() on every video4linux node whose name contains name,
+ * until one of them returns a context.
+ */
+void *v4l2_probe(const char *name, void *(*open_node)(const char *path)) {
     DIR *dir;
     struct dirent *ent;
 
-    enc_context_p ctx = NULL;
+    void *ctx = NULL;
 
 #define SYS_PATH		"/sys/class/video4linux/"
 #define DEV_PATH		"/dev/"
@@ -95,7 +105,7 @@ enc_context_p v4l2_init_by_name(const char *name) {
             snprintf(path, sizeof(path), DEV_PATH "%s",
                     ent->d_name);
 
-            ctx = v4l2_init(path);
+            ctx = open_node(path);
             if (ctx)
                 break;
         }
@@ -104,12 +114,52 @@ enc_context_p v4l2_init_by_name(const char *name) {
     return ctx;
 }
 
+static void *v4l2_open_encoder(const char *path) {
+    return v4l2_init(path);
+}
+
+enc_context_p v4l2_init_by_name(const char *name) {
+    return v4l2_probe(name, v4l2_open_encoder);
+}
+
+/**
+ * A context on the software encoder, for hosts without an encoder node.
+ * H.264 only; there is no device to allocate dma-buf frames on.
+ */
+enc_context_p v4l2_init_software(void) {
+    enc_context_t *ctx = (enc_context_t *) calloc(1, sizeof(enc_context_t));
+    if (ctx == NULL)
+        return NULL;
+
+    ctx->sw = h264_swenc_create();
+    if (!ctx->sw) {
+        free(ctx);
+        return NULL;
+    }
+    PRINT(" got software encoder");
+
+    ctx->fd = -1;
+    ctx->coded_format = V4L2_PIX_FMT_H264;
+    ctx->input_memory = V4L2_MEMORY_MMAP;
+    ctx->coded_buffer_size = 2 * 1024 * 1024;
+
+    return ctx;
+}
+
+static void *v4l2_mmap(enc_context_p ctx, int size, __u32 offset) {
+    if (ctx->sw)
+        return h264_swenc_mmap(ctx->sw, offset);
+
+    return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            ctx->fd, offset);
+}
+
 int v4l2_deinit(enc_context_p ctx) {
     struct v4l2_requestbuffers reqbufs;
     memset(&reqbufs, 0, sizeof(reqbufs));
     reqbufs.count = 0;
     reqbufs.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
-    reqbufs.memory = V4L2_MEMORY_MMAP;
+    reqbufs.memory = ctx->input_memory;
     IOCTL_OR_LOG_ERROR(VIDIOC_REQBUFS, &reqbufs);
 
     memset(&reqbufs, 0, sizeof(reqbufs));
@@ -118,8 +168,13 @@ int v4l2_deinit(enc_context_p ctx) {
     reqbufs.memory = V4L2_MEMORY_MMAP;
     IOCTL_OR_ERROR_RETURN(VIDIOC_REQBUFS, &reqbufs);
 
-    plugin_close(ctx->enc);
-    close(ctx->fd);
+    if (ctx->sw) {
+        h264_swenc_destroy(ctx->sw);
+    } else {
+        plugin_close(ctx->enc);
+        close(ctx->fd);
+    }
+    v4l2_frame_free(ctx->input_frame);
     free(ctx);
 
     return 0;
@@ -130,7 +185,7 @@ int v4l2_reqbufs(enc_context_p ctx) {
     memset(&reqbufs, 0, sizeof(reqbufs));
     reqbufs.count = 1;
     reqbufs.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
-    reqbufs.memory = V4L2_MEMORY_MMAP;
+    reqbufs.memory = ctx->input_memory;
     IOCTL_OR_ERROR_RETURN(VIDIOC_REQBUFS, &reqbufs);
 
     memset(&reqbufs, 0, sizeof(reqbufs));
@@ -142,27 +197,11 @@ int v4l2_reqbufs(enc_context_p ctx) {
     return 0;
 }
 
-int v4l2_querybuf(enc_context_p ctx) {
+/* Map the mmap input buffer of the OUTPUT queue */
+static int v4l2_query_input(enc_context_p ctx) {
     struct v4l2_plane planes[VIDEO_MAX_PLANES];
     struct v4l2_buffer buffer;
-    memset(&buffer, 0, sizeof(buffer));
-    memset(planes, 0, sizeof(planes));
-    buffer.index = 0;
-    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
-    buffer.memory = V4L2_MEMORY_MMAP;
-    buffer.m.planes = planes;
-    buffer.length = 1;
-    IOCTL_OR_ERROR_RETURN(VIDIOC_QUERYBUF, &buffer);
-
-    ctx->coded_size = buffer.m.planes[0].length;
-    ctx->coded_buffer = mmap(NULL, ctx->coded_size,
-            PROT_READ | PROT_WRITE,
-            MAP_SHARED, ctx->fd,
-            buffer.m.planes[0].m.mem_offset);
-    if (ctx->coded_buffer == MAP_FAILED) {
-        PRINT("create coded buffer: mmap() failed");
-        return -1;
-    }
+    int i;
 
     memset(&buffer, 0, sizeof(buffer));
     memset(planes, 0, sizeof(planes));
@@ -173,12 +212,9 @@ int v4l2_querybuf(enc_context_p ctx) {
     buffer.length = 3;
     IOCTL_OR_ERROR_RETURN(VIDIOC_QUERYBUF, &buffer);
 
-    int i;
     for (i = 0; i < 3; i++) {
         ctx->input_size[i] = buffer.m.planes[i].length;
-        ctx->input_buffer[i] = mmap(NULL, ctx->input_size[i],
-                PROT_READ | PROT_WRITE,
-                MAP_SHARED, ctx->fd,
+        ctx->input_buffer[i] = v4l2_mmap(ctx, ctx->input_size[i],
                 buffer.m.planes[i].m.mem_offset);
         if (ctx->input_buffer[i] == MAP_FAILED) {
             PRINT("create input buffer[%d]: mmap() failed", i);
@@ -188,14 +224,41 @@ int v4l2_querybuf(enc_context_p ctx) {
     return 0;
 }
 
+int v4l2_querybuf(enc_context_p ctx) {
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    struct v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    memset(planes, 0, sizeof(planes));
+    buffer.index = 0;
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.m.planes = planes;
+    buffer.length = 1;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_QUERYBUF, &buffer);
+
+    ctx->coded_size = buffer.m.planes[0].length;
+    ctx->coded_buffer = v4l2_mmap(ctx, ctx->coded_size,
+            buffer.m.planes[0].m.mem_offset);
+    if (ctx->coded_buffer == MAP_FAILED) {
+        PRINT("create coded buffer: mmap() failed");
+        return -1;
+    }
+
+    /* The input buffer is input_frame, mapped when it was allocated */
+    if (ctx->input_memory == V4L2_MEMORY_DMABUF)
+        return 0;
+
+    return v4l2_query_input(ctx);
+}
+
 int v4l2_s_fmt(enc_context_p ctx) {
     struct v4l2_format format;
     memset(&format, 0, sizeof(format));
     format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
     format.fmt.pix_mp.width = ctx->width;
     format.fmt.pix_mp.height = ctx->height;
-    format.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_H264;
-    format.fmt.pix_mp.plane_fmt[0].sizeimage = (2 * 1024 * 1024);
+    format.fmt.pix_mp.pixelformat = ctx->coded_format;
+    format.fmt.pix_mp.plane_fmt[0].sizeimage = ctx->coded_buffer_size;
     format.fmt.pix_mp.num_planes = 1;
     IOCTL_OR_ERROR_RETURN(VIDIOC_S_FMT, &format);
 
@@ -236,13 +299,115 @@ int v4l2_s_ext_ctrls(enc_context_p ctx, struct v4l2_ext_controls* ext_ctrls) {
     return 0;
 }
 
+int v4l2_s_ctrl(enc_context_p ctx, __u32 id, __s32 value) {
+    struct v4l2_ext_control ctrl;
+    struct v4l2_ext_controls ext_ctrls;
+    memset(&ctrl, 0, sizeof(ctrl));
+    memset(&ext_ctrls, 0, sizeof(ext_ctrls));
+    ctrl.id = id;
+    ctrl.value = value;
+    ext_ctrls.count = 1;
+    ext_ctrls.controls = &ctrl;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_S_EXT_CTRLS, &ext_ctrls);
+
+    return 0;
+}
+
+int v4l2_s_ctrl_ptr(enc_context_p ctx, __u32 id, void *ptr, __u32 size) {
+    struct v4l2_ext_control ctrl;
+    struct v4l2_ext_controls ext_ctrls;
+    memset(&ctrl, 0, sizeof(ctrl));
+    memset(&ext_ctrls, 0, sizeof(ext_ctrls));
+    ctrl.id = id;
+    ctrl.ptr = ptr;
+    ctrl.size = size;
+    ext_ctrls.count = 1;
+    ext_ctrls.controls = &ctrl;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_S_EXT_CTRLS, &ext_ctrls);
+
+    return 0;
+}
+
+int v4l2_g_ctrl_ptr(enc_context_p ctx, __u32 id, void *ptr, __u32 size) {
+    struct v4l2_ext_control ctrl;
+    struct v4l2_ext_controls ext_ctrls;
+    memset(&ctrl, 0, sizeof(ctrl));
+    memset(&ext_ctrls, 0, sizeof(ext_ctrls));
+    ctrl.id = id;
+    ctrl.ptr = ptr;
+    ctrl.size = size;
+    ext_ctrls.count = 1;
+    ext_ctrls.controls = &ctrl;
+    IOCTL_OR_ERROR_RETURN(VIDIOC_G_EXT_CTRLS, &ext_ctrls);
+
+    return 0;
+}
+
 int v4l2_s_parm(enc_context_p ctx, struct v4l2_streamparm *parm) {
     IOCTL_OR_ERROR_RETURN(VIDIOC_S_PARM, parm);
 
     return 0;
 }
 
+/* Copy a frame into the three input planes, byte for byte */
+static void v4l2_copy_input(void *planes[3], int luma, void *data) {
+    memcpy(planes[0], data, luma);
+    data += luma;
+    memcpy(planes[1], data, luma / 4);
+    data += luma / 4;
+    memcpy(planes[2], data, luma / 4);
+}
+
 int v4l2_qbuf_input(enc_context_p ctx, void *data, int size) {
+    v4l2_copy_input(ctx->input_buffer, ctx->width * ctx->height, data);
+    ctx->input_filled = 1;
+    ctx->queued_frame = ctx->input_frame;
+
+    return v4l2_requeue_input(ctx);
+}
+
+/**
+ * Queue a frame another context may have uploaded, without copying. The
+ * input buffer no longer matches the last coded frame after that.
+ */
+int v4l2_qbuf_input_frame(enc_context_p ctx, v4l2_frame_p frame) {
+    ctx->input_filled = 0;
+    ctx->queued_frame = frame;
+
+    return v4l2_requeue_input(ctx);
+}
+
+/**
+ * Copy one rectangle of the frame into the input buffer, leaving the
+ * rest as it was. x, y, width and height must be even.
+ */
+void v4l2_update_input(enc_context_p ctx, void *data,
+        int x, int y, int width, int height) {
+    int luma = ctx->width * ctx->height;
+    unsigned char *src = data;
+    int row;
+
+    ctx->queued_frame = ctx->input_frame;
+
+    for (row = y; row < y + height; row++)
+        memcpy(ctx->input_buffer[0] + row * ctx->width + x,
+                src + row * ctx->width + x, width);
+
+    for (row = y / 2; row < (y + height) / 2; row++) {
+        int offset = row * ctx->width / 2 + x / 2;
+
+        memcpy(ctx->input_buffer[1] + offset,
+                src + luma + offset, width / 2);
+        memcpy(ctx->input_buffer[2] + offset,
+                src + luma * 5 / 4 + offset, width / 2);
+    }
+}
+
+/**
+ * Queue the input buffer again with whatever it already holds, used to
+ * encode the same picture another time.
+ */
+int v4l2_requeue_input(enc_context_p ctx) {
     struct v4l2_buffer qbuf;
     struct v4l2_plane qbuf_planes[VIDEO_MAX_PLANES];
     memset(&qbuf, 0, sizeof(qbuf));
@@ -255,16 +420,21 @@ int v4l2_qbuf_input(enc_context_p ctx, void *data, int size) {
     qbuf.m.planes[1].bytesused = ctx->width * ctx->height / 4;
     qbuf.m.planes[2].bytesused = ctx->width * ctx->height / 4;
 
-    memcpy(ctx->input_buffer[0], data, qbuf.m.planes[0].bytesused);
-    data += qbuf.m.planes[0].bytesused;
-    memcpy(ctx->input_buffer[1], data, qbuf.m.planes[1].bytesused);
-    data += qbuf.m.planes[1].bytesused;
-    memcpy(ctx->input_buffer[2], data, qbuf.m.planes[2].bytesused);
-
-    qbuf.memory = V4L2_MEMORY_MMAP;
+    qbuf.memory = ctx->input_memory;
     qbuf.length = 3;
 
+    if (ctx->input_memory == V4L2_MEMORY_DMABUF) {
+        int i;
+
+        for (i = 0; i < 3; i++) {
+            qbuf.m.planes[i].m.fd = ctx->queued_frame->dmabuf[i];
+            qbuf.m.planes[i].length = ctx->queued_frame->size[i];
+        }
+    }
+
     IOCTL_OR_ERROR_RETURN(VIDIOC_QBUF, &qbuf);
+    ctx->input_queued = 1;
+    gettimeofday(&ctx->queued_time, NULL);
 
     return 0;
 }
@@ -290,7 +460,7 @@ int v4l2_dqbuf_input(enc_context_p ctx) {
     memset(&dqbuf, 0, sizeof(dqbuf));
     memset(&planes, 0, sizeof(planes));
     dqbuf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
-    dqbuf.memory = V4L2_MEMORY_MMAP;
+    dqbuf.memory = ctx->input_memory;
     dqbuf.m.planes = planes;
     dqbuf.length = 3;
     while (IOCTL(VIDIOC_DQBUF, &dqbuf) != 0) {
@@ -301,6 +471,7 @@ int v4l2_dqbuf_input(enc_context_p ctx) {
         PRINT("ioctl() failed: VIDIOC_DQBUF");
         return -1;
     }
+    ctx->input_queued = 0;
 
     return 0;
 }
@@ -308,6 +479,7 @@ int v4l2_dqbuf_input(enc_context_p ctx) {
 int v4l2_dqbuf_output(enc_context_p ctx) {
     struct v4l2_buffer dqbuf;
     struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    struct timeval done;
 
     memset(&dqbuf, 0, sizeof(dqbuf));
     memset(&planes, 0, sizeof(planes));
@@ -318,14 +490,191 @@ int v4l2_dqbuf_output(enc_context_p ctx) {
 
     while (IOCTL(VIDIOC_DQBUF, &dqbuf) != 0) {
         if (errno == EAGAIN) {
-            usleep(1000);
+            struct pollfd pfd;
+
+            /* Wake up as soon as the frame is done, not on a 1ms tick */
+            pfd.fd = ctx->fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if (poll(&pfd, 1, 100) < 0 || (pfd.revents & POLLERR))
+                usleep(1000);
             continue;
         }
         PRINT("ioctl() failed: VIDIOC_DQBUF");
         return -1;
     }
 
+    gettimeofday(&done, NULL);
+    ctx->encode_us = (done.tv_sec - ctx->queued_time.tv_sec) * 1000000LL +
+        done.tv_usec - ctx->queued_time.tv_usec;
     ctx->coded_size = dqbuf.m.planes[0].bytesused;
 
     return 0;
 }
+
+/**
+ * Allocate an input frame the size of ctx's pictures. The memory comes
+ * from the OUTPUT queue of a second instance of the node, which is never
+ * started and only keeps the buffer alive.
+ */
+v4l2_frame_p v4l2_frame_alloc(enc_context_p ctx) {
+    struct v4l2_format format;
+    struct v4l2_requestbuffers reqbufs;
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    struct v4l2_buffer buffer;
+    struct v4l2_exportbuffer expbuf;
+    v4l2_frame_p frame;
+    int i;
+
+    frame = calloc(1, sizeof(*frame));
+    if (!frame)
+        return NULL;
+
+    for (i = 0; i < 3; i++) {
+        frame->dmabuf[i] = -1;
+        frame->data[i] = MAP_FAILED;
+    }
+    frame->width = ctx->width;
+    frame->height = ctx->height;
+
+    frame->fd = open(ctx->device_path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (frame->fd < 0)
+        goto failed;
+
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    format.fmt.pix_mp.width = ctx->width;
+    format.fmt.pix_mp.height = ctx->height;
+    format.fmt.pix_mp.pixelformat = ctx->coded_format;
+    format.fmt.pix_mp.num_planes = 1;
+    if (ioctl(frame->fd, VIDIOC_S_FMT, &format) != 0)
+        goto failed;
+
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    format.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_YUV420M;
+    format.fmt.pix_mp.width = ctx->width;
+    format.fmt.pix_mp.height = ctx->height;
+    format.fmt.pix_mp.num_planes = 3;
+    if (ioctl(frame->fd, VIDIOC_S_FMT, &format) != 0)
+        goto failed;
+
+    memset(&reqbufs, 0, sizeof(reqbufs));
+    reqbufs.count = 1;
+    reqbufs.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    reqbufs.memory = V4L2_MEMORY_MMAP;
+    if (ioctl(frame->fd, VIDIOC_REQBUFS, &reqbufs) != 0)
+        goto failed;
+
+    memset(&buffer, 0, sizeof(buffer));
+    memset(planes, 0, sizeof(planes));
+    buffer.index = 0;
+    buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.m.planes = planes;
+    buffer.length = 3;
+    if (ioctl(frame->fd, VIDIOC_QUERYBUF, &buffer) != 0)
+        goto failed;
+
+    for (i = 0; i < 3; i++) {
+        frame->size[i] = planes[i].length;
+        frame->data[i] = mmap(NULL, frame->size[i], PROT_READ | PROT_WRITE,
+                MAP_SHARED, frame->fd, planes[i].m.mem_offset);
+        if (frame->data[i] == MAP_FAILED)
+            goto failed;
+
+        memset(&expbuf, 0, sizeof(expbuf));
+        expbuf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        expbuf.index = 0;
+        expbuf.plane = i;
+        expbuf.flags = O_RDWR | O_CLOEXEC;
+        if (ioctl(frame->fd, VIDIOC_EXPBUF, &expbuf) != 0)
+            goto failed;
+        frame->dmabuf[i] = expbuf.fd;
+    }
+
+    return frame;
+
+failed:
+    PRINT("cannot allocate a %dx%d dma-buf frame", ctx->width, ctx->height);
+    v4l2_frame_free(frame);
+
+    return NULL;
+}
+
+void v4l2_frame_write(v4l2_frame_p frame, void *data) {
+    v4l2_copy_input(frame->data, frame->width * frame->height, data);
+}
+
+void v4l2_frame_free(v4l2_frame_p frame) {
+    int i;
+
+    if (!frame)
+        return;
+
+    for (i = 0; i < 3; i++) {
+        if (frame->data[i] != MAP_FAILED)
+            munmap(frame->data[i], frame->size[i]);
+        if (frame->dmabuf[i] >= 0)
+            close(frame->dmabuf[i]);
+    }
+    if (frame->fd >= 0)
+        close(frame->fd);
+    free(frame);
+}
+
+/**
+ * Switch to input frames by dma-buf, our own one included, so that frames
+ * uploaded by other contexts can be queued too. Our own frame takes a
+ * second instance of the node, see v4l2_frame_alloc(). Call between
+ * querybuf and streamon; the context stays with its mmap buffer when this
+ * fails.
+ */
+int v4l2_use_dmabuf_input(enc_context_p ctx) {
+    struct v4l2_requestbuffers reqbufs;
+    v4l2_frame_p frame;
+    int i;
+
+    if (ctx->sw)
+        return -1;
+    if (ctx->input_memory == V4L2_MEMORY_DMABUF)
+        return 0;
+
+    frame = v4l2_frame_alloc(ctx);
+    if (!frame)
+        return -1;
+
+    for (i = 0; i < 3; i++)
+        munmap(ctx->input_buffer[i], ctx->input_size[i]);
+
+    memset(&reqbufs, 0, sizeof(reqbufs));
+    reqbufs.count = 0;
+    reqbufs.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    reqbufs.memory = V4L2_MEMORY_MMAP;
+    IOCTL_OR_LOG_ERROR(VIDIOC_REQBUFS, &reqbufs);
+
+    reqbufs.count = 1;
+    reqbufs.memory = V4L2_MEMORY_DMABUF;
+    if (IOCTL(VIDIOC_REQBUFS, &reqbufs) != 0) {
+        /* No dma-buf import on this node, go back to its own buffer */
+        PRINT("no dma-buf input, using mmap");
+        v4l2_frame_free(frame);
+
+        reqbufs.count = 1;
+        reqbufs.memory = V4L2_MEMORY_MMAP;
+        IOCTL_OR_ERROR_RETURN(VIDIOC_REQBUFS, &reqbufs);
+
+        v4l2_query_input(ctx);
+        return -1;
+    }
+
+    for (i = 0; i < 3; i++) {
+        ctx->input_buffer[i] = frame->data[i];
+        ctx->input_size[i] = frame->size[i];
+    }
+    ctx->input_frame = frame;
+    ctx->queued_frame = frame;
+    ctx->input_memory = V4L2_MEMORY_DMABUF;
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2016 Rockchip Electronics Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "vp8_utils.h"
+
+#define VP8_START_CODE_0    0x9d
+#define VP8_START_CODE_1    0x01
+#define VP8_START_CODE_2    0x2a
+
+/**
+ * Write the uncompressed data chunk. Returns its size, or -1 when it
+ * does not fit.
+ */
+int vp8_write_frame_header(vp8_frame_header_p header,
+        unsigned char *data, int size)
+{
+    unsigned int tag;
+    int length;
+
+    length = header->key_frame ? VP8_FRAME_HEADER_SIZE : VP8_INTER_HEADER_SIZE;
+    if (size < length || header->first_part_size >= (1 << 19))
+        return -1;
+
+    /* frame_type is 0 for key frames */
+    tag = (header->key_frame ? 0 : 1) |
+        ((header->version & 0x7) << 1) |
+        ((header->show_frame & 0x1) << 4) |
+        (header->first_part_size << 5);
+
+    data[0] = tag & 0xff;
+    data[1] = (tag >> 8) & 0xff;
+    data[2] = (tag >> 16) & 0xff;
+
+    if (!header->key_frame)
+        return length;
+
+    data[3] = VP8_START_CODE_0;
+    data[4] = VP8_START_CODE_1;
+    data[5] = VP8_START_CODE_2;
+    data[6] = header->width & 0xff;
+    data[7] = ((header->width >> 8) & 0x3f) | (header->horiz_scale << 6);
+    data[8] = header->height & 0xff;
+    data[9] = ((header->height >> 8) & 0x3f) | (header->vert_scale << 6);
+
+    return length;
+}